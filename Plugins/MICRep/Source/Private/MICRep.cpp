@@ -1,638 +1,1911 @@
-﻿// Fill out your copyright notice in the Description page of Project Settings.
-
-#include "MICRep.h"
-#include "LevelEditor.h"
-#include "AssetRegistryModule.h"
-#include "ContentBrowserModule.h"
-#include "IContentBrowserSingleton.h"
-#include "AssetToolsModule.h"
-#include "IAssetTools.h"
-#include "SAssetSearchBox.h"
-#include "Factories/MaterialInstanceConstantFactoryNew.h"
-
-
-#define LOCTEXT_NAMESPACE "MICRep"
-
-
-class FMICRepModule : public IModuleInterface
-{
-	virtual void StartupModule() override;
-	virtual void ShutdownModule() override;
-
-private:
-	static TSharedRef<FExtender> OnExtendContentBrowserAssetSelectionMenu(const TArray<FAssetData>& SelectedAssets);
-	static void CreateAssetMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets);
-	static void CreateReparentSubMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets);
-	static void CreateReparentSubSubMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets);
-
-	static void ReplaceMaterials(TArray<FAssetData> SelectedAssets);
-	static void ReplaceMaterialsUnify(TArray<FAssetData> SelectedAssets);
-	static void GetTextureFromMaterial(UMaterialInterface* Material, UTexture*& OutColorTexture, UTexture*& OutNormalTexture);
-	static UMaterialInterface* CreateMIC(UMaterialInterface* BaseMaterial, FString BaseMaterialSimpleName, UMaterialInterface* OldMaterial, FString TargetPathName);
-	static void ReplaceStaticMeshMaterial(FAssetData& Asset);
-	static void ReplaceSkeletalMeshMaterial(FAssetData& Asset);
-	static void ReparentMICs(const FAssetData& NewParentAssetData, TArray<FAssetData> SelectedAssets);
-};
-
-IMPLEMENT_MODULE(FMICRepModule, MICRepModule)
-
-namespace
-{
-	FContentBrowserMenuExtender_SelectedAssets ContentBrowserExtenderDelegate;
-	FDelegateHandle ContentBrowserExtenderDelegateHandle;
-}
-
-
-
-void FMICRepModule::StartupModule()
-{
-	if(IsRunningCommandlet()){ return; }
-
-	FContentBrowserModule& ContentBrowserModule =
-		FModuleManager::LoadModuleChecked<FContentBrowserModule>(TEXT("ContentBrowser"));
-
-	// アセット右クリックメニューへのExtender登録 
-	ContentBrowserExtenderDelegate =
-		FContentBrowserMenuExtender_SelectedAssets::CreateStatic(
-			&FMICRepModule::OnExtendContentBrowserAssetSelectionMenu
-			);
-	TArray<FContentBrowserMenuExtender_SelectedAssets>& CBMenuExtenderDelegates =
-		ContentBrowserModule.GetAllAssetViewContextMenuExtenders();
-	CBMenuExtenderDelegates.Add(ContentBrowserExtenderDelegate);
-	ContentBrowserExtenderDelegateHandle = CBMenuExtenderDelegates.Last().GetHandle();
-}
-void FMICRepModule::ShutdownModule()
-{
-	FContentBrowserModule* ContentBrowserModule =
-		FModuleManager::GetModulePtr<FContentBrowserModule>(TEXT("ContentBrowser"));
-	if(nullptr != ContentBrowserModule)
-	{
-		TArray<FContentBrowserMenuExtender_SelectedAssets>& CBMenuExtenderDelegates =
-			ContentBrowserModule->GetAllAssetViewContextMenuExtenders();
-		CBMenuExtenderDelegates.RemoveAll([](const FContentBrowserMenuExtender_SelectedAssets& Delegate)
-			{ return Delegate.GetHandle() == ContentBrowserExtenderDelegateHandle; });
-	}
-}
-
-
-TSharedRef<FExtender> FMICRepModule::OnExtendContentBrowserAssetSelectionMenu(const TArray<FAssetData>& SelectedAssets)
-{
-	TSharedRef<FExtender> Extender(new FExtender());
-
-	bool bAnyMeshes = false;
-	bool bAnyMICs = false;
-	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
-	{
-		bAnyMeshes |= ((*ItAsset).AssetClass == UStaticMesh::StaticClass()->GetFName());
-		bAnyMeshes |= ((*ItAsset).AssetClass == USkeletalMesh::StaticClass()->GetFName());
-		bAnyMICs   |= ((*ItAsset).AssetClass == UMaterialInstanceConstant::StaticClass()->GetFName());
-	}
-
-	if(bAnyMeshes | bAnyMICs)
-	{
-		Extender->AddMenuExtension(
-			"GetAssetActions",
-			EExtensionHook::After,
-			nullptr,
-			FMenuExtensionDelegate::CreateStatic(&FMICRepModule::CreateAssetMenu, SelectedAssets)
-			);
-	}
-
-	return Extender;
-}
-void FMICRepModule::CreateAssetMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets)
-{
-	int32 MeshesCount = 0;
-	int32 MICCount = 0;
-	bool bAnyMICs = false;
-	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
-	{
-		if(    ((*ItAsset).AssetClass == UStaticMesh::StaticClass()->GetFName())
-			|| ((*ItAsset).AssetClass == USkeletalMesh::StaticClass()->GetFName())
-			)
-		{
-			MeshesCount++;
-		}
-		else if(((*ItAsset).AssetClass == UMaterialInstanceConstant::StaticClass()->GetFName()))
-		{
-			MICCount++;
-		}
-	}
-
-	if(0 < MeshesCount)
-	{
-		MenuBuilder.AddMenuEntry(
-			LOCTEXT("ReplaceMaterials", "ReplaceMaterials"),
-			LOCTEXT("ReplaceMaterials_Tooltip", "Replace all Materials to MaterialInstance"),
-			FSlateIcon(),
-			FUIAction(FExecuteAction::CreateStatic(&FMICRepModule::ReplaceMaterials, SelectedAssets)),
-			NAME_None,
-			EUserInterfaceActionType::Button
-			);
-		if(2 <= MeshesCount)
-		{
-			MenuBuilder.AddMenuEntry(
-				LOCTEXT("ReplaceMaterials(Unify)", "ReplaceMaterials(Unify)"),
-				LOCTEXT("ReplaceMaterials_Tooltip", "Replace all Materials to MaterialInstance. (Derived from unified material)"),
-				FSlateIcon(),
-				FUIAction(FExecuteAction::CreateStatic(&FMICRepModule::ReplaceMaterialsUnify, SelectedAssets)),
-				NAME_None,
-				EUserInterfaceActionType::Button
-				);
-		}
-	}
-	if(0 < MICCount)
-	{
-		MenuBuilder.AddSubMenu(
-			LOCTEXT("ReparentMaterialInstance", "Reparent MaterialInstance"),
-			LOCTEXT("ReparentMaterialInstance_Tooltip", "Reparent MaterialInstance"),
-			FNewMenuDelegate::CreateStatic(&FMICRepModule::CreateReparentSubMenu, SelectedAssets)
-			);
-	}
-}
-void FMICRepModule::CreateReparentSubMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets)
-{
-	MenuBuilder.AddSubMenu(
-		LOCTEXT("ReparentMaterialInstance", "Reparent MaterialInstance"),
-		LOCTEXT("ReparentMaterialInstance_Tooltip", "Reparent MaterialInstance"),
-		FNewMenuDelegate::CreateStatic(&FMICRepModule::CreateReparentSubSubMenu, SelectedAssets)
-		);
-}
-void FMICRepModule::CreateReparentSubSubMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets)
-{
-	FContentBrowserModule& ContentBrowserModule =
-		FModuleManager::LoadModuleChecked<FContentBrowserModule>(TEXT("ContentBrowser"));
-
-	FAssetPickerConfig Config;
-	Config.SelectionMode = ESelectionMode::Single;
-	Config.InitialAssetViewType = EAssetViewType::List;
-	Config.Filter.ClassNames.Add(FName(*UMaterialInterface::StaticClass()->GetName()));
-	Config.Filter.bRecursiveClasses = true;
-	Config.OnAssetDoubleClicked = FOnAssetDoubleClicked::CreateStatic(&FMICRepModule::ReparentMICs, SelectedAssets);
-	Config.bFocusSearchBoxWhenOpened = true;
-
-	MenuBuilder.AddWidget(ContentBrowserModule.Get().CreateAssetPicker(Config), FText());
-}
-
-//
-// StaticMesh/SkeletalMeshマテリアルの一括置換 
-//
-void FMICRepModule::ReplaceMaterials(TArray<FAssetData> SelectedAssets)
-{
-	FAssetRegistryModule&  AssetRegistryModule  = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
-	FContentBrowserModule& ContentBrowserModule = FModuleManager::LoadModuleChecked<FContentBrowserModule>("ContentBrowser");
-	FAssetToolsModule&     AssetToolsModule     = FModuleManager::LoadModuleChecked<FAssetToolsModule>("AssetTools");
-
-	// ベースマテリアルの複製元を取得 
-	UMaterial* BaseMatOriginal = nullptr;
-	{
-		FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(TEXT("/MICRep/M_MICRepBase.M_MICRepBase")));
-		BaseMatOriginal = Cast<UMaterial>(AssetData.GetAsset());
-		check(BaseMatOriginal);
-	}
-
-	TArray<UObject*> ObjectsToSync;
-	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
-	{
-		// 編集対象メッシュを取得 
-		const FAssetData& MeshAssetData = (*ItAsset);
-		UObject* TargetAsset = MeshAssetData.GetAsset();
-		if(nullptr == TargetAsset)
-		{
-			continue;
-		}
-
-		// ベースマテリアルを複製 
-		FString TargetPathName = FPackageName::GetLongPackagePath(TargetAsset->GetPathName());
-		UMaterial* BaseMat = nullptr;
-		FString BaseMatSimpleName;
-		{
-			BaseMatSimpleName = TargetAsset->GetName().Replace(TEXT("SM_"), TEXT(""), ESearchCase::CaseSensitive);
-			FString BaseMatName = FString::Printf(TEXT("M_%s_Base"), *BaseMatSimpleName);
-
-			UObject* DuplicatedObject = AssetToolsModule.Get().DuplicateAsset(
-				BaseMatName,
-				TargetPathName,
-				BaseMatOriginal
-				);
-			BaseMat = Cast<UMaterial>(DuplicatedObject);
-			if (nullptr == BaseMat)
-			{
-				continue;
-			}
-		}
-
-		// StaticMesh 
-		UStaticMesh* TargetStaticMesh = Cast<UStaticMesh>(MeshAssetData.GetAsset());
-		if(nullptr != TargetStaticMesh)
-		{
-			// メッシュの各マテリアルについて 
-			int32 MatIdx = 0;
-			for(auto ItMat = TargetStaticMesh->StaticMaterials.CreateConstIterator(); ItMat; ++ItMat, ++MatIdx)
-			{
-				FStaticMaterial StaMat = TargetStaticMesh->StaticMaterials[MatIdx];
-
-				UMaterialInterface* NewMIC = CreateMIC(
-					BaseMat,
-					BaseMatSimpleName,
-					StaMat.MaterialInterface,
-					TargetPathName
-					);
-				if(nullptr == NewMIC)
-				{
-					continue;
-				}
-				ObjectsToSync.Add(NewMIC);
-
-				// メッシュに新MICをセット 
-				StaMat.MaterialInterface = NewMIC;
-				TargetStaticMesh->StaticMaterials[MatIdx] = StaMat;
-			}
-
-			// メッシュアセットに要保存マーク 
-			TargetStaticMesh->MarkPackageDirty();
-		}
-
-		// SkeletalMesh 
-		USkeletalMesh* TargetSkeletalMesh = Cast<USkeletalMesh>(MeshAssetData.GetAsset());
-		if(nullptr != TargetSkeletalMesh)
-		{
-			// メッシュの各マテリアルについて 
-			int32 MatIdx = 0;
-			for(auto ItMat = TargetSkeletalMesh->Materials.CreateConstIterator(); ItMat; ++ItMat, ++MatIdx)
-			{
-				UMaterialInterface* NewMIC = CreateMIC(
-					BaseMat,
-					BaseMatSimpleName,
-					TargetSkeletalMesh->Materials[MatIdx].MaterialInterface,
-					TargetPathName
-					);
-				if (nullptr == NewMIC)
-				{
-					continue;
-				}
-				ObjectsToSync.Add(NewMIC);
-
-				// メッシュに新MICをセット 
-				TargetSkeletalMesh->Materials[MatIdx].MaterialInterface = NewMIC;
-			}
-
-			// メッシュアセットに要保存マーク 
-			TargetSkeletalMesh->MarkPackageDirty();
-		}
-	}
-
-	if(0 < ObjectsToSync.Num())
-	{
-		ContentBrowserModule.Get().SyncBrowserToAssets(ObjectsToSync, true);
-	}
-}
-
-//
-// StaticMesh/SkeletalMeshマテリアルの一括置換（基底マテリアルを統一） 
-//
-void FMICRepModule::ReplaceMaterialsUnify(TArray<FAssetData> SelectedAssets)
-{
-	FAssetRegistryModule&  AssetRegistryModule  = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
-	FContentBrowserModule& ContentBrowserModule = FModuleManager::LoadModuleChecked<FContentBrowserModule>("ContentBrowser");
-	FAssetToolsModule&     AssetToolsModule     = FModuleManager::LoadModuleChecked<FAssetToolsModule>("AssetTools");
-
-	// ベースマテリアルの複製元を取得 
-	UMaterial* BaseMatOriginal = nullptr;
-	{
-		FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(TEXT("/MICRep/M_MICRepBase.M_MICRepBase")));
-		BaseMatOriginal = Cast<UMaterial>(AssetData.GetAsset());
-		check(BaseMatOriginal);
-	}
-
-	// ベースマテリアルを複製 
-	UMaterial* BaseMat = nullptr;
-	FString BaseMatSimpleName;
-	{
-		for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
-		{
-			UObject* TargetAsset = (*ItAsset).GetAsset();
-			if(nullptr == TargetAsset)
-			{
-				continue;
-			}
-
-			FString TargetPathName = FPackageName::GetLongPackagePath(TargetAsset->GetPathName());
-			{
-				BaseMatSimpleName = TargetAsset->GetName().Replace(TEXT("SM_"), TEXT(""), ESearchCase::CaseSensitive);
-				FString BaseMatName = FString::Printf(TEXT("M_%s_Base"), *BaseMatSimpleName);
-
-				UObject* DuplicatedObject = AssetToolsModule.Get().DuplicateAsset(
-					BaseMatName,
-					TargetPathName,
-					BaseMatOriginal
-					);
-				BaseMat = Cast<UMaterial>(DuplicatedObject);
-				if(nullptr != BaseMat)
-				{
-					break;
-				}
-			}
-		}
-	}
-	if(nullptr == BaseMat)
-	{
-		UE_LOG(LogTemp, Error, TEXT("Failed Create Base Material..."));
-		return;
-	}
-
-	// 共通のテクスチャであれば統一するため、生成したMICを保存 
-	// <ColorTexture, <NormalTexture, MIC>> 
-	TMap<UTexture*, TMap<UTexture*, UMaterialInterface*>> CreatedMICMap;
-
-
-	TArray<UObject*> ObjectsToSync;
-	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
-	{
-		// 編集対象メッシュを取得 
-		const FAssetData& MeshAssetData = (*ItAsset);
-		UObject* TargetAsset = MeshAssetData.GetAsset();
-		if(nullptr == TargetAsset)
-		{
-			continue;
-		}
-		FString TargetPathName = FPackageName::GetLongPackagePath(TargetAsset->GetPathName());
-
-		// StaticMesh 
-		UStaticMesh* TargetStaticMesh = Cast<UStaticMesh>(MeshAssetData.GetAsset());
-		if(nullptr != TargetStaticMesh)
-		{
-			// メッシュの各マテリアルについて 
-			int32 MatIdx = 0;
-			for(auto ItMat = TargetStaticMesh->StaticMaterials.CreateConstIterator(); ItMat; ++ItMat, ++MatIdx)
-			{
-				FStaticMaterial StaMat = TargetStaticMesh->StaticMaterials[MatIdx];
-
-				UTexture* ColorTex = nullptr;
-				UTexture* NormalTex = nullptr;
-				GetTextureFromMaterial(StaMat.MaterialInterface, ColorTex, NormalTex);
-
-				bool bCreated = false;
-				if(CreatedMICMap.Contains(ColorTex))
-				{
-					if(CreatedMICMap[ColorTex].Contains(NormalTex))
-					{
-						// メッシュにMICをセット 
-						StaMat.MaterialInterface = CreatedMICMap[ColorTex][NormalTex];
-						TargetStaticMesh->StaticMaterials[MatIdx] = StaMat;
-						bCreated = true;
-					}
-				}
-
-				if(!bCreated)
-				{
-					UMaterialInterface* NewMIC = CreateMIC(
-						BaseMat,
-						BaseMatSimpleName,
-						StaMat.MaterialInterface,
-						TargetPathName
-						);
-
-					ObjectsToSync.Add(NewMIC);
-
-					// メッシュに新MICをセット 
-					StaMat.MaterialInterface = NewMIC;
-					TargetStaticMesh->StaticMaterials[MatIdx] = StaMat;
-
-					if(!CreatedMICMap.Contains(ColorTex))
-					{
-						TMap<UTexture*, UMaterialInterface*> Tmp;
-						CreatedMICMap.Add(ColorTex, Tmp);
-					}
-					CreatedMICMap[ColorTex].Add(NormalTex, NewMIC);
-				}
-			}
-
-			// メッシュアセットに要保存マーク 
-			TargetStaticMesh->MarkPackageDirty();
-		}
-
-		// SkeletalMesh 
-		USkeletalMesh* TargetSkeletalMesh = Cast<USkeletalMesh>(MeshAssetData.GetAsset());
-		if(nullptr != TargetSkeletalMesh)
-		{
-			// メッシュの各マテリアルについて 
-			int32 MatIdx = 0;
-			for(auto ItMat = TargetSkeletalMesh->Materials.CreateConstIterator(); ItMat; ++ItMat, ++MatIdx)
-			{
-				UTexture* ColorTex = nullptr;
-				UTexture* NormalTex = nullptr;
-				GetTextureFromMaterial(TargetSkeletalMesh->Materials[MatIdx].MaterialInterface, ColorTex, NormalTex);
-
-				bool bCreated = false;
-				if(CreatedMICMap.Contains(ColorTex))
-				{
-					if(CreatedMICMap[ColorTex].Contains(NormalTex))
-					{
-						// メッシュにMICをセット 
-						TargetSkeletalMesh->Materials[MatIdx].MaterialInterface = CreatedMICMap[ColorTex][NormalTex];
-						bCreated = true;
-					}
-				}
-
-				if(!bCreated)
-				{
-					UMaterialInterface* NewMIC = CreateMIC(
-						BaseMat,
-						BaseMatSimpleName,
-						TargetSkeletalMesh->Materials[MatIdx].MaterialInterface,
-						TargetPathName
-						);
-
-					ObjectsToSync.Add(NewMIC);
-
-					// メッシュに新MICをセット 
-					TargetSkeletalMesh->Materials[MatIdx].MaterialInterface = NewMIC;
-
-					if(!CreatedMICMap.Contains(ColorTex))
-					{
-						TMap<UTexture*, UMaterialInterface*> Tmp;
-						CreatedMICMap.Add(ColorTex, Tmp);
-					}
-					CreatedMICMap[ColorTex].Add(NormalTex, NewMIC);
-				}
-			}
-
-			// メッシュアセットに要保存マーク 
-			TargetSkeletalMesh->MarkPackageDirty();
-		}
-	}
-
-	if(0 < ObjectsToSync.Num())
-	{
-		ContentBrowserModule.Get().SyncBrowserToAssets(ObjectsToSync, true);
-	}
-}
-
-void FMICRepModule::GetTextureFromMaterial(
-	UMaterialInterface* Material,
-	UTexture*& OutColorTexture,
-	UTexture*& OutNormalTexture
-	)
-{
-	OutColorTexture = nullptr;
-	OutNormalTexture = nullptr;
-	if(nullptr == Material)
-	{
-		return;
-	}
-
-	{
-		TArray<UTexture*> Textures;
-		TArray<FName> TextureNames;
-		Material->GetTexturesInPropertyChain(
-			EMaterialProperty::MP_BaseColor,
-			Textures,
-			&TextureNames,
-			nullptr
-			);
-		if (0 < Textures.Num())
-		{
-			OutColorTexture = Textures[0];
-		}
-	}
-	{
-		TArray<UTexture*> Textures;
-		TArray<FName> TextureNames;
-		Material->GetTexturesInPropertyChain(
-			EMaterialProperty::MP_Normal,
-			Textures,
-			&TextureNames,
-			nullptr
-			);
-		if (0 < Textures.Num())
-		{
-			OutNormalTexture = Textures[0];
-		}
-	}
-}
-
-UMaterialInterface* FMICRepModule::CreateMIC(
-	UMaterialInterface* BaseMaterial,
-	FString BaseMaterialSimpleName,
-	UMaterialInterface* OldMaterial,
-	FString TargetPathName
-	)
-{
-	if((nullptr == BaseMaterial) || (nullptr == OldMaterial))
-	{
-		return nullptr;
-	}
-
-	FAssetToolsModule& AssetToolsModule =
-		FModuleManager::LoadModuleChecked<FAssetToolsModule>("AssetTools");
-
-	// 元マテリアル情報 
-	UTexture* ColorTex = nullptr;
-	UTexture* NormalTex = nullptr;
-	GetTextureFromMaterial(OldMaterial, ColorTex, NormalTex);
-
-	// 新MIC名 
-	FString NewMICName = FString::Printf(
-		TEXT("MI_%s_%s"),
-		*BaseMaterialSimpleName,
-		*(OldMaterial->GetName().Replace(TEXT("M_"), TEXT(""), ESearchCase::CaseSensitive))
-		);
-
-	// 新MIC作成 
-	UMaterialInstanceConstant* NewMIC = nullptr;
-	{
-		UMaterialInstanceConstantFactoryNew* Factory =
-			NewObject<UMaterialInstanceConstantFactoryNew>();
-		Factory->InitialParent = BaseMaterial;
-
-		UObject* NewAsset = AssetToolsModule.Get().CreateAsset(
-			NewMICName,
-			TargetPathName,
-			UMaterialInstanceConstant::StaticClass(),
-			Factory
-			);
-
-		NewMIC = Cast<UMaterialInstanceConstant>(NewAsset);
-	}
-	if(nullptr == NewMIC)
-	{
-		return nullptr;
-	}
-
-	// 新MICへテクスチャ設定 
-	FStaticParameterSet StaticParams;
-	if (nullptr != ColorTex)
-	{
-		NewMIC->SetTextureParameterValueEditorOnly(
-			FName(TEXT("BaseColor")),
-			ColorTex
-			);
-	}
-	if (nullptr != NormalTex)
-	{
-		NewMIC->SetTextureParameterValueEditorOnly(
-			FName(TEXT("Normal")),
-			NormalTex
-			);
-	}
-	else
-	{
-		// NoramlMap不要な場合はStaticSwitchでオフにする 
-		FStaticSwitchParameter Param;
-		Param.ParameterName = FName("UseNormal");
-		Param.Value = false;
-		Param.bOverride = true;
-		StaticParams.StaticSwitchParameters.Add(Param);
-	}
-	// StaticSwitchの適用 
-	if (0 < StaticParams.StaticSwitchParameters.Num())
-	{
-		NewMIC->UpdateStaticPermutation(StaticParams);
-	}
-
-	return NewMIC;
-}
-
-//
-// マテリアルの一括Reparent. 
-//
-void FMICRepModule::ReparentMICs(const FAssetData& NewParentAssetData, TArray<FAssetData> SelectedAssets)
-{
-	// 新たに親にするマテリアルを取得 
-	UMaterialInterface* NewParent = Cast<UMaterialInterface>(NewParentAssetData.GetAsset());
-	if(nullptr == NewParent)
-	{
-		return;
-	}
-
-	// 各選択アセットについて 
-	TArray<UObject*> ObjectsToSync;
-	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
-	{
-		// 編集対象MICを取得 
-		const FAssetData& MICAssetData = (*ItAsset);
-		UMaterialInstanceConstant* TargetMIC = Cast<UMaterialInstanceConstant>(MICAssetData.GetAsset());
-		if(nullptr == TargetMIC)
-		{
-			continue;
-		}
-
-		// 親マテリアルを変更 
-		TargetMIC->SetParentEditorOnly(NewParent);
-		TargetMIC->MarkPackageDirty();
-		TargetMIC->PostEditChange();
-
-		ObjectsToSync.Add(TargetMIC);
-	}
-
-	if(0 < ObjectsToSync.Num())
-	{
-		FContentBrowserModule& ContentBrowserModule = 
-			FModuleManager::LoadModuleChecked<FContentBrowserModule>("ContentBrowser");
-
-		ContentBrowserModule.Get().SyncBrowserToAssets(ObjectsToSync, true);
-	}
-}
-
-#undef LOCTEXT_NAMESPACE
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepModule.h"
+#include "MICRepMICIndex.h"
+#include "MICRepMaterialAnalysis.h"
+#include "MICRepTextureHash.h"
+#include "MICRepParameterCluster.h"
+#include "MICRepSectionMerge.h"
+#include "MICRepMaterialRemap.h"
+#include "MICRepProvenance.h"
+#include "MICRepShaderBatch.h"
+#include "MICRepBaseMaterialRegistry.h"
+#include "MICRepSettings.h"
+#include "MICRepPreloader.h"
+#include "MICRepPlanner.h"
+#include "MICRepStats.h"
+#include "MICRepSlicedTask.h"
+#include "MICRepParentIndex.h"
+#include "SMICRepParentPicker.h"
+#include "MICRepHierarchy.h"
+#include "MICRepImpactReport.h"
+#include "MICRepTextureRules.h"
+#include "MICRepJournal.h"
+#include "MICRepLODMaterials.h"
+#include "LevelEditor.h"
+#include "AssetRegistryModule.h"
+#include "ContentBrowserModule.h"
+#include "IContentBrowserSingleton.h"
+#include "AssetToolsModule.h"
+#include "IAssetTools.h"
+#include "SAssetSearchBox.h"
+#include "Factories/MaterialInstanceConstantFactoryNew.h"
+#include "FileHelpers.h"
+#include "PackageTools.h"
+#include "PackageHelperFunctions.h"
+
+
+#define LOCTEXT_NAMESPACE "MICRep"
+
+
+DEFINE_LOG_CATEGORY(LogMICRep);
+
+IMPLEMENT_MODULE(FMICRepModule, MICRepModule)
+
+namespace
+{
+	// 分割実行中の状態（タスク終了まで保持） 
+	struct FMICRepSlicedState
+	{
+		TArray<FStringAssetReference> ObjectsToSync;
+		FMICRepReplaceContext Context;
+		TUniquePtr<FMICRepRunStats::FScopedRun> ScopedRun;
+		TUniquePtr<FMICRepJournal::FScopedRun> ScopedJournal;
+
+		// 変換前後の計測（bWriteImpactReport） 
+		TArray<FAssetData> MeshAssets;
+		TUniquePtr<FMICRepImpactReport> ImpactReport;
+
+		FMICRepSlicedState() : Context(ObjectsToSync) {}
+	};
+
+	FContentBrowserMenuExtender_SelectedAssets ContentBrowserExtenderDelegate;
+	FDelegateHandle ContentBrowserExtenderDelegateHandle;
+
+	// ベースマテリアルの複製元（UMICRepSettings::BaseMaterial） 
+	UMaterial* LoadBaseMaterialOriginal()
+	{
+		const FStringAssetReference& BaseMaterial = GetDefault<UMICRepSettings>()->BaseMaterial;
+		UMaterial* BaseMatOriginal = Cast<UMaterial>(BaseMaterial.TryLoad());
+		if(nullptr == BaseMatOriginal)
+		{
+			UE_LOG(LogMICRep, Error, TEXT("Base material '%s' could not be loaded. Check Project Settings > Plugins > MIC Rep."), *BaseMaterial.ToString());
+		}
+		return BaseMatOriginal;
+	}
+}
+
+
+
+void FMICRepModule::StartupModule()
+{
+	if(IsRunningCommandlet()){ return; }
+
+	FContentBrowserModule& ContentBrowserModule =
+		FModuleManager::LoadModuleChecked<FContentBrowserModule>(TEXT("ContentBrowser"));
+
+	// アセット右クリックメニューへのExtender登録 
+	ContentBrowserExtenderDelegate =
+		FContentBrowserMenuExtender_SelectedAssets::CreateStatic(
+			&FMICRepModule::OnExtendContentBrowserAssetSelectionMenu
+			);
+	TArray<FContentBrowserMenuExtender_SelectedAssets>& CBMenuExtenderDelegates =
+		ContentBrowserModule.GetAllAssetViewContextMenuExtenders();
+	CBMenuExtenderDelegates.Add(ContentBrowserExtenderDelegate);
+	ContentBrowserExtenderDelegateHandle = CBMenuExtenderDelegates.Last().GetHandle();
+}
+void FMICRepModule::ShutdownModule()
+{
+	FMICRepSlicedTask::Abort();
+	SaveCaches();
+	FMICRepParentIndex::Get().UnregisterEvents();
+
+	FContentBrowserModule* ContentBrowserModule =
+		FModuleManager::GetModulePtr<FContentBrowserModule>(TEXT("ContentBrowser"));
+	if(nullptr != ContentBrowserModule)
+	{
+		TArray<FContentBrowserMenuExtender_SelectedAssets>& CBMenuExtenderDelegates =
+			ContentBrowserModule->GetAllAssetViewContextMenuExtenders();
+		CBMenuExtenderDelegates.RemoveAll([](const FContentBrowserMenuExtender_SelectedAssets& Delegate)
+			{ return Delegate.GetHandle() == ContentBrowserExtenderDelegateHandle; });
+	}
+}
+
+
+TSharedRef<FExtender> FMICRepModule::OnExtendContentBrowserAssetSelectionMenu(const TArray<FAssetData>& SelectedAssets)
+{
+	TSharedRef<FExtender> Extender(new FExtender());
+
+	bool bAnyMeshes = false;
+	bool bAnyMICs = false;
+	bool bAnyMaterials = false;
+	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+	{
+		bAnyMeshes |= ((*ItAsset).AssetClass == UStaticMesh::StaticClass()->GetFName());
+		bAnyMeshes |= ((*ItAsset).AssetClass == USkeletalMesh::StaticClass()->GetFName());
+		bAnyMICs   |= ((*ItAsset).AssetClass == UMaterialInstanceConstant::StaticClass()->GetFName());
+		bAnyMaterials |= ((*ItAsset).AssetClass == UMaterial::StaticClass()->GetFName());
+	}
+
+	if(bAnyMeshes | bAnyMICs | bAnyMaterials)
+	{
+		Extender->AddMenuExtension(
+			"GetAssetActions",
+			EExtensionHook::After,
+			nullptr,
+			FMenuExtensionDelegate::CreateStatic(&FMICRepModule::CreateAssetMenu, SelectedAssets)
+			);
+	}
+
+	return Extender;
+}
+void FMICRepModule::CreateAssetMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets)
+{
+	int32 MeshesCount = 0;
+	int32 MICCount = 0;
+	bool bAnyMICs = false;
+	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+	{
+		if(    ((*ItAsset).AssetClass == UStaticMesh::StaticClass()->GetFName())
+			|| ((*ItAsset).AssetClass == USkeletalMesh::StaticClass()->GetFName())
+			)
+		{
+			MeshesCount++;
+		}
+		else if(((*ItAsset).AssetClass == UMaterialInstanceConstant::StaticClass()->GetFName()))
+		{
+			MICCount++;
+		}
+	}
+
+	if(0 < MeshesCount)
+	{
+		MenuBuilder.AddMenuEntry(
+			LOCTEXT("ReplaceMaterials", "ReplaceMaterials"),
+			LOCTEXT("ReplaceMaterials_Tooltip", "Replace all Materials to MaterialInstance"),
+			FSlateIcon(),
+			FUIAction(FExecuteAction::CreateStatic(&FMICRepModule::ReplaceMaterials, SelectedAssets)),
+			NAME_None,
+			EUserInterfaceActionType::Button
+			);
+		if(2 <= MeshesCount)
+		{
+			MenuBuilder.AddMenuEntry(
+				LOCTEXT("ReplaceMaterials(Unify)", "ReplaceMaterials(Unify)"),
+				LOCTEXT("ReplaceMaterials_Tooltip", "Replace all Materials to MaterialInstance. (Derived from unified material)"),
+				FSlateIcon(),
+				FUIAction(FExecuteAction::CreateStatic(&FMICRepModule::ReplaceMaterialsUnify, SelectedAssets)),
+				NAME_None,
+				EUserInterfaceActionType::Button
+				);
+		}
+	}
+	if(0 < MICCount)
+	{
+		MenuBuilder.AddSubMenu(
+			LOCTEXT("ReparentMaterialInstance", "Reparent MaterialInstance"),
+			LOCTEXT("ReparentMaterialInstance_Tooltip", "Reparent MaterialInstance"),
+			FNewMenuDelegate::CreateStatic(&FMICRepModule::CreateReparentSubMenu, SelectedAssets)
+			);
+	}
+	// 1つのマテリアルを選択した場合は、その子孫のMICをまとめて付け替えられる 
+	if(    (1 == SelectedAssets.Num())
+		&& (   (SelectedAssets[0].AssetClass == UMaterial::StaticClass()->GetFName())
+			|| (SelectedAssets[0].AssetClass == UMaterialInstanceConstant::StaticClass()->GetFName())
+			)
+		)
+	{
+		MenuBuilder.AddSubMenu(
+			LOCTEXT("ReparentDescendants", "Reparent Descendant Instances"),
+			LOCTEXT("ReparentDescendants_Tooltip", "Move every MaterialInstance derived from this material under another parent"),
+			FNewMenuDelegate::CreateStatic(&FMICRepModule::CreateReparentDescendantsSubMenu, SelectedAssets[0])
+			);
+	}
+	if((0 < MeshesCount) || (0 < MICCount))
+	{
+		MenuBuilder.AddMenuEntry(
+			LOCTEXT("RollbackLastRun", "Roll Back Last MICRep Run"),
+			LOCTEXT("RollbackLastRun_Tooltip", "Restore the materials and parents the last MICRep run changed on the selected assets"),
+			FSlateIcon(),
+			FUIAction(FExecuteAction::CreateStatic(&FMICRepModule::RollbackSelected, SelectedAssets)),
+			NAME_None,
+			EUserInterfaceActionType::Button
+			);
+	}
+}
+void FMICRepModule::CreateReparentSubMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets)
+{
+	MenuBuilder.AddSubMenu(
+		LOCTEXT("ReparentMaterialInstance", "Reparent MaterialInstance"),
+		LOCTEXT("ReparentMaterialInstance_Tooltip", "Reparent MaterialInstance"),
+		FNewMenuDelegate::CreateStatic(&FMICRepModule::CreateReparentSubSubMenu, SelectedAssets)
+		);
+}
+void FMICRepModule::CreateReparentSubSubMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets)
+{
+	// 親候補は FMICRepParentIndex から引くだけ（メニューを開く際にアセット列挙やロードをしない） 
+	MenuBuilder.AddWidget(
+		SNew(SMICRepParentPicker)
+		.OnParentPicked(FOnMICRepParentPicked::CreateStatic(&FMICRepModule::ReparentMICs, SelectedAssets)),
+		FText(), true);
+}
+void FMICRepModule::CreateReparentDescendantsSubMenu(FMenuBuilder& MenuBuilder, FAssetData RootAssetData)
+{
+	MenuBuilder.AddWidget(
+		SNew(SMICRepParentPicker)
+		.OnParentPicked(FOnMICRepParentPicked::CreateStatic(&FMICRepModule::ReparentDescendants, RootAssetData)),
+		FText(), true);
+}
+
+//
+// StaticMesh/SkeletalMeshマテリアルの一括置換 
+//
+void FMICRepModule::ReplaceMaterials(TArray<FAssetData> SelectedAssets)
+{
+	StartSlicedReplace(SelectedAssets, false);
+}
+void FMICRepModule::ExecuteReplaceMaterials(const TArray<FAssetData>& SelectedAssets, TArray<FStringAssetReference>& ObjectsToSync)
+{
+	FMICRepRunStats::FScopedRun ScopedRun(TEXT("ReplaceMaterials"));
+	FMICRepJournal::FScopedRun ScopedJournal(TEXT("ReplaceMaterials"));
+
+	FMICRepReplaceContext Context(ObjectsToSync);
+	FMICRepSlicedWork Work;
+	if(!MakeReplaceWork(SelectedAssets, false, Context, Work))
+	{
+		return;
+	}
+	FMICRepSlicedTask::Run(Work);
+
+	SaveCaches();
+}
+
+//
+// StaticMesh/SkeletalMeshマテリアルの一括置換（基底マテリアルを統一） 
+//
+void FMICRepModule::ReplaceMaterialsUnify(TArray<FAssetData> SelectedAssets)
+{
+	StartSlicedReplace(SelectedAssets, true);
+}
+bool FMICRepModule::ExecuteReplaceMaterialsUnify(const TArray<FAssetData>& SelectedAssets, TArray<FStringAssetReference>& ObjectsToSync)
+{
+	FMICRepRunStats::FScopedRun ScopedRun(TEXT("ReplaceMaterialsUnify"));
+	FMICRepJournal::FScopedRun ScopedJournal(TEXT("ReplaceMaterialsUnify"));
+
+	FMICRepReplaceContext Context(ObjectsToSync);
+	FMICRepSlicedWork Work;
+	if(!MakeReplaceWork(SelectedAssets, true, Context, Work))
+	{
+		return false;
+	}
+	FMICRepSlicedTask::Run(Work);
+
+	SaveCaches();
+	return true;
+}
+
+//
+// 置換処理をエディタのTickで分割実行 
+//
+void FMICRepModule::StartSlicedReplace(const TArray<FAssetData>& SelectedAssets, bool bUnify)
+{
+	if(!FMICRepSlicedTask::CanStart())
+	{
+		return;
+	}
+
+	const TCHAR* RunName = bUnify ? TEXT("ReplaceMaterialsUnify") : TEXT("ReplaceMaterials");
+	TSharedRef<FMICRepSlicedState> State = MakeShareable(new FMICRepSlicedState());
+	State->ScopedRun.Reset(new FMICRepRunStats::FScopedRun(RunName));
+	State->ScopedJournal.Reset(new FMICRepJournal::FScopedRun(RunName));
+
+	// 変換前の計測（ロードせずに済む範囲で） 
+	if(GetDefault<UMICRepSettings>()->bWriteImpactReport)
+	{
+		for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+		{
+			if(    ((*ItAsset).AssetClass == UStaticMesh::StaticClass()->GetFName())
+				|| ((*ItAsset).AssetClass == USkeletalMesh::StaticClass()->GetFName())
+				)
+			{
+				State->MeshAssets.Add(*ItAsset);
+			}
+		}
+		State->ImpactReport.Reset(new FMICRepImpactReport());
+		FMICRepImpact::MeasureBefore(RunName, State->MeshAssets, *State->ImpactReport);
+	}
+
+	FMICRepSlicedWork Work;
+	if(!MakeReplaceWork(SelectedAssets, bUnify, State->Context, Work))
+	{
+		return;
+	}
+	Work.Finished = [State](bool bCancelled)
+	{
+		SaveCaches();
+		if(State->ImpactReport.IsValid() && !bCancelled)
+		{
+			FMICRepImpact::MeasureAfter(State->MeshAssets, *State->ImpactReport);
+			FMICRepImpact::LogSummary(*State->ImpactReport);
+			FMICRepImpact::SaveReportToSavedDir(*State->ImpactReport);
+		}
+		SyncBrowserToObjects(State->ObjectsToSync);
+		State->ScopedJournal.Reset();
+		State->ScopedRun.Reset();
+	};
+	Work.Aborted = [State]()
+	{
+		State->ScopedJournal.Reset();
+		State->ScopedRun.Reset();
+	};
+	FMICRepSlicedTask::Start(MoveTemp(Work));
+}
+
+//
+// 置換処理の内容を作成 
+//
+bool FMICRepModule::MakeReplaceWork(const TArray<FAssetData>& SelectedAssets, bool bUnify, FMICRepReplaceContext& Context, FMICRepSlicedWork& OutWork)
+{
+	// ベースマテリアルの複製元を取得 
+	UMaterial* BaseMatOriginal = LoadBaseMaterialOriginal();
+	if(nullptr == BaseMatOriginal)
+	{
+		return false;
+	}
+
+	if(!bUnify)
+	{
+		OutWork.Description = LOCTEXT("ReplaceMaterialsTask", "Replacing materials");
+		MakeMeshWork(SelectedAssets, Context, [BaseMatOriginal, &Context](UObject* TargetAsset)
+			{
+				// ベースマテリアルを複製（共有設定時は共有ベースを利用） 
+				// 変換済みのスロットしか無く、前回と同じモード/設定の場合は複製しない 
+				Context.BaseMat = nullptr;
+				if(HasUnconvertedMaterials(TargetAsset) || FMICRepProvenance::NeedsReconversion(TargetAsset, false))
+				{
+					FString TargetPathName = FPackageName::GetLongPackagePath(TargetAsset->GetPathName());
+					Context.BaseMatSimpleName = TargetAsset->GetName().Replace(TEXT("SM_"), TEXT(""), ESearchCase::CaseSensitive);
+					Context.BaseMat = ResolveBaseMaterial(BaseMatOriginal, Context.BaseMatSimpleName, TargetPathName);
+					if (nullptr == Context.BaseMat)
+					{
+						return;
+					}
+					Context.TouchedPackages.Add(Context.BaseMat->GetOutermost());
+				}
+
+				ReplaceMeshMaterials(TargetAsset, Context);
+			}, OutWork);
+		return true;
+	}
+
+	Context.bUnify = true;
+
+	// ベースマテリアルを複製 
+	{
+		for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+		{
+			UObject* TargetAsset = (*ItAsset).GetAsset();
+			if(nullptr == TargetAsset)
+			{
+				continue;
+			}
+
+			FString TargetPathName = FPackageName::GetLongPackagePath(TargetAsset->GetPathName());
+			{
+				Context.BaseMatSimpleName = TargetAsset->GetName().Replace(TEXT("SM_"), TEXT(""), ESearchCase::CaseSensitive);
+				Context.BaseMat = ResolveBaseMaterial(BaseMatOriginal, Context.BaseMatSimpleName, TargetPathName);
+				if(nullptr != Context.BaseMat)
+				{
+					break;
+				}
+			}
+		}
+	}
+	if(nullptr == Context.BaseMat)
+	{
+		UE_LOG(LogMICRep, Error, TEXT("Failed Create Base Material..."));
+		return false;
+	}
+	Context.TouchedPackages.Add(Context.BaseMat->GetOutermost());
+
+	OutWork.Description = LOCTEXT("ReplaceMaterialsUnifyTask", "Replacing materials (Unify)");
+	MakeMeshWork(SelectedAssets, Context, [&Context](UObject* TargetAsset)
+		{
+			ReplaceMeshMaterials(TargetAsset, Context);
+		}, OutWork);
+	return true;
+}
+
+//
+// 事前に作成したプランの適用 
+//
+// プラン作成時から内容が変わっていても、同一内容のMICは重複排除インデックスで再利用される. 
+// シャード実行時は担当範囲のMIC作成、またはメッシュへの割り当てのみを行い、作成結果をプランへ書き戻す. 
+//
+bool FMICRepModule::ExecuteApplyPlan(FMICRepPlan& Plan, const FMICRepApplyOptions& Options, TArray<FStringAssetReference>& ObjectsToSync)
+{
+	FMICRepRunStats::FScopedRun ScopedRun(TEXT("ApplyPlan"));
+	FMICRepJournal::FScopedRun ScopedJournal(TEXT("ApplyPlan"));
+	FAssetRegistryModule&  AssetRegistryModule  = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+
+	// ベースマテリアルの複製元を取得 
+	UMaterial* BaseMatOriginal = LoadBaseMaterialOriginal();
+	if(nullptr == BaseMatOriginal)
+	{
+		return false;
+	}
+
+	// 担当範囲 
+	int32 InstanceBegin = 0;
+	int32 InstanceEnd = 0;
+	int32 MeshBegin = 0;
+	int32 MeshEnd = 0;
+	if(Options.bInstances)
+	{
+		FMICRepPlanner::GetShardRange(Plan.Instances.Num(), Options.ShardIndex, Options.NumShards, InstanceBegin, InstanceEnd);
+	}
+	if(Options.bMeshes)
+	{
+		FMICRepPlanner::GetShardRange(Plan.Meshes.Num(), Options.ShardIndex, Options.NumShards, MeshBegin, MeshEnd);
+	}
+
+	// 対象メッシュ 
+	TArray<FAssetData> MeshAssets;
+	MeshAssets.SetNum(Plan.Meshes.Num());
+	for(int32 MeshIdx = MeshBegin; MeshIdx < MeshEnd; ++MeshIdx)
+	{
+		const FString& MeshPath = Plan.Meshes[MeshIdx].ObjectPath;
+		MeshAssets[MeshIdx] = AssetRegistryModule.Get().GetAssetByObjectPath(FName(*MeshPath));
+		if(!MeshAssets[MeshIdx].IsValid())
+		{
+			UE_LOG(LogMICRep, Warning, TEXT("Planned mesh not found: %s"), *MeshPath);
+		}
+	}
+	{
+		TArray<FAssetData> MeshesToLoad;
+		MeshesToLoad.Append(MeshAssets.GetData() + MeshBegin, MeshEnd - MeshBegin);
+		FMICRepPreloader::Preload(MeshesToLoad, 3);
+	}
+
+	bool bSucceeded = true;
+	{
+		FMICRepShaderBatch ShaderBatch;
+
+		// ベースマテリアル 
+		TArray<UMaterial*> BaseMaterials;
+		BaseMaterials.SetNumZeroed(Plan.BaseMaterials.Num());
+		if(Options.bBases || (InstanceBegin < InstanceEnd))
+		{
+			for(int32 BaseIdx = 0; BaseIdx < Plan.BaseMaterials.Num(); ++BaseIdx)
+			{
+				const FMICRepPlannedBase& PlannedBase = Plan.BaseMaterials[BaseIdx];
+
+				// ベースを作成しないシャードでは作成済みのものをロード 
+				UMaterial* BaseMat = Options.bBases
+					? ResolveBaseMaterial(BaseMatOriginal, PlannedBase.SimpleName, PlannedBase.TargetPathName)
+					: LoadObject<UMaterial>(nullptr, *PlannedBase.ObjectPath);
+				if(nullptr == BaseMat)
+				{
+					UE_LOG(LogMICRep, Error, TEXT("Failed Create Base Material... (%s)"), *PlannedBase.ObjectPath);
+					bSucceeded = false;
+					continue;
+				}
+				BaseMaterials[BaseIdx] = BaseMat;
+
+				// シャード間で同じバリアントを作らないよう、テクスチャが欠けたMIC用の親もここで作成 
+				if(Options.bBases)
+				{
+					for(auto ItVariant = PlannedBase.Variants.CreateConstIterator(); ItVariant; ++ItVariant)
+					{
+						TArray<TPair<FName, FString>> NoTextures;
+						TArray<FName> DisabledSwitches;
+						FMICRepPlanner::ParseSwitches(*ItVariant, DisabledSwitches);
+						FMICRepTextureRules::FilterForBase(BaseMat, NoTextures, DisabledSwitches);
+						GetBaseVariant(BaseMat, DisabledSwitches);
+					}
+				}
+			}
+		}
+
+		// 遠景LOD用の簡易MICの作成結果 
+		FMICRepReplaceContext LODContext(ObjectsToSync);
+		LODContext.bUnify = (TEXT("unify") == Plan.Mode);
+
+		// MIC 
+		TArray<UMaterialInterface*> Instances;
+		Instances.SetNumZeroed(Plan.Instances.Num());
+		for(int32 InstanceIdx = InstanceBegin; InstanceIdx < InstanceEnd; ++InstanceIdx)
+		{
+			FMICRepPlannedInstance& PlannedInstance = Plan.Instances[InstanceIdx];
+			UMaterial* BaseMat = BaseMaterials.IsValidIndex(PlannedInstance.Base) ? BaseMaterials[PlannedInstance.Base] : nullptr;
+
+			// プランはベースを確認せずに作成しているため、ここでベースの持つパラメータに絞る 
+			TArray<TPair<FName, FString>> TexturePaths;
+			for(auto ItTexture = PlannedInstance.Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+			{
+				TexturePaths.Add(TPair<FName, FString>(FName(*(*ItTexture).Parameter), (*ItTexture).Texture));
+			}
+			TArray<FName> DisabledSwitches;
+			FMICRepPlanner::ParseSwitches(PlannedInstance.DisabledSwitches, DisabledSwitches);
+			FMICRepTextureRules::FilterForBase(BaseMat, TexturePaths, DisabledSwitches);
+			FMICRepTextureSet TextureSet;
+			FMICRepTextureRules::LoadTextureSet(TexturePaths, DisabledSwitches, TextureSet);
+
+			// 元マテリアルからパラメータを引き継ぎ、来歴を記録する 
+			UMaterialInterface* SourceMaterial = PlannedInstance.SourceMaterial.IsEmpty()
+				? nullptr
+				: LoadObject<UMaterialInterface>(nullptr, *PlannedInstance.SourceMaterial, nullptr, LOAD_NoWarn);
+			if(!PlannedInstance.SourceMaterial.IsEmpty() && (nullptr == SourceMaterial))
+			{
+				UE_LOG(LogMICRep, Warning, TEXT("Planned source material not found: %s"), *PlannedInstance.SourceMaterial);
+			}
+
+			UMaterialInterface* NewMIC = CreateMICWithTextures(BaseMat, PlannedInstance.Name, PlannedInstance.PackagePath, TextureSet, SourceMaterial);
+			if(nullptr == NewMIC)
+			{
+				continue;
+			}
+			ObjectsToSync.Add(FStringAssetReference(NewMIC));
+			Instances[InstanceIdx] = NewMIC;
+
+			// 遠景LOD用の簡易MICもMICと同じシャードで作成し、メッシュのシャード間で重複させない 
+			if(GetDefault<UMICRepSettings>()->bGenerateLODVariants)
+			{
+				GetLODVariantMIC(NewMIC, LODContext);
+			}
+
+			// 作成結果（重複排除インデックスへの登録用） 
+			PlannedInstance.ObjectPath = NewMIC->GetPathName();
+			PlannedInstance.Hash = FMICRepMICKey::FromInstance(Cast<UMaterialInstanceConstant>(NewMIC)).GetHash().ToString();
+		}
+
+		// メッシュへ割り当て 
+		const bool bMergeSections = (TEXT("unify") == Plan.Mode) && GetDefault<UMICRepSettings>()->bMergeSectionsAfterUnify;
+		for(int32 MeshIdx = MeshBegin; MeshIdx < MeshEnd; ++MeshIdx)
+		{
+			UObject* TargetAsset = MeshAssets[MeshIdx].IsValid() ? MeshAssets[MeshIdx].GetAsset() : nullptr;
+			if(nullptr == TargetAsset)
+			{
+				continue;
+			}
+
+			// <SourceMaterialPath, MIC>（他のプロセスで作成したMICはパスからロード） 
+			TMap<FString, UMaterialInterface*> ReplacementMap;
+			for(auto ItReplacement = Plan.Meshes[MeshIdx].Replacements.CreateConstIterator(); ItReplacement; ++ItReplacement)
+			{
+				const int32 InstanceIdx = (*ItReplacement).Instance;
+				if(!Instances.IsValidIndex(InstanceIdx))
+				{
+					continue;
+				}
+				if((nullptr == Instances[InstanceIdx]) && !Plan.Instances[InstanceIdx].ObjectPath.IsEmpty())
+				{
+					Instances[InstanceIdx] = LoadObject<UMaterialInterface>(nullptr, *Plan.Instances[InstanceIdx].ObjectPath);
+				}
+				if(nullptr != Instances[InstanceIdx])
+				{
+					ReplacementMap.Add((*ItReplacement).SourceMaterial, Instances[InstanceIdx]);
+					FMICRepMaterialRemap::Get().Add((*ItReplacement).SourceMaterial, Instances[InstanceIdx]->GetPathName());
+				}
+			}
+
+			// 来歴として記録する元マテリアル 
+			TArray<FString> SourceMaterials;
+			auto ReplaceSlot = [&ReplacementMap, &SourceMaterials](UMaterialInterface* OldMaterial) -> UMaterialInterface*
+			{
+				if(nullptr == OldMaterial)
+				{
+					return nullptr;
+				}
+				UMaterialInterface* const* NewMIC = ReplacementMap.Find(OldMaterial->GetPathName());
+				if(nullptr != NewMIC)
+				{
+					SourceMaterials.Add(OldMaterial->GetPathName());
+					FMICRepProvenance::RecordUse(*NewMIC, OldMaterial);
+					return *NewMIC;
+				}
+
+				// 変換済みのMICは元マテリアルを引き継ぐ 
+				FString SourcePath;
+				bool bNeedsRefresh = false;
+				SourceMaterials.Add(FMICRepProvenance::FindSource(OldMaterial, SourcePath, bNeedsRefresh) ? SourcePath : OldMaterial->GetPathName());
+				return nullptr;
+			};
+
+			UStaticMesh* TargetStaticMesh = Cast<UStaticMesh>(TargetAsset);
+			if(nullptr != TargetStaticMesh)
+			{
+				bool bChanged = false;
+				for(auto ItMat = TargetStaticMesh->StaticMaterials.CreateIterator(); ItMat; ++ItMat)
+				{
+					UMaterialInterface* OldMaterial = (*ItMat).MaterialInterface;
+					UMaterialInterface* NewMIC = ReplaceSlot(OldMaterial);
+					if(nullptr != NewMIC)
+					{
+						FMICRepJournal::RecordSlot(TargetStaticMesh, ItMat.GetIndex(), OldMaterial, NewMIC);
+						(*ItMat).MaterialInterface = NewMIC;
+						bChanged = true;
+					}
+				}
+				if(bChanged && bMergeSections)
+				{
+					FMICRepSectionMerge::MergeStaticMesh(TargetStaticMesh, &Plan.Meshes[MeshIdx].OldSlotToNew);
+				}
+				if(    GetDefault<UMICRepSettings>()->bGenerateLODVariants
+					&& FMICRepLODMaterials::AssignStaticMesh(TargetStaticMesh, GetDefault<UMICRepSettings>()->LODVariantStartLOD,
+						[&LODContext](UMaterialInterface* Material) { return GetLODVariantMIC(Material, LODContext); })
+					)
+				{
+					bChanged = true;
+				}
+				if(bChanged)
+				{
+					TargetStaticMesh->MarkPackageDirty();
+				}
+				FMICRepProvenance::Get().RecordMesh(TargetStaticMesh, SourceMaterials, LODContext.bUnify);
+			}
+
+			USkeletalMesh* TargetSkeletalMesh = Cast<USkeletalMesh>(TargetAsset);
+			if(nullptr != TargetSkeletalMesh)
+			{
+				bool bChanged = false;
+				for(auto ItMat = TargetSkeletalMesh->Materials.CreateIterator(); ItMat; ++ItMat)
+				{
+					UMaterialInterface* OldMaterial = (*ItMat).MaterialInterface;
+					UMaterialInterface* NewMIC = ReplaceSlot(OldMaterial);
+					if(nullptr != NewMIC)
+					{
+						FMICRepJournal::RecordSlot(TargetSkeletalMesh, ItMat.GetIndex(), OldMaterial, NewMIC);
+						(*ItMat).MaterialInterface = NewMIC;
+						bChanged = true;
+					}
+				}
+				if(bChanged && bMergeSections)
+				{
+					FMICRepSectionMerge::CompactSkeletalMesh(TargetSkeletalMesh, &Plan.Meshes[MeshIdx].OldSlotToNew);
+				}
+				if(    GetDefault<UMICRepSettings>()->bGenerateLODVariants
+					&& FMICRepLODMaterials::AssignSkeletalMesh(TargetSkeletalMesh, GetDefault<UMICRepSettings>()->LODVariantStartLOD,
+						[&LODContext](UMaterialInterface* Material) { return GetLODVariantMIC(Material, LODContext); })
+					)
+				{
+					bChanged = true;
+				}
+				if(bChanged)
+				{
+					TargetSkeletalMesh->MarkPackageDirty();
+				}
+				FMICRepProvenance::Get().RecordMesh(TargetSkeletalMesh, SourceMaterials, LODContext.bUnify);
+			}
+		}
+	}
+
+	SaveCaches();
+	return bSucceeded;
+}
+
+//
+// メッシュ群の処理内容を作成 
+//
+// 対象をチャンクに区切り、チャンクごとに先読みとシェーダーコンパイルをまとめて行う. 
+// ストリーミング設定時はチャンクごとに変更を保存して解放し、メモリ使用量を一定に保つ. 
+//
+void FMICRepModule::MakeMeshWork(
+	const TArray<FAssetData>& SelectedAssets,
+	FMICRepReplaceContext& Context,
+	TFunction<void(UObject*)> ProcessMesh,
+	FMICRepSlicedWork& OutWork
+	)
+{
+	struct FChunkState
+	{
+		TArray<FAssetData> Assets;
+		TArray<UPackage*> LoadedPackages;
+		TUniquePtr<FMICRepShaderBatch> ShaderBatch;
+	};
+	TSharedRef<FChunkState> Chunk = MakeShareable(new FChunkState());
+
+	// 前回の変換以降に変更されていないメッシュはロードせずに除外 
+	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+	{
+		if(!FMICRepProvenance::Get().IsUpToDate(*ItAsset, Context.bUnify))
+		{
+			Chunk->Assets.Add(*ItAsset);
+		}
+	}
+	const int32 NumSkipped = SelectedAssets.Num() - Chunk->Assets.Num();
+	if(0 < NumSkipped)
+	{
+		UE_LOG(LogMICRep, Display, TEXT("Skipped %d meshes unchanged since their last conversion."), NumSkipped);
+		MICREP_INC_COUNTER(SkippedAssets, NumSkipped);
+	}
+
+	const UMICRepSettings* Settings = GetDefault<UMICRepSettings>();
+	const bool bStreaming = Settings->bStreamingConversion;
+
+	OutWork.NumItems = Chunk->Assets.Num();
+	OutWork.WindowSize = bStreaming ? FMath::Max(1, Settings->StreamingChunkSize) : FMath::Max(1, Chunk->Assets.Num());
+	OutWork.BeginWindow = [Chunk](int32 Begin, int32 End)
+	{
+		// メッシュ、マテリアル、テクスチャを先にまとめてロード 
+		TArray<FAssetData> ChunkAssets;
+		ChunkAssets.Append(&Chunk->Assets[Begin], End - Begin);
+		Chunk->LoadedPackages.Reset();
+		FMICRepPreloader::Preload(ChunkAssets, 3, &Chunk->LoadedPackages);
+
+		// シェーダーコンパイルはチャンクの最後にまとめて実行 
+		Chunk->ShaderBatch.Reset(new FMICRepShaderBatch());
+	};
+	OutWork.ProcessItem = [Chunk, ProcessMesh](int32 ItemIndex)
+	{
+		// 編集対象メッシュを取得 
+		UObject* TargetAsset = nullptr;
+		{
+			MICREP_SCOPE_PHASE(Load);
+			TargetAsset = Chunk->Assets[ItemIndex].GetAsset();
+		}
+		if(nullptr != TargetAsset)
+		{
+			ProcessMesh(TargetAsset);
+		}
+	};
+	OutWork.EndWindow = [Chunk, &Context, bStreaming](int32 Begin, int32 End)
+	{
+		Chunk->ShaderBatch.Reset();
+		if(bStreaming)
+		{
+			FlushChunk(Context, Chunk->LoadedPackages);
+		}
+		Chunk->LoadedPackages.Reset();
+	};
+}
+
+//
+// チャンク内で変更したパッケージを保存し、ロードしたパッケージごと解放 
+//
+// 保存（チェックアウト）に失敗したパッケージは変更を失わないようロードしたまま残す. 
+//
+void FMICRepModule::FlushChunk(FMICRepReplaceContext& Context, const TArray<UPackage*>& LoadedPackages)
+{
+	TArray<UPackage*> PackagesToSave;
+	for(auto ItPackage = Context.TouchedPackages.CreateConstIterator(); ItPackage; ++ItPackage)
+	{
+		if((*ItPackage)->IsDirty())
+		{
+			PackagesToSave.Add(*ItPackage);
+		}
+	}
+	const int32 SavedCount = SavePackages(PackagesToSave);
+
+	// ベースマテリアルは次のチャンクでも使うため残す 
+	TSet<UPackage*> PackagesToUnload = Context.TouchedPackages;
+	PackagesToUnload.Append(LoadedPackages);
+	if(nullptr != Context.BaseMat)
+	{
+		PackagesToUnload.Remove(Context.BaseMat->GetOutermost());
+	}
+	if(SavedCount < PackagesToSave.Num())
+	{
+		for(auto ItPackage = PackagesToSave.CreateConstIterator(); ItPackage; ++ItPackage)
+		{
+			if((*ItPackage)->IsDirty())
+			{
+				PackagesToUnload.Remove(*ItPackage);
+				UE_LOG(LogMICRep, Error, TEXT("'%s' was not saved and is kept loaded with its changes. Save it manually."), *(*ItPackage)->GetName());
+			}
+		}
+	}
+	Context.TouchedPackages.Reset();
+
+	MICREP_SCOPE_PHASE(Unload);
+	FText ErrorMessage;
+	if(!PackageTools::UnloadPackages(PackagesToUnload.Array(), ErrorMessage))
+	{
+		UE_LOG(LogMICRep, Warning, TEXT("%s"), *ErrorMessage.ToString());
+	}
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+}
+
+//
+// メッシュ1つ分のマテリアル置換 
+//
+void FMICRepModule::ReplaceMeshMaterials(UObject* TargetAsset, FMICRepReplaceContext& Context)
+{
+	FString TargetPathName = FPackageName::GetLongPackagePath(TargetAsset->GetPathName());
+
+	// 来歴として記録する元マテリアル 
+	TArray<FString> SourceMaterials;
+
+	// 前回と異なるモード/設定で変換する場合は、変換済みのMICも元マテリアルから作り直す 
+	const bool bReconvert = FMICRepProvenance::NeedsReconversion(TargetAsset, Context.bUnify);
+
+	// StaticMesh 
+	UStaticMesh* TargetStaticMesh = Cast<UStaticMesh>(TargetAsset);
+	if(nullptr != TargetStaticMesh)
+	{
+		// メッシュの各マテリアルについて 
+		bool bChanged = false;
+		int32 MatIdx = 0;
+		for(auto ItMat = TargetStaticMesh->StaticMaterials.CreateConstIterator(); ItMat; ++ItMat, ++MatIdx)
+		{
+			FStaticMaterial StaMat = TargetStaticMesh->StaticMaterials[MatIdx];
+
+			UMaterialInterface* NewMIC = ConvertSlotMaterial(StaMat.MaterialInterface, TargetPathName, Context, bReconvert, SourceMaterials);
+			if(nullptr == NewMIC)
+			{
+				continue;
+			}
+
+			// メッシュに新MICをセット 
+			FMICRepJournal::RecordSlot(TargetStaticMesh, MatIdx, StaMat.MaterialInterface, NewMIC);
+			StaMat.MaterialInterface = NewMIC;
+			TargetStaticMesh->StaticMaterials[MatIdx] = StaMat;
+			bChanged = true;
+		}
+
+		// 同じMICになったスロットのセクションを統合 
+		if(bChanged && Context.bUnify && GetDefault<UMICRepSettings>()->bMergeSectionsAfterUnify)
+		{
+			FMICRepSectionMerge::MergeStaticMesh(TargetStaticMesh);
+		}
+
+		// 遠景LODのセクションを簡易MICへ付け替え 
+		if(    GetDefault<UMICRepSettings>()->bGenerateLODVariants
+			&& FMICRepLODMaterials::AssignStaticMesh(TargetStaticMesh, GetDefault<UMICRepSettings>()->LODVariantStartLOD,
+				[&Context](UMaterialInterface* Material) { return GetLODVariantMIC(Material, Context); })
+			)
+		{
+			bChanged = true;
+		}
+
+		// メッシュアセットに要保存マーク 
+		if(bChanged)
+		{
+			TargetStaticMesh->MarkPackageDirty();
+			Context.TouchedPackages.Add(TargetStaticMesh->GetOutermost());
+		}
+		FMICRepProvenance::Get().RecordMesh(TargetStaticMesh, SourceMaterials, Context.bUnify);
+	}
+
+	// SkeletalMesh 
+	USkeletalMesh* TargetSkeletalMesh = Cast<USkeletalMesh>(TargetAsset);
+	if(nullptr != TargetSkeletalMesh)
+	{
+		// メッシュの各マテリアルについて 
+		bool bChanged = false;
+		int32 MatIdx = 0;
+		for(auto ItMat = TargetSkeletalMesh->Materials.CreateConstIterator(); ItMat; ++ItMat, ++MatIdx)
+		{
+			UMaterialInterface* NewMIC = ConvertSlotMaterial(TargetSkeletalMesh->Materials[MatIdx].MaterialInterface, TargetPathName, Context, bReconvert, SourceMaterials);
+			if (nullptr == NewMIC)
+			{
+				continue;
+			}
+
+			// メッシュに新MICをセット 
+			FMICRepJournal::RecordSlot(TargetSkeletalMesh, MatIdx, TargetSkeletalMesh->Materials[MatIdx].MaterialInterface, NewMIC);
+			TargetSkeletalMesh->Materials[MatIdx].MaterialInterface = NewMIC;
+			bChanged = true;
+		}
+
+		// 同じMICになったスロットを詰める 
+		if(bChanged && Context.bUnify && GetDefault<UMICRepSettings>()->bMergeSectionsAfterUnify)
+		{
+			FMICRepSectionMerge::CompactSkeletalMesh(TargetSkeletalMesh);
+		}
+
+		// 遠景LODのセクションを簡易MICへ付け替え 
+		if(    GetDefault<UMICRepSettings>()->bGenerateLODVariants
+			&& FMICRepLODMaterials::AssignSkeletalMesh(TargetSkeletalMesh, GetDefault<UMICRepSettings>()->LODVariantStartLOD,
+				[&Context](UMaterialInterface* Material) { return GetLODVariantMIC(Material, Context); })
+			)
+		{
+			bChanged = true;
+		}
+
+		// メッシュアセットに要保存マーク 
+		if(bChanged)
+		{
+			TargetSkeletalMesh->MarkPackageDirty();
+			Context.TouchedPackages.Add(TargetSkeletalMesh->GetOutermost());
+		}
+		FMICRepProvenance::Get().RecordMesh(TargetSkeletalMesh, SourceMaterials, Context.bUnify);
+	}
+}
+
+//
+// スロット1つ分の変換 
+//
+// 変換済みのMICはそのまま使い、元マテリアルが変更されている場合のみ内容を更新する. 
+// 更新したMICが他の元マテリアルと共有されていた場合は、この元マテリアル用に作成したMICを返す（それ以外はnullptr）. 
+// bReconvert（前回とモード/設定が異なる）の場合は、記録した元マテリアルから改めて置換先を求める. 
+//
+UMaterialInterface* FMICRepModule::ConvertSlotMaterial(UMaterialInterface* Material, const FString& TargetPathName, FMICRepReplaceContext& Context, bool bReconvert, TArray<FString>& OutSourceMaterials)
+{
+	if(nullptr == Material)
+	{
+		return nullptr;
+	}
+
+	FString SourcePath;
+	bool bNeedsRefresh = false;
+	if(FMICRepProvenance::FindSource(Material, SourcePath, bNeedsRefresh))
+	{
+		OutSourceMaterials.Add(SourcePath);
+
+		// Replace後のUnifyなど（元マテリアルが削除されていればそのまま使う） 
+		UMaterialInterface* SourceMaterial = (bReconvert && (nullptr != Context.BaseMat) && !FMICRepProvenance::IsLODVariant(Material))
+			? LoadObject<UMaterialInterface>(nullptr, *SourcePath, nullptr, LOAD_NoWarn)
+			: nullptr;
+		if(nullptr != SourceMaterial)
+		{
+			UMaterialInterface* NewMIC = GetReplacementMIC(SourceMaterial, TargetPathName, Context);
+			return (Material != NewMIC) ? NewMIC : nullptr;
+		}
+		if(bNeedsRefresh)
+		{
+			return RefreshMIC(Cast<UMaterialInstanceConstant>(Material), SourcePath, Context);
+		}
+		return nullptr;
+	}
+
+	OutSourceMaterials.Add(Material->GetPathName());
+	return GetReplacementMIC(Material, TargetPathName, Context);
+}
+
+//
+// 変換済みのMICを元マテリアルの現在の内容で作り直す 
+//
+// 重複排除で他の元マテリアルと共有しているMICは書き換えず、この元マテリアル用のMICを別に作成して返す. 
+// その場で更新した場合はnullptrを返す. 
+//
+UMaterialInterface* FMICRepModule::RefreshMIC(UMaterialInstanceConstant* MIC, const FString& SourcePath, FMICRepReplaceContext& Context)
+{
+	UMaterialInterface* SourceMaterial = LoadObject<UMaterialInterface>(nullptr, *SourcePath, nullptr, LOAD_NoWarn);
+	if((nullptr == MIC) || (nullptr == SourceMaterial))
+	{
+		return nullptr;
+	}
+
+	FMICRepTextureSet TextureSet;
+	FMICRepTextureRules::GetTextureSet(SourceMaterial, MIC->GetMaterial(), TextureSet);
+	if(GetDefault<UMICRepSettings>()->bRedirectDuplicateTextures)
+	{
+		TextureSet.RedirectToCanonical();
+	}
+
+	// 遠景LOD用の簡易MICは簡易化したまま作り直す 
+	const bool bLODVariant = FMICRepProvenance::IsLODVariant(MIC);
+	if(bLODVariant)
+	{
+		FMICRepTextureRules::DisableSwitches(MIC->GetMaterial(), GetDefault<UMICRepSettings>()->LODVariantDisabledSwitches, TextureSet);
+	}
+
+	// 共有されているMICは残し、同じフォルダへ別名で作成 
+	if(FMICRepProvenance::IsShared(MIC))
+	{
+		FAssetToolsModule& AssetToolsModule = FModuleManager::LoadModuleChecked<FAssetToolsModule>("AssetTools");
+		FString NewPackageName;
+		FString NewAssetName;
+		AssetToolsModule.Get().CreateUniqueAssetName(MIC->GetOutermost()->GetName(), TEXT(""), NewPackageName, NewAssetName);
+		UMaterialInterface* NewMIC = CreateMICWithTextures(MIC->GetMaterial(), NewAssetName, FPackageName::GetLongPackagePath(NewPackageName), TextureSet, SourceMaterial, bLODVariant);
+		if(nullptr != NewMIC)
+		{
+			Context.ObjectsToSync.Add(FStringAssetReference(NewMIC));
+			Context.TouchedPackages.Add(NewMIC->GetOutermost());
+			UMaterialInstance* NewInstance = Cast<UMaterialInstance>(NewMIC);
+			if((nullptr != NewInstance) && (nullptr != NewInstance->Parent))
+			{
+				Context.TouchedPackages.Add(NewInstance->Parent->GetOutermost());
+			}
+			MICREP_INC_COUNTER(RefreshedMICs, 1);
+		}
+		return NewMIC;
+	}
+
+	// テクスチャの有無が変わった場合は親も切り替える 
+	UMaterialInterface* ParentMaterial = GetBaseVariant(MIC->GetMaterial(), TextureSet.DisabledSwitches);
+	if(nullptr == ParentMaterial)
+	{
+		return nullptr;
+	}
+	if(MIC->Parent != ParentMaterial)
+	{
+		FMICRepJournal::RecordParent(MIC, MIC->Parent, ParentMaterial);
+	}
+	MIC->SetParentEditorOnly(ParentMaterial);
+	MIC->ClearParameterValuesEditorOnly();
+
+	FMICRepMICKey MICKey;
+	MICKey.Parent = ParentMaterial->GetPathName();
+	FMICRepParameterClusters::GatherParameters(SourceMaterial, ParentMaterial, MICKey);
+	SetMICParameters(MIC, TextureSet, MICKey);
+
+	FMICRepProvenance::RecordInstance(MIC, SourceMaterial, bLODVariant);
+	FMICRepShaderBatch::PostEditChange(MIC);
+	FMICRepMICIndex::Get().Add(FMICRepMICKey::FromInstance(MIC).GetHash(), MIC);
+
+	MIC->MarkPackageDirty();
+	Context.TouchedPackages.Add(MIC->GetOutermost());
+	MICREP_INC_COUNTER(RefreshedMICs, 1);
+	return nullptr;
+}
+
+//
+// 置換対象のメッシュに、MICRepで作成したMIC以外のマテリアルがあればtrue 
+//
+bool FMICRepModule::HasUnconvertedMaterials(UObject* TargetAsset)
+{
+	TArray<UMaterialInterface*> Materials;
+	UStaticMesh* TargetStaticMesh = Cast<UStaticMesh>(TargetAsset);
+	if(nullptr != TargetStaticMesh)
+	{
+		for(auto ItMat = TargetStaticMesh->StaticMaterials.CreateConstIterator(); ItMat; ++ItMat)
+		{
+			Materials.Add((*ItMat).MaterialInterface);
+		}
+	}
+	USkeletalMesh* TargetSkeletalMesh = Cast<USkeletalMesh>(TargetAsset);
+	if(nullptr != TargetSkeletalMesh)
+	{
+		for(auto ItMat = TargetSkeletalMesh->Materials.CreateConstIterator(); ItMat; ++ItMat)
+		{
+			Materials.Add((*ItMat).MaterialInterface);
+		}
+	}
+
+	for(auto ItMat = Materials.CreateConstIterator(); ItMat; ++ItMat)
+	{
+		FString SourcePath;
+		bool bNeedsRefresh = false;
+		if((nullptr != *ItMat) && !FMICRepProvenance::FindSource(*ItMat, SourcePath, bNeedsRefresh))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//
+// 置換先MICの取得（Unify時は共通テクスチャのMICを再利用） 
+//
+UMaterialInterface* FMICRepModule::GetReplacementMIC(UMaterialInterface* OldMaterial, const FString& TargetPathName, FMICRepReplaceContext& Context)
+{
+	FString TexturesKey;
+	if(Context.bUnify)
+	{
+		// 別名でインポートされた同一内容のテクスチャも同じキーにする 
+		FMICRepTextureSet TextureSet;
+		FMICRepTextureRules::GetTextureSet(OldMaterial, Context.BaseMat, TextureSet);
+		TexturesKey = TextureSet.GetUnifyKey();
+
+		// 共通のテクスチャであれば統一 
+		const FStringAssetReference* CreatedMIC = Context.CreatedMICMap.Find(TexturesKey);
+		if(nullptr != CreatedMIC)
+		{
+			UMaterialInterface* ExistingMIC = Cast<UMaterialInterface>(CreatedMIC->TryLoad());
+			if(nullptr != ExistingMIC)
+			{
+				FMICRepProvenance::RecordUse(ExistingMIC, OldMaterial);
+				FMICRepMaterialRemap::Get().Add(OldMaterial, ExistingMIC);
+				return ExistingMIC;
+			}
+		}
+	}
+
+	UMaterialInterface* NewMIC = CreateMIC(
+		Context.BaseMat,
+		Context.BaseMatSimpleName,
+		OldMaterial,
+		TargetPathName
+		);
+	if(nullptr == NewMIC)
+	{
+		return nullptr;
+	}
+
+	Context.ObjectsToSync.Add(FStringAssetReference(NewMIC));
+	Context.TouchedPackages.Add(NewMIC->GetOutermost());
+	UMaterialInstance* NewInstance = Cast<UMaterialInstance>(NewMIC);
+	if((nullptr != NewInstance) && (nullptr != NewInstance->Parent))
+	{
+		Context.TouchedPackages.Add(NewInstance->Parent->GetOutermost());
+	}
+
+	if(Context.bUnify)
+	{
+		Context.CreatedMICMap.Add(TexturesKey, FStringAssetReference(NewMIC));
+	}
+
+	// レベル上のOverrideMaterialsの置換用 
+	FMICRepMaterialRemap::Get().Add(OldMaterial, NewMIC);
+	return NewMIC;
+}
+
+UMaterialInterface* FMICRepModule::CreateMIC(
+	UMaterialInterface* BaseMaterial,
+	FString BaseMaterialSimpleName,
+	UMaterialInterface* OldMaterial,
+	FString TargetPathName
+	)
+{
+	if((nullptr == BaseMaterial) || (nullptr == OldMaterial))
+	{
+		return nullptr;
+	}
+
+	// 元マテリアル情報（TextureRules でベースのパラメータへ対応付け） 
+	FMICRepTextureSet TextureSet;
+	FMICRepTextureRules::GetTextureSet(OldMaterial, BaseMaterial, TextureSet);
+
+	return CreateMICWithTextures(
+		BaseMaterial,
+		GetMICName(BaseMaterialSimpleName, OldMaterial->GetName()),
+		TargetPathName,
+		TextureSet,
+		OldMaterial
+		);
+}
+
+//
+// 遠景LOD用の簡易MIC（LODVariantDisabledSwitches のテクスチャをサンプリングしない） 
+//
+// 変換済みのMICから元マテリアルを辿って作成し、元のMICと同じフォルダへ <MIC名>_LOD として配置する. 
+// 簡易化するテクスチャが無い場合はnullptrを返し、元のMICをそのまま使わせる. 
+//
+UMaterialInterface* FMICRepModule::GetLODVariantMIC(UMaterialInterface* Material, FMICRepReplaceContext& Context)
+{
+	UMaterialInstanceConstant* MIC = Cast<UMaterialInstanceConstant>(Material);
+	FString SourcePath;
+	bool bNeedsRefresh = false;
+	if((nullptr == MIC) || FMICRepProvenance::IsLODVariant(MIC) || !FMICRepProvenance::FindSource(MIC, SourcePath, bNeedsRefresh))
+	{
+		return nullptr;
+	}
+
+	// 同じ実行内で作成済み 
+	const FStringAssetReference* CreatedVariant = Context.LODVariantMap.Find(MIC->GetPathName());
+	if(nullptr != CreatedVariant)
+	{
+		return Cast<UMaterialInterface>(CreatedVariant->TryLoad());
+	}
+
+	UMaterialInterface* SourceMaterial = LoadObject<UMaterialInterface>(nullptr, *SourcePath, nullptr, LOAD_NoWarn);
+	if(nullptr == SourceMaterial)
+	{
+		return nullptr;
+	}
+	FMICRepTextureSet TextureSet;
+	FMICRepTextureRules::GetTextureSet(SourceMaterial, MIC->GetMaterial(), TextureSet);
+	if(!FMICRepTextureRules::DisableSwitches(MIC->GetMaterial(), GetDefault<UMICRepSettings>()->LODVariantDisabledSwitches, TextureSet))
+	{
+		Context.LODVariantMap.Add(MIC->GetPathName(), FStringAssetReference());
+		return nullptr;
+	}
+
+	// 前回の実行で作成したものがあれば使う（元マテリアルが変わっていれば作り直す） 
+	const FString VariantName = MIC->GetName() + TEXT("_LOD");
+	const FString PackagePath = FPackageName::GetLongPackagePath(MIC->GetOutermost()->GetName());
+	const FString VariantObjectPath = FString::Printf(TEXT("%s/%s.%s"), *PackagePath, *VariantName, *VariantName);
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	UMaterialInterface* Variant = nullptr;
+	if(AssetRegistryModule.Get().GetAssetByObjectPath(FName(*VariantObjectPath)).IsValid())
+	{
+		UMaterialInstanceConstant* ExistingVariant = LoadObject<UMaterialInstanceConstant>(nullptr, *VariantObjectPath, nullptr, LOAD_NoWarn);
+		FString VariantSourcePath;
+		bool bVariantNeedsRefresh = false;
+		if(    (nullptr != ExistingVariant)
+			&& FMICRepProvenance::IsLODVariant(ExistingVariant)
+			&& FMICRepProvenance::FindSource(ExistingVariant, VariantSourcePath, bVariantNeedsRefresh)
+			)
+		{
+			UMaterialInterface* RefreshedVariant = bVariantNeedsRefresh ? RefreshMIC(ExistingVariant, VariantSourcePath, Context) : nullptr;
+			Variant = (nullptr != RefreshedVariant) ? RefreshedVariant : ExistingVariant;
+		}
+	}
+	else
+	{
+		Variant = CreateMICWithTextures(MIC->GetMaterial(), VariantName, PackagePath, TextureSet, SourceMaterial, true);
+	}
+	if(nullptr == Variant)
+	{
+		return nullptr;
+	}
+
+	Context.ObjectsToSync.Add(FStringAssetReference(Variant));
+	Context.TouchedPackages.Add(Variant->GetOutermost());
+	UMaterialInstance* VariantInstance = Cast<UMaterialInstance>(Variant);
+	if((nullptr != VariantInstance) && (nullptr != VariantInstance->Parent))
+	{
+		Context.TouchedPackages.Add(VariantInstance->Parent->GetOutermost());
+	}
+	Context.LODVariantMap.Add(MIC->GetPathName(), FStringAssetReference(Variant));
+	return Variant;
+}
+
+//
+// 新MIC名 
+//
+FString FMICRepModule::GetMICName(const FString& BaseMaterialSimpleName, const FString& OldMaterialName)
+{
+	return FString::Printf(
+		TEXT("MI_%s_%s"),
+		*BaseMaterialSimpleName,
+		*(OldMaterialName.Replace(TEXT("M_"), TEXT(""), ESearchCase::CaseSensitive))
+		);
+}
+
+//
+// テクスチャを指定してMICを作成（同一内容のMICがあれば再利用） 
+//
+// SourceMaterialを指定した場合、親が公開しているスカラー/ベクターパラメータの値を引き継ぐ. 
+//
+UMaterialInterface* FMICRepModule::CreateMICWithTextures(
+	UMaterialInterface* BaseMaterial,
+	const FString& NewMICName,
+	const FString& TargetPathName,
+	const FMICRepTextureSet& InTextureSet,
+	UMaterialInterface* SourceMaterial,
+	bool bLODVariant
+	)
+{
+	if(nullptr == BaseMaterial)
+	{
+		return nullptr;
+	}
+
+	FAssetToolsModule& AssetToolsModule =
+		FModuleManager::LoadModuleChecked<FAssetToolsModule>("AssetTools");
+
+	// 同一内容のテクスチャが複数あれば代表を参照させる 
+	FMICRepTextureSet TextureSet = InTextureSet;
+	if(GetDefault<UMICRepSettings>()->bRedirectDuplicateTextures)
+	{
+		TextureSet.RedirectToCanonical();
+	}
+
+	// テクスチャの有無で親を切り替え、MIC自体にはStaticSwitchを持たせない 
+	UMaterialInterface* ParentMaterial = GetBaseVariant(BaseMaterial, TextureSet.DisabledSwitches);
+	if(nullptr == ParentMaterial)
+	{
+		return nullptr;
+	}
+
+	// 同一内容のMICが既にあれば再利用 
+	FMICRepMICKey MICKey;
+	MICKey.Parent = ParentMaterial->GetPathName();
+	for(auto ItTexture = TextureSet.Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+	{
+		MICKey.AddTexture((*ItTexture).Key, (*ItTexture).Value);
+	}
+	FMICRepParameterClusters::GatherParameters(SourceMaterial, ParentMaterial, MICKey);
+
+	// パラメータの差が許容範囲内であれば代表の値にそろえる 
+	const UMICRepSettings* Settings = GetDefault<UMICRepSettings>();
+	if(Settings->bClusterParameters && ((0 < MICKey.Scalars.Num()) || (0 < MICKey.Vectors.Num())))
+	{
+		FMICRepParameterClusters::Get().Snap(MICKey, Settings->ParameterTolerance);
+	}
+	const FSHAHash MICHash = MICKey.GetHash();
+	UMaterialInstanceConstant* ExistingMIC = FMICRepMICIndex::Get().Find(MICHash);
+	if(nullptr != ExistingMIC)
+	{
+		MICREP_INC_COUNTER(MICIndexHits, 1);
+		FMICRepProvenance::RecordUse(ExistingMIC, SourceMaterial);
+		return ExistingMIC;
+	}
+
+	// 新MIC作成 
+	UMaterialInstanceConstant* NewMIC = nullptr;
+	{
+		UMaterialInstanceConstantFactoryNew* Factory =
+			NewObject<UMaterialInstanceConstantFactoryNew>();
+		Factory->InitialParent = ParentMaterial;
+
+		// 設定を変えて変換し直す場合など、同名で内容の異なるMICが既にあれば別名にする 
+		FString AssetName = NewMICName;
+		const FString PackageName = TargetPathName / NewMICName;
+		if(FPackageName::DoesPackageExist(PackageName) || (nullptr != FindPackage(nullptr, *PackageName)))
+		{
+			FString UniquePackageName;
+			AssetToolsModule.Get().CreateUniqueAssetName(PackageName, TEXT(""), UniquePackageName, AssetName);
+		}
+
+		MICREP_SCOPE_PHASE(CreateAsset);
+		UObject* NewAsset = AssetToolsModule.Get().CreateAsset(
+			AssetName,
+			TargetPathName,
+			UMaterialInstanceConstant::StaticClass(),
+			Factory
+			);
+
+		NewMIC = Cast<UMaterialInstanceConstant>(NewAsset);
+	}
+	if(nullptr == NewMIC)
+	{
+		return nullptr;
+	}
+	MICREP_INC_COUNTER(AssetsCreated, 1);
+	FMICRepJournal::RecordCreated(NewMIC);
+
+	SetMICParameters(NewMIC, TextureSet, MICKey);
+	FMICRepProvenance::RecordInstance(NewMIC, SourceMaterial, bLODVariant);
+
+	FMICRepMICIndex::Get().Add(MICHash, NewMIC);
+
+	return NewMIC;
+}
+
+//
+// MICへテクスチャとスカラー/ベクターパラメータを設定 
+//
+void FMICRepModule::SetMICParameters(UMaterialInstanceConstant* MIC, const FMICRepTextureSet& TextureSet, const FMICRepMICKey& MICKey)
+{
+	for(auto ItTexture = TextureSet.Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+	{
+		if(nullptr != (*ItTexture).Value)
+		{
+			MIC->SetTextureParameterValueEditorOnly(
+				(*ItTexture).Key,
+				(*ItTexture).Value
+				);
+		}
+	}
+	for(auto ItParam = MICKey.Scalars.CreateConstIterator(); ItParam; ++ItParam)
+	{
+		MIC->SetScalarParameterValueEditorOnly((*ItParam).Key, (*ItParam).Value);
+	}
+	for(auto ItParam = MICKey.Vectors.CreateConstIterator(); ItParam; ++ItParam)
+	{
+		MIC->SetVectorParameterValueEditorOnly((*ItParam).Key, (*ItParam).Value);
+	}
+}
+
+//
+// ベースマテリアルの配置先（共有しない場合はScopeKeyが空） 
+//
+// 共有ベースは複製元ごとに名前とScopeKeyを分け、設定の複製元を変えても以前のベースを使い続けないようにする. 
+//
+void FMICRepModule::GetBaseMaterialLocation(
+	const FString& BaseMatSimpleName,
+	const FString& TargetPathName,
+	FString& OutName,
+	FString& OutPackagePath,
+	FString& OutScopeKey
+	)
+{
+	const UMICRepSettings* Settings = GetDefault<UMICRepSettings>();
+	const FString OriginalPath = Settings->BaseMaterial.ToString();
+	const FString OriginalName = FPackageName::GetShortName(FPackageName::ObjectPathToPackageName(OriginalPath));
+	const FString SharedName = FString::Printf(TEXT("M_MICRep_%s"), *OriginalName.Replace(TEXT("M_"), TEXT(""), ESearchCase::CaseSensitive));
+
+	OutScopeKey.Empty();
+	switch(Settings->BaseMaterialScope)
+	{
+	case EMICRepBaseMaterialScope::PerFolder:
+		OutName = SharedName;
+		OutPackagePath = TargetPathName;
+		OutScopeKey = FString::Printf(TEXT("%s|%s"), *TargetPathName, *OriginalPath);
+		break;
+	case EMICRepBaseMaterialScope::PerProject:
+		OutName = SharedName;
+		OutPackagePath = Settings->SharedBaseMaterialDirectory.Path;
+		OutScopeKey = FString::Printf(TEXT("Project|%s"), *OriginalPath);
+		break;
+	default:
+		OutName = FString::Printf(TEXT("M_%s_Base"), *BaseMatSimpleName);
+		OutPackagePath = TargetPathName;
+		break;
+	}
+}
+
+//
+// ベースマテリアルの取得 
+//
+// 共有範囲がPerMeshの場合はメッシュごとに複製し、それ以外は登録簿から共有ベースを解決する. 
+//
+UMaterial* FMICRepModule::ResolveBaseMaterial(UMaterial* BaseMatOriginal, const FString& BaseMatSimpleName, const FString& TargetPathName)
+{
+	FString BaseMatName;
+	FString BaseMatPathName;
+	FString ScopeKey;
+	GetBaseMaterialLocation(BaseMatSimpleName, TargetPathName, BaseMatName, BaseMatPathName, ScopeKey);
+
+	if(!ScopeKey.IsEmpty())
+	{
+		// 登録済みの共有ベース 
+		UMaterial* SharedBaseMat = FMICRepBaseMaterialRegistry::Get().Find(ScopeKey);
+		if(FMICRepBaseMaterialRegistry::IsDuplicatedFrom(SharedBaseMat, BaseMatOriginal))
+		{
+			MICREP_INC_COUNTER(SharedBaseHits, 1);
+			return SharedBaseMat;
+		}
+
+		// 登録簿に無くても、同じ複製元から作られた同名アセットがあれば採用 
+		FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+		const FString BaseMatObjectPath = FString::Printf(TEXT("%s/%s.%s"), *BaseMatPathName, *BaseMatName, *BaseMatName);
+		FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(*BaseMatObjectPath));
+		if(AssetData.IsValid())
+		{
+			SharedBaseMat = Cast<UMaterial>(AssetData.GetAsset());
+			if(!FMICRepBaseMaterialRegistry::IsDuplicatedFrom(SharedBaseMat, BaseMatOriginal))
+			{
+				UE_LOG(LogMICRep, Error, TEXT("%s was not duplicated from %s. Rename or delete it to create a new shared base."),
+					*BaseMatObjectPath, *BaseMatOriginal->GetPathName());
+				return nullptr;
+			}
+			FMICRepBaseMaterialRegistry::Get().Register(ScopeKey, SharedBaseMat);
+			return SharedBaseMat;
+		}
+	}
+
+	FAssetToolsModule& AssetToolsModule =
+		FModuleManager::LoadModuleChecked<FAssetToolsModule>("AssetTools");
+
+	UObject* DuplicatedObject = nullptr;
+	{
+		MICREP_SCOPE_PHASE(DuplicateAsset);
+		DuplicatedObject = AssetToolsModule.Get().DuplicateAsset(
+			BaseMatName,
+			BaseMatPathName,
+			BaseMatOriginal
+			);
+	}
+	UMaterial* BaseMat = Cast<UMaterial>(DuplicatedObject);
+	if(nullptr != BaseMat)
+	{
+		MICREP_INC_COUNTER(AssetsCreated, 1);
+		FMICRepJournal::RecordCreated(BaseMat);
+	}
+	if((nullptr != BaseMat) && !ScopeKey.IsEmpty())
+	{
+		FMICRepBaseMaterialRegistry::RecordOriginal(BaseMat, BaseMatOriginal);
+		FMICRepBaseMaterialRegistry::Get().Register(ScopeKey, BaseMat);
+	}
+	return BaseMat;
+}
+
+//
+// テクスチャ有無ごとのベースマテリアル 
+//
+// すべてのテクスチャがあればベースをそのまま使い、無いものがあれば対応するStaticSwitch（UseNormal等）を 
+// falseにした子MICを組み合わせごとに一度だけ作成する. 
+// 各MICはStaticSwitchを持たないため、ベースごとのシェーダーマップは組み合わせの数に限られる. 
+//
+UMaterialInterface* FMICRepModule::GetBaseVariant(UMaterialInterface* BaseMaterial, const TArray<FName>& DisabledSwitches)
+{
+	if((nullptr == BaseMaterial) || (0 == DisabledSwitches.Num()))
+	{
+		return BaseMaterial;
+	}
+
+	// UseNormal -> MI_<Base>_NoNormal 
+	FString VariantSuffix;
+	for(auto ItSwitch = DisabledSwitches.CreateConstIterator(); ItSwitch; ++ItSwitch)
+	{
+		FString SwitchName = (*ItSwitch).ToString();
+		SwitchName.RemoveFromStart(TEXT("Use"), ESearchCase::CaseSensitive);
+		VariantSuffix += TEXT("_No") + SwitchName;
+	}
+	const FString VariantPathName = FPackageName::GetLongPackagePath(BaseMaterial->GetOutermost()->GetName());
+	const FString VariantName = FString::Printf(
+		TEXT("MI_%s%s"),
+		*(BaseMaterial->GetName().Replace(TEXT("M_"), TEXT(""), ESearchCase::CaseSensitive)),
+		*VariantSuffix
+		);
+
+	// 作成済みであれば再利用 
+	{
+		FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+		const FString VariantObjectPath = FString::Printf(TEXT("%s/%s.%s"), *VariantPathName, *VariantName, *VariantName);
+		FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(*VariantObjectPath));
+		UMaterialInstanceConstant* ExistingVariant = Cast<UMaterialInstanceConstant>(AssetData.GetAsset());
+		if((nullptr != ExistingVariant) && (BaseMaterial == ExistingVariant->Parent))
+		{
+			return ExistingVariant;
+		}
+	}
+
+	FAssetToolsModule& AssetToolsModule =
+		FModuleManager::LoadModuleChecked<FAssetToolsModule>("AssetTools");
+
+	UMaterialInstanceConstant* Variant = nullptr;
+	{
+		UMaterialInstanceConstantFactoryNew* Factory =
+			NewObject<UMaterialInstanceConstantFactoryNew>();
+		Factory->InitialParent = BaseMaterial;
+
+		MICREP_SCOPE_PHASE(CreateAsset);
+		UObject* NewAsset = AssetToolsModule.Get().CreateAsset(
+			VariantName,
+			VariantPathName,
+			UMaterialInstanceConstant::StaticClass(),
+			Factory
+			);
+
+		Variant = Cast<UMaterialInstanceConstant>(NewAsset);
+	}
+	if(nullptr == Variant)
+	{
+		return nullptr;
+	}
+	MICREP_INC_COUNTER(AssetsCreated, 1);
+	FMICRepJournal::RecordCreated(Variant);
+
+	// テクスチャが無いものはStaticSwitchでオフにする 
+	FStaticParameterSet StaticParams;
+	for(auto ItSwitch = DisabledSwitches.CreateConstIterator(); ItSwitch; ++ItSwitch)
+	{
+		FStaticSwitchParameter Param;
+		Param.ParameterName = *ItSwitch;
+		Param.Value = false;
+		Param.bOverride = true;
+		StaticParams.StaticSwitchParameters.Add(Param);
+	}
+	FMICRepShaderBatch::UpdateStaticPermutation(Variant, StaticParams);
+
+	return Variant;
+}
+
+//
+// マテリアルの一括Reparent. 
+//
+void FMICRepModule::ReparentMICs(const FAssetData& NewParentAssetData, TArray<FAssetData> SelectedAssets)
+{
+	// 新たに親にするマテリアルを取得 
+	UMaterialInterface* NewParent = Cast<UMaterialInterface>(NewParentAssetData.GetAsset());
+	if(nullptr == NewParent)
+	{
+		return;
+	}
+	if(!FMICRepSlicedTask::CanStart())
+	{
+		return;
+	}
+	FMICRepParentIndex::Get().AddRecent(NewParentAssetData.ObjectPath.ToString());
+
+	TSharedRef<FMICRepSlicedState> State = MakeShareable(new FMICRepSlicedState());
+	State->ScopedRun.Reset(new FMICRepRunStats::FScopedRun(TEXT("ReparentMICs")));
+	State->ScopedJournal.Reset(new FMICRepJournal::FScopedRun(TEXT("ReparentMICs")));
+
+	FMICRepSlicedWork Work;
+	MakeReparentWork(NewParent, SelectedAssets, SelectedAssets.Num(), State->ObjectsToSync, Work);
+	Work.Finished = [State](bool bCancelled)
+	{
+		SyncBrowserToObjects(State->ObjectsToSync);
+		State->ScopedJournal.Reset();
+		State->ScopedRun.Reset();
+	};
+	Work.Aborted = [State]()
+	{
+		State->ScopedJournal.Reset();
+		State->ScopedRun.Reset();
+	};
+	FMICRepSlicedTask::Start(MoveTemp(Work));
+}
+void FMICRepModule::ExecuteReparentMICs(UMaterialInterface* NewParent, const TArray<FAssetData>& SelectedAssets, TArray<FStringAssetReference>& ObjectsToSync)
+{
+	FMICRepRunStats::FScopedRun ScopedRun(TEXT("ReparentMICs"));
+	FMICRepJournal::FScopedRun ScopedJournal(TEXT("ReparentMICs"));
+	if(nullptr == NewParent)
+	{
+		return;
+	}
+
+	FMICRepSlicedWork Work;
+	MakeReparentWork(NewParent, SelectedAssets, SelectedAssets.Num(), ObjectsToSync, Work);
+	FMICRepSlicedTask::Run(Work);
+}
+
+//
+// マテリアルの子孫MICの一括Reparent. 
+//
+void FMICRepModule::ReparentDescendants(const FAssetData& NewParentAssetData, FAssetData RootAssetData)
+{
+	UMaterialInterface* NewParent = Cast<UMaterialInterface>(NewParentAssetData.GetAsset());
+	if(nullptr == NewParent)
+	{
+		return;
+	}
+	if(!FMICRepSlicedTask::CanStart())
+	{
+		return;
+	}
+	TArray<FAssetData> Instances;
+	int32 NumToReparent = 0;
+	if(!GatherDescendantsToReparent(RootAssetData.ObjectPath, NewParent, Instances, NumToReparent) || (0 == Instances.Num()))
+	{
+		return;
+	}
+	FMICRepParentIndex::Get().AddRecent(NewParentAssetData.ObjectPath.ToString());
+
+	TSharedRef<FMICRepSlicedState> State = MakeShareable(new FMICRepSlicedState());
+	State->ScopedRun.Reset(new FMICRepRunStats::FScopedRun(TEXT("ReparentDescendants")));
+	State->ScopedJournal.Reset(new FMICRepJournal::FScopedRun(TEXT("ReparentDescendants")));
+
+	FMICRepSlicedWork Work;
+	MakeReparentWork(NewParent, Instances, NumToReparent, State->ObjectsToSync, Work);
+	Work.Finished = [State](bool bCancelled)
+	{
+		SyncBrowserToObjects(State->ObjectsToSync);
+		State->ScopedJournal.Reset();
+		State->ScopedRun.Reset();
+	};
+	Work.Aborted = [State]()
+	{
+		State->ScopedJournal.Reset();
+		State->ScopedRun.Reset();
+	};
+	FMICRepSlicedTask::Start(MoveTemp(Work));
+}
+bool FMICRepModule::ExecuteReparentDescendants(FName RootObjectPath, UMaterialInterface* NewParent, TArray<FStringAssetReference>& ObjectsToSync)
+{
+	FMICRepRunStats::FScopedRun ScopedRun(TEXT("ReparentDescendants"));
+	FMICRepJournal::FScopedRun ScopedJournal(TEXT("ReparentDescendants"));
+	if(nullptr == NewParent)
+	{
+		return false;
+	}
+
+	TArray<FAssetData> Instances;
+	int32 NumToReparent = 0;
+	if(!GatherDescendantsToReparent(RootObjectPath, NewParent, Instances, NumToReparent))
+	{
+		return false;
+	}
+	if(0 == Instances.Num())
+	{
+		return true;
+	}
+
+	FMICRepSlicedWork Work;
+	MakeReparentWork(NewParent, Instances, NumToReparent, ObjectsToSync, Work);
+	FMICRepSlicedTask::Run(Work);
+	return true;
+}
+bool FMICRepModule::GatherDescendantsToReparent(FName RootObjectPath, UMaterialInterface* NewParent, TArray<FAssetData>& OutInstances, int32& OutNumToReparent)
+{
+	const FName NewParentPath(*NewParent->GetPathName());
+	if(NewParentPath == RootObjectPath)
+	{
+		UE_LOG(LogMICRep, Warning, TEXT("'%s' is already the parent of its descendants."), *RootObjectPath.ToString());
+		return false;
+	}
+
+	TArray<int32> Depths;
+	FMICRepHierarchy::GatherDescendants(RootObjectPath, OutInstances, Depths);
+
+	// 新しい親が子孫に含まれていると循環する 
+	for(auto ItInstance = OutInstances.CreateConstIterator(); ItInstance; ++ItInstance)
+	{
+		if((*ItInstance).ObjectPath == NewParentPath)
+		{
+			UE_LOG(LogMICRep, Error, TEXT("'%s' derives from '%s' and cannot become the parent of its own ancestors."), *NewParentPath.ToString(), *RootObjectPath.ToString());
+			OutInstances.Reset();
+			return false;
+		}
+	}
+
+	// 付け替えるのは直接の子のみ（幅優先なので先頭に並ぶ）. それより深いMICは親が変わらないので再コンパイルのみ 
+	OutNumToReparent = 0;
+	while((OutNumToReparent < Depths.Num()) && (1 == Depths[OutNumToReparent]))
+	{
+		OutNumToReparent++;
+	}
+	UE_LOG(LogMICRep, Log, TEXT("Descendants of '%s': %d direct, %d total."), *RootObjectPath.ToString(), OutNumToReparent, OutInstances.Num());
+	return true;
+}
+
+void FMICRepModule::MakeReparentWork(
+	UMaterialInterface* NewParent,
+	const TArray<FAssetData>& SelectedAssets,
+	int32 NumToReparent,
+	TArray<FStringAssetReference>& ObjectsToSync,
+	FMICRepSlicedWork& OutWork
+	)
+{
+	struct FChunkState
+	{
+		TArray<FAssetData> Assets;
+		int32 NumToReparent;
+		TWeakObjectPtr<UMaterialInterface> NewParent;
+		FName NewParentPath;
+		TUniquePtr<FMICRepShaderBatch> ShaderBatch;
+	};
+	TSharedRef<FChunkState> Chunk = MakeShareable(new FChunkState());
+	Chunk->Assets = SelectedAssets;
+	Chunk->NumToReparent = NumToReparent;
+	Chunk->NewParent = NewParent;
+	Chunk->NewParentPath = FName(*NewParent->GetPathName());
+
+	OutWork.Description = LOCTEXT("ReparentMICsTask", "Reparenting MaterialInstances");
+	OutWork.NumItems = SelectedAssets.Num();
+	OutWork.WindowSize = FMath::Max(1, SelectedAssets.Num());
+	OutWork.BeginWindow = [Chunk](int32 Begin, int32 End)
+	{
+		// MICと親、テクスチャを先にまとめてロード 
+		TArray<FAssetData> ChunkAssets;
+		ChunkAssets.Append(&Chunk->Assets[Begin], End - Begin);
+		FMICRepPreloader::Preload(ChunkAssets, 1);
+
+		// シェーダーコンパイルはチャンクの最後にまとめて実行 
+		Chunk->ShaderBatch.Reset(new FMICRepShaderBatch());
+	};
+	OutWork.ProcessItem = [Chunk, &ObjectsToSync](int32 ItemIndex)
+	{
+		UMaterialInterface* NewParentMaterial = Chunk->NewParent.Get();
+		if(nullptr == NewParentMaterial)
+		{
+			return;
+		}
+
+		// 既に新しい親の下にあるMICはロードしない 
+		const FAssetData& MICAssetData = Chunk->Assets[ItemIndex];
+		const bool bReparent = (ItemIndex < Chunk->NumToReparent);
+		if(bReparent && (FMICRepHierarchy::GetParentPath(MICAssetData) == Chunk->NewParentPath))
+		{
+			MICREP_INC_COUNTER(SkippedAssets, 1);
+			return;
+		}
+
+		// 編集対象MICを取得 
+		UMaterialInstanceConstant* TargetMIC = nullptr;
+		{
+			MICREP_SCOPE_PHASE(Load);
+			TargetMIC = Cast<UMaterialInstanceConstant>(MICAssetData.GetAsset());
+		}
+		if(nullptr == TargetMIC)
+		{
+			return;
+		}
+
+		if(!bReparent)
+		{
+			// 祖先の親が変わった子孫は親より後に再コンパイル（バッチは登録順に処理） 
+			FMICRepShaderBatch::PostEditChange(TargetMIC);
+			return;
+		}
+		if(TargetMIC->Parent == NewParentMaterial)
+		{
+			MICREP_INC_COUNTER(SkippedAssets, 1);
+			return;
+		}
+
+		// 親マテリアルを変更 
+		FMICRepJournal::RecordParent(TargetMIC, TargetMIC->Parent, NewParentMaterial);
+		TargetMIC->SetParentEditorOnly(NewParentMaterial);
+		TargetMIC->MarkPackageDirty();
+		FMICRepShaderBatch::PostEditChange(TargetMIC);
+
+		ObjectsToSync.Add(FStringAssetReference(TargetMIC));
+	};
+	OutWork.EndWindow = [Chunk](int32 Begin, int32 End)
+	{
+		Chunk->ShaderBatch.Reset();
+	};
+}
+
+//
+// 直前の実行を選択したアセットの範囲で元に戻す 
+//
+void FMICRepModule::RollbackSelected(TArray<FAssetData> SelectedAssets)
+{
+	if(!FMICRepSlicedTask::CanStart())
+	{
+		return;
+	}
+	const FString JournalFile = FMICRepJournal::FindLatest();
+	if(JournalFile.IsEmpty())
+	{
+		UE_LOG(LogMICRep, Warning, TEXT("No MICRep journal to roll back."));
+		return;
+	}
+
+	TArray<FString> PathFilters;
+	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+	{
+		PathFilters.Add((*ItAsset).ObjectPath.ToString());
+	}
+	FMICRepJournal::Rollback(JournalFile, PathFilters, true);
+
+	TArray<FStringAssetReference> ObjectsToSync;
+	for(auto ItAsset = SelectedAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+	{
+		ObjectsToSync.Add(FStringAssetReference((*ItAsset).ObjectPath.ToString()));
+	}
+	SyncBrowserToObjects(ObjectsToSync);
+}
+
+//
+// 永続キャッシュの保存 
+//
+void FMICRepModule::SaveCaches()
+{
+	FMICRepMICIndex::Get().Save();
+	FMICRepMaterialAnalysisCache::Get().Save();
+	FMICRepBaseMaterialRegistry::Get().Save();
+	FMICRepTextureHashCache::Get().Save();
+	FMICRepMaterialRemap::Get().Save();
+	FMICRepProvenance::Get().Save();
+	FMICRepParameterClusters::Get().Save();
+	FMICRepParentIndex::Get().Save();
+}
+
+//
+// 処理結果をコンテンツブラウザで選択 
+//
+void FMICRepModule::SyncBrowserToObjects(const TArray<FStringAssetReference>& ObjectsToSync)
+{
+	if(0 < ObjectsToSync.Num())
+	{
+		MICREP_SCOPE_PHASE(SyncBrowser);
+
+		FAssetRegistryModule&  AssetRegistryModule  = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+		FContentBrowserModule& ContentBrowserModule = 
+			FModuleManager::LoadModuleChecked<FContentBrowserModule>("ContentBrowser");
+
+		// 解放済みのアセットもあるため、ロードせずにアセットデータで選択 
+		TArray<FAssetData> AssetsToSync;
+		for(auto ItObject = ObjectsToSync.CreateConstIterator(); ItObject; ++ItObject)
+		{
+			FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(*(*ItObject).ToString()));
+			if(AssetData.IsValid())
+			{
+				AssetsToSync.AddUnique(AssetData);
+			}
+		}
+		ContentBrowserModule.Get().SyncBrowserToAssets(AssetsToSync, true);
+	}
+}
+
+//
+// パッケージの保存 
+//
+int32 FMICRepModule::SavePackages(const TArray<UPackage*>& Packages)
+{
+	if(0 == Packages.Num())
+	{
+		return 0;
+	}
+
+	MICREP_SCOPE_PHASE(Save);
+
+	// エディタ上ではソースコントロールのチェックアウトも含めて保存 
+	if(!IsRunningCommandlet())
+	{
+		const FEditorFileUtils::EPromptReturnCode Result = FEditorFileUtils::PromptForCheckoutAndSave(Packages, false, false);
+		const int32 SavedCount = (FEditorFileUtils::PR_Success == Result) ? Packages.Num() : 0;
+		if(0 < SavedCount)
+		{
+			FMICRepProvenance::Get().OnPackagesSaved(Packages);
+		}
+		MICREP_INC_COUNTER(PackagesSaved, SavedCount);
+		return SavedCount;
+	}
+
+	int32 SavedCount = 0;
+	TArray<UPackage*> SavedPackages;
+	for(auto ItPackage = Packages.CreateConstIterator(); ItPackage; ++ItPackage)
+	{
+		UPackage* Package = (*ItPackage);
+		const FString Filename = FPackageName::LongPackageNameToFilename(
+			Package->GetName(),
+			Package->ContainsMap() ? FPackageName::GetMapPackageExtension() : FPackageName::GetAssetPackageExtension()
+			);
+		if(SavePackageHelper(Package, Filename))
+		{
+			SavedPackages.Add(Package);
+			SavedCount++;
+		}
+		else
+		{
+			UE_LOG(LogMICRep, Error, TEXT("Failed to save '%s'."), *Filename);
+		}
+	}
+	FMICRepProvenance::Get().OnPackagesSaved(SavedPackages);
+	MICREP_INC_COUNTER(PackagesSaved, SavedCount);
+	return SavedCount;
+}
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,102 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepBaseMaterialRegistry.h"
+#include "MICRepCache.h"
+#include "AssetRegistryModule.h"
+
+
+namespace
+{
+	const TCHAR* BaseMaterialRegistryFileName = TEXT("BaseMaterials.bin");
+	const int32 BaseMaterialRegistryVersion = 2;
+	const TCHAR* BaseOriginalKey = TEXT("MICRep.BaseOriginal");
+}
+
+
+FMICRepBaseMaterialRegistry& FMICRepBaseMaterialRegistry::Get()
+{
+	static FMICRepBaseMaterialRegistry Instance;
+	return Instance;
+}
+
+FMICRepBaseMaterialRegistry::FMICRepBaseMaterialRegistry()
+	: bDirty(false)
+{
+	Load();
+}
+
+UMaterial* FMICRepBaseMaterialRegistry::Find(const FString& ScopeKey)
+{
+	const FString* Path = ScopeToPath.Find(ScopeKey);
+	if(nullptr == Path)
+	{
+		return nullptr;
+	}
+
+	// 削除/リネーム済みのアセットは登録を外す 
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(**Path));
+	UMaterial* BaseMaterial = AssetData.IsValid() ? Cast<UMaterial>(AssetData.GetAsset()) : nullptr;
+	if(nullptr == BaseMaterial)
+	{
+		ScopeToPath.Remove(ScopeKey);
+		bDirty = true;
+	}
+	return BaseMaterial;
+}
+
+void FMICRepBaseMaterialRegistry::Register(const FString& ScopeKey, const UMaterial* BaseMaterial)
+{
+	if(nullptr != BaseMaterial)
+	{
+		ScopeToPath.Add(ScopeKey, BaseMaterial->GetPathName());
+		bDirty = true;
+	}
+}
+
+void FMICRepBaseMaterialRegistry::RecordOriginal(UMaterial* BaseMaterial, const UMaterial* Original)
+{
+	if((nullptr != BaseMaterial) && (nullptr != Original))
+	{
+		BaseMaterial->GetOutermost()->GetMetaData()->SetValue(BaseMaterial, BaseOriginalKey, *Original->GetPathName());
+		BaseMaterial->MarkPackageDirty();
+	}
+}
+
+bool FMICRepBaseMaterialRegistry::IsDuplicatedFrom(const UMaterial* BaseMaterial, const UMaterial* Original)
+{
+	if((nullptr == BaseMaterial) || (nullptr == Original))
+	{
+		return false;
+	}
+	UMetaData* MetaData = BaseMaterial->GetOutermost()->GetMetaData();
+	return MetaData->HasValue(BaseMaterial, BaseOriginalKey)
+		&& (MetaData->GetValue(BaseMaterial, BaseOriginalKey) == Original->GetPathName());
+}
+
+void FMICRepBaseMaterialRegistry::Load()
+{
+	const bool bLoaded = MICRepCache::Load(BaseMaterialRegistryFileName, BaseMaterialRegistryVersion, [this](FArchive& Ar)
+		{
+			Ar << ScopeToPath;
+		});
+	if(!bLoaded)
+	{
+		ScopeToPath.Reset();
+	}
+	bDirty = false;
+}
+
+void FMICRepBaseMaterialRegistry::Save()
+{
+	if(!bDirty)
+	{
+		return;
+	}
+	MICRepCache::Save(BaseMaterialRegistryFileName, BaseMaterialRegistryVersion, [this](FArchive& Ar)
+		{
+			Ar << ScopeToPath;
+		});
+	bDirty = false;
+}
@@ -0,0 +1,35 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UMaterial;
+
+//
+// 共有ベースマテリアルの登録簿 <ScopeKey, ObjectPath> 
+//
+// ScopeKeyには複製元のパスを含め、設定の複製元を変えた場合は別のベースを作成させる. 
+//
+class FMICRepBaseMaterialRegistry
+{
+public:
+	static FMICRepBaseMaterialRegistry& Get();
+
+	// 登録済みのベースマテリアル（削除済みならnullptr） 
+	UMaterial* Find(const FString& ScopeKey);
+	void Register(const FString& ScopeKey, const UMaterial* BaseMaterial);
+
+	// 複製元をベースのメタデータに記録/照合（記録の無い以前のベースはfalse） 
+	static void RecordOriginal(UMaterial* BaseMaterial, const UMaterial* Original);
+	static bool IsDuplicatedFrom(const UMaterial* BaseMaterial, const UMaterial* Original);
+
+	void Save();
+
+private:
+	FMICRepBaseMaterialRegistry();
+	void Load();
+
+	TMap<FString, FString> ScopeToPath;
+	bool bDirty;
+};
@@ -0,0 +1,469 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepBenchmarkCommandlet.h"
+#include "MICRepModule.h"
+#include "MICRepCache.h"
+#include "MICRepJournal.h"
+#include "MICRepProvenance.h"
+#include "MICRepSettings.h"
+#include "MICRepShaderBatch.h"
+#include "MICRepStats.h"
+#include "AssetRegistryModule.h"
+#include "PackageTools.h"
+#include "Materials/MaterialExpressionTextureSampleParameter2D.h"
+
+
+DEFINE_LOG_CATEGORY_STATIC(LogMICRepBenchmark, Log, All);
+
+
+namespace
+{
+	//
+	// 処理中のメモリ使用量のピークを別スレッドで採取 
+	//
+	// FPlatformMemoryStats::PeakUsedPhysical はプロセス開始からのピークのため、処理ごとの値にはならない. 
+	//
+	class FMemoryPeakSampler : public FRunnable
+	{
+	public:
+		FMemoryPeakSampler()
+			: PeakUsedPhysical(FPlatformMemory::GetStats().UsedPhysical)
+			, Thread(nullptr)
+		{
+			Thread = FRunnableThread::Create(this, TEXT("MICRepMemorySampler"), 0, TPri_BelowNormal);
+		}
+
+		virtual ~FMemoryPeakSampler()
+		{
+			Finish();
+		}
+
+		virtual uint32 Run() override
+		{
+			while(!bStopping)
+			{
+				Sample();
+				FPlatformProcess::Sleep(0.01f);
+			}
+			return 0;
+		}
+
+		virtual void Stop() override
+		{
+			bStopping = true;
+		}
+
+		// 採取を終えてピークを返す 
+		uint64 Finish()
+		{
+			if(nullptr != Thread)
+			{
+				Stop();
+				Thread->WaitForCompletion();
+				delete Thread;
+				Thread = nullptr;
+			}
+			Sample();
+			return PeakUsedPhysical;
+		}
+
+	private:
+		void Sample()
+		{
+			PeakUsedPhysical = FMath::Max<uint64>(PeakUsedPhysical, FPlatformMemory::GetStats().UsedPhysical);
+		}
+
+		uint64 PeakUsedPhysical;
+		FRunnableThread* Thread;
+		FThreadSafeBool bStopping;
+	};
+}
+
+
+UMICRepBenchmarkCommandlet::UMICRepBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMICRepBenchmarkCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamsMap;
+	ParseCommandLine(*Params, Tokens, Switches, ParamsMap);
+
+	// 計測条件の組み合わせ 
+	TArray<FCase> Cases;
+	{
+		TArray<FString> MeshCounts;
+		TArray<FString> SlotCounts;
+		TArray<FString> SharingRatios;
+		ParseList(ParamsMap.FindRef(TEXT("meshes")), TEXT("10+1000+10000"), MeshCounts);
+		ParseList(ParamsMap.FindRef(TEXT("slots")), TEXT("1+4"), SlotCounts);
+		ParseList(ParamsMap.FindRef(TEXT("sharing")), TEXT("0+0.9"), SharingRatios);
+
+		for(auto ItMeshes = MeshCounts.CreateConstIterator(); ItMeshes; ++ItMeshes)
+		{
+			for(auto ItSlots = SlotCounts.CreateConstIterator(); ItSlots; ++ItSlots)
+			{
+				for(auto ItSharing = SharingRatios.CreateConstIterator(); ItSharing; ++ItSharing)
+				{
+					FCase Case;
+					Case.NumMeshes = FMath::Max(1, FCString::Atoi(**ItMeshes));
+					Case.NumSlots = FMath::Max(1, FCString::Atoi(**ItSlots));
+					Case.TextureSharing = FMath::Clamp(FCString::Atof(**ItSharing), 0.0f, 1.0f);
+					Cases.Add(Case);
+				}
+			}
+		}
+	}
+
+	FString CsvFile = ParamsMap.FindRef(TEXT("csv"));
+	if(CsvFile.IsEmpty())
+	{
+		CsvFile = GetDefaultCsvFile();
+	}
+	const FString Label = ParamsMap.FindRef(TEXT("label"));
+	const FString Timestamp = FDateTime::UtcNow().ToIso8601();
+
+	// ストリーミング変換は途中で保存するため無効化（生成アセットは保存しない） 
+	GetMutableDefault<UMICRepSettings>()->bStreamingConversion = false;
+	BeginUnsavedRun();
+
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	AssetRegistryModule.Get().SearchAllAssets(true);
+
+	TArray<FString> Rows;
+	for(auto ItCase = Cases.CreateConstIterator(); ItCase; ++ItCase)
+	{
+		FCaseResult Result;
+		if(!RunCase(*ItCase, Timestamp, Label, Rows, Result))
+		{
+			return 1;
+		}
+	}
+
+	if(!WriteRows(CsvFile, Rows))
+	{
+		return 1;
+	}
+	UE_LOG(LogMICRepBenchmark, Display, TEXT("Wrote %d rows to %s"), Rows.Num(), *CsvFile);
+
+	return 0;
+}
+
+void UMICRepBenchmarkCommandlet::BeginUnsavedRun()
+{
+	MICRepCache::SetReadOnly(true);
+	FMICRepJournal::SetSuppressed(true);
+}
+
+FString UMICRepBenchmarkCommandlet::GetDefaultCsvFile()
+{
+	return FPaths::Combine(*FPaths::GameSavedDir(), TEXT("MICRep"), TEXT("Benchmark.csv"));
+}
+
+bool UMICRepBenchmarkCommandlet::RunCase(const FCase& Case, const FString& Timestamp, const FString& Label, TArray<FString>& OutRows, FCaseResult& OutResult)
+{
+	UMaterialInterface* ReparentTarget = Cast<UMaterialInterface>(GetDefault<UMICRepSettings>()->BaseMaterial.TryLoad());
+	if(nullptr == ReparentTarget)
+	{
+		UE_LOG(LogMICRepBenchmark, Error, TEXT("Base material '%s' could not be loaded."), *GetDefault<UMICRepSettings>()->BaseMaterial.ToString());
+		return false;
+	}
+
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	const FString RootPath = FString::Printf(TEXT("/Game/MICRepBenchmark/%s"), *Case.GetName());
+	UE_LOG(LogMICRepBenchmark, Display, TEXT("Case %s"), *Case.GetName());
+
+	// 1処理分を計測してCSVの行を追加 
+	auto Measure = [&OutRows, &Case, &Timestamp, &Label](const TCHAR* Pipeline, TFunctionRef<int32()> Run)
+	{
+		const int32 ShaderJobsBefore = FMICRepShaderBatch::GetNumSubmitted();
+		FMemoryPeakSampler MemorySampler;
+		const double Start = FPlatformTime::Seconds();
+		const int32 AssetsCreated = Run();
+		const double Seconds = FPlatformTime::Seconds() - Start;
+		const uint64 PeakUsedPhysical = MemorySampler.Finish();
+		const int32 ShaderJobs = FMICRepShaderBatch::GetNumSubmitted() - ShaderJobsBefore;
+		const FPlatformMemoryStats MemoryStats = FPlatformMemory::GetStats();
+
+		OutRows.Add(FString::Printf(
+			TEXT("%s,%s,%d,%d,%.2f,%s,%.3f,%d,%d,%.1f,%.1f"),
+			*Timestamp,
+			*Label,
+			Case.NumMeshes,
+			Case.NumSlots,
+			Case.TextureSharing,
+			Pipeline,
+			Seconds,
+			AssetsCreated,
+			ShaderJobs,
+			MemoryStats.UsedPhysical / (1024.0 * 1024.0),
+			PeakUsedPhysical / (1024.0 * 1024.0)
+			));
+		UE_LOG(LogMICRepBenchmark, Display, TEXT("  %-10s %8.3f sec, Assets=%d, ShaderJobs=%d, PeakMB=%.1f"),
+			Pipeline, Seconds, AssetsCreated, ShaderJobs, PeakUsedPhysical / (1024.0 * 1024.0));
+	};
+
+	FContent Content;
+	Measure(TEXT("Generate"), [&Case, &RootPath, &Content]()
+		{
+			GenerateContent(Case, RootPath, Content);
+			return Content.ReplaceMeshes.Num() + Content.UnifyMeshes.Num() + Content.NumMaterials;
+		});
+	OutResult.NumMaterials = Content.NumMaterials;
+
+	TArray<FStringAssetReference> ReplacedObjects;
+	Measure(TEXT("Replace"), [&Content, &ReplacedObjects]()
+		{
+			FMICRepModule::ExecuteReplaceMaterials(Content.ReplaceMeshes, ReplacedObjects);
+			return FMICRepRunStats::GetCounter(EMICRepCounter::AssetsCreated);
+		});
+	{
+		TSet<UMaterialInstanceConstant*> MICs;
+		GatherConvertedMICs(Content.ReplaceMeshes, MICs);
+		// 親の既定値ではなくMICに設定したもののみ 
+		TSet<UTexture*> NormalTextures;
+		for(auto ItMIC = MICs.CreateConstIterator(); ItMIC; ++ItMIC)
+		{
+			for(auto ItParam = (*ItMIC)->TextureParameterValues.CreateConstIterator(); ItParam; ++ItParam)
+			{
+				if((FName(TEXT("Normal")) == (*ItParam).ParameterName) && (nullptr != (*ItParam).ParameterValue))
+				{
+					NormalTextures.Add((*ItParam).ParameterValue);
+				}
+			}
+		}
+		OutResult.ReplaceMICs = MICs.Num();
+		OutResult.ReplaceNormalTextures = NormalTextures.Num();
+	}
+
+	Measure(TEXT("Unify"), [&Content, &OutResult]()
+		{
+			TArray<FStringAssetReference> UnifiedObjects;
+			FMICRepModule::ExecuteReplaceMaterialsUnify(Content.UnifyMeshes, UnifiedObjects);
+			OutResult.UnifyMICIndexHits = FMICRepRunStats::GetCounter(EMICRepCounter::MICIndexHits);
+			return FMICRepRunStats::GetCounter(EMICRepCounter::AssetsCreated);
+		});
+	{
+		TSet<UMaterialInstanceConstant*> MICs;
+		GatherConvertedMICs(Content.UnifyMeshes, MICs);
+		OutResult.UnifyMICs = MICs.Num();
+	}
+
+	// Replaceで作成したMICの親を一括変更 
+	TArray<FAssetData> ReplacedMICs;
+	for(auto ItObject = ReplacedObjects.CreateConstIterator(); ItObject; ++ItObject)
+	{
+		FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(*(*ItObject).ToString()));
+		if(AssetData.IsValid() && (UMaterialInstanceConstant::StaticClass()->GetFName() == AssetData.AssetClass))
+		{
+			ReplacedMICs.Add(AssetData);
+		}
+	}
+	Measure(TEXT("Reparent"), [&ReplacedMICs, ReparentTarget]()
+		{
+			TArray<FStringAssetReference> ReparentedObjects;
+			FMICRepModule::ExecuteReparentMICs(ReparentTarget, ReplacedMICs, ReparentedObjects);
+			return FMICRepRunStats::GetCounter(EMICRepCounter::AssetsCreated);
+		});
+
+	// 次の条件に影響しないよう解放 
+	UnloadContent(RootPath);
+	return true;
+}
+
+bool UMICRepBenchmarkCommandlet::WriteRows(const FString& CsvFile, const TArray<FString>& Rows)
+{
+	FString CsvText;
+	if(!FPaths::FileExists(CsvFile))
+	{
+		CsvText += TEXT("Timestamp,Label,Meshes,SlotsPerMesh,TextureSharing,Pipeline,Seconds,AssetsCreated,ShaderJobs,UsedPhysicalMB,PeakUsedPhysicalMB") LINE_TERMINATOR;
+	}
+	for(auto ItRow = Rows.CreateConstIterator(); ItRow; ++ItRow)
+	{
+		CsvText += *ItRow + LINE_TERMINATOR;
+	}
+	if(!FFileHelper::SaveStringToFile(CsvText, *CsvFile, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append))
+	{
+		UE_LOG(LogMICRepBenchmark, Error, TEXT("Failed to write '%s'."), *CsvFile);
+		return false;
+	}
+	return true;
+}
+
+void UMICRepBenchmarkCommandlet::GatherConvertedMICs(const TArray<FAssetData>& Meshes, TSet<UMaterialInstanceConstant*>& OutMICs)
+{
+	for(auto ItMesh = Meshes.CreateConstIterator(); ItMesh; ++ItMesh)
+	{
+		UStaticMesh* Mesh = Cast<UStaticMesh>((*ItMesh).GetAsset());
+		if(nullptr == Mesh)
+		{
+			continue;
+		}
+		for(auto ItMat = Mesh->StaticMaterials.CreateConstIterator(); ItMat; ++ItMat)
+		{
+			FString SourcePath;
+			bool bNeedsRefresh = false;
+			if(FMICRepProvenance::FindSource((*ItMat).MaterialInterface, SourcePath, bNeedsRefresh))
+			{
+				OutMICs.Add(CastChecked<UMaterialInstanceConstant>((*ItMat).MaterialInterface));
+			}
+		}
+	}
+}
+
+FString UMICRepBenchmarkCommandlet::FCase::GetName() const
+{
+	return FString::Printf(TEXT("M%d_S%d_T%d"), NumMeshes, NumSlots, FMath::RoundToInt(TextureSharing * 100.0f));
+}
+
+//
+// 合成コンテンツの生成 
+//
+// スロットのうちTextureSharingの割合は既存のマテリアル（同じテクスチャ）を再利用する. 
+// マテリアルは共通の親を持つMICで、半数はNormalMapなし（親の既定テクスチャを使う）. 
+// BaseColorはマテリアルごとに異なる色、NormalMapはすべて同じ内容とし、テクスチャの重複排除の結果を確認できるようにする. 
+// 置換処理はスロットのみ参照するため、メッシュにジオメトリは持たせない. 
+//
+void UMICRepBenchmarkCommandlet::GenerateContent(const FCase& Case, const FString& RootPath, FContent& OutContent)
+{
+	const FString SourcePath = RootPath + TEXT("/Source");
+	const int32 NumTotalSlots = Case.NumMeshes * Case.NumSlots;
+	OutContent.NumMaterials = FMath::Clamp(FMath::CeilToInt(NumTotalSlots * (1.0f - Case.TextureSharing)), 1, NumTotalSlots);
+
+	// 元マテリアルの親 
+	const FColor FlatNormal(128, 128, 255);
+	UTexture2D* DefaultColor = CreateTexture(SourcePath, TEXT("T_Default_D"), FColor::White, false);
+	UTexture2D* DefaultNormal = CreateTexture(SourcePath, TEXT("T_Default_N"), FlatNormal, true);
+	UMaterial* SourceParent = Cast<UMaterial>(CreateBenchmarkAsset(UMaterial::StaticClass(), SourcePath, TEXT("M_Source")));
+	{
+		UMaterialExpressionTextureSampleParameter2D* ColorSample = NewObject<UMaterialExpressionTextureSampleParameter2D>(SourceParent);
+		ColorSample->ParameterName = FName(TEXT("BaseColor"));
+		ColorSample->Texture = DefaultColor;
+		SourceParent->Expressions.Add(ColorSample);
+		SourceParent->BaseColor.Expression = ColorSample;
+
+		UMaterialExpressionTextureSampleParameter2D* NormalSample = NewObject<UMaterialExpressionTextureSampleParameter2D>(SourceParent);
+		NormalSample->ParameterName = FName(TEXT("Normal"));
+		NormalSample->Texture = DefaultNormal;
+		NormalSample->SamplerType = SAMPLERTYPE_Normal;
+		SourceParent->Expressions.Add(NormalSample);
+		SourceParent->Normal.Expression = NormalSample;
+
+		SourceParent->PostEditChange();
+	}
+
+	// 元マテリアル 
+	TArray<UMaterialInstanceConstant*> Materials;
+	for(int32 MatIdx = 0; MatIdx < OutContent.NumMaterials; ++MatIdx)
+	{
+		UMaterialInstanceConstant* Material = Cast<UMaterialInstanceConstant>(CreateBenchmarkAsset(
+			UMaterialInstanceConstant::StaticClass(), SourcePath, FString::Printf(TEXT("M_Source_%d"), MatIdx)));
+		Material->SetParentEditorOnly(SourceParent);
+		Material->SetTextureParameterValueEditorOnly(
+			FName(TEXT("BaseColor")),
+			CreateTexture(SourcePath, FString::Printf(TEXT("T_Source_%d_D"), MatIdx), FColor(MatIdx & 0xFF, (MatIdx >> 8) & 0xFF, (MatIdx >> 16) & 0xFF), false)
+			);
+		if(0 == (MatIdx % 2))
+		{
+			Material->SetTextureParameterValueEditorOnly(
+				FName(TEXT("Normal")),
+				CreateTexture(SourcePath, FString::Printf(TEXT("T_Source_%d_N"), MatIdx), FlatNormal, true)
+				);
+		}
+		Materials.Add(Material);
+	}
+
+	// メッシュ（Replace用とUnify用） 
+	const FString MeshPaths[] = { RootPath + TEXT("/Replace"), RootPath + TEXT("/Unify") };
+	TArray<FAssetData>* MeshLists[] = { &OutContent.ReplaceMeshes, &OutContent.UnifyMeshes };
+	for(int32 ListIdx = 0; ListIdx < 2; ++ListIdx)
+	{
+		for(int32 MeshIdx = 0; MeshIdx < Case.NumMeshes; ++MeshIdx)
+		{
+			UStaticMesh* Mesh = Cast<UStaticMesh>(CreateBenchmarkAsset(
+				UStaticMesh::StaticClass(), MeshPaths[ListIdx], FString::Printf(TEXT("SM_Bench_%d"), MeshIdx)));
+			for(int32 SlotIdx = 0; SlotIdx < Case.NumSlots; ++SlotIdx)
+			{
+				UMaterialInterface* Material = Materials[(MeshIdx * Case.NumSlots + SlotIdx) % Materials.Num()];
+				Mesh->StaticMaterials.Add(FStaticMaterial(Material, FName(*FString::Printf(TEXT("Slot%d"), SlotIdx))));
+			}
+			MeshLists[ListIdx]->Add(FAssetData(Mesh));
+		}
+	}
+}
+
+UObject* UMICRepBenchmarkCommandlet::CreateBenchmarkAsset(UClass* Class, const FString& PackagePath, const FString& AssetName)
+{
+	UPackage* Package = CreatePackage(nullptr, *FString::Printf(TEXT("%s/%s"), *PackagePath, *AssetName));
+	Package->MarkAsFullyLoaded();
+
+	UObject* Asset = NewObject<UObject>(Package, Class, FName(*AssetName), RF_Public | RF_Standalone);
+	FAssetRegistryModule::AssetCreated(Asset);
+	return Asset;
+}
+
+UTexture2D* UMICRepBenchmarkCommandlet::CreateTexture(const FString& PackagePath, const FString& AssetName, const FColor& Color, bool bNormal)
+{
+	UTexture2D* Texture = Cast<UTexture2D>(CreateBenchmarkAsset(UTexture2D::StaticClass(), PackagePath, AssetName));
+
+	const int32 Size = 4;
+	TArray<FColor> Pixels;
+	Pixels.Init(Color, Size * Size);
+	Texture->Source.Init(Size, Size, 1, 1, TSF_BGRA8, reinterpret_cast<const uint8*>(Pixels.GetData()));
+	if(bNormal)
+	{
+		Texture->CompressionSettings = TC_Normalmap;
+		Texture->SRGB = false;
+	}
+	Texture->PostEditChange();
+	return Texture;
+}
+
+//
+// 条件ごとに生成/作成したアセットを解放 
+//
+void UMICRepBenchmarkCommandlet::UnloadContent(const FString& RootPath)
+{
+	TArray<UPackage*> Packages;
+	for(TObjectIterator<UPackage> ItPackage; ItPackage; ++ItPackage)
+	{
+		if((*ItPackage)->GetName().StartsWith(RootPath + TEXT("/")))
+		{
+			Packages.Add(*ItPackage);
+		}
+	}
+
+	for(auto ItPackage = Packages.CreateConstIterator(); ItPackage; ++ItPackage)
+	{
+		TArray<UObject*> Objects;
+		GetObjectsWithOuter(*ItPackage, Objects, false);
+		for(auto ItObject = Objects.CreateConstIterator(); ItObject; ++ItObject)
+		{
+			if((*ItObject)->IsAsset())
+			{
+				FAssetRegistryModule::AssetDeleted(*ItObject);
+			}
+		}
+		(*ItPackage)->SetDirtyFlag(false);
+	}
+
+	FText ErrorMessage;
+	if(!PackageTools::UnloadPackages(Packages, ErrorMessage))
+	{
+		UE_LOG(LogMICRepBenchmark, Warning, TEXT("%s"), *ErrorMessage.ToString());
+	}
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+}
+
+void UMICRepBenchmarkCommandlet::ParseList(const FString& Value, const TCHAR* Default, TArray<FString>& OutValues)
+{
+	const FString ListString = Value.IsEmpty() ? FString(Default) : Value.Replace(TEXT(","), TEXT("+"));
+	ListString.ParseIntoArray(OutValues, TEXT("+"), true);
+}
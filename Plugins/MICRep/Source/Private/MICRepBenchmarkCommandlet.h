@@ -0,0 +1,87 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "AssetData.h"
+#include "MICRepBenchmarkCommandlet.generated.h"
+
+//
+// 合成コンテンツで各処理の所要時間を計測するコマンドレット 
+//
+// UE4Editor-Cmd <Project> -run=MICRepBenchmark [-meshes=10+1000+10000] [-slots=1+4] [-sharing=0+0.9]
+//     [-csv=<File>] [-label=<Text>]
+//
+// 結果はCSVへ追記する（既定は Saved/MICRep/Benchmark.csv）. 生成したアセットは保存しない. 
+// メモリ使用量のピークは処理ごとに別スレッドで採取する. 
+// 同じ計測は自動テスト（MICRep.Benchmark.*）からも実行し、作成されたMICの数と重複排除の結果を確認する. 
+//
+UCLASS()
+class UMICRepBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMICRepBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+	// 計測条件 
+	struct FCase
+	{
+		int32 NumMeshes;
+		int32 NumSlots;
+		float TextureSharing;
+
+		FString GetName() const;
+	};
+
+	// 変換結果（自動テストでの確認用） 
+	struct FCaseResult
+	{
+		// 元マテリアルの数 
+		int32 NumMaterials;
+		// 各メッシュのスロットに割り当てられたMICRepのMICの種類数 
+		int32 ReplaceMICs;
+		int32 UnifyMICs;
+		// Replaceで作成したMICが参照するNormalテクスチャの種類数 
+		int32 ReplaceNormalTextures;
+		// Unifyで重複排除インデックスから再利用したMICの数 
+		int32 UnifyMICIndexHits;
+
+		FCaseResult()
+			: NumMaterials(0)
+			, ReplaceMICs(0)
+			, UnifyMICs(0)
+			, ReplaceNormalTextures(0)
+			, UnifyMICIndexHits(0)
+		{}
+	};
+
+	// 1条件を生成/計測して解放し、CSVの行を追加（ベースマテリアルを読み込めなければfalse） 
+	static bool RunCase(const FCase& Case, const FString& Timestamp, const FString& Label, TArray<FString>& OutRows, FCaseResult& OutResult);
+	// CSVへ追記（新規作成時のみヘッダー） 
+	static bool WriteRows(const FString& CsvFile, const TArray<FString>& Rows);
+	static FString GetDefaultCsvFile();
+
+	// 生成したアセットをキャッシュやジャーナルに残さない 
+	static void BeginUnsavedRun();
+	static void UnloadContent(const FString& RootPath);
+
+private:
+	// 合成コンテンツ 
+	struct FContent
+	{
+		TArray<FAssetData> ReplaceMeshes;
+		TArray<FAssetData> UnifyMeshes;
+		int32 NumMaterials;
+	};
+
+	static void GenerateContent(const FCase& Case, const FString& RootPath, FContent& OutContent);
+	static UObject* CreateBenchmarkAsset(UClass* Class, const FString& PackagePath, const FString& AssetName);
+	static UTexture2D* CreateTexture(const FString& PackagePath, const FString& AssetName, const FColor& Color, bool bNormal);
+	// メッシュのスロットに割り当てられたMICRepのMIC 
+	static void GatherConvertedMICs(const TArray<FAssetData>& Meshes, TSet<UMaterialInstanceConstant*>& OutMICs);
+
+	static void ParseList(const FString& Value, const TCHAR* Default, TArray<FString>& OutValues);
+};
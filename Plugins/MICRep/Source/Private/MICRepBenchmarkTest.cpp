@@ -0,0 +1,132 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepBenchmarkCommandlet.h"
+#include "MICRepCache.h"
+#include "MICRepJournal.h"
+#include "MICRepSettings.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	//
+	// 結果が設定に左右されないよう変換設定を固定し、終了時に戻す 
+	//
+	class FScopedBenchmarkSettings
+	{
+	public:
+		FScopedBenchmarkSettings()
+		{
+			UMICRepSettings* Settings = GetMutableDefault<UMICRepSettings>();
+			bStreamingConversion = Settings->bStreamingConversion;
+			bDeduplicateTextures = Settings->bDeduplicateTextures;
+			bRedirectDuplicateTextures = Settings->bRedirectDuplicateTextures;
+			bClusterParameters = Settings->bClusterParameters;
+			bMergeSectionsAfterUnify = Settings->bMergeSectionsAfterUnify;
+			bGenerateLODVariants = Settings->bGenerateLODVariants;
+			BaseMaterialScope = Settings->BaseMaterialScope;
+			SharedBaseMaterialDirectory = Settings->SharedBaseMaterialDirectory.Path;
+			bCacheReadOnly = MICRepCache::IsReadOnly();
+			bJournalSuppressed = FMICRepJournal::IsSuppressed();
+
+			// ReplaceとUnifyが同じベースを使い、同じ内容のテクスチャは代表を参照する 
+			Settings->bStreamingConversion = false;
+			Settings->bDeduplicateTextures = true;
+			Settings->bRedirectDuplicateTextures = true;
+			Settings->bClusterParameters = false;
+			Settings->bMergeSectionsAfterUnify = false;
+			Settings->bGenerateLODVariants = false;
+			Settings->BaseMaterialScope = EMICRepBaseMaterialScope::PerProject;
+			Settings->SharedBaseMaterialDirectory.Path = SharedPath;
+			UMICRepBenchmarkCommandlet::BeginUnsavedRun();
+		}
+
+		~FScopedBenchmarkSettings()
+		{
+			UMICRepBenchmarkCommandlet::UnloadContent(SharedPath);
+
+			UMICRepSettings* Settings = GetMutableDefault<UMICRepSettings>();
+			Settings->bStreamingConversion = bStreamingConversion;
+			Settings->bDeduplicateTextures = bDeduplicateTextures;
+			Settings->bRedirectDuplicateTextures = bRedirectDuplicateTextures;
+			Settings->bClusterParameters = bClusterParameters;
+			Settings->bMergeSectionsAfterUnify = bMergeSectionsAfterUnify;
+			Settings->bGenerateLODVariants = bGenerateLODVariants;
+			Settings->BaseMaterialScope = BaseMaterialScope;
+			Settings->SharedBaseMaterialDirectory.Path = SharedBaseMaterialDirectory;
+			MICRepCache::SetReadOnly(bCacheReadOnly);
+			FMICRepJournal::SetSuppressed(bJournalSuppressed);
+		}
+
+	private:
+		static const TCHAR* const SharedPath;
+
+		bool bStreamingConversion;
+		bool bDeduplicateTextures;
+		bool bRedirectDuplicateTextures;
+		bool bClusterParameters;
+		bool bMergeSectionsAfterUnify;
+		bool bGenerateLODVariants;
+		EMICRepBaseMaterialScope BaseMaterialScope;
+		FString SharedBaseMaterialDirectory;
+		bool bCacheReadOnly;
+		bool bJournalSuppressed;
+	};
+	const TCHAR* const FScopedBenchmarkSettings::SharedPath = TEXT("/Game/MICRepBenchmark/Shared");
+
+	//
+	// ベンチマークの1条件を実行し、作成されたMICの数と重複排除の結果を確認する 
+	//
+	bool RunBenchmarkTest(FAutomationTestBase& Test, int32 NumMeshes)
+	{
+		FScopedBenchmarkSettings ScopedSettings;
+
+		UMICRepBenchmarkCommandlet::FCase Case;
+		Case.NumMeshes = NumMeshes;
+		Case.NumSlots = 2;
+		Case.TextureSharing = 0.5f;
+
+		TArray<FString> Rows;
+		UMICRepBenchmarkCommandlet::FCaseResult Result;
+		if(!UMICRepBenchmarkCommandlet::RunCase(Case, FDateTime::UtcNow().ToIso8601(), TEXT("Automation"), Rows, Result))
+		{
+			Test.AddError(TEXT("Failed to run the benchmark case."));
+			return false;
+		}
+
+		// BaseColorは元マテリアルごとに異なるため、MICは元マテリアルと同数 
+		Test.TestEqual(TEXT("Replace MICs"), Result.ReplaceMICs, Result.NumMaterials);
+		// UnifyはReplaceと同じベース/テクスチャのMICを重複排除インデックスからすべて再利用する 
+		Test.TestEqual(TEXT("Unify MICs"), Result.UnifyMICs, Result.NumMaterials);
+		Test.TestEqual(TEXT("Unify MIC index hits"), Result.UnifyMICIndexHits, Result.NumMaterials);
+		// 同じ内容のNormalMapは代表の1つを参照する 
+		Test.TestEqual(TEXT("Normal textures referenced by Replace MICs"), Result.ReplaceNormalTextures, 1);
+
+		// Generate/Replace/Unify/Reparent 
+		Test.TestEqual(TEXT("CSV rows"), Rows.Num(), 4);
+		Test.TestTrue(TEXT("Write CSV"), UMICRepBenchmarkCommandlet::WriteRows(UMICRepBenchmarkCommandlet::GetDefaultCsvFile(), Rows));
+		return true;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMICRepBenchmark10Test, "MICRep.Benchmark.10 Meshes", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+bool FMICRepBenchmark10Test::RunTest(const FString& Parameters)
+{
+	return RunBenchmarkTest(*this, 10);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMICRepBenchmark1kTest, "MICRep.Benchmark.1k Meshes", EAutomationTestFlags::EditorContext | EAutomationTestFlags::PerfFilter)
+bool FMICRepBenchmark1kTest::RunTest(const FString& Parameters)
+{
+	return RunBenchmarkTest(*this, 1000);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMICRepBenchmark10kTest, "MICRep.Benchmark.10k Meshes", EAutomationTestFlags::EditorContext | EAutomationTestFlags::StressFilter)
+bool FMICRepBenchmark10kTest::RunTest(const FString& Parameters)
+{
+	return RunBenchmarkTest(*this, 10000);
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,71 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepCache.h"
+
+
+namespace
+{
+	const uint32 MICRepCacheMagic = 0x4D494352;	// 'MICR'
+
+	bool bReadOnly = false;
+}
+
+FString MICRepCache::GetFilePath(const TCHAR* FileName)
+{
+	return FPaths::Combine(*FPaths::GameSavedDir(), TEXT("MICRep"), FileName);
+}
+
+bool MICRepCache::Load(const TCHAR* FileName, int32 Version, TFunctionRef<void(FArchive&)> Serializer)
+{
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*GetFilePath(FileName)));
+	if(!Reader.IsValid())
+	{
+		return false;
+	}
+
+	// ヘッダが一致しない場合は破棄して作り直す 
+	uint32 Magic = 0;
+	int32 FileVersion = 0;
+	*Reader << Magic;
+	*Reader << FileVersion;
+	if((MICRepCacheMagic != Magic) || (Version != FileVersion))
+	{
+		return false;
+	}
+
+	Serializer(*Reader);
+	return !Reader->IsError() && Reader->Close();
+}
+
+bool MICRepCache::Save(const TCHAR* FileName, int32 Version, TFunctionRef<void(FArchive&)> Serializer)
+{
+	if(bReadOnly)
+	{
+		return false;
+	}
+
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*GetFilePath(FileName)));
+	if(!Writer.IsValid())
+	{
+		return false;
+	}
+
+	uint32 Magic = MICRepCacheMagic;
+	int32 FileVersion = Version;
+	*Writer << Magic;
+	*Writer << FileVersion;
+
+	Serializer(*Writer);
+	return Writer->Close();
+}
+
+void MICRepCache::SetReadOnly(bool bInReadOnly)
+{
+	bReadOnly = bInReadOnly;
+}
+
+bool MICRepCache::IsReadOnly()
+{
+	return bReadOnly;
+}
@@ -0,0 +1,24 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//
+// Saved/MICRep 以下に保存する永続キャッシュの読み書き 
+//
+namespace MICRepCache
+{
+	// キャッシュファイルのフルパス 
+	FString GetFilePath(const TCHAR* FileName);
+
+	// バージョンが一致した場合のみ Serializer で読み込む 
+	bool Load(const TCHAR* FileName, int32 Version, TFunctionRef<void(FArchive&)> Serializer);
+
+	// Serializer で書き出す（読み取り専用時は何もしない） 
+	bool Save(const TCHAR* FileName, int32 Version, TFunctionRef<void(FArchive&)> Serializer);
+
+	// 複数プロセスで同じキャッシュを共有する場合、書き込みは1プロセスのみとする 
+	void SetReadOnly(bool bInReadOnly);
+	bool IsReadOnly();
+}
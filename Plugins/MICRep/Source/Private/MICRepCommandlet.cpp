@@ -0,0 +1,395 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepCommandlet.h"
+#include "MICRepModule.h"
+#include "MICRepMICIndex.h"
+#include "MICRepParentIndex.h"
+#include "MICRepHierarchy.h"
+#include "MICRepImpactReport.h"
+#include "MICRepSettings.h"
+#include "MICRepPlanner.h"
+#include "MICRepStats.h"
+#include "MICRepShardCoordinator.h"
+#include "MICRepLevelRemap.h"
+#include "MICRepJournal.h"
+#include "MICRepCache.h"
+#include "AssetRegistryModule.h"
+#include "FileHelpers.h"
+#include "Json.h"
+
+
+DEFINE_LOG_CATEGORY_STATIC(LogMICRepCommandlet, Log, All);
+
+
+UMICRepCommandlet::UMICRepCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UMICRepCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamsMap;
+	ParseCommandLine(*Params, Tokens, Switches, ParamsMap);
+
+	const FString Mode = ParamsMap.FindRef(TEXT("mode")).ToLower();
+	const bool bNoSave = Switches.Contains(TEXT("nosave"));
+	const FString PlanFile = ParamsMap.FindRef(TEXT("plan"));
+
+	// 共有キャッシュは読み込みのみ（シャードのワーカー） 
+	if(Switches.Contains(TEXT("nocaches")))
+	{
+		MICRepCache::SetReadOnly(true);
+	}
+	if((TEXT("shard") == Mode) && bNoSave)
+	{
+		UE_LOG(LogMICRepCommandlet, Error, TEXT("-nosave cannot be used with mode 'shard'; workers load the saved assets."));
+		return 1;
+	}
+	if(((TEXT("plan") == Mode) || (TEXT("apply") == Mode)) && PlanFile.IsEmpty())
+	{
+		UE_LOG(LogMICRepCommandlet, Error, TEXT("-plan=<File> is required for mode '%s'."), *Mode);
+		return 1;
+	}
+	if((TEXT("descendants") == Mode) && !ParamsMap.Contains(TEXT("root")))
+	{
+		UE_LOG(LogMICRepCommandlet, Error, TEXT("-root=<ObjectPath> is required for mode 'descendants'."));
+		return 1;
+	}
+
+	// 対象パス 
+	TArray<FString> PackagePaths;
+	{
+		FString PathsString = ParamsMap.FindRef(TEXT("paths")).Replace(TEXT(","), TEXT("+"));
+		PathsString.ParseIntoArray(PackagePaths, TEXT("+"), true);
+	}
+	if((0 == PackagePaths.Num()) && (TEXT("apply") != Mode) && (TEXT("descendants") != Mode) && (TEXT("rollback") != Mode))
+	{
+		UE_LOG(LogMICRepCommandlet, Error, TEXT("No content paths. Usage: -run=MICRep -mode=<replace|unify|reparent|reindex|plan|apply|shard|levels|descendants|rollback> -paths=/Game/A+/Game/B [-root=<ObjectPath>] [-parent=<ObjectPath>] [-plan=<File>] [-journal=<File|latest>] [-unify] [-workers=<N>] [-chunk=<N>] [-summary=<File>] [-report=<File.json|File.csv>] [-nosave]"));
+		return 1;
+	}
+
+	// -chunk=N でストリーミング変換を有効化 
+	if(ParamsMap.Contains(TEXT("chunk")))
+	{
+		UMICRepSettings* Settings = GetMutableDefault<UMICRepSettings>();
+		Settings->bStreamingConversion = true;
+		Settings->StreamingChunkSize = FMath::Max(1, FCString::Atoi(*ParamsMap[TEXT("chunk")]));
+	}
+
+	// 処理の種類ごとの対象クラス 
+	TArray<FName> ClassNames;
+	if((TEXT("replace") == Mode) || (TEXT("unify") == Mode) || (TEXT("plan") == Mode) || (TEXT("shard") == Mode))
+	{
+		ClassNames.Add(UStaticMesh::StaticClass()->GetFName());
+		ClassNames.Add(USkeletalMesh::StaticClass()->GetFName());
+	}
+	else if((TEXT("reparent") == Mode) || (TEXT("reindex") == Mode))
+	{
+		ClassNames.Add(UMaterialInstanceConstant::StaticClass()->GetFName());
+	}
+	else if(TEXT("levels") == Mode)
+	{
+		ClassNames.Add(UWorld::StaticClass()->GetFName());
+	}
+	else if((TEXT("apply") == Mode) || (TEXT("descendants") == Mode) || (TEXT("rollback") == Mode))
+	{
+		// 対象はプランやジャーナルに記載、または -root から辿る 
+	}
+	else
+	{
+		UE_LOG(LogMICRepCommandlet, Error, TEXT("Unknown mode '%s'. (replace / unify / reparent / reindex / plan / apply / shard / levels / descendants / rollback)"), *Mode);
+		return 1;
+	}
+
+	// 各フェーズの所要時間 <Phase, Seconds> 
+	TArray<TPair<FString, double>> PhaseTimes;
+	double PhaseStart = FPlatformTime::Seconds();
+	auto EndPhase = [&PhaseTimes, &PhaseStart](const TCHAR* PhaseName)
+	{
+		const double Now = FPlatformTime::Seconds();
+		PhaseTimes.Add(TPair<FString, double>(PhaseName, Now - PhaseStart));
+		UE_LOG(LogMICRepCommandlet, Display, TEXT("%-12s %8.3f sec"), PhaseName, Now - PhaseStart);
+		PhaseStart = Now;
+	};
+	const double TotalStart = PhaseStart;
+
+	// アセットレジストリの構築と対象の収集 
+	TArray<FAssetData> TargetAssets;
+	if(0 < ClassNames.Num())
+	{
+		GatherAssets(PackagePaths, ClassNames, TargetAssets);
+	}
+	else
+	{
+		FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get().SearchAllAssets(true);
+	}
+	EndPhase(TEXT("Gather"));
+
+	UE_LOG(LogMICRepCommandlet, Display, TEXT("Mode=%s, Targets=%d"), *Mode, TargetAssets.Num());
+
+	// 変換と保存の内訳は終了時に集計表として出力 
+	FMICRepRunStats::FScopedRun ScopedRun(*Mode);
+
+	// 変換前の計測（-report） 
+	const FString ReportFile = ParamsMap.FindRef(TEXT("report"));
+	const bool bMeasureImpact = !ReportFile.IsEmpty() && ((TEXT("replace") == Mode) || (TEXT("unify") == Mode));
+	FMICRepImpactReport ImpactReport;
+	if(bMeasureImpact)
+	{
+		FMICRepImpact::MeasureBefore(*Mode, TargetAssets, ImpactReport);
+	}
+
+	// 変換 
+	bool bSucceeded = true;
+	TArray<FStringAssetReference> ProcessedObjects;
+	if(TEXT("replace") == Mode)
+	{
+		FMICRepModule::ExecuteReplaceMaterials(TargetAssets, ProcessedObjects);
+	}
+	else if(TEXT("unify") == Mode)
+	{
+		bSucceeded = FMICRepModule::ExecuteReplaceMaterialsUnify(TargetAssets, ProcessedObjects);
+	}
+	else if(TEXT("plan") == Mode)
+	{
+		// アセットはロードせず、レジストリの情報のみでプランを作成 
+		FMICRepPlan Plan;
+		FMICRepPlanner::BuildPlan(TargetAssets, Switches.Contains(TEXT("unify")), Plan);
+		UE_LOG(LogMICRepCommandlet, Display, TEXT("Plan: Meshes=%d, BaseMaterials=%d, MICs=%d, StaticPermutations=%d, EstimatedMaterials=%d"),
+			Plan.Meshes.Num(), Plan.BaseMaterials.Num(), Plan.Instances.Num(), Plan.NumStaticPermutations, Plan.NumEstimatedMaterials);
+
+		// テクスチャ配列にまとめた場合に削減できるMIC数 
+		int32 NumPackable = 0;
+		for(auto ItFamily = Plan.TextureFamilies.CreateConstIterator(); ItFamily; ++ItFamily)
+		{
+			NumPackable += (*ItFamily).Instances.Num();
+		}
+		UE_LOG(LogMICRepCommandlet, Display, TEXT("TextureFamilies=%d, PackableMICs=%d (MICs after packing: %d)"),
+			Plan.TextureFamilies.Num(), NumPackable, Plan.Instances.Num() - NumPackable + Plan.TextureFamilies.Num());
+		bSucceeded = FMICRepPlanner::SavePlan(Plan, PlanFile);
+		if(!bSucceeded)
+		{
+			UE_LOG(LogMICRepCommandlet, Error, TEXT("Failed to write plan '%s'."), *PlanFile);
+		}
+
+		// 変換後の見積もり 
+		if(!ReportFile.IsEmpty())
+		{
+			FMICRepImpact::BuildProjection(TargetAssets, Plan, ImpactReport);
+		}
+	}
+	else if(TEXT("apply") == Mode)
+	{
+		FMICRepPlan Plan;
+		if(!FMICRepPlanner::LoadPlan(PlanFile, Plan))
+		{
+			UE_LOG(LogMICRepCommandlet, Error, TEXT("Failed to read plan '%s'."), *PlanFile);
+			return 1;
+		}
+
+		// -stage/-shard/-shards で適用範囲を限定（シャードのワーカー） 
+		FMICRepApplyOptions Options;
+		const FString Stage = ParamsMap.FindRef(TEXT("stage")).ToLower();
+		if(!Stage.IsEmpty())
+		{
+			Options.bBases = (TEXT("bases") == Stage);
+			Options.bInstances = (TEXT("instances") == Stage);
+			Options.bMeshes = (TEXT("meshes") == Stage);
+		}
+		if(ParamsMap.Contains(TEXT("shards")))
+		{
+			Options.NumShards = FMath::Max(1, FCString::Atoi(*ParamsMap[TEXT("shards")]));
+			Options.ShardIndex = FMath::Clamp(FCString::Atoi(*ParamsMap.FindRef(TEXT("shard"))), 0, Options.NumShards - 1);
+		}
+		// -journal で変更履歴の出力先を指定（シャードのワーカーは統合側へ渡す） 
+		if(ParamsMap.Contains(TEXT("journal")))
+		{
+			FMICRepJournal::SetFileName(ParamsMap[TEXT("journal")]);
+		}
+		bSucceeded = FMICRepModule::ExecuteApplyPlan(Plan, Options, ProcessedObjects);
+
+		// 作成したMICを書き戻したプランを出力 
+		const FString ResultFile = ParamsMap.FindRef(TEXT("result"));
+		if(!ResultFile.IsEmpty() && !FMICRepPlanner::SavePlan(Plan, ResultFile))
+		{
+			UE_LOG(LogMICRepCommandlet, Error, TEXT("Failed to write result '%s'."), *ResultFile);
+			bSucceeded = false;
+		}
+	}
+	else if(TEXT("shard") == Mode)
+	{
+		const int32 NumWorkers = ParamsMap.Contains(TEXT("workers"))
+			? FMath::Max(1, FCString::Atoi(*ParamsMap[TEXT("workers")]))
+			: FMath::Max(1, FPlatformMisc::NumberOfCores() / 2);
+		FString WorkDir = ParamsMap.FindRef(TEXT("workdir"));
+		if(WorkDir.IsEmpty())
+		{
+			WorkDir = MICRepCache::GetFilePath(TEXT("Shard"));
+		}
+		bSucceeded = FMICRepShardCoordinator::Run(TargetAssets, Switches.Contains(TEXT("unify")), NumWorkers, WorkDir, ProcessedObjects);
+	}
+	else if(TEXT("levels") == Mode)
+	{
+		// レベルは1つずつ保存/アンロードする 
+		const int32 PatchedLevels = FMICRepLevelRemap::Run(TargetAssets, !bNoSave);
+		UE_LOG(LogMICRepCommandlet, Display, TEXT("Remapped override materials in %d levels."), PatchedLevels);
+	}
+	else if(TEXT("descendants") == Mode)
+	{
+		const FName RootPath(*ParamsMap.FindRef(TEXT("root")));
+		const FString ParentPath = ParamsMap.FindRef(TEXT("parent"));
+		if(ParentPath.IsEmpty())
+		{
+			// -parent が無ければ階層の表示のみ（ロードしない） 
+			TArray<FAssetData> Instances;
+			TArray<int32> Depths;
+			FMICRepHierarchy::GatherDescendants(RootPath, Instances, Depths);
+			for(int32 Idx = 0; Idx < Instances.Num(); ++Idx)
+			{
+				UE_LOG(LogMICRepCommandlet, Display, TEXT("%d %s (parent %s)"), Depths[Idx], *Instances[Idx].ObjectPath.ToString(), *FMICRepHierarchy::GetParentPath(Instances[Idx]).ToString());
+			}
+			UE_LOG(LogMICRepCommandlet, Display, TEXT("%d MICs derive from '%s'."), Instances.Num(), *RootPath.ToString());
+		}
+		else
+		{
+			UMaterialInterface* NewParent = LoadObject<UMaterialInterface>(nullptr, *ParentPath);
+			if(nullptr == NewParent)
+			{
+				UE_LOG(LogMICRepCommandlet, Error, TEXT("Failed to load parent material '%s'."), *ParentPath);
+				return 1;
+			}
+			bSucceeded = FMICRepModule::ExecuteReparentDescendants(RootPath, NewParent, ProcessedObjects);
+		}
+	}
+	else if(TEXT("rollback") == Mode)
+	{
+		// -paths は対象の絞り込みとして扱う 
+		FString JournalFile = ParamsMap.FindRef(TEXT("journal"));
+		if(JournalFile.IsEmpty() || (TEXT("latest") == JournalFile.ToLower()))
+		{
+			JournalFile = FMICRepJournal::FindLatest();
+		}
+		if(JournalFile.IsEmpty())
+		{
+			UE_LOG(LogMICRepCommandlet, Error, TEXT("No journal to roll back."));
+			return 1;
+		}
+		bSucceeded = FMICRepJournal::Rollback(JournalFile, PackagePaths, !bNoSave);
+	}
+	else if(TEXT("reindex") == Mode)
+	{
+		// 既存MICを重複排除インデックスへ登録 
+		const int32 IndexedCount = FMICRepMICIndex::Get().Rebuild(TargetAssets);
+		FMICRepMICIndex::Get().Save();
+		UE_LOG(LogMICRepCommandlet, Display, TEXT("Indexed %d MICs."), IndexedCount);
+
+		// Reparentメニューの親候補も事前に判定しておく 
+		FMICRepParentIndex::Get().Refresh();
+		const int32 ParentCount = FMICRepParentIndex::Get().ProcessPending(0.0, true);
+		FMICRepParentIndex::Get().Save();
+		UE_LOG(LogMICRepCommandlet, Display, TEXT("Indexed %d parent materials."), ParentCount);
+	}
+	else
+	{
+		const FString ParentPath = ParamsMap.FindRef(TEXT("parent"));
+		UMaterialInterface* NewParent = LoadObject<UMaterialInterface>(nullptr, *ParentPath);
+		if(nullptr == NewParent)
+		{
+			UE_LOG(LogMICRepCommandlet, Error, TEXT("Failed to load parent material '%s'."), *ParentPath);
+			return 1;
+		}
+		FMICRepModule::ExecuteReparentMICs(NewParent, TargetAssets, ProcessedObjects);
+	}
+	EndPhase(TEXT("Convert"));
+
+	// 保存 
+	int32 SavedPackages = 0;
+	if(!bNoSave)
+	{
+		SavedPackages = SaveDirtyPackages();
+	}
+	EndPhase(TEXT("Save"));
+
+	// 変換後の計測とレポートの出力 
+	if(bMeasureImpact)
+	{
+		FMICRepImpact::MeasureAfter(TargetAssets, ImpactReport);
+	}
+	if(!ReportFile.IsEmpty() && (bMeasureImpact || (TEXT("plan") == Mode)))
+	{
+		FMICRepImpact::LogSummary(ImpactReport);
+		if(!FMICRepImpact::SaveReport(ImpactReport, ReportFile))
+		{
+			UE_LOG(LogMICRepCommandlet, Error, TEXT("Failed to write impact report '%s'."), *ReportFile);
+			bSucceeded = false;
+		}
+	}
+
+	const double TotalSeconds = FPlatformTime::Seconds() - TotalStart;
+
+	// 集計結果をJSONで出力 
+	FString Summary;
+	{
+		TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer =
+			TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&Summary);
+		Writer->WriteObjectStart();
+		Writer->WriteValue(TEXT("mode"), Mode);
+		Writer->WriteValue(TEXT("succeeded"), bSucceeded);
+		Writer->WriteValue(TEXT("targets"), TargetAssets.Num());
+		Writer->WriteValue(TEXT("outputAssets"), ProcessedObjects.Num());
+		Writer->WriteValue(TEXT("savedPackages"), SavedPackages);
+		Writer->WriteObjectStart(TEXT("seconds"));
+		for(auto ItPhase = PhaseTimes.CreateConstIterator(); ItPhase; ++ItPhase)
+		{
+			Writer->WriteValue((*ItPhase).Key, (*ItPhase).Value);
+		}
+		Writer->WriteValue(TEXT("Total"), TotalSeconds);
+		Writer->WriteObjectEnd();
+		Writer->WriteObjectEnd();
+		Writer->Close();
+	}
+	UE_LOG(LogMICRepCommandlet, Display, TEXT("MICRepSummary: %s"), *Summary);
+
+	const FString SummaryFile = ParamsMap.FindRef(TEXT("summary"));
+	if(!SummaryFile.IsEmpty())
+	{
+		if(!FFileHelper::SaveStringToFile(Summary, *SummaryFile))
+		{
+			UE_LOG(LogMICRepCommandlet, Warning, TEXT("Failed to write summary '%s'."), *SummaryFile);
+		}
+	}
+
+	return bSucceeded ? 0 : 1;
+}
+
+void UMICRepCommandlet::GatherAssets(const TArray<FString>& PackagePaths, const TArray<FName>& ClassNames, TArray<FAssetData>& OutAssets)
+{
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+
+	// コマンドレットでは非同期スキャンが走らないため同期で検索 
+	AssetRegistryModule.Get().SearchAllAssets(true);
+
+	FARFilter Filter;
+	for(auto ItPath = PackagePaths.CreateConstIterator(); ItPath; ++ItPath)
+	{
+		Filter.PackagePaths.Add(FName(**ItPath));
+	}
+	Filter.ClassNames = ClassNames;
+	Filter.bRecursivePaths = true;
+
+	AssetRegistryModule.Get().GetAssets(Filter, OutAssets);
+}
+
+int32 UMICRepCommandlet::SaveDirtyPackages()
+{
+	TArray<UPackage*> DirtyPackages;
+	FEditorFileUtils::GetDirtyContentPackages(DirtyPackages);
+
+	return FMICRepModule::SavePackages(DirtyPackages);
+}
@@ -0,0 +1,37 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "MICRepCommandlet.generated.h"
+
+//
+// MICRepのバッチ実行用コマンドレット 
+//
+// UE4Editor-Cmd <Project> -run=MICRep -mode=<replace|unify|reparent|reindex|plan|apply|shard|levels|descendants|rollback> -paths=/Game/A+/Game/B
+//     [-root=<ObjectPath>] [-parent=/Game/Path/M_Parent.M_Parent] [-plan=<File>] [-journal=<File|latest>] [-unify] [-chunk=<N>] [-summary=<File>] [-nosave]
+//     [-workers=<N>] [-workdir=<Dir>] [-stage=<bases|instances|meshes>] [-shard=<i> -shards=<N>] [-result=<File>] [-nocaches]
+//
+// plan  : アセットをロードせずに置換内容をJSONへ出力（-unify で統一モード） 
+// apply : -plan で指定したプランを適用（-stage/-shard で範囲を限定、-result で作成結果、-journal で変更履歴を出力） 
+// shard : 対象を -workers 個のワーカープロセスに分割して変換し、作成したMICを統合 
+// levels: -paths 以下のレベルのOverrideMaterialsを、これまでの置換結果に合わせて付け替え 
+// descendants: -root の子孫MICを -parent へReparent（-parent が無ければ階層の表示のみ） 
+// rollback: -journal の実行結果を元に戻す（-paths を指定した場合はその範囲のみ） 
+//
+UCLASS()
+class UMICRepCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UMICRepCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// 指定パス以下のアセットをアセットレジストリから取得 
+	static void GatherAssets(const TArray<FString>& PackagePaths, const TArray<FName>& ClassNames, TArray<FAssetData>& OutAssets);
+	// 変更されたパッケージを保存 
+	static int32 SaveDirtyPackages();
+};
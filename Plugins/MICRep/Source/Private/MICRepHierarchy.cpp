@@ -0,0 +1,69 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepHierarchy.h"
+#include "AssetRegistryModule.h"
+
+
+void FMICRepHierarchy::GatherDescendants(FName RootObjectPath, TArray<FAssetData>& OutInstances, TArray<int32>& OutDepths)
+{
+	OutInstances.Reset();
+	OutDepths.Reset();
+
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+	const FName MICClassName = UMaterialInstanceConstant::StaticClass()->GetFName();
+
+	// 循環参照があっても止まるように訪問済みを記録 
+	TSet<FName> Visited;
+	Visited.Add(RootObjectPath);
+
+	TArray<TPair<FName, int32>> Queue;
+	Queue.Add(TPair<FName, int32>(RootObjectPath, 0));
+	for(int32 QueueIdx = 0; QueueIdx < Queue.Num(); ++QueueIdx)
+	{
+		const FName ParentPath = Queue[QueueIdx].Key;
+		const int32 Depth = Queue[QueueIdx].Value;
+
+		// 親を参照しているパッケージのみが子の候補 
+		TArray<FName> Referencers;
+		AssetRegistry.GetReferencers(FName(*FPackageName::ObjectPathToPackageName(ParentPath.ToString())), Referencers);
+
+		TArray<FAssetData> Children;
+		for(auto ItReferencer = Referencers.CreateConstIterator(); ItReferencer; ++ItReferencer)
+		{
+			TArray<FAssetData> PackageAssets;
+			AssetRegistry.GetAssetsByPackageName(*ItReferencer, PackageAssets);
+			for(auto ItAsset = PackageAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+			{
+				if(    ((*ItAsset).AssetClass == MICClassName)
+					&& (GetParentPath(*ItAsset) == ParentPath)
+					&& !Visited.Contains((*ItAsset).ObjectPath)
+					)
+				{
+					Children.Add(*ItAsset);
+				}
+			}
+		}
+
+		// 結果を安定させるためパス順 
+		Children.Sort([](const FAssetData& A, const FAssetData& B) { return A.ObjectPath.ToString() < B.ObjectPath.ToString(); });
+		for(auto ItChild = Children.CreateConstIterator(); ItChild; ++ItChild)
+		{
+			Visited.Add((*ItChild).ObjectPath);
+			OutInstances.Add(*ItChild);
+			OutDepths.Add(Depth + 1);
+			Queue.Add(TPair<FName, int32>((*ItChild).ObjectPath, Depth + 1));
+		}
+	}
+}
+
+FName FMICRepHierarchy::GetParentPath(const FAssetData& InstanceAssetData)
+{
+	// Parent は AssetRegistrySearchable（"Material'/Game/M.M'" 形式） 
+	FString ParentTag;
+	if(!InstanceAssetData.GetTagValue(FName(TEXT("Parent")), ParentTag) || (TEXT("None") == ParentTag))
+	{
+		return NAME_None;
+	}
+	return FName(*FPackageName::ExportTextPathToObjectPath(ParentTag));
+}
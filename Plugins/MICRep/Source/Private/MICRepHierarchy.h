@@ -0,0 +1,22 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+
+//
+// マテリアルインスタンスの親子関係をアセットレジストリから辿る（アセットはロードしない） 
+//
+// 子の候補はルートパッケージの参照元から絞り込み、"Parent" タグで直接の親を確認する. 
+//
+class FMICRepHierarchy
+{
+public:
+	// Root の子孫のMICを幅優先（親が必ず子より先、直接の子が先頭）で取得 
+	// OutDepths には各MICのルートからの深さ（直接の子は1） 
+	static void GatherDescendants(FName RootObjectPath, TArray<FAssetData>& OutInstances, TArray<int32>& OutDepths);
+
+	// レジストリに記録された親のオブジェクトパス（不明な場合は NAME_None） 
+	static FName GetParentPath(const FAssetData& InstanceAssetData);
+};
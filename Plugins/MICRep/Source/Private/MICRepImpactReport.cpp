@@ -0,0 +1,349 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepImpactReport.h"
+#include "MICRepPlanner.h"
+#include "MICRepHierarchy.h"
+#include "MICRepCache.h"
+#include "MICRepSettings.h"
+#include "AssetRegistryModule.h"
+#include "JsonObjectConverter.h"
+
+
+void FMICRepImpact::MeasureBefore(const TCHAR* RunName, const TArray<FAssetData>& MeshAssets, FMICRepImpactReport& OutReport)
+{
+	OutReport = FMICRepImpactReport();
+	OutReport.Version = ReportVersion;
+	OutReport.RunName = RunName;
+
+	TArray<int32> Slots;
+	Measure(TEXT("Before"), MeshAssets, OutReport.Before, OutReport.Materials, Slots);
+	for(int32 MeshIdx = 0; MeshIdx < MeshAssets.Num(); ++MeshIdx)
+	{
+		FMICRepImpactMesh Mesh;
+		Mesh.ObjectPath = MeshAssets[MeshIdx].ObjectPath.ToString();
+		Mesh.SlotsBefore = Slots[MeshIdx];
+		Mesh.SlotsAfter = Slots[MeshIdx];
+		OutReport.Meshes.Add(Mesh);
+	}
+}
+
+void FMICRepImpact::MeasureAfter(const TArray<FAssetData>& MeshAssets, FMICRepImpactReport& InOutReport)
+{
+	TArray<int32> Slots;
+	Measure(TEXT("After"), MeshAssets, InOutReport.After, InOutReport.Materials, Slots);
+	for(int32 MeshIdx = 0; (MeshIdx < MeshAssets.Num()) && (MeshIdx < InOutReport.Meshes.Num()); ++MeshIdx)
+	{
+		InOutReport.Meshes[MeshIdx].SlotsAfter = Slots[MeshIdx];
+	}
+}
+
+void FMICRepImpact::BuildProjection(const TArray<FAssetData>& MeshAssets, const FMICRepPlan& Plan, FMICRepImpactReport& OutReport)
+{
+	MeasureBefore(*FString::Printf(TEXT("Plan(%s)"), *Plan.Mode), MeshAssets, OutReport);
+	OutReport.bProjection = true;
+
+	// ベースマテリアルごとに1つ、テクスチャが欠けた組み合わせごとにもう1つ 
+	FMICRepImpactTotals& After = OutReport.After;
+	After.Materials = Plan.Instances.Num();
+	After.StaticPermutations = Plan.NumStaticPermutations;
+	After.ShaderMaps = Plan.BaseMaterials.Num() + Plan.NumStaticPermutations;
+
+	int32 TotalTextureReferences = 0;
+	for(auto ItInstance = Plan.Instances.CreateConstIterator(); ItInstance; ++ItInstance)
+	{
+		FMICRepImpactMaterial Material;
+		Material.Stage = TEXT("After");
+		Material.ObjectPath = FString::Printf(TEXT("%s/%s.%s"), *(*ItInstance).PackagePath, *(*ItInstance).Name, *(*ItInstance).Name);
+		for(auto ItTexture = (*ItInstance).Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+		{
+			Material.TextureReferences += (*ItTexture).Texture.IsEmpty() ? 0 : 1;
+		}
+		Material.bStaticPermutation = !(*ItInstance).DisabledSwitches.IsEmpty();
+		TotalTextureReferences += Material.TextureReferences;
+		OutReport.Materials.Add(Material);
+	}
+
+	// Unify後にセクションをまとめる場合は、同じMICになるスロットが1つになる 
+	const bool bMergeSections = (TEXT("unify") == Plan.Mode) && GetDefault<UMICRepSettings>()->bMergeSectionsAfterUnify;
+	TMap<FString, int32> MeshIndices;
+	for(int32 MeshIdx = 0; MeshIdx < OutReport.Meshes.Num(); ++MeshIdx)
+	{
+		MeshIndices.Add(OutReport.Meshes[MeshIdx].ObjectPath, MeshIdx);
+	}
+	After.MaterialSlots = 0;
+	for(auto ItMesh = Plan.Meshes.CreateConstIterator(); ItMesh; ++ItMesh)
+	{
+		const int32* MeshIdx = MeshIndices.Find((*ItMesh).ObjectPath);
+		if(nullptr == MeshIdx)
+		{
+			continue;
+		}
+		FMICRepImpactMesh& Mesh = OutReport.Meshes[*MeshIdx];
+		if(bMergeSections && (0 < (*ItMesh).Replacements.Num()))
+		{
+			TSet<int32> Instances;
+			for(auto ItReplacement = (*ItMesh).Replacements.CreateConstIterator(); ItReplacement; ++ItReplacement)
+			{
+				Instances.Add((*ItReplacement).Instance);
+			}
+			Mesh.SlotsAfter = FMath::Min(Mesh.SlotsBefore, Instances.Num());
+		}
+		After.MaterialSlots += Mesh.SlotsAfter;
+	}
+
+	FinishTotals(After, TotalTextureReferences);
+}
+
+//
+// メッシュが参照するマテリアルとシェーダーマップの集計 
+//
+void FMICRepImpact::Measure(const TCHAR* Stage, const TArray<FAssetData>& MeshAssets, FMICRepImpactTotals& OutTotals, TArray<FMICRepImpactMaterial>& OutMaterials, TArray<int32>& OutSlots)
+{
+	OutTotals = FMICRepImpactTotals();
+	OutSlots.Reset(MeshAssets.Num());
+
+	TSet<FString> MaterialPaths;
+	TSet<FString> ShaderMapKeys;
+	TSet<FString> StaticPermutationKeys;
+	int32 TotalTextureReferences = 0;
+
+	for(auto ItMesh = MeshAssets.CreateConstIterator(); ItMesh; ++ItMesh)
+	{
+		TArray<FString> SlotMaterials;
+		int32 NumSlots = 0;
+		GetMeshSlots(*ItMesh, SlotMaterials, NumSlots);
+		OutSlots.Add(NumSlots);
+		OutTotals.MaterialSlots += NumSlots;
+
+		for(auto ItMaterial = SlotMaterials.CreateConstIterator(); ItMaterial; ++ItMaterial)
+		{
+			if(ItMaterial->IsEmpty() || MaterialPaths.Contains(*ItMaterial))
+			{
+				continue;
+			}
+			MaterialPaths.Add(*ItMaterial);
+
+			FMICRepImpactMaterial Material;
+			Material.Stage = Stage;
+			Material.ObjectPath = *ItMaterial;
+			FString ShaderMapKey;
+			DescribeMaterial(*ItMaterial, ShaderMapKey, Material.TextureReferences, Material.bStaticPermutation, Material.bStaticPermutationKnown);
+			ShaderMapKeys.Add(ShaderMapKey);
+			if(Material.bStaticPermutation)
+			{
+				StaticPermutationKeys.Add(ShaderMapKey);
+			}
+			if(!Material.bStaticPermutationKnown)
+			{
+				OutTotals.UnknownStaticPermutations++;
+			}
+			TotalTextureReferences += Material.TextureReferences;
+			OutMaterials.Add(Material);
+		}
+	}
+
+	OutTotals.Materials = MaterialPaths.Num();
+	OutTotals.ShaderMaps = ShaderMapKeys.Num();
+	OutTotals.StaticPermutations = StaticPermutationKeys.Num();
+	FinishTotals(OutTotals, TotalTextureReferences);
+}
+
+void FMICRepImpact::GetMeshSlots(const FAssetData& MeshAsset, TArray<FString>& OutMaterialPaths, int32& OutNumSlots)
+{
+	OutMaterialPaths.Reset();
+	OutNumSlots = 0;
+
+	// ロード済みなら変換途中（未保存）の状態を見る 
+	UObject* LoadedMesh = MeshAsset.IsAssetLoaded() ? MeshAsset.GetAsset() : nullptr;
+	if(UStaticMesh* StaticMesh = Cast<UStaticMesh>(LoadedMesh))
+	{
+		for(auto ItMaterial = StaticMesh->StaticMaterials.CreateConstIterator(); ItMaterial; ++ItMaterial)
+		{
+			OutMaterialPaths.Add((nullptr != (*ItMaterial).MaterialInterface) ? (*ItMaterial).MaterialInterface->GetPathName() : FString());
+		}
+		OutNumSlots = StaticMesh->StaticMaterials.Num();
+		return;
+	}
+	if(USkeletalMesh* SkeletalMesh = Cast<USkeletalMesh>(LoadedMesh))
+	{
+		for(auto ItMaterial = SkeletalMesh->Materials.CreateConstIterator(); ItMaterial; ++ItMaterial)
+		{
+			OutMaterialPaths.Add((nullptr != (*ItMaterial).MaterialInterface) ? (*ItMaterial).MaterialInterface->GetPathName() : FString());
+		}
+		OutNumSlots = SkeletalMesh->Materials.Num();
+		return;
+	}
+
+	// 未ロードはレジストリから（スロット数はタグが無ければ参照マテリアル数） 
+	TArray<FAssetData> Materials;
+	FMICRepPlanner::GetMeshMaterials(MeshAsset, Materials);
+	for(auto ItMaterial = Materials.CreateConstIterator(); ItMaterial; ++ItMaterial)
+	{
+		OutMaterialPaths.Add((*ItMaterial).ObjectPath.ToString());
+	}
+	FString NumMaterialsTag;
+	OutNumSlots = MeshAsset.GetTagValue(FName(TEXT("Materials")), NumMaterialsTag) ? FCString::Atoi(*NumMaterialsTag) : Materials.Num();
+}
+
+void FMICRepImpact::DescribeMaterial(const FString& MaterialPath, FString& OutShaderMapKey, int32& OutTextureReferences, bool& bOutStaticPermutation, bool& bOutStaticPermutationKnown)
+{
+	OutTextureReferences = 0;
+	bOutStaticPermutation = false;
+	bOutStaticPermutationKnown = true;
+
+	UMaterialInterface* LoadedMaterial = FindObject<UMaterialInterface>(nullptr, *MaterialPath);
+	if(nullptr != LoadedMaterial)
+	{
+		UMaterial* RootMaterial = LoadedMaterial->GetMaterial();
+		OutShaderMapKey = (nullptr != RootMaterial) ? RootMaterial->GetPathName() : MaterialPath;
+
+		// 静的パーミュテーションは上書きしたStaticSwitchの組み合わせごとに1つ 
+		UMaterialInstance* Instance = Cast<UMaterialInstance>(LoadedMaterial);
+		if((nullptr != Instance) && Instance->bHasStaticPermutationResource)
+		{
+			bOutStaticPermutation = true;
+			FStaticParameterSet StaticParams;
+			Instance->GetStaticParameterValues(StaticParams);
+			TArray<FString> Switches;
+			for(auto It = StaticParams.StaticSwitchParameters.CreateConstIterator(); It; ++It)
+			{
+				if((*It).bOverride)
+				{
+					Switches.Add(FString::Printf(TEXT("%s=%d"), *(*It).ParameterName.ToString(), (*It).Value ? 1 : 0));
+				}
+			}
+			Switches.Sort();
+			OutShaderMapKey += TEXT("|") + FString::Join(Switches, TEXT(","));
+		}
+
+		TArray<UTexture*> Textures;
+		LoadedMaterial->GetUsedTextures(Textures, EMaterialQualityLevel::Num, true, GMaxRHIFeatureLevel, true);
+		OutTextureReferences = Textures.Num();
+		return;
+	}
+
+	// 未ロードは親チェーンを辿ってルートとテクスチャの依存を集める 
+	// （インスタンスのStaticSwitchの上書きはレジストリに無いため、パーミュテーションは不明とする） 
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+	TSet<FName> Textures;
+	TSet<FName> Visited;
+	FName CurrentPath(*MaterialPath);
+	OutShaderMapKey = MaterialPath;
+	while((NAME_None != CurrentPath) && !Visited.Contains(CurrentPath))
+	{
+		Visited.Add(CurrentPath);
+		const FAssetData AssetData = AssetRegistry.GetAssetByObjectPath(CurrentPath);
+		if(!AssetData.IsValid())
+		{
+			break;
+		}
+		OutShaderMapKey = CurrentPath.ToString();
+
+		TArray<FName> Dependencies;
+		AssetRegistry.GetDependencies(AssetData.PackageName, Dependencies, EAssetRegistryDependencyType::Hard);
+		for(auto ItDependency = Dependencies.CreateConstIterator(); ItDependency; ++ItDependency)
+		{
+			TArray<FAssetData> Assets;
+			AssetRegistry.GetAssetsByPackageName(*ItDependency, Assets);
+			for(auto ItAsset = Assets.CreateConstIterator(); ItAsset; ++ItAsset)
+			{
+				if(UTexture2D::StaticClass()->GetFName() == (*ItAsset).AssetClass)
+				{
+					Textures.Add((*ItAsset).ObjectPath);
+				}
+			}
+		}
+
+		if(UMaterialInstanceConstant::StaticClass()->GetFName() != AssetData.AssetClass)
+		{
+			break;
+		}
+		bOutStaticPermutationKnown = false;
+		CurrentPath = FMICRepHierarchy::GetParentPath(AssetData);
+	}
+	OutTextureReferences = Textures.Num();
+}
+
+void FMICRepImpact::FinishTotals(FMICRepImpactTotals& Totals, int32 TotalTextureReferences)
+{
+	Totals.EstimatedShaderMapKilobytes = Totals.ShaderMaps * GetDefault<UMICRepSettings>()->EstimatedShaderMapKilobytes;
+	Totals.TexturesPerMaterial = (0 < Totals.Materials) ? ((float)TotalTextureReferences / Totals.Materials) : 0.0f;
+}
+
+void FMICRepImpact::LogSummary(const FMICRepImpactReport& Report)
+{
+	const FMICRepImpactTotals& B = Report.Before;
+	const FMICRepImpactTotals& A = Report.After;
+	UE_LOG(LogMICRep, Display, TEXT("---- MICRep impact: %s%s ----"), *Report.RunName, Report.bProjection ? TEXT(" (projection)") : TEXT(""));
+	UE_LOG(LogMICRep, Display, TEXT("%-24s %10s %10s"), TEXT(""), TEXT("Before"), TEXT("After"));
+	UE_LOG(LogMICRep, Display, TEXT("%-24s %10d %10d"), TEXT("Materials"), B.Materials, A.Materials);
+	UE_LOG(LogMICRep, Display, TEXT("%-24s %10d %10d"), TEXT("ShaderMaps"), B.ShaderMaps, A.ShaderMaps);
+	UE_LOG(LogMICRep, Display, TEXT("%-24s %10d %10d"), TEXT("StaticPermutations"), B.StaticPermutations, A.StaticPermutations);
+	if((0 < B.UnknownStaticPermutations) || (0 < A.UnknownStaticPermutations))
+	{
+		UE_LOG(LogMICRep, Display, TEXT("%-24s %10d %10d  (unloaded instances; not counted above)"), TEXT("UnknownPermutations"), B.UnknownStaticPermutations, A.UnknownStaticPermutations);
+	}
+	UE_LOG(LogMICRep, Display, TEXT("%-24s %10d %10d"), TEXT("ShaderMapMemory(KB)"), B.EstimatedShaderMapKilobytes, A.EstimatedShaderMapKilobytes);
+	UE_LOG(LogMICRep, Display, TEXT("%-24s %10d %10d"), TEXT("MaterialSlots"), B.MaterialSlots, A.MaterialSlots);
+	UE_LOG(LogMICRep, Display, TEXT("%-24s %10.2f %10.2f"), TEXT("TexturesPerMaterial"), B.TexturesPerMaterial, A.TexturesPerMaterial);
+}
+
+bool FMICRepImpact::SaveReport(const FMICRepImpactReport& Report, const FString& FileName)
+{
+	if(FPaths::GetExtension(FileName).Equals(TEXT("csv"), ESearchCase::IgnoreCase))
+	{
+		return SaveCsv(Report, FileName);
+	}
+
+	FString JsonString;
+	if(!FJsonObjectConverter::UStructToJsonObjectString(FMICRepImpactReport::StaticStruct(), &Report, JsonString, 0, 0))
+	{
+		return false;
+	}
+	return FFileHelper::SaveStringToFile(JsonString, *FileName);
+}
+
+void FMICRepImpact::SaveReportToSavedDir(const FMICRepImpactReport& Report)
+{
+	const FString BaseName = FPaths::Combine(*MICRepCache::GetFilePath(TEXT("Reports")),
+		*FString::Printf(TEXT("%s_%s"), *Report.RunName, *FDateTime::Now().ToString()));
+	if(SaveReport(Report, BaseName + TEXT(".json")) && SaveReport(Report, BaseName + TEXT(".csv")))
+	{
+		UE_LOG(LogMICRep, Display, TEXT("Impact report: %s.json/.csv"), *BaseName);
+	}
+}
+
+//
+// 1ファイルで扱えるよう Type 列で行の種類を区別する 
+//
+bool FMICRepImpact::SaveCsv(const FMICRepImpactReport& Report, const FString& FileName)
+{
+	FString Csv = TEXT("Type,Name,Before,After\n");
+	auto AddRow = [&Csv](const TCHAR* Type, const FString& Name, const FString& Before, const FString& After)
+	{
+		Csv += FString::Printf(TEXT("%s,\"%s\",%s,%s\n"), Type, *Name.Replace(TEXT("\""), TEXT("\"\"")), *Before, *After);
+	};
+
+	const FMICRepImpactTotals& B = Report.Before;
+	const FMICRepImpactTotals& A = Report.After;
+	AddRow(TEXT("Summary"), TEXT("Materials"), FString::FromInt(B.Materials), FString::FromInt(A.Materials));
+	AddRow(TEXT("Summary"), TEXT("ShaderMaps"), FString::FromInt(B.ShaderMaps), FString::FromInt(A.ShaderMaps));
+	AddRow(TEXT("Summary"), TEXT("StaticPermutations"), FString::FromInt(B.StaticPermutations), FString::FromInt(A.StaticPermutations));
+	AddRow(TEXT("Summary"), TEXT("UnknownStaticPermutations"), FString::FromInt(B.UnknownStaticPermutations), FString::FromInt(A.UnknownStaticPermutations));
+	AddRow(TEXT("Summary"), TEXT("EstimatedShaderMapKilobytes"), FString::FromInt(B.EstimatedShaderMapKilobytes), FString::FromInt(A.EstimatedShaderMapKilobytes));
+	AddRow(TEXT("Summary"), TEXT("MaterialSlots"), FString::FromInt(B.MaterialSlots), FString::FromInt(A.MaterialSlots));
+	AddRow(TEXT("Summary"), TEXT("TexturesPerMaterial"), FString::SanitizeFloat(B.TexturesPerMaterial), FString::SanitizeFloat(A.TexturesPerMaterial));
+
+	for(auto ItMesh = Report.Meshes.CreateConstIterator(); ItMesh; ++ItMesh)
+	{
+		AddRow(TEXT("MeshSlots"), (*ItMesh).ObjectPath, FString::FromInt((*ItMesh).SlotsBefore), FString::FromInt((*ItMesh).SlotsAfter));
+	}
+	for(auto ItMaterial = Report.Materials.CreateConstIterator(); ItMaterial; ++ItMaterial)
+	{
+		const FString TextureReferences = FString::FromInt((*ItMaterial).TextureReferences);
+		const bool bBefore = (TEXT("Before") == (*ItMaterial).Stage);
+		AddRow(TEXT("MaterialTextures"), (*ItMaterial).ObjectPath, bBefore ? TextureReferences : FString(), bBefore ? FString() : TextureReferences);
+	}
+	return FFileHelper::SaveStringToFile(Csv, *FileName);
+}
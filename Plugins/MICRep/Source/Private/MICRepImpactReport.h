@@ -0,0 +1,141 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+#include "MICRepImpactReport.generated.h"
+
+struct FMICRepPlan;
+
+//
+// 変換によるシェーダー/描画コストの変化（JSON/CSVで出力） 
+//
+USTRUCT()
+struct FMICRepImpactTotals
+{
+	GENERATED_BODY()
+
+	// メッシュが参照するユニークなマテリアル（インスタンスを含む） 
+	UPROPERTY()
+	int32 Materials;
+	// ユニークなシェーダーマップ（ルートのマテリアル + 静的パーミュテーション） 
+	UPROPERTY()
+	int32 ShaderMaps;
+	UPROPERTY()
+	int32 StaticPermutations;
+	// 未ロードのため静的パーミュテーションの有無を判別できなかったインスタンス（StaticPermutations/ShaderMaps に含まない） 
+	UPROPERTY()
+	int32 UnknownStaticPermutations;
+	// ShaderMaps * UMICRepSettings::EstimatedShaderMapKilobytes 
+	UPROPERTY()
+	int32 EstimatedShaderMapKilobytes;
+	UPROPERTY()
+	int32 MaterialSlots;
+	UPROPERTY()
+	float TexturesPerMaterial;
+
+	FMICRepImpactTotals()
+		: Materials(0)
+		, ShaderMaps(0)
+		, StaticPermutations(0)
+		, UnknownStaticPermutations(0)
+		, EstimatedShaderMapKilobytes(0)
+		, MaterialSlots(0)
+		, TexturesPerMaterial(0.0f)
+	{}
+};
+
+USTRUCT()
+struct FMICRepImpactMesh
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FString ObjectPath;
+	UPROPERTY()
+	int32 SlotsBefore;
+	UPROPERTY()
+	int32 SlotsAfter;
+
+	FMICRepImpactMesh() : SlotsBefore(0), SlotsAfter(0) {}
+};
+
+USTRUCT()
+struct FMICRepImpactMaterial
+{
+	GENERATED_BODY()
+
+	// "Before" / "After" 
+	UPROPERTY()
+	FString Stage;
+	UPROPERTY()
+	FString ObjectPath;
+	UPROPERTY()
+	int32 TextureReferences;
+	UPROPERTY()
+	bool bStaticPermutation;
+	// false なら bStaticPermutation は不明（未ロードのインスタンス） 
+	UPROPERTY()
+	bool bStaticPermutationKnown;
+
+	FMICRepImpactMaterial() : TextureReferences(0), bStaticPermutation(false), bStaticPermutationKnown(true) {}
+};
+
+USTRUCT()
+struct FMICRepImpactReport
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	int32 Version;
+	UPROPERTY()
+	FString RunName;
+	// プランからの見積もりか（falseなら変換前後の計測） 
+	UPROPERTY()
+	bool bProjection;
+
+	UPROPERTY()
+	FMICRepImpactTotals Before;
+	UPROPERTY()
+	FMICRepImpactTotals After;
+	UPROPERTY()
+	TArray<FMICRepImpactMesh> Meshes;
+	UPROPERTY()
+	TArray<FMICRepImpactMaterial> Materials;
+
+	FMICRepImpactReport() : Version(0), bProjection(false) {}
+};
+
+//
+// 変換前後の計測とレポートの出力 
+//
+// ロード済みのアセットはオブジェクトから、それ以外はアセットレジストリの情報から計測する（ロードはしない）. 
+// 静的パーミュテーションはロード済みのMICのみ判別でき、未ロードのMICは 0 ではなく不明として別に数える. 
+//
+class FMICRepImpact
+{
+public:
+	static const int32 ReportVersion = 2;
+
+	// 変換前の計測 
+	static void MeasureBefore(const TCHAR* RunName, const TArray<FAssetData>& MeshAssets, FMICRepImpactReport& OutReport);
+	// 変換後の計測 
+	static void MeasureAfter(const TArray<FAssetData>& MeshAssets, FMICRepImpactReport& InOutReport);
+	// 変換前の計測とプランから見積もる 
+	static void BuildProjection(const TArray<FAssetData>& MeshAssets, const FMICRepPlan& Plan, FMICRepImpactReport& OutReport);
+
+	static void LogSummary(const FMICRepImpactReport& Report);
+
+	// 拡張子が .csv ならCSV、それ以外はJSON 
+	static bool SaveReport(const FMICRepImpactReport& Report, const FString& FileName);
+	// Saved/MICRep/Reports/<RunName>_<日時>.json/.csv 
+	static void SaveReportToSavedDir(const FMICRepImpactReport& Report);
+
+private:
+	static void Measure(const TCHAR* Stage, const TArray<FAssetData>& MeshAssets, FMICRepImpactTotals& OutTotals, TArray<FMICRepImpactMaterial>& OutMaterials, TArray<int32>& OutSlots);
+	static void GetMeshSlots(const FAssetData& MeshAsset, TArray<FString>& OutMaterialPaths, int32& OutNumSlots);
+	static void DescribeMaterial(const FString& MaterialPath, FString& OutShaderMapKey, int32& OutTextureReferences, bool& bOutStaticPermutation, bool& bOutStaticPermutationKnown);
+	static void FinishTotals(FMICRepImpactTotals& Totals, int32 TotalTextureReferences);
+	static bool SaveCsv(const FMICRepImpactReport& Report, const FString& FileName);
+};
@@ -0,0 +1,901 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepJournal.h"
+#include "MICRepCache.h"
+#include "MICRepModule.h"
+#include "MICRepShaderBatch.h"
+#include "MICRepMaterialRemap.h"
+#include "ObjectTools.h"
+#include "RawMesh.h"
+#include "SkeletalMeshTypes.h"
+
+
+namespace
+{
+	const uint32 JournalMagic = 0x4D49434A;	// 'MICJ'
+	const int32 JournalVersion = 2;
+
+	// クラッシュ時に失う記録を抑えつつ、書き込みのたびにはフラッシュしない 
+	const int32 FlushInterval = 256;
+
+	const TCHAR* JournalDirectory = TEXT("Journal");
+
+	// SectionSlot の Index は上位に LOD、下位にセクション番号を詰める（SlotMerged は統合前/後のスロット番号） 
+	const int32 SectionIndexBits = 16;
+	const int32 SectionIndexMask = (1 << SectionIndexBits) - 1;
+
+	// SectionInfo の設定 
+	const int32 SectionEnableCollision = 1 << 0;
+	const int32 SectionCastShadow = 1 << 1;
+
+	FString GetPathName(const UObject* Object)
+	{
+		return (nullptr != Object) ? Object->GetPathName() : FString();
+	}
+
+	// 取り除こうとしているスロットをまだ参照しているセクションがあるか 
+	bool IsSlotReferenced(const UStaticMesh* Mesh, int32 SlotIndex)
+	{
+		for(auto ItInfo = Mesh->SectionInfoMap.Map.CreateConstIterator(); ItInfo; ++ItInfo)
+		{
+			if(SlotIndex == ItInfo.Value().MaterialIndex)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool IsSlotReferenced(const USkeletalMesh* Mesh, int32 SlotIndex)
+	{
+		for(auto ItLOD = Mesh->LODInfo.CreateConstIterator(); ItLOD; ++ItLOD)
+		{
+			if((*ItLOD).LODMaterialMap.Contains(SlotIndex))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// 統合前のスロットを統合後のスロットから作る（マテリアルは同じで名前だけが異なる） 
+	template<typename SlotType>
+	bool RestoreSlot(const TArray<SlotType>& Slots, int32 NewSlot, const FString& SlotName, const FString& ImportedSlotName, SlotType& OutSlot)
+	{
+		if(!Slots.IsValidIndex(NewSlot))
+		{
+			return false;
+		}
+		OutSlot = Slots[NewSlot];
+		OutSlot.MaterialSlotName = FName(*SlotName);
+#if WITH_EDITORONLY_DATA
+		OutSlot.ImportedMaterialSlotName = FName(*ImportedSlotName);
+#endif
+		return true;
+	}
+
+	bool PassesFilter(const FString& ObjectPath, const TArray<FString>& PathFilters)
+	{
+		if(0 == PathFilters.Num())
+		{
+			return true;
+		}
+		for(auto ItFilter = PathFilters.CreateConstIterator(); ItFilter; ++ItFilter)
+		{
+			if(ObjectPath.StartsWith(*ItFilter))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+int32 FMICRepJournal::RunDepth = 0;
+FArchive* FMICRepJournal::Writer = nullptr;
+TMap<FString, int32> FMICRepJournal::StringIds;
+int32 FMICRepJournal::NumUnflushed = 0;
+FString FMICRepJournal::NextFileName;
+bool FMICRepJournal::bSuppressed = false;
+
+
+FMICRepJournal::FScopedRun::FScopedRun(const TCHAR* RunName)
+{
+	if((0 == RunDepth++) && !bSuppressed)
+	{
+		FString FileName = NextFileName;
+		NextFileName.Empty();
+		if(FileName.IsEmpty())
+		{
+			FileName = FPaths::Combine(*MICRepCache::GetFilePath(JournalDirectory),
+				*FString::Printf(TEXT("%s_%s_%u.bin"), RunName, *FDateTime::Now().ToString(), FPlatformProcess::GetCurrentProcessId()));
+		}
+		Writer = IFileManager::Get().CreateFileWriter(*FileName);
+		if(nullptr != Writer)
+		{
+			uint32 Magic = JournalMagic;
+			int32 Version = JournalVersion;
+			*Writer << Magic;
+			*Writer << Version;
+		}
+		StringIds.Reset();
+		NumUnflushed = 0;
+	}
+}
+
+FMICRepJournal::FScopedRun::~FScopedRun()
+{
+	if(0 == --RunDepth)
+	{
+		if(nullptr != Writer)
+		{
+			Writer->Close();
+			delete Writer;
+			Writer = nullptr;
+		}
+		StringIds.Reset();
+	}
+}
+
+void FMICRepJournal::RecordSlot(UObject* Mesh, int32 SlotIndex, UMaterialInterface* OldMaterial, UMaterialInterface* NewMaterial)
+{
+	if(nullptr != Writer)
+	{
+		Write(EOp::Slot, GetStringId(GetPathName(Mesh)), SlotIndex, GetStringId(GetPathName(OldMaterial)), GetStringId(GetPathName(NewMaterial)));
+	}
+}
+
+void FMICRepJournal::RecordCreated(UObject* Asset)
+{
+	if(nullptr != Writer)
+	{
+		Write(EOp::Created, GetStringId(GetPathName(Asset)), 0, 0, 0);
+	}
+}
+
+void FMICRepJournal::RecordParent(UMaterialInstance* Instance, UMaterialInterface* OldParent, UMaterialInterface* NewParent)
+{
+	if(nullptr != Writer)
+	{
+		Write(EOp::Parent, GetStringId(GetPathName(Instance)), 0, GetStringId(GetPathName(OldParent)), GetStringId(GetPathName(NewParent)));
+	}
+}
+
+void FMICRepJournal::RecordSlotAdded(UObject* Mesh, int32 SlotIndex, UMaterialInterface* Material)
+{
+	if(nullptr != Writer)
+	{
+		Write(EOp::SlotAdded, GetStringId(GetPathName(Mesh)), SlotIndex, GetStringId(FString()), GetStringId(GetPathName(Material)));
+	}
+}
+
+void FMICRepJournal::RecordSectionSlot(UObject* Mesh, int32 LODIndex, int32 SectionIndex, int32 OldSlot, int32 NewSlot)
+{
+	if(nullptr != Writer)
+	{
+		Write(EOp::SectionSlot, GetStringId(GetPathName(Mesh)), (LODIndex << SectionIndexBits) | SectionIndex, OldSlot, NewSlot);
+	}
+}
+
+void FMICRepJournal::RecordMerged(UStaticMesh* Mesh, const TArray<int32>& OldToNew, const TArray<TArray<int32>>& OldFaceSections)
+{
+	if((nullptr == Writer) || (nullptr == Mesh))
+	{
+		return;
+	}
+	const int32 MeshId = GetStringId(GetPathName(Mesh));
+	const int32 NumNewSlots = (0 < OldToNew.Num()) ? FMath::Max(OldToNew) + 1 : 0;
+	Write(EOp::MergeBegin, MeshId, 0, OldToNew.Num(), NumNewSlots);
+
+	for(int32 SlotIdx = 0; SlotIdx < Mesh->StaticMaterials.Num(); ++SlotIdx)
+	{
+		const FStaticMaterial& Slot = Mesh->StaticMaterials[SlotIdx];
+		FString ImportedSlotName;
+#if WITH_EDITORONLY_DATA
+		ImportedSlotName = Slot.ImportedMaterialSlotName.ToString();
+#endif
+		Write(EOp::SlotMerged, MeshId, (SlotIdx << SectionIndexBits) | OldToNew[SlotIdx], GetStringId(Slot.MaterialSlotName.ToString()), GetStringId(ImportedSlotName));
+	}
+
+	for(auto ItInfo = Mesh->SectionInfoMap.Map.CreateConstIterator(); ItInfo; ++ItInfo)
+	{
+		const FMeshSectionInfo& Info = ItInfo.Value();
+		const int32 Flags = (Info.bEnableCollision ? SectionEnableCollision : 0) | (Info.bCastShadow ? SectionCastShadow : 0);
+		// SectionInfoMap のキーも上位に LOD、下位にセクション番号 
+		Write(EOp::SectionInfo, MeshId, static_cast<int32>(ItInfo.Key()), Info.MaterialIndex, Flags);
+	}
+
+	// 面はセクションごとに並んでいることが多いため、同じ番号が続く数で記録する 
+	for(int32 LODIdx = 0; LODIdx < OldFaceSections.Num(); ++LODIdx)
+	{
+		const TArray<int32>& Faces = OldFaceSections[LODIdx];
+		int32 RunStart = 0;
+		for(int32 FaceIdx = 1; FaceIdx <= Faces.Num(); ++FaceIdx)
+		{
+			if((Faces.Num() == FaceIdx) || (Faces[FaceIdx] != Faces[RunStart]))
+			{
+				Write(EOp::FaceSections, MeshId, LODIdx, Faces[RunStart], FaceIdx - RunStart);
+				RunStart = FaceIdx;
+			}
+		}
+	}
+}
+
+void FMICRepJournal::RecordMerged(USkeletalMesh* Mesh, const TArray<int32>& OldToNew)
+{
+	if((nullptr == Writer) || (nullptr == Mesh))
+	{
+		return;
+	}
+	const int32 MeshId = GetStringId(GetPathName(Mesh));
+	const int32 NumNewSlots = (0 < OldToNew.Num()) ? FMath::Max(OldToNew) + 1 : 0;
+	Write(EOp::MergeBegin, MeshId, 0, OldToNew.Num(), NumNewSlots);
+
+	for(int32 SlotIdx = 0; SlotIdx < Mesh->Materials.Num(); ++SlotIdx)
+	{
+		const FSkeletalMaterial& Slot = Mesh->Materials[SlotIdx];
+		FString ImportedSlotName;
+#if WITH_EDITORONLY_DATA
+		ImportedSlotName = Slot.ImportedMaterialSlotName.ToString();
+#endif
+		Write(EOp::SlotMerged, MeshId, (SlotIdx << SectionIndexBits) | OldToNew[SlotIdx], GetStringId(Slot.MaterialSlotName.ToString()), GetStringId(ImportedSlotName));
+	}
+
+	// 番号が変わるセクションと LODMaterialMap だけを記録する 
+	FSkeletalMeshResource* Resource = Mesh->GetImportedResource();
+	for(int32 LODIdx = 0; LODIdx < Resource->LODModels.Num(); ++LODIdx)
+	{
+		const TArray<FSkelMeshSection>& Sections = Resource->LODModels[LODIdx].Sections;
+		for(int32 SectionIdx = 0; SectionIdx < Sections.Num(); ++SectionIdx)
+		{
+			const int32 OldSlot = Sections[SectionIdx].MaterialIndex;
+			if(OldToNew.IsValidIndex(OldSlot) && (OldToNew[OldSlot] != OldSlot))
+			{
+				Write(EOp::SectionMaterial, MeshId, (LODIdx << SectionIndexBits) | SectionIdx, OldSlot, OldToNew[OldSlot]);
+			}
+		}
+	}
+	for(int32 LODIdx = 0; LODIdx < Mesh->LODInfo.Num(); ++LODIdx)
+	{
+		const TArray<int32>& MaterialMap = Mesh->LODInfo[LODIdx].LODMaterialMap;
+		for(int32 MapIdx = 0; MapIdx < MaterialMap.Num(); ++MapIdx)
+		{
+			const int32 OldSlot = MaterialMap[MapIdx];
+			if(OldToNew.IsValidIndex(OldSlot) && (OldToNew[OldSlot] != OldSlot))
+			{
+				Write(EOp::MaterialMapSlot, MeshId, (LODIdx << SectionIndexBits) | MapIdx, OldSlot, OldToNew[OldSlot]);
+			}
+		}
+	}
+}
+
+void FMICRepJournal::SetFileName(const FString& FileName)
+{
+	NextFileName = FileName;
+}
+
+void FMICRepJournal::SetSuppressed(bool bInSuppressed)
+{
+	bSuppressed = bInSuppressed;
+}
+
+bool FMICRepJournal::Append(const FString& JournalFile)
+{
+	if(nullptr == Writer)
+	{
+		return false;
+	}
+	TArray<FString> Strings;
+	TArray<FRecord> Records;
+	if(!Read(JournalFile, Strings, Records))
+	{
+		UE_LOG(LogMICRep, Warning, TEXT("Failed to read journal '%s'."), *JournalFile);
+		return false;
+	}
+
+	// 文字列はこのジャーナルの番号へ振り直す 
+	for(auto ItRecord = Records.CreateConstIterator(); ItRecord; ++ItRecord)
+	{
+		const FRecord& Record = *ItRecord;
+		if(HasStringValues(Record.Op))
+		{
+			Write(Record.Op, GetStringId(Strings[Record.Object]), Record.Index, GetStringId(Strings[Record.Old]), GetStringId(Strings[Record.New]));
+		}
+		else
+		{
+			Write(Record.Op, GetStringId(Strings[Record.Object]), Record.Index, Record.Old, Record.New);
+		}
+	}
+	return true;
+}
+
+int32 FMICRepJournal::GetStringId(const FString& String)
+{
+	const int32* FoundId = StringIds.Find(String);
+	if(nullptr != FoundId)
+	{
+		return *FoundId;
+	}
+
+	// 初出の文字列はその場で定義する 
+	const int32 NewId = StringIds.Num();
+	StringIds.Add(String, NewId);
+	uint8 Op = static_cast<uint8>(EOp::String);
+	FString Value = String;
+	*Writer << Op;
+	*Writer << Value;
+	return NewId;
+}
+
+void FMICRepJournal::Write(EOp Op, int32 Object, int32 Index, int32 Old, int32 New)
+{
+	uint8 OpValue = static_cast<uint8>(Op);
+	*Writer << OpValue;
+	Writer->SerializeIntPacked(reinterpret_cast<uint32&>(Object));
+	Writer->SerializeIntPacked(reinterpret_cast<uint32&>(Index));
+	Writer->SerializeIntPacked(reinterpret_cast<uint32&>(Old));
+	Writer->SerializeIntPacked(reinterpret_cast<uint32&>(New));
+
+	if(FlushInterval <= ++NumUnflushed)
+	{
+		Writer->Flush();
+		NumUnflushed = 0;
+	}
+}
+
+bool FMICRepJournal::HasStringValues(EOp Op)
+{
+	switch(Op)
+	{
+	case EOp::Slot:
+	case EOp::Created:
+	case EOp::Parent:
+	case EOp::Rebuilt:
+	case EOp::SlotAdded:
+	case EOp::SlotMerged:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool FMICRepJournal::Read(const FString& JournalFile, TArray<FString>& OutStrings, TArray<FRecord>& OutRecords)
+{
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*JournalFile));
+	if(!Reader.IsValid())
+	{
+		return false;
+	}
+	uint32 Magic = 0;
+	int32 Version = 0;
+	*Reader << Magic;
+	*Reader << Version;
+	// 以前のバージョンは記録の種類が少ないだけで読み方は同じ 
+	if((JournalMagic != Magic) || (Version < 1) || (JournalVersion < Version))
+	{
+		return false;
+	}
+
+	// 途中で書き込みが止まっていても読めたところまでを使う 
+	while(!Reader->AtEnd() && !Reader->IsError())
+	{
+		uint8 Op = 0;
+		*Reader << Op;
+		if(static_cast<uint8>(EOp::String) == Op)
+		{
+			FString Value;
+			*Reader << Value;
+			OutStrings.Add(Value);
+			continue;
+		}
+
+		FRecord Record;
+		Record.Op = static_cast<EOp>(Op);
+		Reader->SerializeIntPacked(reinterpret_cast<uint32&>(Record.Object));
+		Reader->SerializeIntPacked(reinterpret_cast<uint32&>(Record.Index));
+		Reader->SerializeIntPacked(reinterpret_cast<uint32&>(Record.Old));
+		Reader->SerializeIntPacked(reinterpret_cast<uint32&>(Record.New));
+		if(Reader->IsError() || !OutStrings.IsValidIndex(Record.Object))
+		{
+			break;
+		}
+		if(HasStringValues(Record.Op) && (!OutStrings.IsValidIndex(Record.Old) || !OutStrings.IsValidIndex(Record.New)))
+		{
+			break;
+		}
+		OutRecords.Add(Record);
+	}
+	return true;
+}
+
+bool FMICRepJournal::RestoreMerged(UStaticMesh* Mesh, const FRecord& Begin, const TArray<FRecord>& Details, const TArray<FString>& Strings)
+{
+	if(Mesh->StaticMaterials.Num() != Begin.New)
+	{
+		return false;
+	}
+
+	TArray<FStaticMaterial> OldMaterials;
+	OldMaterials.SetNum(Begin.Old);
+	int32 NumSlots = 0;
+	FMeshSectionInfoMap OldSectionInfoMap;
+	// <LOD, 面のセクション番号> 
+	TMap<int32, TArray<int32>> OldFaceSections;
+	for(auto ItDetail = Details.CreateConstIterator(); ItDetail; ++ItDetail)
+	{
+		const FRecord& Detail = *ItDetail;
+		switch(Detail.Op)
+		{
+		case EOp::SlotMerged:
+		{
+			const int32 OldSlot = Detail.Index >> SectionIndexBits;
+			if(!OldMaterials.IsValidIndex(OldSlot) || !RestoreSlot(Mesh->StaticMaterials, Detail.Index & SectionIndexMask, Strings[Detail.Old], Strings[Detail.New], OldMaterials[OldSlot]))
+			{
+				return false;
+			}
+			NumSlots++;
+			break;
+		}
+		case EOp::SectionInfo:
+		{
+			FMeshSectionInfo Info(Detail.Old);
+			Info.bEnableCollision = (0 != (Detail.New & SectionEnableCollision));
+			Info.bCastShadow = (0 != (Detail.New & SectionCastShadow));
+			OldSectionInfoMap.Set(Detail.Index >> SectionIndexBits, Detail.Index & SectionIndexMask, Info);
+			break;
+		}
+		case EOp::FaceSections:
+		{
+			TArray<int32>& Faces = OldFaceSections.FindOrAdd(Detail.Index);
+			for(int32 FaceIdx = 0; FaceIdx < Detail.New; ++FaceIdx)
+			{
+				Faces.Add(Detail.Old);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	if(NumSlots != OldMaterials.Num())
+	{
+		return false;
+	}
+
+	// 面の数が変わっていれば統合後に作り直されている 
+	TMap<int32, FRawMesh> RawMeshes;
+	for(auto ItLOD = OldFaceSections.CreateConstIterator(); ItLOD; ++ItLOD)
+	{
+		if(!Mesh->SourceModels.IsValidIndex(ItLOD.Key()) || Mesh->SourceModels[ItLOD.Key()].RawMeshBulkData->IsEmpty())
+		{
+			return false;
+		}
+		FRawMesh& RawMesh = RawMeshes.Add(ItLOD.Key());
+		Mesh->SourceModels[ItLOD.Key()].RawMeshBulkData->LoadRawMesh(RawMesh);
+		if(RawMesh.FaceMaterialIndices.Num() != ItLOD.Value().Num())
+		{
+			return false;
+		}
+	}
+
+	Mesh->Modify();
+	for(auto ItLOD = RawMeshes.CreateIterator(); ItLOD; ++ItLOD)
+	{
+		ItLOD.Value().FaceMaterialIndices = OldFaceSections.FindChecked(ItLOD.Key());
+		Mesh->SourceModels[ItLOD.Key()].RawMeshBulkData->SaveRawMesh(ItLOD.Value());
+	}
+	Mesh->SectionInfoMap = OldSectionInfoMap;
+	Mesh->StaticMaterials = OldMaterials;
+	return true;
+}
+
+bool FMICRepJournal::RestoreMerged(USkeletalMesh* Mesh, const FRecord& Begin, const TArray<FRecord>& Details, const TArray<FString>& Strings)
+{
+	if(Mesh->Materials.Num() != Begin.New)
+	{
+		return false;
+	}
+
+	TArray<FSkeletalMaterial> OldMaterials;
+	OldMaterials.SetNum(Begin.Old);
+	int32 NumSlots = 0;
+	FSkeletalMeshResource* Resource = Mesh->GetImportedResource();
+	// 先にすべて確認してから戻す 
+	for(auto ItDetail = Details.CreateConstIterator(); ItDetail; ++ItDetail)
+	{
+		const FRecord& Detail = *ItDetail;
+		const int32 LODIdx = Detail.Index >> SectionIndexBits;
+		const int32 SubIdx = Detail.Index & SectionIndexMask;
+		switch(Detail.Op)
+		{
+		case EOp::SlotMerged:
+		{
+			const int32 OldSlot = Detail.Index >> SectionIndexBits;
+			if(!OldMaterials.IsValidIndex(OldSlot) || !RestoreSlot(Mesh->Materials, Detail.Index & SectionIndexMask, Strings[Detail.Old], Strings[Detail.New], OldMaterials[OldSlot]))
+			{
+				return false;
+			}
+			NumSlots++;
+			break;
+		}
+		case EOp::SectionMaterial:
+			if(    !Resource->LODModels.IsValidIndex(LODIdx)
+				|| !Resource->LODModels[LODIdx].Sections.IsValidIndex(SubIdx)
+				|| (Detail.New != Resource->LODModels[LODIdx].Sections[SubIdx].MaterialIndex)
+				)
+			{
+				return false;
+			}
+			break;
+		case EOp::MaterialMapSlot:
+			if(    !Mesh->LODInfo.IsValidIndex(LODIdx)
+				|| !Mesh->LODInfo[LODIdx].LODMaterialMap.IsValidIndex(SubIdx)
+				|| (Detail.New != Mesh->LODInfo[LODIdx].LODMaterialMap[SubIdx])
+				)
+			{
+				return false;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	if(NumSlots != OldMaterials.Num())
+	{
+		return false;
+	}
+
+	Mesh->Modify();
+	for(auto ItDetail = Details.CreateConstIterator(); ItDetail; ++ItDetail)
+	{
+		const FRecord& Detail = *ItDetail;
+		const int32 LODIdx = Detail.Index >> SectionIndexBits;
+		const int32 SubIdx = Detail.Index & SectionIndexMask;
+		if(EOp::SectionMaterial == Detail.Op)
+		{
+			Resource->LODModels[LODIdx].Sections[SubIdx].MaterialIndex = (uint16)Detail.Old;
+		}
+		else if(EOp::MaterialMapSlot == Detail.Op)
+		{
+			Mesh->LODInfo[LODIdx].LODMaterialMap[SubIdx] = Detail.Old;
+		}
+	}
+	Mesh->Materials = OldMaterials;
+	return true;
+}
+
+FString FMICRepJournal::FindLatest()
+{
+	const FString Directory = MICRepCache::GetFilePath(JournalDirectory);
+	TArray<FString> FileNames;
+	IFileManager::Get().FindFiles(FileNames, *FPaths::Combine(*Directory, TEXT("*.bin")), true, false);
+
+	FString Latest;
+	FDateTime LatestTime = FDateTime::MinValue();
+	for(auto ItFile = FileNames.CreateConstIterator(); ItFile; ++ItFile)
+	{
+		const FString FilePath = FPaths::Combine(*Directory, **ItFile);
+		const FDateTime TimeStamp = IFileManager::Get().GetTimeStamp(*FilePath);
+		if(LatestTime < TimeStamp)
+		{
+			LatestTime = TimeStamp;
+			Latest = FilePath;
+		}
+	}
+	return Latest;
+}
+
+bool FMICRepJournal::Rollback(const FString& JournalFile, const TArray<FString>& PathFilters, bool bSave)
+{
+	TArray<FString> Strings;
+	TArray<FRecord> Records;
+	if(!Read(JournalFile, Strings, Records))
+	{
+		UE_LOG(LogMICRep, Error, TEXT("Failed to read journal '%s'."), *JournalFile);
+		return false;
+	}
+
+	// バージョン1で記録したスロット番号が変わったメッシュは戻さない 
+	TSet<int32> RebuiltMeshes;
+	for(auto ItRecord = Records.CreateConstIterator(); ItRecord; ++ItRecord)
+	{
+		if(EOp::Rebuilt == (*ItRecord).Op)
+		{
+			RebuiltMeshes.Add((*ItRecord).Object);
+		}
+	}
+	for(auto ItMesh = RebuiltMeshes.CreateConstIterator(); ItMesh; ++ItMesh)
+	{
+		if(PassesFilter(Strings[*ItMesh], PathFilters))
+		{
+			UE_LOG(LogMICRep, Warning, TEXT("'%s' had its sections merged and cannot be rolled back from the journal; restore it from source control."), *Strings[*ItMesh]);
+		}
+	}
+
+	TSet<UPackage*> ChangedPackages;
+	TSet<UStaticMesh*> StaticMeshesToBuild;
+	TSet<USkeletalMesh*> SkeletalMeshesToUpdate;
+	TArray<FAssetData> CreatedAssets;
+	// <メッシュ, まだ戻していない統合の記録（新しい順）> 
+	TMap<int32, TArray<FRecord>> MergeDetails;
+	int32 NumRestored = 0;
+	int32 NumConflicts = 0;
+	{
+		FMICRepShaderBatch ShaderBatch;
+
+		// 新しい順に戻す（現在の値が記録した新しい値と一致する場合のみ） 
+		for(int32 RecordIdx = Records.Num() - 1; 0 <= RecordIdx; --RecordIdx)
+		{
+			const FRecord& Record = Records[RecordIdx];
+			const FString& ObjectPath = Strings[Record.Object];
+			if(!PassesFilter(ObjectPath, PathFilters))
+			{
+				continue;
+			}
+
+			switch(Record.Op)
+			{
+			case EOp::Slot:
+			{
+				if(RebuiltMeshes.Contains(Record.Object))
+				{
+					break;
+				}
+				UObject* Mesh = LoadObject<UObject>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn);
+				UMaterialInterface* OldMaterial = Strings[Record.Old].IsEmpty() ? nullptr : LoadObject<UMaterialInterface>(nullptr, *Strings[Record.Old], nullptr, LOAD_NoWarn);
+				UMaterialInterface** Slot = nullptr;
+				if(UStaticMesh* StaticMesh = Cast<UStaticMesh>(Mesh))
+				{
+					Slot = StaticMesh->StaticMaterials.IsValidIndex(Record.Index) ? &StaticMesh->StaticMaterials[Record.Index].MaterialInterface : nullptr;
+				}
+				else if(USkeletalMesh* SkeletalMesh = Cast<USkeletalMesh>(Mesh))
+				{
+					Slot = SkeletalMesh->Materials.IsValidIndex(Record.Index) ? &SkeletalMesh->Materials[Record.Index].MaterialInterface : nullptr;
+				}
+				else if(UMeshComponent* Component = Cast<UMeshComponent>(Mesh))
+				{
+					Slot = Component->OverrideMaterials.IsValidIndex(Record.Index) ? &Component->OverrideMaterials[Record.Index] : nullptr;
+				}
+				if((nullptr == Slot) || (GetPathName(*Slot) != Strings[Record.New]))
+				{
+					NumConflicts++;
+					break;
+				}
+				Mesh->Modify();
+				*Slot = OldMaterial;
+				if(UMeshComponent* Component = Cast<UMeshComponent>(Mesh))
+				{
+					Component->MarkRenderStateDirty();
+				}
+				Mesh->MarkPackageDirty();
+				ChangedPackages.Add(Mesh->GetOutermost());
+				NumRestored++;
+				break;
+			}
+			case EOp::SectionSlot:
+			{
+				if(RebuiltMeshes.Contains(Record.Object))
+				{
+					break;
+				}
+				UObject* Mesh = LoadObject<UObject>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn);
+				const int32 LODIdx = Record.Index >> SectionIndexBits;
+				const int32 SectionIdx = Record.Index & SectionIndexMask;
+				bool bRestored = false;
+				if(UStaticMesh* StaticMesh = Cast<UStaticMesh>(Mesh))
+				{
+					FMeshSectionInfo Info = StaticMesh->SectionInfoMap.Get(LODIdx, SectionIdx);
+					if(Record.New == Info.MaterialIndex)
+					{
+						StaticMesh->Modify();
+						Info.MaterialIndex = Record.Old;
+						StaticMesh->SectionInfoMap.Set(LODIdx, SectionIdx, Info);
+						StaticMeshesToBuild.Add(StaticMesh);
+						bRestored = true;
+					}
+				}
+				else if(USkeletalMesh* SkeletalMesh = Cast<USkeletalMesh>(Mesh))
+				{
+					TArray<int32>* MaterialMap = SkeletalMesh->LODInfo.IsValidIndex(LODIdx) ? &SkeletalMesh->LODInfo[LODIdx].LODMaterialMap : nullptr;
+					if((nullptr != MaterialMap) && MaterialMap->IsValidIndex(SectionIdx) && (Record.New == (*MaterialMap)[SectionIdx]))
+					{
+						SkeletalMesh->Modify();
+						(*MaterialMap)[SectionIdx] = Record.Old;
+						SkeletalMeshesToUpdate.Add(SkeletalMesh);
+						bRestored = true;
+					}
+				}
+				if(!bRestored)
+				{
+					NumConflicts++;
+					break;
+				}
+				Mesh->MarkPackageDirty();
+				ChangedPackages.Add(Mesh->GetOutermost());
+				NumRestored++;
+				break;
+			}
+			case EOp::SlotAdded:
+			{
+				if(RebuiltMeshes.Contains(Record.Object))
+				{
+					break;
+				}
+				// 末尾のスロットで、どのセクションからも参照されていない場合のみ取り除く 
+				UObject* Mesh = LoadObject<UObject>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn);
+				bool bRemoved = false;
+				if(UStaticMesh* StaticMesh = Cast<UStaticMesh>(Mesh))
+				{
+					if(    (Record.Index == StaticMesh->StaticMaterials.Num() - 1)
+						&& (GetPathName(StaticMesh->StaticMaterials[Record.Index].MaterialInterface) == Strings[Record.New])
+						&& !IsSlotReferenced(StaticMesh, Record.Index)
+						)
+					{
+						StaticMesh->Modify();
+						StaticMesh->StaticMaterials.RemoveAt(Record.Index);
+						StaticMeshesToBuild.Add(StaticMesh);
+						bRemoved = true;
+					}
+				}
+				else if(USkeletalMesh* SkeletalMesh = Cast<USkeletalMesh>(Mesh))
+				{
+					if(    (Record.Index == SkeletalMesh->Materials.Num() - 1)
+						&& (GetPathName(SkeletalMesh->Materials[Record.Index].MaterialInterface) == Strings[Record.New])
+						&& !IsSlotReferenced(SkeletalMesh, Record.Index)
+						)
+					{
+						SkeletalMesh->Modify();
+						SkeletalMesh->Materials.RemoveAt(Record.Index);
+						SkeletalMeshesToUpdate.Add(SkeletalMesh);
+						bRemoved = true;
+					}
+				}
+				if(!bRemoved)
+				{
+					NumConflicts++;
+					break;
+				}
+				Mesh->MarkPackageDirty();
+				ChangedPackages.Add(Mesh->GetOutermost());
+				NumRestored++;
+				break;
+			}
+			case EOp::Parent:
+			{
+				UMaterialInstanceConstant* Instance = LoadObject<UMaterialInstanceConstant>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn);
+				UMaterialInterface* OldParent = Strings[Record.Old].IsEmpty() ? nullptr : LoadObject<UMaterialInterface>(nullptr, *Strings[Record.Old], nullptr, LOAD_NoWarn);
+				if((nullptr == Instance) || (GetPathName(Instance->Parent) != Strings[Record.New]))
+				{
+					NumConflicts++;
+					break;
+				}
+				Instance->SetParentEditorOnly(OldParent);
+				Instance->MarkPackageDirty();
+				FMICRepShaderBatch::PostEditChange(Instance);
+				ChangedPackages.Add(Instance->GetOutermost());
+				NumRestored++;
+				break;
+			}
+			case EOp::SlotMerged:
+			case EOp::SectionInfo:
+			case EOp::FaceSections:
+			case EOp::SectionMaterial:
+			case EOp::MaterialMapSlot:
+			{
+				MergeDetails.FindOrAdd(Record.Object).Add(Record);
+				break;
+			}
+			case EOp::MergeBegin:
+			{
+				// 統合の記録は記録順に並べ直してまとめて戻す 
+				TArray<FRecord> Details;
+				if(TArray<FRecord>* Found = MergeDetails.Find(Record.Object))
+				{
+					for(int32 DetailIdx = Found->Num() - 1; 0 <= DetailIdx; --DetailIdx)
+					{
+						Details.Add((*Found)[DetailIdx]);
+					}
+					MergeDetails.Remove(Record.Object);
+				}
+				UObject* Mesh = LoadObject<UObject>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn);
+				bool bRestored = false;
+				if(UStaticMesh* StaticMesh = Cast<UStaticMesh>(Mesh))
+				{
+					bRestored = RestoreMerged(StaticMesh, Record, Details, Strings);
+					if(bRestored)
+					{
+						StaticMeshesToBuild.Add(StaticMesh);
+					}
+				}
+				else if(USkeletalMesh* SkeletalMesh = Cast<USkeletalMesh>(Mesh))
+				{
+					bRestored = RestoreMerged(SkeletalMesh, Record, Details, Strings);
+					if(bRestored)
+					{
+						SkeletalMeshesToUpdate.Add(SkeletalMesh);
+					}
+				}
+				if(!bRestored)
+				{
+					UE_LOG(LogMICRep, Warning, TEXT("'%s' was modified after its sections were merged and cannot be restored."), *ObjectPath);
+					NumConflicts++;
+					break;
+				}
+				// 戻したメッシュのスロットの対応表は、まだ並べ替えていないレベルへ適用しない 
+				FMICRepMaterialRemap::Get().RemoveLastSlotRemap(ObjectPath);
+				Mesh->MarkPackageDirty();
+				ChangedPackages.Add(Mesh->GetOutermost());
+				NumRestored++;
+				break;
+			}
+			case EOp::Created:
+			{
+				UObject* Asset = FindObject<UObject>(nullptr, *ObjectPath);
+				if(nullptr == Asset)
+				{
+					Asset = LoadObject<UObject>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn);
+				}
+				if(nullptr != Asset)
+				{
+					CreatedAssets.Add(FAssetData(Asset));
+				}
+				break;
+			}
+			default:
+				break;
+			}
+		}
+
+		// セクションのマテリアル番号はビルド時にレンダーデータへ反映される 
+		for(auto ItMesh = StaticMeshesToBuild.CreateConstIterator(); ItMesh; ++ItMesh)
+		{
+			(*ItMesh)->Build(true);
+		}
+		for(auto ItMesh = SkeletalMeshesToUpdate.CreateConstIterator(); ItMesh; ++ItMesh)
+		{
+			(*ItMesh)->PostEditChange();
+		}
+	}
+	FMICRepMaterialRemap::Get().Save();
+
+	// 戻したパッケージを先に保存する. 保存されていない参照が残ったまま削除すると元に戻せなくなる 
+	const TArray<UPackage*> ChangedPackageArray = ChangedPackages.Array();
+	bool bAllSaved = bSave;
+	if(bSave)
+	{
+		FMICRepModule::SavePackages(ChangedPackageArray);
+		for(auto ItPackage = ChangedPackageArray.CreateConstIterator(); ItPackage; ++ItPackage)
+		{
+			if((*ItPackage)->IsDirty())
+			{
+				UE_LOG(LogMICRep, Error, TEXT("'%s' was not saved."), *(*ItPackage)->GetName());
+				bAllSaved = false;
+			}
+		}
+	}
+
+	// 作成したアセットを削除（参照が残っているものは削除されない） 
+	int32 NumDeleted = 0;
+	if(0 < CreatedAssets.Num())
+	{
+		if(bAllSaved)
+		{
+			NumDeleted = ObjectTools::DeleteAssets(CreatedAssets, false);
+		}
+		else
+		{
+			UE_LOG(LogMICRep, Warning, TEXT("Created assets were not deleted because the restored packages are not saved. Save them and roll back again to delete them."));
+		}
+	}
+
+	// 全体を戻し終えたジャーナルは次回の FindLatest の対象から外す 
+	if((0 == PathFilters.Num()) && bAllSaved)
+	{
+		IFileManager::Get().Move(*FPaths::ChangeExtension(JournalFile, TEXT("rolledback")), *JournalFile);
+	}
+
+	UE_LOG(LogMICRep, Display, TEXT("Rolled back '%s': %d changes restored, %d skipped (modified since), %d of %d created assets deleted."),
+		*FPaths::GetCleanFilename(JournalFile), NumRestored, NumConflicts, NumDeleted, CreatedAssets.Num());
+	return true;
+}
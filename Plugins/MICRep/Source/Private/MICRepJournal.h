@@ -0,0 +1,103 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UMaterialInterface;
+class UMaterialInstance;
+class UStaticMesh;
+class USkeletalMesh;
+
+//
+// 一括処理の変更履歴（ロールバック用） 
+//
+// 変更前の状態そのものは保持せず、スロットの差し替え・追加/セクションの付け替え/作成したアセット/親の変更だけを 
+// Saved/MICRep/Journal/<RunName>_<日時>_<PID>.bin に追記する. パスは初出時のみ書き出し、以降は番号で参照する. 
+// セクションの統合のみ、統合前のスロットとセクションの構成（StaticMeshは面ごとのセクション番号も）を記録する. 
+//
+class FMICRepJournal
+{
+public:
+	// 最も外側のスコープでファイルを開き、終了時に閉じる 
+	class FScopedRun
+	{
+	public:
+		explicit FScopedRun(const TCHAR* RunName);
+		~FScopedRun();
+	};
+
+	// 記録（実行中でなければ何もしない）. スロットはメッシュのマテリアルかコンポーネントの OverrideMaterials 
+	static void RecordSlot(UObject* Mesh, int32 SlotIndex, UMaterialInterface* OldMaterial, UMaterialInterface* NewMaterial);
+	static void RecordCreated(UObject* Asset);
+	static void RecordParent(UMaterialInstance* Instance, UMaterialInterface* OldParent, UMaterialInterface* NewParent);
+	// 末尾に追加したスロット（戻す時に末尾から取り除く） 
+	static void RecordSlotAdded(UObject* Mesh, int32 SlotIndex, UMaterialInterface* Material);
+	// LOD のセクションが参照するスロット番号の付け替え（StaticMesh の SectionInfoMap / SkeletalMesh の LODMaterialMap） 
+	static void RecordSectionSlot(UObject* Mesh, int32 LODIndex, int32 SectionIndex, int32 OldSlot, int32 NewSlot);
+	// セクションの統合（メッシュを変更する前に呼ぶ）. OldFaceSections: LODごとの統合前の面のセクション番号 
+	static void RecordMerged(UStaticMesh* Mesh, const TArray<int32>& OldToNew, const TArray<TArray<int32>>& OldFaceSections);
+	static void RecordMerged(USkeletalMesh* Mesh, const TArray<int32>& OldToNew);
+
+	// 次に開始する実行の出力先を指定（シャードのワーカーが統合側へ渡す場合） 
+	static void SetFileName(const FString& FileName);
+
+	// 記録しない（ベンチマークなど、生成したアセットを保存しない実行） 
+	static void SetSuppressed(bool bInSuppressed);
+	static bool IsSuppressed() { return bSuppressed; }
+
+	// 別のジャーナルの記録を現在の実行へ追加（実行中でなければ何もしない） 
+	static bool Append(const FString& JournalFile);
+
+	// 最新のジャーナル（無ければ空） 
+	static FString FindLatest();
+
+	// ジャーナルを新しい順に戻す. PathFilters を指定した場合はそのパス以下のアセットのみ 
+	// 作成したアセットは、戻したパッケージをすべて保存できた場合に参照されなくなったもののみ削除する（bSave が false なら削除しない） 
+	static bool Rollback(const FString& JournalFile, const TArray<FString>& PathFilters, bool bSave);
+
+private:
+	enum class EOp : uint8
+	{
+		String,
+		Slot,
+		Created,
+		Parent,
+		Rebuilt,		// バージョン1のみ（セクションを統合したメッシュは戻せない） 
+		SlotAdded,
+		SectionSlot,	// Index は LOD/セクション番号、Old/New は文字列ではなくスロット番号 
+		// セクションの統合. 戻す時は MergeBegin より後の記録をまとめて適用する 
+		MergeBegin,		// Old/New は統合前/後のスロット数 
+		SlotMerged,		// Index は統合前/後のスロット番号、Old/New は統合前の MaterialSlotName/ImportedMaterialSlotName 
+		SectionInfo,	// StaticMesh: Index は LOD/セクション番号、Old はスロット番号、New は設定（bit0: コリジョン, bit1: 影） 
+		FaceSections,	// StaticMesh: Index は LOD、Old は面のセクション番号、New は同じ番号が続く面の数（面の順に記録） 
+		SectionMaterial,	// SkeletalMesh: Index は LOD/セクション番号、Old/New はスロット番号 
+		MaterialMapSlot,	// SkeletalMesh: Index は LOD/LODMaterialMap の番号、Old/New はスロット番号 
+	};
+
+	struct FRecord
+	{
+		EOp Op;
+		int32 Object;
+		int32 Index;
+		int32 Old;
+		int32 New;
+	};
+
+	static int32 GetStringId(const FString& String);
+	static void Write(EOp Op, int32 Object, int32 Index, int32 Old, int32 New);
+	static bool Read(const FString& JournalFile, TArray<FString>& OutStrings, TArray<FRecord>& OutRecords);
+	// Old/New が文字列の番号か 
+	static bool HasStringValues(EOp Op);
+
+	// 統合前の構成へ戻す（統合後に変更されていればfalse）. Details は記録順 
+	static bool RestoreMerged(UStaticMesh* Mesh, const FRecord& Begin, const TArray<FRecord>& Details, const TArray<FString>& Strings);
+	static bool RestoreMerged(USkeletalMesh* Mesh, const FRecord& Begin, const TArray<FRecord>& Details, const TArray<FString>& Strings);
+
+	static int32 RunDepth;
+	static FArchive* Writer;
+	static TMap<FString, int32> StringIds;
+	static int32 NumUnflushed;
+	static FString NextFileName;
+	static bool bSuppressed;
+};
@@ -0,0 +1,199 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepLODMaterials.h"
+#include "MICRepJournal.h"
+#include "SkeletalMeshTypes.h"
+
+
+namespace
+{
+	FName GetVariantSlotName(FName SlotName)
+	{
+		return (NAME_None != SlotName) ? FName(*(SlotName.ToString() + TEXT("_LOD"))) : NAME_None;
+	}
+
+	FStaticMaterial MakeVariantSlot(const FStaticMaterial& Slot, UMaterialInterface* Variant)
+	{
+		FStaticMaterial NewSlot = Slot;
+		NewSlot.MaterialInterface = Variant;
+		NewSlot.MaterialSlotName = GetVariantSlotName(Slot.MaterialSlotName);
+		return NewSlot;
+	}
+
+	FSkeletalMaterial MakeVariantSlot(const FSkeletalMaterial& Slot, UMaterialInterface* Variant)
+	{
+		FSkeletalMaterial NewSlot = Slot;
+		NewSlot.MaterialInterface = Variant;
+		NewSlot.MaterialSlotName = GetVariantSlotName(Slot.MaterialSlotName);
+		return NewSlot;
+	}
+}
+
+template<typename SlotType>
+int32 FMICRepLODMaterials::FindOrAddVariantSlot(TArray<SlotType>& Slots, int32 SlotIndex, TMap<int32, int32>& VariantSlots, TFunctionRef<UMaterialInterface*(UMaterialInterface*)> GetVariant)
+{
+	const int32* FoundSlot = VariantSlots.Find(SlotIndex);
+	if(nullptr != FoundSlot)
+	{
+		return *FoundSlot;
+	}
+
+	int32 VariantSlot = INDEX_NONE;
+	UMaterialInterface* Material = Slots.IsValidIndex(SlotIndex) ? Slots[SlotIndex].MaterialInterface : nullptr;
+	UMaterialInterface* Variant = (nullptr != Material) ? GetVariant(Material) : nullptr;
+	if((nullptr != Variant) && (Variant != Material))
+	{
+		VariantSlot = Slots.IndexOfByPredicate([Variant](const SlotType& Slot) { return Slot.MaterialInterface == Variant; });
+		if(INDEX_NONE == VariantSlot)
+		{
+			VariantSlot = Slots.Add(MakeVariantSlot(Slots[SlotIndex], Variant));
+		}
+	}
+	VariantSlots.Add(SlotIndex, VariantSlot);
+	return VariantSlot;
+}
+
+bool FMICRepLODMaterials::AssignStaticMesh(UStaticMesh* Mesh, int32 StartLOD, TFunctionRef<UMaterialInterface*(UMaterialInterface*)> GetVariant)
+{
+	if((nullptr == Mesh) || (nullptr == Mesh->RenderData))
+	{
+		return false;
+	}
+
+	// <元スロット, 簡易MICのスロット> 
+	TMap<int32, int32> VariantSlots;
+	TArray<FStaticMaterial> Slots = Mesh->StaticMaterials;
+	FMeshSectionInfoMap SectionInfoMap = Mesh->SectionInfoMap;
+	bool bChanged = false;
+
+	const int32 NumLODs = FMath::Min(Mesh->SourceModels.Num(), Mesh->RenderData->LODResources.Num());
+	for(int32 LODIdx = FMath::Max(1, StartLOD); LODIdx < NumLODs; ++LODIdx)
+	{
+		const int32 NumSections = Mesh->RenderData->LODResources[LODIdx].Sections.Num();
+		for(int32 SectionIdx = 0; SectionIdx < NumSections; ++SectionIdx)
+		{
+			FMeshSectionInfo Info = SectionInfoMap.Get(LODIdx, SectionIdx);
+			const int32 VariantSlot = FindOrAddVariantSlot(Slots, Info.MaterialIndex, VariantSlots, GetVariant);
+			if((INDEX_NONE != VariantSlot) && (Info.MaterialIndex != VariantSlot))
+			{
+				Info.MaterialIndex = VariantSlot;
+				SectionInfoMap.Set(LODIdx, SectionIdx, Info);
+				bChanged = true;
+			}
+		}
+	}
+	if(!bChanged)
+	{
+		return false;
+	}
+
+	// 追加したスロット、付け替えたセクションの順に記録する（戻す時はセクションから） 
+	for(int32 SlotIdx = Mesh->StaticMaterials.Num(); SlotIdx < Slots.Num(); ++SlotIdx)
+	{
+		FMICRepJournal::RecordSlotAdded(Mesh, SlotIdx, Slots[SlotIdx].MaterialInterface);
+	}
+	for(int32 LODIdx = FMath::Max(1, StartLOD); LODIdx < NumLODs; ++LODIdx)
+	{
+		const int32 NumSections = Mesh->RenderData->LODResources[LODIdx].Sections.Num();
+		for(int32 SectionIdx = 0; SectionIdx < NumSections; ++SectionIdx)
+		{
+			const int32 OldSlot = Mesh->SectionInfoMap.Get(LODIdx, SectionIdx).MaterialIndex;
+			const int32 NewSlot = SectionInfoMap.Get(LODIdx, SectionIdx).MaterialIndex;
+			if(OldSlot != NewSlot)
+			{
+				FMICRepJournal::RecordSectionSlot(Mesh, LODIdx, SectionIdx, OldSlot, NewSlot);
+			}
+		}
+	}
+
+	// セクションのマテリアル番号はビルド時にレンダーデータへ反映される 
+	Mesh->Modify();
+	Mesh->StaticMaterials = Slots;
+	Mesh->SectionInfoMap = SectionInfoMap;
+	Mesh->Build(true);
+	Mesh->MarkPackageDirty();
+
+	UE_LOG(LogMICRep, Verbose, TEXT("Assigned LOD materials of %s from LOD %d"), *Mesh->GetPathName(), StartLOD);
+	return true;
+}
+
+bool FMICRepLODMaterials::AssignSkeletalMesh(USkeletalMesh* Mesh, int32 StartLOD, TFunctionRef<UMaterialInterface*(UMaterialInterface*)> GetVariant)
+{
+	FSkeletalMeshResource* Resource = (nullptr != Mesh) ? Mesh->GetImportedResource() : nullptr;
+	if(nullptr == Resource)
+	{
+		return false;
+	}
+
+	// <元スロット, 簡易MICのスロット> 
+	TMap<int32, int32> VariantSlots;
+	TArray<FSkeletalMaterial> Slots = Mesh->Materials;
+	TArray<TArray<int32>> MaterialMaps;
+	MaterialMaps.SetNum(Mesh->LODInfo.Num());
+	bool bChanged = false;
+
+	const int32 NumLODs = FMath::Min(Mesh->LODInfo.Num(), Resource->LODModels.Num());
+	for(int32 LODIdx = FMath::Max(1, StartLOD); LODIdx < NumLODs; ++LODIdx)
+	{
+		// 未設定の要素はセクション自身のスロットで埋める 
+		const TArray<FSkelMeshSection>& Sections = Resource->LODModels[LODIdx].Sections;
+		TArray<int32>& MaterialMap = MaterialMaps[LODIdx];
+		MaterialMap = Mesh->LODInfo[LODIdx].LODMaterialMap;
+		for(int32 SectionIdx = 0; SectionIdx < Sections.Num(); ++SectionIdx)
+		{
+			if(!MaterialMap.IsValidIndex(SectionIdx))
+			{
+				MaterialMap.Add(Sections[SectionIdx].MaterialIndex);
+			}
+			else if(INDEX_NONE == MaterialMap[SectionIdx])
+			{
+				MaterialMap[SectionIdx] = Sections[SectionIdx].MaterialIndex;
+			}
+
+			const int32 VariantSlot = FindOrAddVariantSlot(Slots, MaterialMap[SectionIdx], VariantSlots, GetVariant);
+			if((INDEX_NONE != VariantSlot) && (MaterialMap[SectionIdx] != VariantSlot))
+			{
+				MaterialMap[SectionIdx] = VariantSlot;
+				bChanged = true;
+			}
+		}
+	}
+	if(!bChanged)
+	{
+		return false;
+	}
+
+	// 追加したスロット、付け替えたセクションの順に記録する（戻す時はセクションから） 
+	for(int32 SlotIdx = Mesh->Materials.Num(); SlotIdx < Slots.Num(); ++SlotIdx)
+	{
+		FMICRepJournal::RecordSlotAdded(Mesh, SlotIdx, Slots[SlotIdx].MaterialInterface);
+	}
+	for(int32 LODIdx = FMath::Max(1, StartLOD); LODIdx < NumLODs; ++LODIdx)
+	{
+		// 未設定だった要素は元のセクション自身のスロットとして記録する 
+		const TArray<FSkelMeshSection>& Sections = Resource->LODModels[LODIdx].Sections;
+		const TArray<int32>& OldMaterialMap = Mesh->LODInfo[LODIdx].LODMaterialMap;
+		const TArray<int32>& MaterialMap = MaterialMaps[LODIdx];
+		for(int32 SectionIdx = 0; SectionIdx < MaterialMap.Num(); ++SectionIdx)
+		{
+			const int32 OldSlot = (OldMaterialMap.IsValidIndex(SectionIdx) && (INDEX_NONE != OldMaterialMap[SectionIdx])) ? OldMaterialMap[SectionIdx] : Sections[SectionIdx].MaterialIndex;
+			if(OldSlot != MaterialMap[SectionIdx])
+			{
+				FMICRepJournal::RecordSectionSlot(Mesh, LODIdx, SectionIdx, OldSlot, MaterialMap[SectionIdx]);
+			}
+		}
+	}
+
+	Mesh->Modify();
+	Mesh->Materials = Slots;
+	for(int32 LODIdx = FMath::Max(1, StartLOD); LODIdx < NumLODs; ++LODIdx)
+	{
+		Mesh->LODInfo[LODIdx].LODMaterialMap = MaterialMaps[LODIdx];
+	}
+	Mesh->PostEditChange();
+	Mesh->MarkPackageDirty();
+
+	UE_LOG(LogMICRep, Verbose, TEXT("Assigned LOD materials of %s from LOD %d"), *Mesh->GetPathName(), StartLOD);
+	return true;
+}
@@ -0,0 +1,30 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UStaticMesh;
+class USkeletalMesh;
+class UMaterialInterface;
+
+//
+// 遠景LODのセクションを簡易MICのスロットへ付け替える 
+//
+// GetVariant はスロットのマテリアルに対する簡易MICを返す（無ければ nullptr）. 
+// 簡易MICのスロットは末尾に追加し、同じマテリアルのスロットがあれば再利用する. 
+//
+class FMICRepLODMaterials
+{
+public:
+	// StaticMesh: SectionInfoMap を書き換えてビルドし直す（変更した場合true） 
+	static bool AssignStaticMesh(UStaticMesh* Mesh, int32 StartLOD, TFunctionRef<UMaterialInterface*(UMaterialInterface*)> GetVariant);
+
+	// SkeletalMesh: LODInfo の LODMaterialMap を書き換える（変更した場合true） 
+	static bool AssignSkeletalMesh(USkeletalMesh* Mesh, int32 StartLOD, TFunctionRef<UMaterialInterface*(UMaterialInterface*)> GetVariant);
+
+private:
+	// 元スロットに対応する簡易MICのスロット（不要なら INDEX_NONE） 
+	template<typename SlotType>
+	static int32 FindOrAddVariantSlot(TArray<SlotType>& Slots, int32 SlotIndex, TMap<int32, int32>& VariantSlots, TFunctionRef<UMaterialInterface*(UMaterialInterface*)> GetVariant);
+};
@@ -0,0 +1,161 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepLevelRemap.h"
+#include "MICRepJournal.h"
+#include "MICRepMaterialRemap.h"
+#include "MICRepModule.h"
+#include "MICRepStats.h"
+#include "PackageTools.h"
+
+
+int32 FMICRepLevelRemap::Run(const TArray<FAssetData>& LevelAssets, bool bSave)
+{
+	FMICRepRunStats::FScopedRun ScopedRun(TEXT("RemapLevels"));
+	FMICRepJournal::FScopedRun ScopedJournal(TEXT("RemapLevels"));
+
+	if(0 == FMICRepMaterialRemap::Get().Num())
+	{
+		UE_LOG(LogMICRep, Warning, TEXT("No material replacements or slot merges recorded. Run ReplaceMaterials first."));
+		return 0;
+	}
+
+	int32 PatchedLevels = 0;
+	for(auto ItLevel = LevelAssets.CreateConstIterator(); ItLevel; ++ItLevel)
+	{
+		const FString PackageName = (*ItLevel).PackageName.ToString();
+
+		UPackage* Package = FindPackage(nullptr, *PackageName);
+		const bool bWasLoaded = (nullptr != Package);
+		if(!bWasLoaded)
+		{
+			MICREP_SCOPE_PHASE(Load);
+			Package = LoadPackage(nullptr, *PackageName, LOAD_None);
+		}
+		if(nullptr == Package)
+		{
+			UE_LOG(LogMICRep, Warning, TEXT("Failed to load level '%s'."), *PackageName);
+			continue;
+		}
+
+		TSet<UObject*> SlotRemappedMeshes;
+		const int32 NumRemapped = RemapPackage(Package, SlotRemappedMeshes);
+		if(0 < NumRemapped)
+		{
+			UE_LOG(LogMICRep, Display, TEXT("%s: %d override materials remapped."), *PackageName, NumRemapped);
+			PatchedLevels++;
+		}
+
+		// 前回並べ替えて保存しなかったレベルも保存する 
+		bool bNeedsSave = (0 < NumRemapped);
+		for(auto ItMesh = SlotRemappedMeshes.CreateConstIterator(); ItMesh && !bNeedsSave; ++ItMesh)
+		{
+			bNeedsSave = FMICRepMaterialRemap::Get().HasUnsavedSlotRemaps(*ItMesh, Package);
+		}
+		bool bSaved = false;
+		if(bSave && bNeedsSave)
+		{
+			TArray<UPackage*> Packages;
+			Packages.Add(Package);
+			bSaved = (0 < FMICRepModule::SavePackages(Packages));
+		}
+
+		// 並べ替えを保存できたレベルだけを適用済みとして記録する. 
+		// 変更が無ければディスク上も並べ替え済み 
+		for(auto ItMesh = SlotRemappedMeshes.CreateConstIterator(); ItMesh; ++ItMesh)
+		{
+			FMICRepMaterialRemap::Get().MarkSlotRemapsApplied(*ItMesh, Package, bSaved || !bNeedsSave);
+		}
+
+		// 未保存のレベルはアンロードしない 
+		if(!bWasLoaded && !Package->IsDirty())
+		{
+			MICREP_SCOPE_PHASE(Unload);
+			TArray<UPackage*> PackagesToUnload;
+			PackagesToUnload.Add(Package);
+			FText ErrorMessage;
+			if(!PackageTools::UnloadPackages(PackagesToUnload, ErrorMessage))
+			{
+				UE_LOG(LogMICRep, Warning, TEXT("%s"), *ErrorMessage.ToString());
+			}
+		}
+	}
+
+	// 並べ替えを適用したレベルを記録 
+	FMICRepMaterialRemap::Get().Save();
+	return PatchedLevels;
+}
+
+int32 FMICRepLevelRemap::RemapPackage(UPackage* Package, TSet<UObject*>& OutSlotRemappedMeshes)
+{
+	FMICRepMaterialRemap& Remap = FMICRepMaterialRemap::Get();
+
+	TArray<UObject*> Objects;
+	GetObjectsWithOuter(Package, Objects, true);
+
+	int32 NumRemapped = 0;
+	for(auto ItObject = Objects.CreateConstIterator(); ItObject; ++ItObject)
+	{
+		UMeshComponent* Component = Cast<UMeshComponent>(*ItObject);
+		if((nullptr == Component) || Component->IsTemplate())
+		{
+			continue;
+		}
+
+		bool bChanged = false;
+
+		// セクションを統合したメッシュはスロット番号の変更に合わせて並べ替える 
+		UObject* Mesh = nullptr;
+		if(UStaticMeshComponent* StaticMeshComponent = Cast<UStaticMeshComponent>(Component))
+		{
+			Mesh = StaticMeshComponent->GetStaticMesh();
+		}
+		else if(USkinnedMeshComponent* SkinnedMeshComponent = Cast<USkinnedMeshComponent>(Component))
+		{
+			Mesh = SkinnedMeshComponent->SkeletalMesh;
+		}
+		TArray<UMaterialInterface*> Overrides = Component->OverrideMaterials;
+		if(Remap.RemapOverrides(Mesh, Package, Overrides))
+		{
+			Component->Modify();
+			for(int32 MatIdx = 0; MatIdx < Overrides.Num(); ++MatIdx)
+			{
+				if(Overrides[MatIdx] != Component->OverrideMaterials[MatIdx])
+				{
+					FMICRepJournal::RecordSlot(Component, MatIdx, Component->OverrideMaterials[MatIdx], Overrides[MatIdx]);
+					Component->OverrideMaterials[MatIdx] = Overrides[MatIdx];
+					NumRemapped++;
+				}
+			}
+			bChanged = true;
+		}
+		if(nullptr != Mesh)
+		{
+			OutSlotRemappedMeshes.Add(Mesh);
+		}
+
+		for(int32 MatIdx = 0; MatIdx < Component->OverrideMaterials.Num(); ++MatIdx)
+		{
+			UMaterialInterface* NewMaterial = Remap.Resolve(Component->OverrideMaterials[MatIdx]);
+			if((nullptr == NewMaterial) || (NewMaterial == Component->OverrideMaterials[MatIdx]))
+			{
+				continue;
+			}
+			Component->Modify();
+			FMICRepJournal::RecordSlot(Component, MatIdx, Component->OverrideMaterials[MatIdx], NewMaterial);
+			Component->OverrideMaterials[MatIdx] = NewMaterial;
+			NumRemapped++;
+			bChanged = true;
+		}
+		if(bChanged)
+		{
+			Component->MarkRenderStateDirty();
+		}
+	}
+
+	if(0 < NumRemapped)
+	{
+		Package->MarkPackageDirty();
+	}
+	return NumRemapped;
+}
@@ -0,0 +1,26 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+
+class UPackage;
+
+//
+// レベル上のメッシュコンポーネントのOverrideMaterialsを置換先MICへ付け替える 
+// （セクションを統合したメッシュのコンポーネントは、先に詰めたスロットの順へ並べ替える） 
+//
+// メモリを抑えるため、レベルを1つずつ ロード → 置換 → 保存 → アンロード する. 
+// 既に開いているレベルはその場で置換し、アンロードしない. 
+//
+class FMICRepLevelRemap
+{
+public:
+	// 変更したレベル数 
+	static int32 Run(const TArray<FAssetData>& LevelAssets, bool bSave = true);
+
+private:
+	// 付け替えたOverrideMaterialsの数（スロットの対応表を確認したメッシュを OutSlotRemappedMeshes へ追加） 
+	static int32 RemapPackage(UPackage* Package, TSet<UObject*>& OutSlotRemappedMeshes);
+};
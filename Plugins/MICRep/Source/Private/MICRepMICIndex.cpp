@@ -0,0 +1,214 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepMICIndex.h"
+#include "MICRepCache.h"
+#include "MICRepTextureHash.h"
+#include "AssetRegistryModule.h"
+
+
+namespace
+{
+	const TCHAR* MICIndexFileName = TEXT("MICIndex.bin");
+	const int32 MICIndexVersion = 2;
+
+	template<typename ValueType>
+	void SortByName(TArray<TPair<FName, ValueType>>& Params)
+	{
+		Params.Sort([](const TPair<FName, ValueType>& A, const TPair<FName, ValueType>& B)
+			{ return A.Key.Compare(B.Key) < 0; });
+	}
+}
+
+
+void FMICRepMICKey::AddTexture(FName ParameterName, UTexture* Texture)
+{
+	if(nullptr != Texture)
+	{
+		Textures.Add(TPair<FName, FString>(ParameterName, FMICRepTextureHashCache::Get().GetCanonicalPath(Texture)));
+	}
+}
+
+FSHAHash FMICRepMICKey::GetHash() const
+{
+	// パラメータ名でソートして正規化した文字列をハッシュ化 
+	FMICRepMICKey Sorted = *this;
+	SortByName(Sorted.Textures);
+	SortByName(Sorted.Scalars);
+	SortByName(Sorted.Vectors);
+	SortByName(Sorted.StaticSwitches);
+
+	FString Canonical = FString::Printf(TEXT("P=%s;"), *Sorted.Parent);
+	for(auto It = Sorted.Textures.CreateConstIterator(); It; ++It)
+	{
+		Canonical += FString::Printf(TEXT("T:%s=%s;"), *(*It).Key.ToString(), *(*It).Value);
+	}
+	for(auto It = Sorted.Scalars.CreateConstIterator(); It; ++It)
+	{
+		Canonical += FString::Printf(TEXT("S:%s=%.9g;"), *(*It).Key.ToString(), (*It).Value);
+	}
+	for(auto It = Sorted.Vectors.CreateConstIterator(); It; ++It)
+	{
+		const FLinearColor& Value = (*It).Value;
+		Canonical += FString::Printf(TEXT("V:%s=%.9g,%.9g,%.9g,%.9g;"), *(*It).Key.ToString(), Value.R, Value.G, Value.B, Value.A);
+	}
+	for(auto It = Sorted.StaticSwitches.CreateConstIterator(); It; ++It)
+	{
+		Canonical += FString::Printf(TEXT("B:%s=%d;"), *(*It).Key.ToString(), (*It).Value ? 1 : 0);
+	}
+	Canonical.ToLowerInline();
+
+	FSHAHash Hash;
+	FSHA1::HashBuffer(*Canonical, Canonical.Len() * sizeof(TCHAR), Hash.Hash);
+	return Hash;
+}
+
+FMICRepMICKey FMICRepMICKey::FromInstance(UMaterialInstanceConstant* MIC)
+{
+	FMICRepMICKey Key;
+	if(nullptr == MIC)
+	{
+		return Key;
+	}
+
+	Key.Parent = (nullptr != MIC->Parent) ? MIC->Parent->GetPathName() : FString();
+	for(auto It = MIC->TextureParameterValues.CreateConstIterator(); It; ++It)
+	{
+		Key.AddTexture((*It).ParameterName, (*It).ParameterValue);
+	}
+	for(auto It = MIC->ScalarParameterValues.CreateConstIterator(); It; ++It)
+	{
+		Key.Scalars.Add(TPair<FName, float>((*It).ParameterName, (*It).ParameterValue));
+	}
+	for(auto It = MIC->VectorParameterValues.CreateConstIterator(); It; ++It)
+	{
+		Key.Vectors.Add(TPair<FName, FLinearColor>((*It).ParameterName, (*It).ParameterValue));
+	}
+
+	// 上書きされているStaticSwitchのみ 
+	FStaticParameterSet StaticParams;
+	MIC->GetStaticParameterValues(StaticParams);
+	for(auto It = StaticParams.StaticSwitchParameters.CreateConstIterator(); It; ++It)
+	{
+		if((*It).bOverride)
+		{
+			Key.StaticSwitches.Add(TPair<FName, bool>((*It).ParameterName, (*It).Value));
+		}
+	}
+	return Key;
+}
+
+
+FMICRepMICIndex& FMICRepMICIndex::Get()
+{
+	static FMICRepMICIndex Instance;
+	return Instance;
+}
+
+FMICRepMICIndex::FMICRepMICIndex()
+	: bDirty(false)
+{
+	Load();
+}
+
+UMaterialInstanceConstant* FMICRepMICIndex::Find(const FSHAHash& Hash)
+{
+	const FString* Path = HashToPath.Find(Hash);
+	if(nullptr == Path)
+	{
+		return nullptr;
+	}
+
+	// 削除/リネーム済みのアセットはインデックスから外す 
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(**Path));
+	UMaterialInstanceConstant* MIC = AssetData.IsValid() ? Cast<UMaterialInstanceConstant>(AssetData.GetAsset()) : nullptr;
+	if(nullptr == MIC)
+	{
+		HashToPath.Remove(Hash);
+		bDirty = true;
+		return nullptr;
+	}
+
+	// 登録後に内容が変わったもの（元マテリアルの変更による更新、Reparent、ロールバックなど）は現在の内容で登録し直す 
+	const FSHAHash CurrentHash = FMICRepMICKey::FromInstance(MIC).GetHash();
+	if(CurrentHash != Hash)
+	{
+		HashToPath.Remove(Hash);
+		HashToPath.Add(CurrentHash, MIC->GetPathName());
+		bDirty = true;
+		return nullptr;
+	}
+	return MIC;
+}
+
+void FMICRepMICIndex::Add(const FSHAHash& Hash, const UMaterialInstanceConstant* MIC)
+{
+	if(nullptr != MIC)
+	{
+		HashToPath.Add(Hash, MIC->GetPathName());
+		bDirty = true;
+	}
+}
+
+void FMICRepMICIndex::Add(const FSHAHash& Hash, const FString& ObjectPath)
+{
+	if(!ObjectPath.IsEmpty())
+	{
+		HashToPath.Add(Hash, ObjectPath);
+		bDirty = true;
+	}
+}
+
+int32 FMICRepMICIndex::Rebuild(const TArray<FAssetData>& MICAssets)
+{
+	// 登録済みのアセットはロードしない 
+	TSet<FString> IndexedPaths;
+	for(auto It = HashToPath.CreateConstIterator(); It; ++It)
+	{
+		IndexedPaths.Add(It.Value());
+	}
+
+	int32 AddedCount = 0;
+	for(auto ItAsset = MICAssets.CreateConstIterator(); ItAsset; ++ItAsset)
+	{
+		if(IndexedPaths.Contains((*ItAsset).ObjectPath.ToString()))
+		{
+			continue;
+		}
+		UMaterialInstanceConstant* MIC = Cast<UMaterialInstanceConstant>((*ItAsset).GetAsset());
+		if(nullptr == MIC)
+		{
+			continue;
+		}
+		Add(FMICRepMICKey::FromInstance(MIC).GetHash(), MIC);
+		AddedCount++;
+	}
+	return AddedCount;
+}
+
+void FMICRepMICIndex::Load()
+{
+	const bool bLoaded = MICRepCache::Load(MICIndexFileName, MICIndexVersion, [this](FArchive& Ar)
+		{
+			Ar << HashToPath;
+		});
+	if(!bLoaded)
+	{
+		HashToPath.Reset();
+	}
+	bDirty = false;
+}
+
+void FMICRepMICIndex::Save()
+{
+	if(!bDirty)
+	{
+		return;
+	}
+	MICRepCache::Save(MICIndexFileName, MICIndexVersion, [this](FArchive& Ar)
+		{
+			Ar << HashToPath;
+		});
+	bDirty = false;
+}
@@ -0,0 +1,59 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SecureHash.h"
+#include "AssetData.h"
+
+class UMaterialInterface;
+class UMaterialInstanceConstant;
+class UTexture;
+
+//
+// MICの内容（親、パラメータ、StaticSwitch）を正規化したキー 
+//
+struct FMICRepMICKey
+{
+	FString Parent;
+	TArray<TPair<FName, FString>> Textures;
+	TArray<TPair<FName, float>> Scalars;
+	TArray<TPair<FName, FLinearColor>> Vectors;
+	TArray<TPair<FName, bool>> StaticSwitches;
+
+	// 内容が同一のテクスチャは代表のパスで登録 
+	void AddTexture(FName ParameterName, UTexture* Texture);
+
+	// パラメータ順に依存しないハッシュ 
+	FSHAHash GetHash() const;
+
+	// 既存MICからキーを作成 
+	static FMICRepMICKey FromInstance(UMaterialInstanceConstant* MIC);
+};
+
+//
+// プロジェクト全体のMIC重複排除インデックス <Hash, ObjectPath> 
+//
+class FMICRepMICIndex
+{
+public:
+	static FMICRepMICIndex& Get();
+
+	// 同一内容のMICを取得（存在しない、または登録後に内容が変わっていればnullptr） 
+	UMaterialInstanceConstant* Find(const FSHAHash& Hash);
+	void Add(const FSHAHash& Hash, const UMaterialInstanceConstant* MIC);
+	// 他のプロセスで作成したMICの登録（ロードしない） 
+	void Add(const FSHAHash& Hash, const FString& ObjectPath);
+
+	// アセットレジストリから列挙した既存MICのうち未登録のものを登録 
+	int32 Rebuild(const TArray<FAssetData>& MICAssets);
+
+	void Save();
+
+private:
+	FMICRepMICIndex();
+	void Load();
+
+	TMap<FSHAHash, FString> HashToPath;
+	bool bDirty;
+};
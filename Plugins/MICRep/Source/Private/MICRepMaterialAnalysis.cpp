@@ -0,0 +1,210 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepMaterialAnalysis.h"
+#include "MICRepCache.h"
+#include "MICRepStats.h"
+#include "MICRepTextureRules.h"
+#include "MICRepSettings.h"
+#include "Materials/MaterialExpressionComponentMask.h"
+#include "Materials/MaterialExpressionTextureSample.h"
+
+
+namespace
+{
+	const TCHAR* MaterialAnalysisFileName = TEXT("MaterialAnalysis.bin");
+	const int32 MaterialAnalysisVersion = 3;
+
+	EMICRepTextureChannel GetMaskChannel(int32 Mask, int32 MaskR, int32 MaskG, int32 MaskB, int32 MaskA)
+	{
+		if(!Mask)
+		{
+			return EMICRepTextureChannel::RGB;
+		}
+		const int32 NumChannels = (MaskR ? 1 : 0) + (MaskG ? 1 : 0) + (MaskB ? 1 : 0) + (MaskA ? 1 : 0);
+		if(1 == NumChannels)
+		{
+			return MaskR ? EMICRepTextureChannel::R : MaskG ? EMICRepTextureChannel::G : MaskB ? EMICRepTextureChannel::B : EMICRepTextureChannel::A;
+		}
+		return (MaskR && MaskG && MaskB && !MaskA) ? EMICRepTextureChannel::RGB : EMICRepTextureChannel::Any;
+	}
+
+	//
+	// プロパティへ直接つながっているテクスチャのチャンネル 
+	//
+	// テクスチャサンプルの出力ピン、またはその RGB/RGBA を ComponentMask で取り出したもののみ判定する. 
+	// 演算を挟んでいるなど判定できない場合は Any. 
+	//
+	EMICRepTextureChannel GetSampledChannel(UMaterialInterface* Material, EMaterialProperty Property)
+	{
+		UMaterial* RootMaterial = Material->GetMaterial();
+		FExpressionInput* Input = (nullptr != RootMaterial) ? RootMaterial->GetExpressionInputForProperty(Property) : nullptr;
+		if((nullptr == Input) || (nullptr == Input->Expression))
+		{
+			return EMICRepTextureChannel::Any;
+		}
+		if(Input->Expression->IsA<UMaterialExpressionTextureSample>())
+		{
+			return GetMaskChannel(Input->Mask, Input->MaskR, Input->MaskG, Input->MaskB, Input->MaskA);
+		}
+		UMaterialExpressionComponentMask* ComponentMask = Cast<UMaterialExpressionComponentMask>(Input->Expression);
+		if(    (nullptr != ComponentMask)
+			&& (nullptr != ComponentMask->Input.Expression)
+			&& ComponentMask->Input.Expression->IsA<UMaterialExpressionTextureSample>()
+			&& (!ComponentMask->Input.Mask || (ComponentMask->Input.MaskR && ComponentMask->Input.MaskG && ComponentMask->Input.MaskB))
+			)
+		{
+			return GetMaskChannel(1, ComponentMask->R, ComponentMask->G, ComponentMask->B, ComponentMask->A);
+		}
+		return EMICRepTextureChannel::Any;
+	}
+}
+
+
+UTexture* FMICRepMaterialAnalysis::GetTexture(EMaterialProperty Property) const
+{
+	const FString* TexturePath = PropertyTextures.Find(static_cast<int32>(Property));
+	if((nullptr == TexturePath) || TexturePath->IsEmpty())
+	{
+		return nullptr;
+	}
+	return LoadObject<UTexture>(nullptr, **TexturePath);
+}
+
+
+FMICRepMaterialAnalysisCache& FMICRepMaterialAnalysisCache::Get()
+{
+	static FMICRepMaterialAnalysisCache Instance;
+	return Instance;
+}
+
+FMICRepMaterialAnalysisCache::FMICRepMaterialAnalysisCache()
+	: bDirty(false)
+{
+	Load();
+}
+
+TArray<EMaterialProperty> FMICRepMaterialAnalysisCache::GetMappedProperties()
+{
+	// UMICRepSettings::TextureRules が参照するプロパティ 
+	return FMICRepTextureRules::GetMappedProperties();
+}
+
+FSHAHash FMICRepMaterialAnalysisCache::ComputeSourceHash(UMaterialInterface* Material)
+{
+	// インスタンスの場合は親の変更でも結果が変わるため、親チェーン全体を含める 
+	FSHA1 Sha;
+
+	// 解析するプロパティ、要求するチャンネルが変わった場合も作り直す 
+	const TArray<EMaterialProperty> Properties = GetMappedProperties();
+	Sha.Update(reinterpret_cast<const uint8*>(Properties.GetData()), Properties.Num() * sizeof(EMaterialProperty));
+	for(auto ItProp = Properties.CreateConstIterator(); ItProp; ++ItProp)
+	{
+		const uint8 Channel = static_cast<uint8>(FMICRepTextureRules::GetRequiredChannel(*ItProp));
+		Sha.Update(&Channel, sizeof(Channel));
+	}
+	for(UMaterialInterface* Current = Material; nullptr != Current; )
+	{
+		const FString PathName = Current->GetPathName();
+		FGuid PackageGuid = Current->GetOutermost()->GetGuid();
+		Sha.Update(reinterpret_cast<const uint8*>(*PathName), PathName.Len() * sizeof(TCHAR));
+		Sha.Update(reinterpret_cast<const uint8*>(&PackageGuid), sizeof(FGuid));
+
+		UMaterialInstance* Instance = Cast<UMaterialInstance>(Current);
+		Current = (nullptr != Instance) ? Instance->Parent : nullptr;
+	}
+	Sha.Final();
+
+	FSHAHash Hash;
+	Sha.GetHash(Hash.Hash);
+	return Hash;
+}
+
+FMICRepMaterialAnalysis FMICRepMaterialAnalysisCache::Analyze(UMaterialInterface* Material)
+{
+	FMICRepMaterialAnalysis Analysis;
+	if(nullptr == Material)
+	{
+		return Analysis;
+	}
+
+	const FString MaterialPath = Material->GetPathName();
+	const FSHAHash SourceHash = ComputeSourceHash(Material);
+
+	// 未保存の変更がある場合はGUIDが更新されていないためキャッシュを使わない 
+	const bool bCacheable = !Material->GetOutermost()->IsDirty();
+	if(bCacheable)
+	{
+		const FMICRepMaterialAnalysis* Cached = Entries.Find(MaterialPath);
+		if((nullptr != Cached) && (Cached->SourceHash == SourceHash))
+		{
+			MICREP_INC_COUNTER(AnalysisCacheHits, 1);
+			return *Cached;
+		}
+	}
+	MICREP_INC_COUNTER(AnalysisCacheMisses, 1);
+	MICREP_SCOPE_PHASE(AnalyzeTextures);
+
+	Analysis.SourceHash = SourceHash;
+	const TArray<EMaterialProperty> Properties = GetMappedProperties();
+	for(auto ItProp = Properties.CreateConstIterator(); ItProp; ++ItProp)
+	{
+		TArray<UTexture*> Textures;
+		TArray<FName> TextureNames;
+		Material->GetTexturesInPropertyChain(
+			*ItProp,
+			Textures,
+			&TextureNames,
+			nullptr
+			);
+		if(0 < Textures.Num() && (nullptr != Textures[0]))
+		{
+			// 別のチャンネルを読んでいるテクスチャはベースのパラメータへ移せない 
+			const EMICRepTextureChannel RequiredChannel = FMICRepTextureRules::GetRequiredChannel(*ItProp);
+			if((EMICRepTextureChannel::Any != RequiredChannel) && (RequiredChannel != GetSampledChannel(Material, *ItProp)))
+			{
+				UE_LOG(LogMICRep, Verbose, TEXT("%s: %s does not sample the channel required by TextureRules."), *MaterialPath, *Textures[0]->GetPathName());
+				continue;
+			}
+			Analysis.PropertyTextures.Add(static_cast<int32>(*ItProp), Textures[0]->GetPathName());
+		}
+	}
+
+	if(bCacheable)
+	{
+		Entries.Add(MaterialPath, Analysis);
+		bDirty = true;
+	}
+	return Analysis;
+}
+
+const FMICRepMaterialAnalysis* FMICRepMaterialAnalysisCache::FindCached(const FString& MaterialPath) const
+{
+	return Entries.Find(MaterialPath);
+}
+
+void FMICRepMaterialAnalysisCache::Load()
+{
+	const bool bLoaded = MICRepCache::Load(MaterialAnalysisFileName, MaterialAnalysisVersion, [this](FArchive& Ar)
+		{
+			Ar << Entries;
+		});
+	if(!bLoaded)
+	{
+		Entries.Reset();
+	}
+	bDirty = false;
+}
+
+void FMICRepMaterialAnalysisCache::Save()
+{
+	if(!bDirty)
+	{
+		return;
+	}
+	MICRepCache::Save(MaterialAnalysisFileName, MaterialAnalysisVersion, [this](FArchive& Ar)
+		{
+			Ar << Entries;
+		});
+	bDirty = false;
+}
@@ -0,0 +1,59 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SecureHash.h"
+#include "SceneTypes.h"
+
+class UMaterialInterface;
+class UTexture;
+
+//
+// マテリアルのプロパティチェーン解析結果 
+//
+struct FMICRepMaterialAnalysis
+{
+	// マテリアルと親チェーンのパッケージGUIDから求めたハッシュ 
+	FSHAHash SourceHash;
+	// <EMaterialProperty, 先頭テクスチャのパス> 
+	TMap<int32, FString> PropertyTextures;
+
+	UTexture* GetTexture(EMaterialProperty Property) const;
+
+	friend FArchive& operator<<(FArchive& Ar, FMICRepMaterialAnalysis& Analysis)
+	{
+		return Ar << Analysis.SourceHash << Analysis.PropertyTextures;
+	}
+};
+
+//
+// GetTexturesInPropertyChain の結果をマテリアル単位でキャッシュ 
+//
+class FMICRepMaterialAnalysisCache
+{
+public:
+	static FMICRepMaterialAnalysisCache& Get();
+
+	// 解析対象のマテリアルプロパティ 
+	static TArray<EMaterialProperty> GetMappedProperties();
+
+	// マテリアル変更の検出用ハッシュ 
+	static FSHAHash ComputeSourceHash(UMaterialInterface* Material);
+
+	// 未変更ならキャッシュを返し、変更されていれば解析し直す 
+	FMICRepMaterialAnalysis Analyze(UMaterialInterface* Material);
+
+	// ロードせずに前回の解析結果を参照（変更の有無は確認しない） 
+	const FMICRepMaterialAnalysis* FindCached(const FString& MaterialPath) const;
+
+	void Save();
+
+private:
+	FMICRepMaterialAnalysisCache();
+	void Load();
+
+	// <MaterialPath, Analysis>
+	TMap<FString, FMICRepMaterialAnalysis> Entries;
+	bool bDirty;
+};
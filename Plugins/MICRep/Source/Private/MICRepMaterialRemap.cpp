@@ -0,0 +1,223 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepMaterialRemap.h"
+#include "MICRepCache.h"
+
+
+namespace
+{
+	const TCHAR* MaterialRemapFileName = TEXT("MaterialRemap.bin");
+	const int32 MaterialRemapVersion = 2;
+}
+
+
+FMICRepMaterialRemap& FMICRepMaterialRemap::Get()
+{
+	static FMICRepMaterialRemap Instance;
+	return Instance;
+}
+
+FMICRepMaterialRemap::FMICRepMaterialRemap()
+	: bDirty(false)
+{
+	Load();
+}
+
+void FMICRepMaterialRemap::Add(const UMaterialInterface* OldMaterial, const UMaterialInterface* NewMaterial)
+{
+	if((nullptr != OldMaterial) && (nullptr != NewMaterial) && (OldMaterial != NewMaterial))
+	{
+		Add(OldMaterial->GetPathName(), NewMaterial->GetPathName());
+	}
+}
+
+void FMICRepMaterialRemap::Add(const FString& OldObjectPath, const FString& NewObjectPath)
+{
+	const FString* Existing = OldToNew.Find(OldObjectPath);
+	if((nullptr == Existing) || (*Existing != NewObjectPath))
+	{
+		OldToNew.Add(OldObjectPath, NewObjectPath);
+		bDirty = true;
+	}
+}
+
+UMaterialInterface* FMICRepMaterialRemap::Resolve(const UMaterialInterface* OldMaterial) const
+{
+	const FString* NewObjectPath = (nullptr != OldMaterial) ? OldToNew.Find(OldMaterial->GetPathName()) : nullptr;
+	if(nullptr == NewObjectPath)
+	{
+		return nullptr;
+	}
+	return LoadObject<UMaterialInterface>(nullptr, **NewObjectPath, nullptr, LOAD_NoWarn);
+}
+
+void FMICRepMaterialRemap::AddSlotRemap(const UObject* Mesh, const TArray<int32>& OldSlotToNew)
+{
+	if(nullptr != Mesh)
+	{
+		AddSlotRemap(Mesh->GetPathName(), OldSlotToNew);
+	}
+}
+
+void FMICRepMaterialRemap::AddSlotRemap(const FString& MeshObjectPath, const TArray<int32>& OldSlotToNew)
+{
+	FSlotRemap Remap;
+	Remap.OldSlotToNew = OldSlotToNew;
+	SlotRemaps.FindOrAdd(MeshObjectPath).Add(Remap);
+	bDirty = true;
+}
+
+void FMICRepMaterialRemap::RemoveLastSlotRemap(const FString& MeshObjectPath)
+{
+	TArray<FSlotRemap>* Remaps = SlotRemaps.Find(MeshObjectPath);
+	if((nullptr == Remaps) || (0 == Remaps->Num()))
+	{
+		return;
+	}
+	Remaps->Pop();
+	if(0 == Remaps->Num())
+	{
+		SlotRemaps.Remove(MeshObjectPath);
+	}
+	bDirty = true;
+}
+
+bool FMICRepMaterialRemap::FSlotRemap::IsApplied(const UPackage* Level) const
+{
+	return AppliedLevels.Contains(Level->GetName()) || IsUnsaved(Level);
+}
+
+bool FMICRepMaterialRemap::FSlotRemap::IsUnsaved(const UPackage* Level) const
+{
+	// 破棄して読み直したレベルは別のパッケージになるため、再び並べ替える 
+	for(auto ItLevel = UnsavedLevels.CreateConstIterator(); ItLevel; ++ItLevel)
+	{
+		if((*ItLevel).Get() == Level)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FMICRepMaterialRemap::RemapOverrides(const UObject* Mesh, const UPackage* Level, TArray<UMaterialInterface*>& InOutOverrides) const
+{
+	const TArray<FSlotRemap>* Remaps = (nullptr != Mesh) ? SlotRemaps.Find(Mesh->GetPathName()) : nullptr;
+	if(nullptr == Remaps)
+	{
+		return false;
+	}
+
+	bool bChanged = false;
+	for(auto ItRemap = Remaps->CreateConstIterator(); ItRemap; ++ItRemap)
+	{
+		const FSlotRemap& Remap = *ItRemap;
+		if(Remap.IsApplied(Level))
+		{
+			continue;
+		}
+
+		// スロットは先頭へ寄せるため、新しい番号は元の番号を超えない 
+		TArray<UMaterialInterface*> NewOverrides;
+		NewOverrides.SetNumZeroed(InOutOverrides.Num());
+		for(int32 SlotIdx = 0; SlotIdx < InOutOverrides.Num(); ++SlotIdx)
+		{
+			UMaterialInterface* Override = InOutOverrides[SlotIdx];
+			if((nullptr == Override) || !Remap.OldSlotToNew.IsValidIndex(SlotIdx))
+			{
+				continue;
+			}
+			UMaterialInterface*& NewOverride = NewOverrides[Remap.OldSlotToNew[SlotIdx]];
+			if(nullptr == NewOverride)
+			{
+				NewOverride = Override;
+			}
+			else if(NewOverride != Override)
+			{
+				UE_LOG(LogMICRep, Warning, TEXT("%s: merged slot %d has different overrides (%s, %s) in %s; keeping the first."),
+					*Mesh->GetPathName(), Remap.OldSlotToNew[SlotIdx], *NewOverride->GetPathName(), *Override->GetPathName(), *Level->GetName());
+			}
+		}
+		if(NewOverrides != InOutOverrides)
+		{
+			InOutOverrides = NewOverrides;
+			bChanged = true;
+		}
+	}
+	return bChanged;
+}
+
+void FMICRepMaterialRemap::MarkSlotRemapsApplied(const UObject* Mesh, const UPackage* Level, bool bSaved)
+{
+	TArray<FSlotRemap>* Remaps = (nullptr != Mesh) ? SlotRemaps.Find(Mesh->GetPathName()) : nullptr;
+	if(nullptr == Remaps)
+	{
+		return;
+	}
+	const FString LevelPackageName = Level->GetName();
+	for(auto ItRemap = Remaps->CreateIterator(); ItRemap; ++ItRemap)
+	{
+		FSlotRemap& Remap = *ItRemap;
+		if(Remap.AppliedLevels.Contains(LevelPackageName))
+		{
+			continue;
+		}
+		if(bSaved)
+		{
+			Remap.AppliedLevels.Add(LevelPackageName);
+			Remap.UnsavedLevels.RemoveAll([Level](const TWeakObjectPtr<const UPackage>& Unsaved) { return !Unsaved.IsValid() || (Unsaved.Get() == Level); });
+			bDirty = true;
+		}
+		else if(!Remap.IsUnsaved(Level))
+		{
+			Remap.UnsavedLevels.Add(Level);
+		}
+	}
+}
+
+bool FMICRepMaterialRemap::HasUnsavedSlotRemaps(const UObject* Mesh, const UPackage* Level) const
+{
+	const TArray<FSlotRemap>* Remaps = (nullptr != Mesh) ? SlotRemaps.Find(Mesh->GetPathName()) : nullptr;
+	if(nullptr == Remaps)
+	{
+		return false;
+	}
+	for(auto ItRemap = Remaps->CreateConstIterator(); ItRemap; ++ItRemap)
+	{
+		if(!(*ItRemap).AppliedLevels.Contains(Level->GetName()) && (*ItRemap).IsUnsaved(Level))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void FMICRepMaterialRemap::Load()
+{
+	const bool bLoaded = MICRepCache::Load(MaterialRemapFileName, MaterialRemapVersion, [this](FArchive& Ar)
+		{
+			Ar << OldToNew;
+			Ar << SlotRemaps;
+		});
+	if(!bLoaded)
+	{
+		OldToNew.Reset();
+		SlotRemaps.Reset();
+	}
+	bDirty = false;
+}
+
+void FMICRepMaterialRemap::Save()
+{
+	if(!bDirty)
+	{
+		return;
+	}
+	MICRepCache::Save(MaterialRemapFileName, MaterialRemapVersion, [this](FArchive& Ar)
+		{
+			Ar << OldToNew;
+			Ar << SlotRemaps;
+		});
+	bDirty = false;
+}
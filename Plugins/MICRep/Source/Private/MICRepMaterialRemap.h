@@ -0,0 +1,70 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UMaterialInterface;
+class UPackage;
+
+//
+// 置換元マテリアルから置換先MICへの対応表 <OldObjectPath, NewObjectPath> 
+//
+// メッシュの置換時に記録し、レベル上のコンポーネントのOverrideMaterialsの置換に使う. 
+// セクションの統合でメッシュのスロットを詰めた場合はその対応表も記録し、OverrideMaterialsを同じ順に並べ替える. 
+//
+class FMICRepMaterialRemap
+{
+public:
+	static FMICRepMaterialRemap& Get();
+
+	void Add(const UMaterialInterface* OldMaterial, const UMaterialInterface* NewMaterial);
+	void Add(const FString& OldObjectPath, const FString& NewObjectPath);
+
+	// 置換先（未登録、または削除済みならnullptr） 
+	UMaterialInterface* Resolve(const UMaterialInterface* OldMaterial) const;
+
+	int32 Num() const { return OldToNew.Num() + SlotRemaps.Num(); }
+
+	// スロットを詰めた時の対応表 <旧スロット, 新スロット> 
+	void AddSlotRemap(const UObject* Mesh, const TArray<int32>& OldSlotToNew);
+	void AddSlotRemap(const FString& MeshObjectPath, const TArray<int32>& OldSlotToNew);
+	// ロールバックで統合前に戻したメッシュの最後の対応表を取り除く 
+	void RemoveLastSlotRemap(const FString& MeshObjectPath);
+
+	// レベルへ未適用の対応表で OverrideMaterials を並べ替える（要素数は変えない. 変更した場合true） 
+	bool RemapOverrides(const UObject* Mesh, const UPackage* Level, TArray<UMaterialInterface*>& InOutOverrides) const;
+	// レベル内のコンポーネントをすべて並べ替えた後に記録する. 
+	// 保存したレベルは適用済みとして残し、未保存のレベルはメモリ上のパッケージが残る間だけ二重に適用しない 
+	void MarkSlotRemapsApplied(const UObject* Mesh, const UPackage* Level, bool bSaved);
+	// 並べ替えたまま保存していないレベルか 
+	bool HasUnsavedSlotRemaps(const UObject* Mesh, const UPackage* Level) const;
+
+	void Save();
+
+private:
+	FMICRepMaterialRemap();
+	void Load();
+
+	struct FSlotRemap
+	{
+		TArray<int32> OldSlotToNew;
+		// 適用済みのレベル（同じレベルへ二度適用しない） 
+		TSet<FString> AppliedLevels;
+		// 並べ替えたが未保存のレベル（保存しない） 
+		TArray<TWeakObjectPtr<const UPackage>> UnsavedLevels;
+
+		bool IsApplied(const UPackage* Level) const;
+		bool IsUnsaved(const UPackage* Level) const;
+
+		friend FArchive& operator<<(FArchive& Ar, FSlotRemap& Remap)
+		{
+			return Ar << Remap.OldSlotToNew << Remap.AppliedLevels;
+		}
+	};
+
+	TMap<FString, FString> OldToNew;
+	// <MeshObjectPath, 記録順の対応表> 
+	TMap<FString, TArray<FSlotRemap>> SlotRemaps;
+	bool bDirty;
+};
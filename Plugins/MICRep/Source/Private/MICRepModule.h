@@ -0,0 +1,95 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "ModuleManager.h"
+#include "AssetData.h"
+#include "StringAssetReference.h"
+
+struct FMICRepPlan;
+struct FMICRepApplyOptions;
+struct FMICRepMICKey;
+struct FMICRepTextureSet;
+struct FMICRepSlicedWork;
+
+
+//
+// 置換処理1回分の状態 
+//
+struct FMICRepReplaceContext
+{
+	UMaterial* BaseMat;
+	FString BaseMatSimpleName;
+
+	// 共通のテクスチャであれば統一するため、生成したMICを保存（Unify時のみ） 
+	// <FMICRepTextureSet::GetUnifyKey, MIC>
+	bool bUnify;
+	TMap<FString, FStringAssetReference> CreatedMICMap;
+
+	// 作成した遠景LOD用の簡易MIC <MICPath, Variant> 
+	TMap<FString, FStringAssetReference> LODVariantMap;
+
+	// 変更したパッケージ（ストリーミング時はチャンクごとに保存して解放） 
+	TSet<UPackage*> TouchedPackages;
+
+	TArray<FStringAssetReference>& ObjectsToSync;
+
+	explicit FMICRepReplaceContext(TArray<FStringAssetReference>& InObjectsToSync)
+		: BaseMat(nullptr)
+		, bUnify(false)
+		, ObjectsToSync(InObjectsToSync)
+	{}
+};
+
+class FMICRepModule : public IModuleInterface
+{
+public:
+	virtual void StartupModule() override;
+	virtual void ShutdownModule() override;
+
+	// 処理本体（メニュー/コマンドレット共通） 
+	static void ExecuteReplaceMaterials(const TArray<FAssetData>& SelectedAssets, TArray<FStringAssetReference>& OutObjectsToSync);
+	static bool ExecuteReplaceMaterialsUnify(const TArray<FAssetData>& SelectedAssets, TArray<FStringAssetReference>& OutObjectsToSync);
+	static bool ExecuteApplyPlan(FMICRepPlan& Plan, const FMICRepApplyOptions& Options, TArray<FStringAssetReference>& OutObjectsToSync);
+	static void ExecuteReparentMICs(UMaterialInterface* NewParent, const TArray<FAssetData>& SelectedAssets, TArray<FStringAssetReference>& OutObjectsToSync);
+	static bool ExecuteReparentDescendants(FName RootObjectPath, UMaterialInterface* NewParent, TArray<FStringAssetReference>& OutObjectsToSync);
+
+	static int32 SavePackages(const TArray<UPackage*>& Packages);
+
+	// 生成アセットの命名/配置規則（プランナーと共通） 
+	static void GetBaseMaterialLocation(const FString& BaseMatSimpleName, const FString& TargetPathName, FString& OutName, FString& OutPackagePath, FString& OutScopeKey);
+	static FString GetMICName(const FString& BaseMaterialSimpleName, const FString& OldMaterialName);
+
+private:
+	static TSharedRef<FExtender> OnExtendContentBrowserAssetSelectionMenu(const TArray<FAssetData>& SelectedAssets);
+	static void CreateAssetMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets);
+	static void CreateReparentSubMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets);
+	static void CreateReparentSubSubMenu(FMenuBuilder& MenuBuilder, TArray<FAssetData> SelectedAssets);
+	static void CreateReparentDescendantsSubMenu(FMenuBuilder& MenuBuilder, FAssetData RootAssetData);
+
+	static void ReplaceMaterials(TArray<FAssetData> SelectedAssets);
+	static void ReplaceMaterialsUnify(TArray<FAssetData> SelectedAssets);
+	static void StartSlicedReplace(const TArray<FAssetData>& SelectedAssets, bool bUnify);
+	static bool MakeReplaceWork(const TArray<FAssetData>& SelectedAssets, bool bUnify, FMICRepReplaceContext& Context, FMICRepSlicedWork& OutWork);
+	static void MakeMeshWork(const TArray<FAssetData>& SelectedAssets, FMICRepReplaceContext& Context, TFunction<void(UObject*)> ProcessMesh, FMICRepSlicedWork& OutWork);
+	static void FlushChunk(FMICRepReplaceContext& Context, const TArray<UPackage*>& LoadedPackages);
+	static void ReplaceMeshMaterials(UObject* TargetAsset, FMICRepReplaceContext& Context);
+	static UMaterialInterface* ConvertSlotMaterial(UMaterialInterface* Material, const FString& TargetPathName, FMICRepReplaceContext& Context, bool bReconvert, TArray<FString>& OutSourceMaterials);
+	static UMaterialInterface* RefreshMIC(UMaterialInstanceConstant* MIC, const FString& SourcePath, FMICRepReplaceContext& Context);
+	static bool HasUnconvertedMaterials(UObject* TargetAsset);
+	static UMaterialInterface* GetReplacementMIC(UMaterialInterface* OldMaterial, const FString& TargetPathName, FMICRepReplaceContext& Context);
+	static UMaterial* ResolveBaseMaterial(UMaterial* BaseMatOriginal, const FString& BaseMatSimpleName, const FString& TargetPathName);
+	static UMaterialInterface* GetBaseVariant(UMaterialInterface* BaseMaterial, const TArray<FName>& DisabledSwitches);
+	static UMaterialInterface* CreateMIC(UMaterialInterface* BaseMaterial, FString BaseMaterialSimpleName, UMaterialInterface* OldMaterial, FString TargetPathName);
+	static void SetMICParameters(UMaterialInstanceConstant* MIC, const FMICRepTextureSet& TextureSet, const FMICRepMICKey& MICKey);
+	static UMaterialInterface* CreateMICWithTextures(UMaterialInterface* BaseMaterial, const FString& NewMICName, const FString& TargetPathName, const FMICRepTextureSet& TextureSet, UMaterialInterface* SourceMaterial = nullptr, bool bLODVariant = false);
+	static UMaterialInterface* GetLODVariantMIC(UMaterialInterface* Material, FMICRepReplaceContext& Context);
+	static void ReparentMICs(const FAssetData& NewParentAssetData, TArray<FAssetData> SelectedAssets);
+	static void ReparentDescendants(const FAssetData& NewParentAssetData, FAssetData RootAssetData);
+	static bool GatherDescendantsToReparent(FName RootObjectPath, UMaterialInterface* NewParent, TArray<FAssetData>& OutInstances, int32& OutNumToReparent);
+	static void RollbackSelected(TArray<FAssetData> SelectedAssets);
+	// 先頭の NumToReparent 個の親を変更し、残りは再コンパイルのみ 
+	static void MakeReparentWork(UMaterialInterface* NewParent, const TArray<FAssetData>& SelectedAssets, int32 NumToReparent, TArray<FStringAssetReference>& ObjectsToSync, FMICRepSlicedWork& OutWork);
+	static void SaveCaches();
+	static void SyncBrowserToObjects(const TArray<FStringAssetReference>& ObjectsToSync);
+};
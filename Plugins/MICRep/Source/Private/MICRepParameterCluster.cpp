@@ -0,0 +1,209 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepParameterCluster.h"
+#include "MICRepCache.h"
+#include "MICRepMICIndex.h"
+#include "MICRepStats.h"
+
+
+namespace
+{
+	const TCHAR* ParameterClustersFileName = TEXT("ParameterClusters.bin");
+	const int32 ParameterClustersVersion = 1;
+
+	// FName は名前テーブルを持たないアーカイブでは保存できないため文字列で書き出す 
+	template<typename ValueType>
+	void SerializeParameters(FArchive& Ar, TArray<TPair<FName, ValueType>>& Params)
+	{
+		int32 NumParams = Params.Num();
+		Ar << NumParams;
+		if(Ar.IsLoading())
+		{
+			Params.Reset(NumParams);
+			Params.AddDefaulted(NumParams);
+		}
+		for(auto ItParam = Params.CreateIterator(); ItParam; ++ItParam)
+		{
+			FString Name = (*ItParam).Key.ToString();
+			Ar << Name;
+			Ar << (*ItParam).Value;
+			if(Ar.IsLoading())
+			{
+				(*ItParam).Key = FName(*Name);
+			}
+		}
+	}
+
+	template<typename ValueType>
+	void SortByName(TArray<TPair<FName, ValueType>>& Params)
+	{
+		Params.Sort([](const TPair<FName, ValueType>& A, const TPair<FName, ValueType>& B)
+			{ return A.Key.Compare(B.Key) < 0; });
+	}
+}
+
+
+FMICRepParameterClusters& FMICRepParameterClusters::Get()
+{
+	static FMICRepParameterClusters Instance;
+	return Instance;
+}
+
+FMICRepParameterClusters::FMICRepParameterClusters()
+	: bDirty(false)
+{
+	Load();
+}
+
+void FMICRepParameterClusters::GatherParameters(UMaterialInterface* SourceMaterial, UMaterialInterface* NewParent, FMICRepMICKey& OutKey)
+{
+	UMaterial* ParentMaterial = (nullptr != NewParent) ? NewParent->GetMaterial() : nullptr;
+	if((nullptr == SourceMaterial) || (nullptr == ParentMaterial))
+	{
+		return;
+	}
+
+	// 元マテリアルに同名のパラメータがあれば値を引き継ぐ（親チェーンの既定値を含む） 
+	TArray<FName> ParameterNames;
+	TArray<FGuid> ParameterIds;
+	ParentMaterial->GetAllScalarParameterNames(ParameterNames, ParameterIds);
+	for(auto ItName = ParameterNames.CreateConstIterator(); ItName; ++ItName)
+	{
+		float Value = 0.0f;
+		if(SourceMaterial->GetScalarParameterValue(*ItName, Value))
+		{
+			OutKey.Scalars.Add(TPair<FName, float>(*ItName, Value));
+		}
+	}
+
+	ParameterNames.Reset();
+	ParameterIds.Reset();
+	ParentMaterial->GetAllVectorParameterNames(ParameterNames, ParameterIds);
+	for(auto ItName = ParameterNames.CreateConstIterator(); ItName; ++ItName)
+	{
+		FLinearColor Value;
+		if(SourceMaterial->GetVectorParameterValue(*ItName, Value))
+		{
+			OutKey.Vectors.Add(TPair<FName, FLinearColor>(*ItName, Value));
+		}
+	}
+}
+
+bool FMICRepParameterClusters::Snap(FMICRepMICKey& Key, float Tolerance)
+{
+	SortByName(Key.Scalars);
+	SortByName(Key.Vectors);
+
+	// パラメータを除いたキーでグループ分け 
+	FMICRepMICKey GroupKey = Key;
+	GroupKey.Scalars.Reset();
+	GroupKey.Vectors.Reset();
+	TArray<FMICRepMICKey>& Representatives = Groups.FindOrAdd(GroupKey.GetHash());
+
+	MICREP_INC_COUNTER(ClusterCandidates, 1);
+	for(auto ItRep = Representatives.CreateConstIterator(); ItRep; ++ItRep)
+	{
+		if(IsWithinTolerance(*ItRep, Key, Tolerance))
+		{
+			Key.Scalars = (*ItRep).Scalars;
+			Key.Vectors = (*ItRep).Vectors;
+			MICREP_INC_COUNTER(ClusteredMICs, 1);
+			return true;
+		}
+	}
+
+	Representatives.Add(Key);
+	bDirty = true;
+	return false;
+}
+
+bool FMICRepParameterClusters::IsWithinTolerance(const FMICRepMICKey& A, const FMICRepMICKey& B, float Tolerance)
+{
+	// 名前順にソート済み、パラメータの種類が異なるものはまとめない 
+	if((A.Scalars.Num() != B.Scalars.Num()) || (A.Vectors.Num() != B.Vectors.Num()))
+	{
+		return false;
+	}
+	for(int32 Idx = 0; Idx < A.Scalars.Num(); ++Idx)
+	{
+		if((A.Scalars[Idx].Key != B.Scalars[Idx].Key) ||
+			(Tolerance < FMath::Abs(A.Scalars[Idx].Value - B.Scalars[Idx].Value)))
+		{
+			return false;
+		}
+	}
+	for(int32 Idx = 0; Idx < A.Vectors.Num(); ++Idx)
+	{
+		if((A.Vectors[Idx].Key != B.Vectors[Idx].Key) ||
+			!A.Vectors[Idx].Value.Equals(B.Vectors[Idx].Value, Tolerance))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FMICRepParameterClusters::Serialize(FArchive& Ar)
+{
+	// 代表はグループのハッシュとパラメータのみ保持する 
+	int32 NumGroups = Groups.Num();
+	Ar << NumGroups;
+	if(Ar.IsLoading())
+	{
+		Groups.Reset();
+		for(int32 GroupIdx = 0; (GroupIdx < NumGroups) && !Ar.IsError(); ++GroupIdx)
+		{
+			FSHAHash Hash;
+			int32 NumRepresentatives = 0;
+			Ar << Hash;
+			Ar << NumRepresentatives;
+			TArray<FMICRepMICKey>& Representatives = Groups.Add(Hash);
+			Representatives.SetNum(NumRepresentatives);
+			for(auto ItRep = Representatives.CreateIterator(); ItRep; ++ItRep)
+			{
+				SerializeParameters(Ar, (*ItRep).Scalars);
+				SerializeParameters(Ar, (*ItRep).Vectors);
+			}
+		}
+		return;
+	}
+	for(auto ItGroup = Groups.CreateIterator(); ItGroup; ++ItGroup)
+	{
+		FSHAHash Hash = ItGroup.Key();
+		int32 NumRepresentatives = ItGroup.Value().Num();
+		Ar << Hash;
+		Ar << NumRepresentatives;
+		for(auto ItRep = ItGroup.Value().CreateIterator(); ItRep; ++ItRep)
+		{
+			SerializeParameters(Ar, (*ItRep).Scalars);
+			SerializeParameters(Ar, (*ItRep).Vectors);
+		}
+	}
+}
+
+void FMICRepParameterClusters::Load()
+{
+	const bool bLoaded = MICRepCache::Load(ParameterClustersFileName, ParameterClustersVersion, [this](FArchive& Ar)
+		{
+			Serialize(Ar);
+		});
+	if(!bLoaded)
+	{
+		Groups.Reset();
+	}
+	bDirty = false;
+}
+
+void FMICRepParameterClusters::Save()
+{
+	if(!bDirty)
+	{
+		return;
+	}
+	MICRepCache::Save(ParameterClustersFileName, ParameterClustersVersion, [this](FArchive& Ar)
+		{
+			Serialize(Ar);
+		});
+	bDirty = false;
+}
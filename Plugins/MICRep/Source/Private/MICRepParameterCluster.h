@@ -0,0 +1,41 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SecureHash.h"
+
+struct FMICRepMICKey;
+class UMaterialInterface;
+
+//
+// 親とテクスチャが同じで、スカラー/ベクターパラメータの差が許容範囲内のMICを1つにまとめる 
+//
+// グループ（親＋テクスチャ）ごとに代表のパラメータを保持し、許容範囲内の候補は代表の値に置き換える. 
+// 置き換え後のキーは代表と一致するため、重複排除インデックスで同じMICが再利用される. 
+// 代表は Saved/MICRep に保存し、次回以降の実行でも同じ代表へまとめる. 
+//
+class FMICRepParameterClusters
+{
+public:
+	static FMICRepParameterClusters& Get();
+
+	// 新しい親が公開しているパラメータについて、元マテリアルでの値をキーへ追加 
+	static void GatherParameters(UMaterialInterface* SourceMaterial, UMaterialInterface* NewParent, FMICRepMICKey& OutKey);
+
+	// 許容範囲内の代表があればその値へ置き換えてtrue、無ければ新しい代表として登録 
+	bool Snap(FMICRepMICKey& Key, float Tolerance);
+
+	void Save();
+
+private:
+	FMICRepParameterClusters();
+	void Load();
+	void Serialize(FArchive& Ar);
+
+	static bool IsWithinTolerance(const FMICRepMICKey& A, const FMICRepMICKey& B, float Tolerance);
+
+	// <親とテクスチャのハッシュ, 代表> 
+	TMap<FSHAHash, TArray<FMICRepMICKey>> Groups;
+	bool bDirty;
+};
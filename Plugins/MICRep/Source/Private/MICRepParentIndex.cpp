@@ -0,0 +1,501 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepParentIndex.h"
+#include "MICRepCache.h"
+#include "MICRepSettings.h"
+#include "AssetRegistryModule.h"
+#include "PackageTools.h"
+
+
+namespace
+{
+	const TCHAR* ParentIndexFileName = TEXT("ParentIndex.bin");
+	const int32 ParentIndexVersion = 2;
+
+	const int32 MaxRecent = 10;
+
+	// 全件判定時にまとめてアンロードするパッケージ数 
+	const int32 UnloadBatchSize = 100;
+
+	// Pattern の各文字が順に現れればマッチ（間が空くほどスコアが下がる） 
+	bool FuzzyMatch(const FString& Pattern, const FString& Name, int32& OutScore)
+	{
+		int32 NameIdx = 0;
+		int32 Gaps = 0;
+		for(int32 PatternIdx = 0; PatternIdx < Pattern.Len(); ++PatternIdx)
+		{
+			const int32 Start = NameIdx;
+			while((NameIdx < Name.Len()) && (Name[NameIdx] != Pattern[PatternIdx]))
+			{
+				NameIdx++;
+			}
+			if(Name.Len() <= NameIdx)
+			{
+				return false;
+			}
+			Gaps += NameIdx - Start;
+			NameIdx++;
+		}
+		OutScore = Gaps;
+		return true;
+	}
+}
+
+
+FMICRepParentIndex& FMICRepParentIndex::Get()
+{
+	static FMICRepParentIndex Instance;
+	return Instance;
+}
+
+FMICRepParentIndex::FMICRepParentIndex()
+	: bCandidatesDirty(true)
+	, bRefreshed(false)
+	, bDirty(false)
+	, bEventsRegistered(false)
+{
+	Load();
+	RegisterEvents();
+}
+
+void FMICRepParentIndex::RegisterEvents()
+{
+	if(IsRunningCommandlet() || GIsRequestingExit)
+	{
+		return;
+	}
+	bEventsRegistered = true;
+
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	AssetRegistryModule.Get().OnAssetAdded().AddRaw(this, &FMICRepParentIndex::OnAssetAdded);
+	AssetRegistryModule.Get().OnAssetRemoved().AddRaw(this, &FMICRepParentIndex::OnAssetRemoved);
+	AssetRegistryModule.Get().OnAssetRenamed().AddRaw(this, &FMICRepParentIndex::OnAssetRenamed);
+	UPackage::PackageSavedEvent.AddRaw(this, &FMICRepParentIndex::OnPackageSaved);
+
+	TickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FMICRepParentIndex::OnTick), 0.5f);
+}
+
+void FMICRepParentIndex::UnregisterEvents()
+{
+	if(!bEventsRegistered)
+	{
+		return;
+	}
+	bEventsRegistered = false;
+
+	FTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+	UPackage::PackageSavedEvent.RemoveAll(this);
+
+	FAssetRegistryModule* AssetRegistryModule = FModuleManager::GetModulePtr<FAssetRegistryModule>("AssetRegistry");
+	if(nullptr != AssetRegistryModule)
+	{
+		AssetRegistryModule->Get().OnAssetAdded().RemoveAll(this);
+		AssetRegistryModule->Get().OnAssetRemoved().RemoveAll(this);
+		AssetRegistryModule->Get().OnAssetRenamed().RemoveAll(this);
+	}
+}
+
+void FMICRepParentIndex::Refresh(double MaxSeconds)
+{
+	// ルールのパラメータが変わった場合は判定結果を使わない 
+	const FString ParametersKey = GetRequiredParametersKey(GetRequiredParameters());
+	if(ParametersKey != RequiredParametersKey)
+	{
+		RequiredParametersKey = ParametersKey;
+		for(auto ItEntry = Entries.CreateIterator(); ItEntry; ++ItEntry)
+		{
+			// 判定し直す前に保存されても次回の起動時に判定し直す 
+			ItEntry.Value().TimeStamp = FDateTime::MinValue();
+			Pending.Add(ItEntry.Key());
+		}
+		bDirty = true;
+	}
+
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	if(!bRefreshed && !AssetRegistryModule.Get().IsLoadingAssets())
+	{
+		bRefreshed = true;
+
+		// インスタンスは対象外. 更新日時はファイルの確認が必要なため後で少しずつ確認する 
+		TArray<FAssetData> Materials;
+		AssetRegistryModule.Get().GetAssetsByClass(UMaterial::StaticClass()->GetFName(), Materials, false);
+
+		TSet<FString> Existing;
+		for(auto ItMaterial = Materials.CreateConstIterator(); ItMaterial; ++ItMaterial)
+		{
+			const FString ObjectPath = (*ItMaterial).ObjectPath.ToString();
+			Existing.Add(ObjectPath);
+			Unrefreshed.Add(ObjectPath, (*ItMaterial).PackageName.ToString());
+		}
+
+		// 削除されたもの 
+		TArray<FString> Removed;
+		for(auto ItEntry = Entries.CreateConstIterator(); ItEntry; ++ItEntry)
+		{
+			if(!Existing.Contains(ItEntry.Key()))
+			{
+				Removed.Add(ItEntry.Key());
+			}
+		}
+		for(auto ItRemoved = Removed.CreateConstIterator(); ItRemoved; ++ItRemoved)
+		{
+			Remove(*ItRemoved);
+		}
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	while(0 < Unrefreshed.Num())
+	{
+		auto ItUnrefreshed = Unrefreshed.CreateIterator();
+		const FString ObjectPath = ItUnrefreshed.Key();
+		const FString PackageName = ItUnrefreshed.Value();
+		ItUnrefreshed.RemoveCurrent();
+
+		const FEntry* Entry = Entries.Find(ObjectPath);
+		if((nullptr == Entry) || (Entry->TimeStamp != GetPackageTimeStamp(PackageName)))
+		{
+			Pending.Add(ObjectPath);
+		}
+
+		if((0.0 < MaxSeconds) && (MaxSeconds <= (FPlatformTime::Seconds() - StartTime)))
+		{
+			break;
+		}
+	}
+}
+
+int32 FMICRepParentIndex::ProcessPending(double MaxSeconds, bool bAllowLoad)
+{
+	// 判定のためにロードしたパッケージ（テクスチャなどの依存先を含む） 
+	TArray<UPackage*> LoadedPackages;
+	auto UnloadLoadedPackages = [&LoadedPackages]()
+	{
+		if(0 < LoadedPackages.Num())
+		{
+			FText ErrorMessage;
+			if(!PackageTools::UnloadPackages(LoadedPackages, ErrorMessage))
+			{
+				UE_LOG(LogMICRep, Warning, TEXT("%s"), *ErrorMessage.ToString());
+			}
+			LoadedPackages.Reset();
+		}
+	};
+
+	const TArray<FName> RequiredParameters = GetRequiredParameters();
+	const double StartTime = FPlatformTime::Seconds();
+	int32 NumProcessed = 0;
+	while(0 < Pending.Num())
+	{
+		auto ItPending = Pending.CreateIterator();
+		const FString ObjectPath = *ItPending;
+		ItPending.RemoveCurrent();
+
+		UMaterial* Material = FindObject<UMaterial>(nullptr, *ObjectPath);
+		if((nullptr == Material) && bAllowLoad)
+		{
+			// 新たにロードされた依存パッケージも後でアンロードする 
+			TSet<FName> WasLoaded;
+			TArray<FName> Dependencies;
+			const FName PackageName(*FPackageName::ObjectPathToPackageName(ObjectPath));
+			FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get().GetDependencies(PackageName, Dependencies, EAssetRegistryDependencyType::Hard);
+			Dependencies.Add(PackageName);
+			for(auto ItDependency = Dependencies.CreateConstIterator(); ItDependency; ++ItDependency)
+			{
+				if(nullptr != FindPackage(nullptr, *(*ItDependency).ToString()))
+				{
+					WasLoaded.Add(*ItDependency);
+				}
+			}
+
+			Material = LoadObject<UMaterial>(nullptr, *ObjectPath, nullptr, LOAD_NoWarn);
+			if(nullptr == Material)
+			{
+				Remove(ObjectPath);
+			}
+			for(auto ItDependency = Dependencies.CreateConstIterator(); ItDependency; ++ItDependency)
+			{
+				UPackage* Package = WasLoaded.Contains(*ItDependency) ? nullptr : FindPackage(nullptr, *(*ItDependency).ToString());
+				if(nullptr != Package)
+				{
+					LoadedPackages.AddUnique(Package);
+				}
+			}
+		}
+		else if(nullptr == Material)
+		{
+			// エディタではロードしない（保存時やreindexで判定する） 
+			if(!Unchecked.Contains(ObjectPath))
+			{
+				Unchecked.Add(ObjectPath);
+				bCandidatesDirty = true;
+			}
+			continue;
+		}
+
+		if(nullptr != Material)
+		{
+			FEntry& Entry = Entries.FindOrAdd(ObjectPath);
+			Entry.TimeStamp = GetPackageTimeStamp(Material->GetOutermost()->GetName());
+			Entry.bCandidate = HasRequiredParameters(Material, RequiredParameters);
+			Unchecked.Remove(ObjectPath);
+			bCandidatesDirty = true;
+			bDirty = true;
+		}
+		NumProcessed++;
+
+		if(UnloadBatchSize <= LoadedPackages.Num())
+		{
+			UnloadLoadedPackages();
+		}
+		if((0.0 < MaxSeconds) && (MaxSeconds <= (FPlatformTime::Seconds() - StartTime)))
+		{
+			break;
+		}
+	}
+	UnloadLoadedPackages();
+	return NumProcessed;
+}
+
+void FMICRepParentIndex::Search(const FString& Query, int32 MaxResults, TArray<FString>& OutObjectPaths) const
+{
+	const_cast<FMICRepParentIndex*>(this)->RebuildCandidates();
+
+	OutObjectPaths.Reset();
+	const FString Pattern = Query.Trim().TrimTrailing().ToLower();
+	if(Pattern.IsEmpty())
+	{
+		for(int32 Idx = 0; (Idx < Candidates.Num()) && (OutObjectPaths.Num() < MaxResults); ++Idx)
+		{
+			OutObjectPaths.Add(Candidates[Idx].Key);
+		}
+		return;
+	}
+
+	// <Score, Index>（小さいほど上位） 
+	TArray<TPair<int32, int32>> Matches;
+	for(int32 Idx = 0; Idx < Candidates.Num(); ++Idx)
+	{
+		const FString& Name = Candidates[Idx].Value;
+		int32 Score = 0;
+		if(Name.StartsWith(Pattern))
+		{
+			Score = 0;
+		}
+		else if(Name.Contains(Pattern))
+		{
+			Score = 1;
+		}
+		else if(FuzzyMatch(Pattern, Name, Score))
+		{
+			Score += 2;
+		}
+		else
+		{
+			continue;
+		}
+		Matches.Add(TPair<int32, int32>(Score, Idx));
+	}
+	Matches.StableSort([](const TPair<int32, int32>& A, const TPair<int32, int32>& B) { return A.Key < B.Key; });
+
+	for(int32 Idx = 0; (Idx < Matches.Num()) && (OutObjectPaths.Num() < MaxResults); ++Idx)
+	{
+		OutObjectPaths.Add(Candidates[Matches[Idx].Value].Key);
+	}
+}
+
+void FMICRepParentIndex::AddRecent(const FString& ObjectPath)
+{
+	Recent.Remove(ObjectPath);
+	Recent.Insert(ObjectPath, 0);
+	if(MaxRecent < Recent.Num())
+	{
+		Recent.SetNum(MaxRecent);
+	}
+	bDirty = true;
+}
+
+void FMICRepParentIndex::OnAssetAdded(const FAssetData& AssetData)
+{
+	if(AssetData.AssetClass == UMaterial::StaticClass()->GetFName())
+	{
+		Pending.Add(AssetData.ObjectPath.ToString());
+	}
+}
+
+void FMICRepParentIndex::OnAssetRemoved(const FAssetData& AssetData)
+{
+	if(AssetData.AssetClass == UMaterial::StaticClass()->GetFName())
+	{
+		Remove(AssetData.ObjectPath.ToString());
+	}
+}
+
+void FMICRepParentIndex::OnAssetRenamed(const FAssetData& AssetData, const FString& OldObjectPath)
+{
+	if(AssetData.AssetClass == UMaterial::StaticClass()->GetFName())
+	{
+		Remove(OldObjectPath);
+		Pending.Add(AssetData.ObjectPath.ToString());
+	}
+}
+
+void FMICRepParentIndex::OnPackageSaved(const FString& PackageFileName, UObject* Outer)
+{
+	// 保存されたマテリアルはパラメータが変わっている可能性がある 
+	UPackage* Package = Cast<UPackage>(Outer);
+	if(nullptr == Package)
+	{
+		return;
+	}
+	TArray<UObject*> Objects;
+	GetObjectsWithOuter(Package, Objects, false);
+	for(auto ItObject = Objects.CreateConstIterator(); ItObject; ++ItObject)
+	{
+		if(UMaterial::StaticClass() == (*ItObject)->GetClass())
+		{
+			Pending.Add((*ItObject)->GetPathName());
+		}
+	}
+}
+
+bool FMICRepParentIndex::OnTick(float DeltaTime)
+{
+	// 更新日時の確認と判定で1回分の時間を分け合う 
+	const double Budget = GetDefault<UMICRepSettings>()->SliceBudgetMilliseconds / 1000.0;
+	const double StartTime = FPlatformTime::Seconds();
+	Refresh(Budget);
+	const double Remaining = Budget - (FPlatformTime::Seconds() - StartTime);
+	if((0 < Pending.Num()) && (0.0 < Remaining))
+	{
+		ProcessPending(Remaining, false);
+	}
+	return true;
+}
+
+void FMICRepParentIndex::Remove(const FString& ObjectPath)
+{
+	Unrefreshed.Remove(ObjectPath);
+	Pending.Remove(ObjectPath);
+	if(0 < Unchecked.Remove(ObjectPath))
+	{
+		bCandidatesDirty = true;
+	}
+	if(0 < Entries.Remove(ObjectPath))
+	{
+		bCandidatesDirty = true;
+		bDirty = true;
+	}
+	if(0 < Recent.Remove(ObjectPath))
+	{
+		bDirty = true;
+	}
+}
+
+void FMICRepParentIndex::RebuildCandidates()
+{
+	if(!bCandidatesDirty)
+	{
+		return;
+	}
+	bCandidatesDirty = false;
+
+	Candidates.Reset();
+	for(auto ItEntry = Entries.CreateConstIterator(); ItEntry; ++ItEntry)
+	{
+		if(ItEntry.Value().bCandidate && !Unchecked.Contains(ItEntry.Key()))
+		{
+			Candidates.Add(TPair<FString, FString>(ItEntry.Key(), FPackageName::ObjectPathToObjectName(ItEntry.Key()).ToLower()));
+		}
+	}
+	// 未確認のものは除外できないため候補に含める 
+	for(auto ItUnchecked = Unchecked.CreateConstIterator(); ItUnchecked; ++ItUnchecked)
+	{
+		Candidates.Add(TPair<FString, FString>(*ItUnchecked, FPackageName::ObjectPathToObjectName(*ItUnchecked).ToLower()));
+	}
+	Candidates.Sort([](const TPair<FString, FString>& A, const TPair<FString, FString>& B) { return A.Value < B.Value; });
+}
+
+TArray<FName> FMICRepParentIndex::GetRequiredParameters()
+{
+	// ReparentMICs の対象（MICRepで作成したMIC）が使うパラメータ 
+	TArray<FName> Parameters;
+	const TArray<FMICRepTextureRule>& Rules = GetDefault<UMICRepSettings>()->TextureRules;
+	for(auto ItRule = Rules.CreateConstIterator(); ItRule; ++ItRule)
+	{
+		if(NAME_None != (*ItRule).ParameterName)
+		{
+			Parameters.AddUnique((*ItRule).ParameterName);
+		}
+	}
+	Parameters.Sort([](const FName& A, const FName& B) { return A.ToString() < B.ToString(); });
+	return Parameters;
+}
+
+FString FMICRepParentIndex::GetRequiredParametersKey(const TArray<FName>& Parameters)
+{
+	FString Key;
+	for(auto ItParameter = Parameters.CreateConstIterator(); ItParameter; ++ItParameter)
+	{
+		Key += (*ItParameter).ToString() + TEXT(";");
+	}
+	return Key;
+}
+
+bool FMICRepParentIndex::HasRequiredParameters(UMaterial* Material, const TArray<FName>& Parameters)
+{
+	TArray<FName> ParameterNames;
+	TArray<FGuid> ParameterIds;
+	Material->GetAllTextureParameterNames(ParameterNames, ParameterIds);
+	for(auto ItParameter = Parameters.CreateConstIterator(); ItParameter; ++ItParameter)
+	{
+		if(!ParameterNames.Contains(*ItParameter))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+FDateTime FMICRepParentIndex::GetPackageTimeStamp(const FString& PackageName)
+{
+	FString FileName;
+	if(!FPackageName::DoesPackageExist(PackageName, nullptr, &FileName))
+	{
+		return FDateTime::MinValue();
+	}
+	return IFileManager::Get().GetTimeStamp(*FileName);
+}
+
+void FMICRepParentIndex::Load()
+{
+	const bool bLoaded = MICRepCache::Load(ParentIndexFileName, ParentIndexVersion, [this](FArchive& Ar)
+		{
+			Ar << Entries;
+			Ar << Recent;
+			Ar << RequiredParametersKey;
+		});
+	if(!bLoaded)
+	{
+		Entries.Reset();
+		Recent.Reset();
+		RequiredParametersKey.Empty();
+	}
+	bCandidatesDirty = true;
+	bDirty = false;
+}
+
+void FMICRepParentIndex::Save()
+{
+	if(!bDirty)
+	{
+		return;
+	}
+	MICRepCache::Save(ParentIndexFileName, ParentIndexVersion, [this](FArchive& Ar)
+		{
+			Ar << Entries;
+			Ar << Recent;
+			Ar << RequiredParametersKey;
+		});
+	bDirty = false;
+}
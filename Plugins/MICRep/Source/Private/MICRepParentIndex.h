@@ -0,0 +1,94 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+#include "Containers/Ticker.h"
+
+//
+// Reparentメニューの親マテリアル候補のインデックス 
+//
+// UMICRepSettings::TextureRules のテクスチャパラメータをすべて持つUMaterial（インスタンスは除く）のみを対象にする. 
+// 判定結果はパッケージの更新日時とともに Saved/MICRep に保存し、アセットレジストリと保存のイベントで差分のみ更新する. 
+// ルールのパラメータが変わった場合は全件を判定し直す. 
+// エディタではパッケージの更新日時の確認とロード済みのマテリアルの判定をTickごとに時間を区切って行い、 
+// ロードされていないものは未確認の候補として扱う. 
+// 全件の判定はコマンドレットの reindex で行う（チャンクごとにアンロードする）. 
+//
+class FMICRepParentIndex
+{
+public:
+	static FMICRepParentIndex& Get();
+
+	// レジストリとの差分を取り、更新されたマテリアルを判定待ちに登録（初回のみ全件を確認. MaxSeconds <= 0 で残りをすべて確認） 
+	void Refresh(double MaxSeconds = 0.0);
+	// 未判定のマテリアルを判定（MaxSeconds <= 0 で全件. bAllowLoad でなければロード済みのもののみ） 
+	int32 ProcessPending(double MaxSeconds, bool bAllowLoad);
+	int32 GetNumPending() const { return Pending.Num() + Unrefreshed.Num(); }
+	int32 GetNumUnchecked() const { return Unchecked.Num(); }
+
+	// モジュール終了時にイベントの登録を解除 
+	void UnregisterEvents();
+
+	// 名前で検索（前方一致、部分一致、あいまい一致の順） 
+	void Search(const FString& Query, int32 MaxResults, TArray<FString>& OutObjectPaths) const;
+
+	// 最近使った親 
+	const TArray<FString>& GetRecent() const { return Recent; }
+	void AddRecent(const FString& ObjectPath);
+
+	void Save();
+
+private:
+	struct FEntry
+	{
+		FDateTime TimeStamp;
+		bool bCandidate;
+
+		FEntry() : bCandidate(false) {}
+
+		friend FArchive& operator<<(FArchive& Ar, FEntry& Entry)
+		{
+			return Ar << Entry.TimeStamp << Entry.bCandidate;
+		}
+	};
+
+	FMICRepParentIndex();
+	void Load();
+	void RegisterEvents();
+
+	void OnAssetAdded(const FAssetData& AssetData);
+	void OnAssetRemoved(const FAssetData& AssetData);
+	void OnAssetRenamed(const FAssetData& AssetData, const FString& OldObjectPath);
+	void OnPackageSaved(const FString& PackageFileName, UObject* Outer);
+	bool OnTick(float DeltaTime);
+
+	void Remove(const FString& ObjectPath);
+	void RebuildCandidates();
+	static TArray<FName> GetRequiredParameters();
+	static FString GetRequiredParametersKey(const TArray<FName>& Parameters);
+	static bool HasRequiredParameters(UMaterial* Material, const TArray<FName>& Parameters);
+	static FDateTime GetPackageTimeStamp(const FString& PackageName);
+
+	// <ObjectPath, Entry>
+	TMap<FString, FEntry> Entries;
+	// 判定に使ったパラメータ（名前順に連結） 
+	FString RequiredParametersKey;
+	// 更新日時の確認待ち <ObjectPath, PackageName> 
+	TMap<FString, FString> Unrefreshed;
+	// 判定待ち 
+	TSet<FString> Pending;
+	// ロードされていないため判定を保留したもの（候補として表示する） 
+	TSet<FString> Unchecked;
+	TArray<FString> Recent;
+
+	// 検索用 <ObjectPath, 小文字のアセット名>（名前順） 
+	TArray<TPair<FString, FString>> Candidates;
+	bool bCandidatesDirty;
+
+	bool bRefreshed;
+	bool bDirty;
+	bool bEventsRegistered;
+	FDelegateHandle TickerHandle;
+};
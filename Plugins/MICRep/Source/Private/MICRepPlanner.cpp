@@ -0,0 +1,384 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepPlanner.h"
+#include "MICRepModule.h"
+#include "MICRepMaterialAnalysis.h"
+#include "MICRepTextureHash.h"
+#include "MICRepTextureRules.h"
+#include "AssetRegistryModule.h"
+#include "JsonObjectConverter.h"
+
+
+void FMICRepPlanner::BuildPlan(const TArray<FAssetData>& MeshAssets, bool bUnify, FMICRepPlan& OutPlan)
+{
+	OutPlan = FMICRepPlan();
+	OutPlan.Version = PlanVersion;
+	OutPlan.Mode = bUnify ? TEXT("unify") : TEXT("replace");
+
+	// <BaseObjectPath, Index>
+	TMap<FString, int32> BaseIndices;
+	// <Base|Textures, Index>（MIC重複排除インデックスと同じ粒度） 
+	TMap<FString, int32> InstanceIndices;
+	// <MaterialPath, <EMaterialProperty, TexturePath>>
+	TMap<FString, TMap<int32, FString>> MaterialTextures;
+
+	// Unify時は最初のメッシュからベースを決める 
+	FString UnifySimpleName;
+	FString UnifyTargetPathName;
+
+	for(auto ItMesh = MeshAssets.CreateConstIterator(); ItMesh; ++ItMesh)
+	{
+		const FAssetData& MeshAsset = *ItMesh;
+
+		FString SimpleName = MeshAsset.AssetName.ToString().Replace(TEXT("SM_"), TEXT(""), ESearchCase::CaseSensitive);
+		FString TargetPathName = MeshAsset.PackagePath.ToString();
+		if(bUnify)
+		{
+			if(UnifySimpleName.IsEmpty())
+			{
+				UnifySimpleName = SimpleName;
+				UnifyTargetPathName = TargetPathName;
+			}
+		}
+
+		// ベースマテリアル 
+		int32 BaseIndex = INDEX_NONE;
+		{
+			const FString& BaseSimpleName = bUnify ? UnifySimpleName : SimpleName;
+			const FString& BaseTargetPathName = bUnify ? UnifyTargetPathName : TargetPathName;
+
+			FString BaseName;
+			FString BasePackagePath;
+			FString ScopeKey;
+			FMICRepModule::GetBaseMaterialLocation(BaseSimpleName, BaseTargetPathName, BaseName, BasePackagePath, ScopeKey);
+			const FString BaseObjectPath = FString::Printf(TEXT("%s/%s.%s"), *BasePackagePath, *BaseName, *BaseName);
+
+			const int32* FoundIndex = BaseIndices.Find(BaseObjectPath);
+			if(nullptr != FoundIndex)
+			{
+				BaseIndex = *FoundIndex;
+			}
+			else
+			{
+				FMICRepPlannedBase PlannedBase;
+				PlannedBase.SimpleName = BaseSimpleName;
+				PlannedBase.TargetPathName = BaseTargetPathName;
+				PlannedBase.ObjectPath = BaseObjectPath;
+				BaseIndex = OutPlan.BaseMaterials.Add(PlannedBase);
+				BaseIndices.Add(BaseObjectPath, BaseIndex);
+			}
+		}
+
+		FMICRepPlannedMesh PlannedMesh;
+		PlannedMesh.ObjectPath = MeshAsset.ObjectPath.ToString();
+
+		TArray<FAssetData> Materials;
+		GetMeshMaterials(MeshAsset, Materials);
+		for(auto ItMaterial = Materials.CreateConstIterator(); ItMaterial; ++ItMaterial)
+		{
+			const FString MaterialPath = (*ItMaterial).ObjectPath.ToString();
+
+			// テクスチャ 
+			TMap<int32, FString>* PropertyTextures = MaterialTextures.Find(MaterialPath);
+			if(nullptr == PropertyTextures)
+			{
+				TMap<int32, FString> NewTextures;
+				if(!GetMaterialTextures(*ItMaterial, NewTextures))
+				{
+					OutPlan.NumEstimatedMaterials++;
+				}
+				PropertyTextures = &MaterialTextures.Add(MaterialPath, NewTextures);
+			}
+
+			// ベースはロードしないため、ベースが持たないパラメータの除外は適用時に行う 
+			TArray<TPair<FName, FString>> Textures;
+			TArray<FName> DisabledSwitches;
+			FMICRepTextureRules::ResolvePaths(*PropertyTextures, Textures, DisabledSwitches);
+
+			// MIC（前回までに内容ハッシュを求めたテクスチャは代表のパスでまとめる） 
+			const FMICRepTextureHashCache& TextureHashCache = FMICRepTextureHashCache::Get();
+			FString InstanceKey = FString::FromInt(BaseIndex);
+			for(auto ItTexture = Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+			{
+				InstanceKey += FString::Printf(TEXT("|%s=%s"), *(*ItTexture).Key.ToString(), *TextureHashCache.FindCanonicalPath((*ItTexture).Value));
+			}
+			int32 InstanceIndex = INDEX_NONE;
+			const int32* FoundIndex = InstanceIndices.Find(InstanceKey);
+			if(nullptr != FoundIndex)
+			{
+				InstanceIndex = *FoundIndex;
+			}
+			else
+			{
+				FMICRepPlannedInstance PlannedInstance;
+				PlannedInstance.Name = FMICRepModule::GetMICName(bUnify ? UnifySimpleName : SimpleName, (*ItMaterial).AssetName.ToString());
+				PlannedInstance.PackagePath = TargetPathName;
+				PlannedInstance.Base = BaseIndex;
+				for(auto ItTexture = Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+				{
+					FMICRepPlannedTexture PlannedTexture;
+					PlannedTexture.Parameter = (*ItTexture).Key.ToString();
+					PlannedTexture.Texture = (*ItTexture).Value;
+					PlannedInstance.Textures.Add(PlannedTexture);
+				}
+				PlannedInstance.DisabledSwitches = JoinSwitches(DisabledSwitches);
+				PlannedInstance.SourceMaterial = MaterialPath;
+				InstanceIndex = OutPlan.Instances.Add(PlannedInstance);
+				InstanceIndices.Add(InstanceKey, InstanceIndex);
+
+				// テクスチャが欠けている組み合わせごとに、ベースの静的パーミュテーションが1つ増える 
+				if(!PlannedInstance.DisabledSwitches.IsEmpty())
+				{
+					OutPlan.BaseMaterials[BaseIndex].Variants.AddUnique(PlannedInstance.DisabledSwitches);
+				}
+			}
+
+			FMICRepPlannedReplacement Replacement;
+			Replacement.SourceMaterial = MaterialPath;
+			Replacement.Instance = InstanceIndex;
+			PlannedMesh.Replacements.Add(Replacement);
+		}
+
+		OutPlan.Meshes.Add(PlannedMesh);
+	}
+
+	for(auto ItBase = OutPlan.BaseMaterials.CreateConstIterator(); ItBase; ++ItBase)
+	{
+		OutPlan.NumStaticPermutations += (*ItBase).Variants.Num();
+	}
+
+	BuildTextureFamilies(OutPlan);
+}
+
+//
+// テクスチャ配列へのパッキング候補 
+//
+// UE4.15 には UTexture2DArray とインスタンスごとのスライス指定手段が無いため、ここでは 
+// まとめられるMICの集まりを求めてプランに記録するのみ（削減できるMIC数の見積もり）. 
+//
+void FMICRepPlanner::BuildTextureFamilies(FMICRepPlan& Plan)
+{
+	// <Base|Formats, Index>
+	TMap<FString, int32> FamilyIndices;
+	// <TexturePath, FormatKey>
+	TMap<FString, FString> FormatKeys;
+	auto GetFormatKey = [&FormatKeys](const FString& TexturePath) -> FString
+	{
+		if(TexturePath.IsEmpty())
+		{
+			return FString();
+		}
+		const FString* FormatKey = FormatKeys.Find(TexturePath);
+		return (nullptr != FormatKey) ? *FormatKey : FormatKeys.Add(TexturePath, GetTextureFormatKey(TexturePath));
+	};
+
+	for(int32 InstanceIdx = 0; InstanceIdx < Plan.Instances.Num(); ++InstanceIdx)
+	{
+		const FMICRepPlannedInstance& Instance = Plan.Instances[InstanceIdx];
+
+		// サイズ/フォーマットが不明なテクスチャがあればまとめない 
+		FString Formats;
+		bool bKnownFormats = true;
+		for(auto ItTexture = Instance.Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+		{
+			const FString Format = GetFormatKey((*ItTexture).Texture);
+			if(!(*ItTexture).Texture.IsEmpty() && Format.IsEmpty())
+			{
+				bKnownFormats = false;
+				break;
+			}
+			Formats += FString::Printf(TEXT("%s=%s;"), *(*ItTexture).Parameter, *Format);
+		}
+		if(!bKnownFormats || (0 == Instance.Textures.Num()))
+		{
+			continue;
+		}
+
+		const FString FamilyKey = FString::Printf(TEXT("%d|%s|%s"), Instance.Base, *Instance.DisabledSwitches, *Formats);
+		const int32* FoundIndex = FamilyIndices.Find(FamilyKey);
+		if(nullptr != FoundIndex)
+		{
+			Plan.TextureFamilies[*FoundIndex].Instances.Add(InstanceIdx);
+			continue;
+		}
+
+		FMICRepPlannedTextureFamily Family;
+		Family.Base = Instance.Base;
+		Family.Formats = Formats;
+		Family.Instances.Add(InstanceIdx);
+		FamilyIndices.Add(FamilyKey, Plan.TextureFamilies.Add(Family));
+	}
+
+	// 1つしか無いものは候補にしない 
+	Plan.TextureFamilies.RemoveAll([](const FMICRepPlannedTextureFamily& Family)
+		{ return Family.Instances.Num() < 2; });
+}
+
+FString FMICRepPlanner::GetTextureFormatKey(const FString& TexturePath)
+{
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	const FAssetData TextureAsset = AssetRegistryModule.Get().GetAssetByObjectPath(FName(*TexturePath));
+
+	FString Dimensions;
+	FString CompressionSettings;
+	FString SRGB;
+	if(!TextureAsset.IsValid() ||
+		!TextureAsset.GetTagValue(FName(TEXT("Dimensions")), Dimensions) ||
+		!TextureAsset.GetTagValue(FName(TEXT("CompressionSettings")), CompressionSettings))
+	{
+		return FString();
+	}
+	TextureAsset.GetTagValue(FName(TEXT("SRGB")), SRGB);
+	return FString::Printf(TEXT("%s|%s|%s"), *Dimensions, *CompressionSettings, *SRGB);
+}
+
+bool FMICRepPlanner::SavePlan(const FMICRepPlan& Plan, const FString& FileName)
+{
+	FString JsonString;
+	if(!FJsonObjectConverter::UStructToJsonObjectString(FMICRepPlan::StaticStruct(), &Plan, JsonString, 0, 0))
+	{
+		return false;
+	}
+	return FFileHelper::SaveStringToFile(JsonString, *FileName);
+}
+
+bool FMICRepPlanner::LoadPlan(const FString& FileName, FMICRepPlan& OutPlan)
+{
+	FString JsonString;
+	if(!FFileHelper::LoadFileToString(JsonString, *FileName))
+	{
+		return false;
+	}
+	if(!FJsonObjectConverter::JsonObjectStringToUStruct(JsonString, &OutPlan, 0, 0))
+	{
+		return false;
+	}
+	return (PlanVersion == OutPlan.Version);
+}
+
+void FMICRepPlanner::GetShardRange(int32 Num, int32 ShardIndex, int32 NumShards, int32& OutBegin, int32& OutEnd)
+{
+	NumShards = FMath::Max(1, NumShards);
+	ShardIndex = FMath::Clamp(ShardIndex, 0, NumShards - 1);
+	OutBegin = (int32)((int64)Num * ShardIndex / NumShards);
+	OutEnd = (int32)((int64)Num * (ShardIndex + 1) / NumShards);
+}
+
+//
+// メッシュが参照しているマテリアル（パッケージの依存関係から取得） 
+//
+void FMICRepPlanner::GetMeshMaterials(const FAssetData& MeshAsset, TArray<FAssetData>& OutMaterials)
+{
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+
+	TArray<FName> Dependencies;
+	AssetRegistry.GetDependencies(MeshAsset.PackageName, Dependencies, EAssetRegistryDependencyType::Hard);
+	for(auto ItDependency = Dependencies.CreateConstIterator(); ItDependency; ++ItDependency)
+	{
+		TArray<FAssetData> Assets;
+		AssetRegistry.GetAssetsByPackageName(*ItDependency, Assets);
+		for(auto ItAsset = Assets.CreateConstIterator(); ItAsset; ++ItAsset)
+		{
+			if((UMaterial::StaticClass()->GetFName() == (*ItAsset).AssetClass)
+				|| (UMaterialInstanceConstant::StaticClass()->GetFName() == (*ItAsset).AssetClass))
+			{
+				OutMaterials.Add(*ItAsset);
+			}
+		}
+	}
+}
+
+//
+// マテリアルのプロパティごとのテクスチャ 
+//
+// 解析キャッシュにあればそれを使い、無ければ親チェーンの依存テクスチャを名前からBaseColor/Normalに振り分ける. 
+// 推定した場合はfalseを返す. 
+//
+bool FMICRepPlanner::GetMaterialTextures(const FAssetData& MaterialAsset, TMap<int32, FString>& OutPropertyTextures)
+{
+	OutPropertyTextures.Reset();
+
+	const FMICRepMaterialAnalysis* Cached = FMICRepMaterialAnalysisCache::Get().FindCached(MaterialAsset.ObjectPath.ToString());
+	if(nullptr != Cached)
+	{
+		OutPropertyTextures = Cached->PropertyTextures;
+		return true;
+	}
+
+	FString ColorTexture;
+	FString NormalTexture;
+
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+
+	TArray<FName> PendingPackages;
+	TSet<FName> VisitedPackages;
+	PendingPackages.Add(MaterialAsset.PackageName);
+	while(0 < PendingPackages.Num())
+	{
+		const FName PackageName = PendingPackages.Pop(false);
+		if(VisitedPackages.Contains(PackageName))
+		{
+			continue;
+		}
+		VisitedPackages.Add(PackageName);
+
+		TArray<FName> Dependencies;
+		AssetRegistry.GetDependencies(PackageName, Dependencies, EAssetRegistryDependencyType::Hard);
+		for(auto ItDependency = Dependencies.CreateConstIterator(); ItDependency; ++ItDependency)
+		{
+			TArray<FAssetData> Assets;
+			AssetRegistry.GetAssetsByPackageName(*ItDependency, Assets);
+			for(auto ItAsset = Assets.CreateConstIterator(); ItAsset; ++ItAsset)
+			{
+				const FAssetData& Asset = *ItAsset;
+				if(UTexture2D::StaticClass()->GetFName() == Asset.AssetClass)
+				{
+					const FString AssetName = Asset.AssetName.ToString();
+					const bool bNormal = AssetName.EndsWith(TEXT("_N")) || AssetName.Contains(TEXT("Normal"));
+					FString& Texture = bNormal ? NormalTexture : ColorTexture;
+					if(Texture.IsEmpty())
+					{
+						Texture = Asset.ObjectPath.ToString();
+					}
+				}
+				else if((UMaterial::StaticClass()->GetFName() == Asset.AssetClass)
+					|| (UMaterialInstanceConstant::StaticClass()->GetFName() == Asset.AssetClass))
+				{
+					// 親マテリアル 
+					PendingPackages.Add(Asset.PackageName);
+				}
+			}
+		}
+	}
+	if(!ColorTexture.IsEmpty())
+	{
+		OutPropertyTextures.Add(static_cast<int32>(EMaterialProperty::MP_BaseColor), ColorTexture);
+	}
+	if(!NormalTexture.IsEmpty())
+	{
+		OutPropertyTextures.Add(static_cast<int32>(EMaterialProperty::MP_Normal), NormalTexture);
+	}
+	return false;
+}
+
+FString FMICRepPlanner::JoinSwitches(const TArray<FName>& Switches)
+{
+	FString Joined;
+	for(auto ItSwitch = Switches.CreateConstIterator(); ItSwitch; ++ItSwitch)
+	{
+		Joined += (Joined.IsEmpty() ? TEXT("") : TEXT("+")) + (*ItSwitch).ToString();
+	}
+	return Joined;
+}
+
+void FMICRepPlanner::ParseSwitches(const FString& Joined, TArray<FName>& OutSwitches)
+{
+	OutSwitches.Reset();
+	TArray<FString> Names;
+	Joined.ParseIntoArray(Names, TEXT("+"), true);
+	for(auto ItName = Names.CreateConstIterator(); ItName; ++ItName)
+	{
+		OutSwitches.Add(FName(**ItName));
+	}
+}
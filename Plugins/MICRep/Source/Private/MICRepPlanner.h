@@ -0,0 +1,201 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+#include "MICRepPlanner.generated.h"
+
+//
+// 置換プラン（JSONで保存/読込） 
+//
+USTRUCT()
+struct FMICRepPlannedBase
+{
+	GENERATED_BODY()
+
+	// ResolveBaseMaterial への入力 
+	UPROPERTY()
+	FString SimpleName;
+	UPROPERTY()
+	FString TargetPathName;
+
+	// 解決されるベースマテリアル 
+	UPROPERTY()
+	FString ObjectPath;
+	// テクスチャが欠けたMIC用の親（オフにするStaticSwitchを"+"で連結） 
+	UPROPERTY()
+	TArray<FString> Variants;
+};
+
+USTRUCT()
+struct FMICRepPlannedTexture
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FString Parameter;
+	// 見つからなければ空 
+	UPROPERTY()
+	FString Texture;
+};
+
+USTRUCT()
+struct FMICRepPlannedInstance
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FString Name;
+	UPROPERTY()
+	FString PackagePath;
+	UPROPERTY()
+	int32 Base;
+	// UMICRepSettings::TextureRules で対応付けたテクスチャ 
+	UPROPERTY()
+	TArray<FMICRepPlannedTexture> Textures;
+	// FMICRepPlannedBase::Variants のいずれか（空ならベースをそのまま使う） 
+	UPROPERTY()
+	FString DisabledSwitches;
+	// パラメータの引き継ぎ元と来歴に記録する元マテリアル（このMICを最初に必要としたもの） 
+	UPROPERTY()
+	FString SourceMaterial;
+
+	// 適用結果（シャード実行時に統合） 
+	UPROPERTY()
+	FString ObjectPath;
+	UPROPERTY()
+	FString Hash;
+
+	FMICRepPlannedInstance() : Base(INDEX_NONE) {}
+};
+
+USTRUCT()
+struct FMICRepPlannedReplacement
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FString SourceMaterial;
+	UPROPERTY()
+	int32 Instance;
+
+	FMICRepPlannedReplacement() : Instance(INDEX_NONE) {}
+};
+
+USTRUCT()
+struct FMICRepPlannedMesh
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FString ObjectPath;
+	UPROPERTY()
+	TArray<FMICRepPlannedReplacement> Replacements;
+
+	// 適用結果: セクションの統合で詰めたスロットの対応表（統合しなければ空. シャード実行時に統合） 
+	UPROPERTY()
+	TArray<int32> OldSlotToNew;
+};
+
+// 各パラメータのテクスチャのサイズ/フォーマットが同じMICの集まり（テクスチャ配列にまとめられる候補） 
+USTRUCT()
+struct FMICRepPlannedTextureFamily
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	int32 Base;
+	// "<Parameter>=<Dimensions>|<CompressionSettings>|<SRGB>;..." 
+	UPROPERTY()
+	FString Formats;
+	UPROPERTY()
+	TArray<int32> Instances;
+
+	FMICRepPlannedTextureFamily() : Base(INDEX_NONE) {}
+};
+
+USTRUCT()
+struct FMICRepPlan
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	int32 Version;
+	UPROPERTY()
+	FString Mode;
+
+	UPROPERTY()
+	TArray<FMICRepPlannedBase> BaseMaterials;
+	UPROPERTY()
+	TArray<FMICRepPlannedInstance> Instances;
+	UPROPERTY()
+	TArray<FMICRepPlannedMesh> Meshes;
+	UPROPERTY()
+	TArray<FMICRepPlannedTextureFamily> TextureFamilies;
+
+	// 集計 
+	UPROPERTY()
+	int32 NumStaticPermutations;
+	// 解析キャッシュが無く、依存関係から推定したマテリアル数 
+	UPROPERTY()
+	int32 NumEstimatedMaterials;
+
+	FMICRepPlan() : Version(0), NumStaticPermutations(0), NumEstimatedMaterials(0) {}
+};
+
+//
+// プラン適用の範囲（シャード実行用） 
+//
+struct FMICRepApplyOptions
+{
+	// ベースマテリアル（とテクスチャが欠けたMIC用の親）の作成 
+	bool bBases;
+	// MICの作成 
+	bool bInstances;
+	// メッシュへの割り当て 
+	bool bMeshes;
+
+	int32 ShardIndex;
+	int32 NumShards;
+
+	FMICRepApplyOptions()
+		: bBases(true)
+		, bInstances(true)
+		, bMeshes(true)
+		, ShardIndex(0)
+		, NumShards(1)
+	{}
+};
+
+//
+// アセットレジストリの情報のみから置換プランを作成する（アセットはロードしない） 
+//
+class FMICRepPlanner
+{
+public:
+	static const int32 PlanVersion = 3;
+
+	static void BuildPlan(const TArray<FAssetData>& MeshAssets, bool bUnify, FMICRepPlan& OutPlan);
+
+	static bool SavePlan(const FMICRepPlan& Plan, const FString& FileName);
+	static bool LoadPlan(const FString& FileName, FMICRepPlan& OutPlan);
+
+	// Num件をNumShards個に分けたときのShardIndex番目の範囲 [OutBegin, OutEnd) 
+	static void GetShardRange(int32 Num, int32 ShardIndex, int32 NumShards, int32& OutBegin, int32& OutEnd);
+
+	// メッシュが参照しているマテリアル 
+	static void GetMeshMaterials(const FAssetData& MeshAsset, TArray<FAssetData>& OutMaterials);
+
+	// FMICRepPlannedInstance::DisabledSwitches / FMICRepPlannedBase::Variants の表記 
+	static FString JoinSwitches(const TArray<FName>& Switches);
+	static void ParseSwitches(const FString& Joined, TArray<FName>& OutSwitches);
+
+private:
+	// マテリアルの <EMaterialProperty, TexturePath>（解析キャッシュが無ければ依存関係と名前からBaseColor/Normalのみ推定） 
+	static bool GetMaterialTextures(const FAssetData& MaterialAsset, TMap<int32, FString>& OutPropertyTextures);
+	// サイズ/フォーマットが同じMICをまとめる 
+	static void BuildTextureFamilies(FMICRepPlan& Plan);
+	// アセットレジストリのタグから求めたテクスチャのサイズ/フォーマット 
+	static FString GetTextureFormatKey(const FString& TexturePath);
+};
@@ -0,0 +1,104 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepPreloader.h"
+#include "MICRepStats.h"
+#include "AssetRegistryModule.h"
+
+
+#define LOCTEXT_NAMESPACE "MICRep"
+
+
+int32 FMICRepPreloader::Preload(const TArray<FAssetData>& Assets, int32 Depth, TArray<UPackage*>* OutLoadedPackages)
+{
+	MICREP_SCOPE_PHASE(Load);
+
+	TArray<FName> PackageNames;
+	GatherPackages(Assets, Depth, PackageNames);
+
+	// ロード済みのパッケージは除外 
+	TArray<FName> PackagesToLoad;
+	for(auto ItPackage = PackageNames.CreateConstIterator(); ItPackage; ++ItPackage)
+	{
+		UPackage* Package = FindPackage(nullptr, *(*ItPackage).ToString());
+		if((nullptr == Package) || !Package->IsFullyLoaded())
+		{
+			PackagesToLoad.Add(*ItPackage);
+		}
+	}
+	if(0 == PackagesToLoad.Num())
+	{
+		return 0;
+	}
+
+	FScopedSlowTask SlowTask(
+		1.0f,
+		FText::Format(LOCTEXT("PreloadingAssets", "Loading {0} packages..."), FText::AsNumber(PackagesToLoad.Num()))
+		);
+	SlowTask.MakeDialog();
+
+	// 全て発行してから一度だけ待つ 
+	for(auto ItPackage = PackagesToLoad.CreateConstIterator(); ItPackage; ++ItPackage)
+	{
+		LoadPackageAsync((*ItPackage).ToString());
+	}
+	SlowTask.EnterProgressFrame(1.0f);
+	FlushAsyncLoading();
+
+	if(nullptr != OutLoadedPackages)
+	{
+		for(auto ItPackage = PackagesToLoad.CreateConstIterator(); ItPackage; ++ItPackage)
+		{
+			UPackage* Package = FindPackage(nullptr, *(*ItPackage).ToString());
+			if(nullptr != Package)
+			{
+				OutLoadedPackages->Add(Package);
+			}
+		}
+	}
+
+	return PackagesToLoad.Num();
+}
+
+void FMICRepPreloader::GatherPackages(const TArray<FAssetData>& Assets, int32 Depth, TArray<FName>& OutPackageNames)
+{
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+
+	// メッシュ → マテリアル → 親マテリアル/テクスチャ の順に依存を辿る 
+	TSet<FName> Visited;
+	TArray<FName> Current;
+	for(auto ItAsset = Assets.CreateConstIterator(); ItAsset; ++ItAsset)
+	{
+		if(!Visited.Contains((*ItAsset).PackageName))
+		{
+			Visited.Add((*ItAsset).PackageName);
+			Current.Add((*ItAsset).PackageName);
+		}
+	}
+
+	for(int32 Level = 0; (Level < Depth) && (0 < Current.Num()); ++Level)
+	{
+		TArray<FName> Next;
+		for(auto ItPackage = Current.CreateConstIterator(); ItPackage; ++ItPackage)
+		{
+			TArray<FName> Dependencies;
+			AssetRegistryModule.Get().GetDependencies(*ItPackage, Dependencies, EAssetRegistryDependencyType::Hard);
+			for(auto ItDep = Dependencies.CreateConstIterator(); ItDep; ++ItDep)
+			{
+				// スクリプトパッケージはロード対象外 
+				if(Visited.Contains(*ItDep) || (*ItDep).ToString().StartsWith(TEXT("/Script/")))
+				{
+					continue;
+				}
+				Visited.Add(*ItDep);
+				Next.Add(*ItDep);
+			}
+		}
+		Current = MoveTemp(Next);
+	}
+
+	OutPackageNames = Visited.Array();
+}
+
+
+#undef LOCTEXT_NAMESPACE
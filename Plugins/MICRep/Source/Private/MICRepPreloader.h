@@ -0,0 +1,19 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+
+//
+// 変換前に対象アセットと依存アセットをまとめて非同期ロードする 
+//
+class FMICRepPreloader
+{
+public:
+	// Assets と、その依存パッケージを Depth 段までロード（OutLoadedPackages: 新たにロードしたパッケージ） 
+	static int32 Preload(const TArray<FAssetData>& Assets, int32 Depth, TArray<UPackage*>* OutLoadedPackages = nullptr);
+
+private:
+	static void GatherPackages(const TArray<FAssetData>& Assets, int32 Depth, TArray<FName>& OutPackageNames);
+};
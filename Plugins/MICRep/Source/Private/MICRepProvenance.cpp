@@ -0,0 +1,321 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepProvenance.h"
+#include "MICRepCache.h"
+#include "MICRepMaterialAnalysis.h"
+#include "MICRepSettings.h"
+
+
+namespace
+{
+	const TCHAR* ProvenanceFileName = TEXT("Provenance.bin");
+	const int32 ProvenanceVersion = 3;
+
+	const TCHAR* SourceMaterialKey = TEXT("MICRep.SourceMaterial");
+	const TCHAR* SourceHashKey = TEXT("MICRep.SourceHash");
+	const TCHAR* SourceMaterialsKey = TEXT("MICRep.SourceMaterials");
+	const TCHAR* VersionKey = TEXT("MICRep.Version");
+	const TCHAR* LODVariantKey = TEXT("MICRep.LODVariant");
+	const TCHAR* SharedKey = TEXT("MICRep.Shared");
+	const TCHAR* ModeKey = TEXT("MICRep.Mode");
+	const TCHAR* SettingsHashKey = TEXT("MICRep.SettingsHash");
+
+	const TCHAR* GetModeName(bool bUnify)
+	{
+		return bUnify ? TEXT("unify") : TEXT("replace");
+	}
+}
+
+
+FMICRepProvenance& FMICRepProvenance::Get()
+{
+	static FMICRepProvenance Instance;
+	return Instance;
+}
+
+FMICRepProvenance::FMICRepProvenance()
+	: bDirty(false)
+{
+	Load();
+}
+
+void FMICRepProvenance::RecordInstance(UMaterialInstanceConstant* MIC, UMaterialInterface* SourceMaterial, bool bLODVariant)
+{
+	if((nullptr == MIC) || (nullptr == SourceMaterial))
+	{
+		return;
+	}
+
+	UMetaData* MetaData = MIC->GetOutermost()->GetMetaData();
+	MetaData->SetValue(MIC, SourceMaterialKey, *SourceMaterial->GetPathName());
+	MetaData->SetValue(MIC, SourceHashKey, *FMICRepMaterialAnalysisCache::ComputeSourceHash(SourceMaterial).ToString());
+	MetaData->SetValue(MIC, VersionKey, *FString::FromInt(ConversionVersion));
+	if(bLODVariant)
+	{
+		MetaData->SetValue(MIC, LODVariantKey, TEXT("1"));
+	}
+	else
+	{
+		MetaData->RemoveValue(MIC, LODVariantKey);
+	}
+}
+
+void FMICRepProvenance::RecordUse(UMaterialInterface* Material, UMaterialInterface* SourceMaterial)
+{
+	UMaterialInstanceConstant* MIC = Cast<UMaterialInstanceConstant>(Material);
+	if((nullptr == MIC) || (nullptr == SourceMaterial))
+	{
+		return;
+	}
+
+	UMetaData* MetaData = MIC->GetOutermost()->GetMetaData();
+	if(    MetaData->HasValue(MIC, SourceMaterialKey)
+		&& (MetaData->GetValue(MIC, SourceMaterialKey) != SourceMaterial->GetPathName())
+		&& !MetaData->HasValue(MIC, SharedKey)
+		)
+	{
+		MetaData->SetValue(MIC, SharedKey, TEXT("1"));
+		MIC->MarkPackageDirty();
+	}
+}
+
+bool FMICRepProvenance::IsShared(UMaterialInterface* Material)
+{
+	UMaterialInstanceConstant* MIC = Cast<UMaterialInstanceConstant>(Material);
+	return (nullptr != MIC) && MIC->GetOutermost()->GetMetaData()->HasValue(MIC, SharedKey);
+}
+
+bool FMICRepProvenance::IsLODVariant(UMaterialInterface* Material)
+{
+	UMaterialInstanceConstant* MIC = Cast<UMaterialInstanceConstant>(Material);
+	return (nullptr != MIC) && MIC->GetOutermost()->GetMetaData()->HasValue(MIC, LODVariantKey);
+}
+
+bool FMICRepProvenance::FindSource(UMaterialInterface* Material, FString& OutSourcePath, bool& bOutNeedsRefresh)
+{
+	bOutNeedsRefresh = false;
+	UMaterialInstanceConstant* MIC = Cast<UMaterialInstanceConstant>(Material);
+	if(nullptr == MIC)
+	{
+		return false;
+	}
+
+	UMetaData* MetaData = MIC->GetOutermost()->GetMetaData();
+	if(!MetaData->HasValue(MIC, SourceMaterialKey))
+	{
+		return false;
+	}
+	OutSourcePath = MetaData->GetValue(MIC, SourceMaterialKey);
+
+	// 元マテリアルが削除されていればそのまま使う 
+	UMaterialInterface* SourceMaterial = LoadObject<UMaterialInterface>(nullptr, *OutSourcePath, nullptr, LOAD_NoWarn);
+	if(nullptr == SourceMaterial)
+	{
+		return true;
+	}
+	bOutNeedsRefresh =
+		(MetaData->GetValue(MIC, VersionKey) != FString::FromInt(ConversionVersion)) ||
+		(MetaData->GetValue(MIC, SourceHashKey) != FMICRepMaterialAnalysisCache::ComputeSourceHash(SourceMaterial).ToString());
+	return true;
+}
+
+void FMICRepProvenance::RecordMesh(UObject* Mesh, const TArray<FString>& SourceMaterials, bool bUnify)
+{
+	if(nullptr == Mesh)
+	{
+		return;
+	}
+
+	UPackage* Package = Mesh->GetOutermost();
+	UMetaData* MetaData = Package->GetMetaData();
+	MetaData->SetValue(Mesh, ModeKey, GetModeName(bUnify));
+	MetaData->SetValue(Mesh, SettingsHashKey, *ComputeSettingsHash(bUnify).ToString());
+	MetaData->SetValue(Mesh, SourceMaterialsKey, *FString::Join(SourceMaterials, TEXT(";")));
+	MetaData->SetValue(Mesh, VersionKey, *FString::FromInt(ConversionVersion));
+
+	// 依存先はロード済みのうちに求めておく. 保存されるまでファイル更新日時は確定しない 
+	FPendingMesh Pending;
+	Pending.bUnify = bUnify;
+	GatherDependencies(SourceMaterials, Pending.DependencyPackages);
+	if(Package->IsDirty())
+	{
+		PendingMeshes.Add(Package->GetName(), Pending);
+	}
+	else
+	{
+		CommitMesh(Package->GetName(), Pending);
+	}
+}
+
+bool FMICRepProvenance::NeedsReconversion(UObject* Mesh, bool bUnify)
+{
+	if(nullptr == Mesh)
+	{
+		return false;
+	}
+
+	// 一度も変換していなければ作り直すものは無い 
+	UMetaData* MetaData = Mesh->GetOutermost()->GetMetaData();
+	if(!MetaData->HasValue(Mesh, SourceMaterialsKey))
+	{
+		return false;
+	}
+	return (MetaData->GetValue(Mesh, ModeKey) != GetModeName(bUnify))
+		|| (MetaData->GetValue(Mesh, SettingsHashKey) != ComputeSettingsHash(bUnify).ToString());
+}
+
+bool FMICRepProvenance::IsUpToDate(const FAssetData& MeshAsset, bool bUnify) const
+{
+	const FString PackageName = MeshAsset.PackageName.ToString();
+	const FMeshEntry* Entry = Meshes.Find(PackageName);
+	if((nullptr == Entry) || (ConversionVersion != Entry->Version) || PendingMeshes.Contains(PackageName))
+	{
+		return false;
+	}
+	if((bUnify != Entry->bUnify) || (ComputeSettingsHash(bUnify) != Entry->SettingsHash))
+	{
+		return false;
+	}
+	if(GetPackageTimeStamp(PackageName) != Entry->TimeStamp)
+	{
+		return false;
+	}
+	for(auto ItSource = Entry->Sources.CreateConstIterator(); ItSource; ++ItSource)
+	{
+		if(GetPackageTimeStamp(ItSource.Key()) != ItSource.Value())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FMICRepProvenance::OnPackagesSaved(const TArray<UPackage*>& Packages)
+{
+	for(auto ItPackage = Packages.CreateConstIterator(); ItPackage; ++ItPackage)
+	{
+		const FString PackageName = (*ItPackage)->GetName();
+		FPendingMesh Pending;
+		if(PendingMeshes.RemoveAndCopyValue(PackageName, Pending))
+		{
+			CommitMesh(PackageName, Pending);
+		}
+	}
+}
+
+void FMICRepProvenance::CommitMesh(const FString& PackageName, const FPendingMesh& Pending)
+{
+	FMeshEntry Entry;
+	Entry.Version = ConversionVersion;
+	Entry.TimeStamp = GetPackageTimeStamp(PackageName);
+	for(auto ItSource = Pending.DependencyPackages.CreateConstIterator(); ItSource; ++ItSource)
+	{
+		Entry.Sources.Add(*ItSource, GetPackageTimeStamp(*ItSource));
+	}
+	Entry.bUnify = Pending.bUnify;
+	Entry.SettingsHash = ComputeSettingsHash(Pending.bUnify);
+	Meshes.Add(PackageName, Entry);
+	bDirty = true;
+}
+
+void FMICRepProvenance::GatherDependencies(const TArray<FString>& SourceMaterials, TArray<FString>& OutPackageNames)
+{
+	OutPackageNames.Reset();
+	for(auto ItSource = SourceMaterials.CreateConstIterator(); ItSource; ++ItSource)
+	{
+		OutPackageNames.AddUnique(FPackageName::ObjectPathToPackageName(*ItSource));
+
+		// 親チェーン 
+		UMaterialInterface* Material = FindObject<UMaterialInterface>(nullptr, **ItSource);
+		for(UMaterialInterface* Current = Material; nullptr != Current; )
+		{
+			OutPackageNames.AddUnique(Current->GetOutermost()->GetName());
+			UMaterialInstance* Instance = Cast<UMaterialInstance>(Current);
+			Current = (nullptr != Instance) ? Instance->Parent : nullptr;
+		}
+
+		// MICへ設定したテクスチャ 
+		const FMICRepMaterialAnalysis* Analysis = FMICRepMaterialAnalysisCache::Get().FindCached(*ItSource);
+		if(nullptr != Analysis)
+		{
+			for(auto ItTexture = Analysis->PropertyTextures.CreateConstIterator(); ItTexture; ++ItTexture)
+			{
+				if(!ItTexture.Value().IsEmpty())
+				{
+					OutPackageNames.AddUnique(FPackageName::ObjectPathToPackageName(ItTexture.Value()));
+				}
+			}
+		}
+	}
+}
+
+FSHAHash FMICRepProvenance::ComputeSettingsHash(bool bUnify)
+{
+	const UMICRepSettings* Settings = GetDefault<UMICRepSettings>();
+
+	FString Description;
+	for(auto ItRule = Settings->TextureRules.CreateConstIterator(); ItRule; ++ItRule)
+	{
+		const FMICRepTextureRule& Rule = *ItRule;
+		Description += FString::Printf(TEXT("%d,%s,%s,%d;"), static_cast<int32>(Rule.Property.GetValue()), *Rule.ParameterName.ToString(), *Rule.StaticSwitch.ToString(), static_cast<int32>(Rule.Channel));
+	}
+	Description += FString::Printf(TEXT("|%s|%d|%s|"), *Settings->BaseMaterial.ToString(), static_cast<int32>(Settings->BaseMaterialScope), *Settings->SharedBaseMaterialDirectory.Path);
+	if(Settings->bClusterParameters)
+	{
+		Description += FString::Printf(TEXT("C%f|"), Settings->ParameterTolerance);
+	}
+	Description += FString::Printf(TEXT("%d%d|"), Settings->bDeduplicateTextures ? 1 : 0, Settings->bRedirectDuplicateTextures ? 1 : 0);
+	if(bUnify)
+	{
+		Description += FString::Printf(TEXT("U%d|"), Settings->bMergeSectionsAfterUnify ? 1 : 0);
+	}
+	if(Settings->bGenerateLODVariants)
+	{
+		Description += FString::Printf(TEXT("%d:"), Settings->LODVariantStartLOD);
+		for(auto ItSwitch = Settings->LODVariantDisabledSwitches.CreateConstIterator(); ItSwitch; ++ItSwitch)
+		{
+			Description += (*ItSwitch).ToString() + TEXT(";");
+		}
+	}
+
+	FSHAHash Hash;
+	FSHA1::HashBuffer(*Description, Description.Len() * sizeof(TCHAR), Hash.Hash);
+	return Hash;
+}
+
+FDateTime FMICRepProvenance::GetPackageTimeStamp(const FString& PackageName)
+{
+	FString FileName;
+	if(!FPackageName::DoesPackageExist(PackageName, nullptr, &FileName))
+	{
+		return FDateTime::MinValue();
+	}
+	return IFileManager::Get().GetTimeStamp(*FileName);
+}
+
+void FMICRepProvenance::Load()
+{
+	const bool bLoaded = MICRepCache::Load(ProvenanceFileName, ProvenanceVersion, [this](FArchive& Ar)
+		{
+			Ar << Meshes;
+		});
+	if(!bLoaded)
+	{
+		Meshes.Reset();
+	}
+	bDirty = false;
+}
+
+void FMICRepProvenance::Save()
+{
+	if(!bDirty)
+	{
+		return;
+	}
+	MICRepCache::Save(ProvenanceFileName, ProvenanceVersion, [this](FArchive& Ar)
+		{
+			Ar << Meshes;
+		});
+	bDirty = false;
+}
@@ -0,0 +1,100 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+#include "SecureHash.h"
+
+class UMaterialInterface;
+class UMaterialInstanceConstant;
+class UPackage;
+
+//
+// 変換の来歴 
+//
+// 作成したMICと変換したメッシュにはUMetaDataで元マテリアル、元マテリアルのハッシュ、変換バージョンを記録する. 
+// また、変換後に保存したメッシュと元マテリアルが依存するパッケージ（親チェーンとテクスチャ）のファイル更新日時、 
+// 変換時のモード（Replace/Unify）と変換結果に影響する設定のハッシュを Saved/MICRep に記録し、 
+// 再実行時はいずれも変わっていないメッシュをロードせずに除外する. 
+// モードや設定が変わった変換済みのメッシュは、記録した元マテリアルから変換し直す. 
+//
+class FMICRepProvenance
+{
+public:
+	// 変換内容を変更した場合は上げる（前回までの変換結果はすべて作り直す） 
+	static const int32 ConversionVersion = 1;
+
+	static FMICRepProvenance& Get();
+
+	// 作成したMICへ元マテリアルを記録（bLODVariant: 遠景LOD用の簡易MIC） 
+	static void RecordInstance(UMaterialInstanceConstant* MIC, UMaterialInterface* SourceMaterial, bool bLODVariant = false);
+
+	// 既存のMICを別の元マテリアルの変換結果として再利用した（共有されたMICは元マテリアルの変更で書き換えない） 
+	static void RecordUse(UMaterialInterface* MIC, UMaterialInterface* SourceMaterial);
+	static bool IsShared(UMaterialInterface* MIC);
+
+	// 遠景LOD用に作成した簡易MICであればtrue 
+	static bool IsLODVariant(UMaterialInterface* Material);
+
+	// MICRepで作成したMICであればtrue 
+	// OutSourcePath: 元マテリアル、bOutNeedsRefresh: 元マテリアルまたは変換バージョンが変わっている 
+	static bool FindSource(UMaterialInterface* Material, FString& OutSourcePath, bool& bOutNeedsRefresh);
+
+	// 変換したメッシュを記録（未保存の場合は保存時にファイル更新日時を記録） 
+	void RecordMesh(UObject* Mesh, const TArray<FString>& SourceMaterials, bool bUnify);
+
+	// 前回の変換以降、メッシュも元マテリアルの依存先もモード/設定も変更されていなければtrue（ロードしない） 
+	bool IsUpToDate(const FAssetData& MeshAsset, bool bUnify) const;
+
+	// 変換済みのメッシュを前回と異なるモード/設定で変換する場合true（MICRepで作成したMICも元マテリアルから作り直す） 
+	static bool NeedsReconversion(UObject* Mesh, bool bUnify);
+
+	// 保存したパッケージのうち記録待ちのメッシュのファイル更新日時を記録 
+	void OnPackagesSaved(const TArray<UPackage*>& Packages);
+
+	void Save();
+
+private:
+	struct FMeshEntry
+	{
+		int32 Version;
+		FDateTime TimeStamp;
+		// <元マテリアル、親チェーン、テクスチャのPackageName, TimeStamp> 
+		TMap<FString, FDateTime> Sources;
+		bool bUnify;
+		FSHAHash SettingsHash;
+
+		FMeshEntry() : Version(0), bUnify(false) {}
+
+		friend FArchive& operator<<(FArchive& Ar, FMeshEntry& Entry)
+		{
+			return Ar << Entry.Version << Entry.TimeStamp << Entry.Sources << Entry.bUnify << Entry.SettingsHash;
+		}
+	};
+
+	// 保存待ちのメッシュ 
+	struct FPendingMesh
+	{
+		bool bUnify;
+		TArray<FString> DependencyPackages;
+	};
+
+	FMICRepProvenance();
+	void Load();
+
+	// パッケージファイルの更新日時（存在しなければFDateTime::MinValue） 
+	static FDateTime GetPackageTimeStamp(const FString& PackageName);
+	// ComputeSourceHash と同じ親チェーンに、解析したテクスチャを加えたパッケージ 
+	static void GatherDependencies(const TArray<FString>& SourceMaterials, TArray<FString>& OutPackageNames);
+	// TextureRules、ベースマテリアル、パラメータのクラスタリング、テクスチャの重複排除、セクション統合（Unify時）、 
+	// 遠景LODなど変換結果を左右する設定のハッシュ 
+	static FSHAHash ComputeSettingsHash(bool bUnify);
+	void CommitMesh(const FString& PackageName, const FPendingMesh& Pending);
+
+	// <MeshPackageName, Entry>
+	TMap<FString, FMeshEntry> Meshes;
+	// <MeshPackageName, 保存待ちのメッシュ> 
+	TMap<FString, FPendingMesh> PendingMeshes;
+	bool bDirty;
+};
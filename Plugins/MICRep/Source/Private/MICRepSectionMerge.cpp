@@ -0,0 +1,195 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepSectionMerge.h"
+#include "MICRepJournal.h"
+#include "MICRepMaterialRemap.h"
+#include "RawMesh.h"
+#include "SkeletalMeshTypes.h"
+
+
+template<typename SlotType>
+bool FMICRepSectionMerge::BuildSlotRemap(const TArray<SlotType>& Slots, TArray<int32>& OutOldToNew, TArray<SlotType>& OutNewSlots)
+{
+	// <Material, 新スロット> 
+	TMap<UMaterialInterface*, int32> MaterialToSlot;
+	OutOldToNew.SetNum(Slots.Num());
+	OutNewSlots.Reset();
+	for(int32 SlotIdx = 0; SlotIdx < Slots.Num(); ++SlotIdx)
+	{
+		// 未設定のスロットはまとめない 
+		UMaterialInterface* Material = Slots[SlotIdx].MaterialInterface;
+		const int32* FoundSlot = (nullptr != Material) ? MaterialToSlot.Find(Material) : nullptr;
+		if(nullptr != FoundSlot)
+		{
+			OutOldToNew[SlotIdx] = *FoundSlot;
+			continue;
+		}
+		OutOldToNew[SlotIdx] = OutNewSlots.Add(Slots[SlotIdx]);
+		if(nullptr != Material)
+		{
+			MaterialToSlot.Add(Material, OutOldToNew[SlotIdx]);
+		}
+	}
+	return OutNewSlots.Num() < Slots.Num();
+}
+
+bool FMICRepSectionMerge::MergeStaticMesh(UStaticMesh* Mesh, TArray<int32>* OutOldToNew)
+{
+	if(nullptr == Mesh)
+	{
+		return false;
+	}
+
+	TArray<int32> OldToNew;
+	TArray<FStaticMaterial> NewMaterials;
+	if(!BuildSlotRemap(Mesh->StaticMaterials, OldToNew, NewMaterials))
+	{
+		return false;
+	}
+
+	// <LOD, 統合後のセクション情報>（自動生成LODはLOD0から作られるためLOD0と同じにする） 
+	TArray<TArray<FMeshSectionInfo>> NewSectionInfos;
+	NewSectionInfos.SetNum(Mesh->SourceModels.Num());
+	// <LOD, 面のセクション番号を付け替えたメッシュ/統合前の面のセクション番号>（自動生成LODは空） 
+	TArray<FRawMesh> RawMeshes;
+	RawMeshes.SetNum(Mesh->SourceModels.Num());
+	TArray<TArray<int32>> OldFaceSections;
+	OldFaceSections.SetNum(Mesh->SourceModels.Num());
+	for(int32 LODIdx = 0; LODIdx < Mesh->SourceModels.Num(); ++LODIdx)
+	{
+		FStaticMeshSourceModel& SourceModel = Mesh->SourceModels[LODIdx];
+		if(SourceModel.RawMeshBulkData->IsEmpty())
+		{
+			if(0 < LODIdx)
+			{
+				NewSectionInfos[LODIdx] = NewSectionInfos[0];
+			}
+			continue;
+		}
+
+		FRawMesh& RawMesh = RawMeshes[LODIdx];
+		SourceModel.RawMeshBulkData->LoadRawMesh(RawMesh);
+		OldFaceSections[LODIdx] = RawMesh.FaceMaterialIndices;
+
+		// 参照先のスロットと影/コリジョン設定が同じセクションを1つにする 
+		// （設定が異なるものは同じスロットを参照する別セクションとして残す） 
+		TMap<int32, int32> OldSectionToNew;
+		TArray<FMeshSectionInfo>& SectionInfos = NewSectionInfos[LODIdx];
+		for(auto ItFace = RawMesh.FaceMaterialIndices.CreateIterator(); ItFace; ++ItFace)
+		{
+			const int32 OldSection = *ItFace;
+			const int32* NewSection = OldSectionToNew.Find(OldSection);
+			if(nullptr == NewSection)
+			{
+				FMeshSectionInfo Info = Mesh->SectionInfoMap.Get(LODIdx, OldSection);
+				Info.MaterialIndex = OldToNew.IsValidIndex(Info.MaterialIndex) ? OldToNew[Info.MaterialIndex] : 0;
+
+				int32 MergedSection = SectionInfos.IndexOfByPredicate([&Info](const FMeshSectionInfo& Other)
+					{
+						return (Other.MaterialIndex == Info.MaterialIndex) &&
+							(Other.bEnableCollision == Info.bEnableCollision) &&
+							(Other.bCastShadow == Info.bCastShadow);
+					});
+				if(INDEX_NONE == MergedSection)
+				{
+					MergedSection = SectionInfos.Add(Info);
+				}
+				NewSection = &OldSectionToNew.Add(OldSection, MergedSection);
+			}
+			*ItFace = *NewSection;
+		}
+	}
+
+	// 統合前の構成をジャーナルへ記録してから、面のセクション番号/セクション情報/スロットを差し替えてビルド 
+	Mesh->Modify();
+	FMICRepJournal::RecordMerged(Mesh, OldToNew, OldFaceSections);
+	for(int32 LODIdx = 0; LODIdx < Mesh->SourceModels.Num(); ++LODIdx)
+	{
+		FStaticMeshSourceModel& SourceModel = Mesh->SourceModels[LODIdx];
+		if(!SourceModel.RawMeshBulkData->IsEmpty())
+		{
+			SourceModel.RawMeshBulkData->SaveRawMesh(RawMeshes[LODIdx]);
+		}
+	}
+	Mesh->SectionInfoMap.Clear();
+	for(int32 LODIdx = 0; LODIdx < NewSectionInfos.Num(); ++LODIdx)
+	{
+		for(int32 SectionIdx = 0; SectionIdx < NewSectionInfos[LODIdx].Num(); ++SectionIdx)
+		{
+			Mesh->SectionInfoMap.Set(LODIdx, SectionIdx, NewSectionInfos[LODIdx][SectionIdx]);
+		}
+	}
+	Mesh->StaticMaterials = NewMaterials;
+	Mesh->Build(true);
+	Mesh->MarkPackageDirty();
+
+	// 配置済みコンポーネントの OverrideMaterials はレベルの置換時に並べ替える 
+	FMICRepMaterialRemap::Get().AddSlotRemap(Mesh, OldToNew);
+	if(nullptr != OutOldToNew)
+	{
+		*OutOldToNew = OldToNew;
+	}
+
+	UE_LOG(LogMICRep, Verbose, TEXT("Merged material slots of %s: %d -> %d"), *Mesh->GetPathName(), OldToNew.Num(), NewMaterials.Num());
+	return true;
+}
+
+bool FMICRepSectionMerge::CompactSkeletalMesh(USkeletalMesh* Mesh, TArray<int32>* OutOldToNew)
+{
+	if(nullptr == Mesh)
+	{
+		return false;
+	}
+
+	TArray<int32> OldToNew;
+	TArray<FSkeletalMaterial> NewMaterials;
+	if(!BuildSlotRemap(Mesh->Materials, OldToNew, NewMaterials))
+	{
+		return false;
+	}
+
+	Mesh->Modify();
+	FMICRepJournal::RecordMerged(Mesh, OldToNew);
+
+	// セクションのマテリアル参照を付け替え 
+	FSkeletalMeshResource* Resource = Mesh->GetImportedResource();
+	for(int32 LODIdx = 0; LODIdx < Resource->LODModels.Num(); ++LODIdx)
+	{
+		FStaticLODModel& LODModel = Resource->LODModels[LODIdx];
+		for(auto ItSection = LODModel.Sections.CreateIterator(); ItSection; ++ItSection)
+		{
+			FSkelMeshSection& Section = *ItSection;
+			if(OldToNew.IsValidIndex(Section.MaterialIndex))
+			{
+				Section.MaterialIndex = (uint16)OldToNew[Section.MaterialIndex];
+			}
+		}
+	}
+
+	// LODごとのマテリアル差し替え 
+	for(auto ItLODInfo = Mesh->LODInfo.CreateIterator(); ItLODInfo; ++ItLODInfo)
+	{
+		for(auto ItMap = (*ItLODInfo).LODMaterialMap.CreateIterator(); ItMap; ++ItMap)
+		{
+			if(OldToNew.IsValidIndex(*ItMap))
+			{
+				*ItMap = OldToNew[*ItMap];
+			}
+		}
+	}
+
+	Mesh->Materials = NewMaterials;
+	Mesh->PostEditChange();
+	Mesh->MarkPackageDirty();
+
+	// 配置済みコンポーネントの OverrideMaterials はレベルの置換時に並べ替える 
+	FMICRepMaterialRemap::Get().AddSlotRemap(Mesh, OldToNew);
+	if(nullptr != OutOldToNew)
+	{
+		*OutOldToNew = OldToNew;
+	}
+
+	UE_LOG(LogMICRep, Verbose, TEXT("Compacted material slots of %s: %d -> %d"), *Mesh->GetPathName(), OldToNew.Num(), NewMaterials.Num());
+	return true;
+}
@@ -0,0 +1,27 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UStaticMesh;
+class USkeletalMesh;
+
+//
+// 同じマテリアルを参照するマテリアルスロットを1つにまとめる（Unify後の後処理） 
+// 統合前のスロットとセクションの構成はジャーナルへ記録し、ロールバックで戻せる. 
+//
+class FMICRepSectionMerge
+{
+public:
+	// StaticMesh: 各LODのセクションを統合してビルドし直す（変更した場合true. OutOldToNew: スロットの対応表） 
+	static bool MergeStaticMesh(UStaticMesh* Mesh, TArray<int32>* OutOldToNew = nullptr);
+
+	// SkeletalMesh: スロットを詰めてセクションの参照先を付け替える（セクション自体は統合しない） 
+	static bool CompactSkeletalMesh(USkeletalMesh* Mesh, TArray<int32>* OutOldToNew = nullptr);
+
+private:
+	// 同じマテリアルのスロットを先頭のスロットへ寄せた対応表 <旧スロット, 新スロット>（重複が無ければfalse） 
+	template<typename SlotType>
+	static bool BuildSlotRemap(const TArray<SlotType>& Slots, TArray<int32>& OutOldToNew, TArray<SlotType>& OutNewSlots);
+};
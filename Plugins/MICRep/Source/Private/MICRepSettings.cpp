@@ -0,0 +1,41 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepSettings.h"
+
+
+UMICRepSettings::UMICRepSettings()
+	: bDeferShaderCompilation(true)
+	, bStreamingConversion(false)
+	, StreamingChunkSize(200)
+	, SliceBudgetMilliseconds(30.0f)
+	, SlicedWindowSize(50)
+	, bDeduplicateTextures(true)
+	, bRedirectDuplicateTextures(false)
+	, bClusterParameters(false)
+	, ParameterTolerance(0.02f)
+	, bMergeSectionsAfterUnify(false)
+	, bGenerateLODVariants(false)
+	, LODVariantStartLOD(1)
+	, bWriteImpactReport(true)
+	, EstimatedShaderMapKilobytes(512)
+	, BaseMaterialScope(EMICRepBaseMaterialScope::PerMesh)
+{
+	BaseMaterial = FStringAssetReference(TEXT("/MICRep/M_MICRepBase.M_MICRepBase"));
+	SharedBaseMaterialDirectory.Path = TEXT("/Game/MICRep");
+
+	// M_MICRepBase が持つのは BaseColor/Normal のみ. ORM/Emissive は対応するパラメータを持つベースでのみ使われる 
+	TextureRules.Add(FMICRepTextureRule(MP_BaseColor, TEXT("BaseColor")));
+	TextureRules.Add(FMICRepTextureRule(MP_Normal, TEXT("Normal"), TEXT("UseNormal")));
+	TextureRules.Add(FMICRepTextureRule(MP_AmbientOcclusion, TEXT("ORM"), TEXT("UseORM"), EMICRepTextureChannel::R));
+	TextureRules.Add(FMICRepTextureRule(MP_Roughness, TEXT("ORM"), TEXT("UseORM"), EMICRepTextureChannel::G));
+	TextureRules.Add(FMICRepTextureRule(MP_Metallic, TEXT("ORM"), TEXT("UseORM"), EMICRepTextureChannel::B));
+	TextureRules.Add(FMICRepTextureRule(MP_EmissiveColor, TEXT("Emissive"), TEXT("UseEmissive")));
+
+	// 遠景LODでは法線マップとORMをサンプリングしない 
+	LODVariantDisabledSwitches.Add(TEXT("UseNormal"));
+	LODVariantDisabledSwitches.Add(TEXT("UseORM"));
+
+	CategoryName = TEXT("Plugins");
+	SectionName = TEXT("MICRep");
+}
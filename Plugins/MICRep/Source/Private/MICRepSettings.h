@@ -0,0 +1,170 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Engine/DeveloperSettings.h"
+#include "SceneTypes.h"
+#include "MICRepSettings.generated.h"
+
+//
+// ベースマテリアルの共有範囲 
+//
+UENUM()
+enum class EMICRepBaseMaterialScope : uint8
+{
+	/** Duplicate the base material for every mesh. */
+	PerMesh,
+	/** Share one base material per content folder. */
+	PerFolder,
+	/** Share one base material across the whole project. */
+	PerProject,
+};
+
+//
+// テクスチャルールが要求するサンプリングチャンネル 
+//
+UENUM()
+enum class EMICRepTextureChannel : uint8
+{
+	/** Accept the texture whichever channels the source material samples. */
+	Any,
+	/** The source material samples the color channels. */
+	RGB,
+	/** The source material samples only the red channel. */
+	R,
+	/** The source material samples only the green channel. */
+	G,
+	/** The source material samples only the blue channel. */
+	B,
+	/** The source material samples only the alpha channel. */
+	A,
+};
+
+//
+// 元マテリアルのプロパティからベースマテリアルのテクスチャパラメータへの対応 
+//
+// 同じ ParameterName を持つルールが複数ある場合はチャンネルをまとめたテクスチャ（ORMなど）とみなし、 
+// すべてのプロパティが同じテクスチャを参照しているときのみ設定する. Channel を指定したルールは 
+// 元マテリアルがそのチャンネルを直接サンプリングしている場合のみテクスチャを採用する. 
+//
+USTRUCT()
+struct FMICRepTextureRule
+{
+	GENERATED_BODY()
+
+	/** Material property whose texture chain is analyzed on the source material. */
+	UPROPERTY(config, EditAnywhere, Category = "Texture")
+	TEnumAsByte<EMaterialProperty> Property;
+
+	/** Texture parameter on the base material that receives the texture. Rules are skipped for bases without this parameter. */
+	UPROPERTY(config, EditAnywhere, Category = "Texture")
+	FName ParameterName;
+
+	/** Optional static switch on the base material that is turned off when no texture is found for this parameter. */
+	UPROPERTY(config, EditAnywhere, Category = "Texture")
+	FName StaticSwitch;
+
+	/** Channel the base material reads for this property. Textures the source samples through other channels (or through math that hides the channel) are not carried over. */
+	UPROPERTY(config, EditAnywhere, Category = "Texture")
+	EMICRepTextureChannel Channel;
+
+	FMICRepTextureRule() : Property(MP_BaseColor), Channel(EMICRepTextureChannel::Any) {}
+	FMICRepTextureRule(EMaterialProperty InProperty, FName InParameterName, FName InStaticSwitch = NAME_None, EMICRepTextureChannel InChannel = EMICRepTextureChannel::Any)
+		: Property(InProperty)
+		, ParameterName(InParameterName)
+		, StaticSwitch(InStaticSwitch)
+		, Channel(InChannel)
+	{}
+};
+
+//
+// MICRepの設定（Project Settings > Plugins > MIC Rep） 
+//
+UCLASS(config=Editor, defaultconfig, meta=(DisplayName="MIC Rep"))
+class UMICRepSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	UMICRepSettings();
+
+	/** Suppress per-instance shader recompiles during bulk operations and submit them together at the end. */
+	UPROPERTY(config, EditAnywhere, Category = "Performance")
+	bool bDeferShaderCompilation;
+
+	/** Process meshes in chunks, saving and unloading touched packages after each chunk to keep memory flat. */
+	UPROPERTY(config, EditAnywhere, Category = "Performance")
+	bool bStreamingConversion;
+
+	/** Number of meshes per chunk when bStreamingConversion is enabled. */
+	UPROPERTY(config, EditAnywhere, Category = "Performance", meta = (ClampMin = "1", EditCondition = "bStreamingConversion"))
+	int32 StreamingChunkSize;
+
+	/** Editor time spent per tick on bulk operations started from the Content Browser. */
+	UPROPERTY(config, EditAnywhere, Category = "Performance", meta = (ClampMin = "1"))
+	float SliceBudgetMilliseconds;
+
+	/** Maximum number of assets preloaded and shader-batched together when running from the Content Browser. */
+	UPROPERTY(config, EditAnywhere, Category = "Performance", meta = (ClampMin = "1"))
+	int32 SlicedWindowSize;
+
+	/** Treat textures whose source data is byte-identical as the same texture when unifying and deduplicating MICs. */
+	UPROPERTY(config, EditAnywhere, Category = "Deduplication")
+	bool bDeduplicateTextures;
+
+	/** Make generated MICs reference one canonical texture instead of its byte-identical duplicates. */
+	UPROPERTY(config, EditAnywhere, Category = "Deduplication", meta = (EditCondition = "bDeduplicateTextures"))
+	bool bRedirectDuplicateTextures;
+
+	/** Merge generated MICs whose parent and textures match and whose scalar/vector parameters differ by at most ParameterTolerance. */
+	UPROPERTY(config, EditAnywhere, Category = "Deduplication")
+	bool bClusterParameters;
+
+	/** Largest per-component difference of scalar/vector parameters that is still treated as the same MIC. */
+	UPROPERTY(config, EditAnywhere, Category = "Deduplication", meta = (ClampMin = "0", EditCondition = "bClusterParameters"))
+	float ParameterTolerance;
+
+	/**
+	 * Which source material properties are carried over to which base material texture parameters.
+	 * Several rules sharing a ParameterName describe one channel-packed texture (e.g. AO/Roughness/Metallic -> ORM)
+	 * and only apply when all of those properties sample the same texture.
+	 */
+	UPROPERTY(config, EditAnywhere, Category = "Textures")
+	TArray<FMICRepTextureRule> TextureRules;
+
+	/** After unifying, merge material slots that end up referencing the same MIC. Static mesh sections are merged and rebuilt; skeletal mesh slots are compacted. */
+	UPROPERTY(config, EditAnywhere, Category = "Mesh")
+	bool bMergeSectionsAfterUnify;
+
+	/** Also create a cheaper MIC per converted material and use it on the lower LODs of each mesh. */
+	UPROPERTY(config, EditAnywhere, Category = "LOD")
+	bool bGenerateLODVariants;
+
+	/** First LOD that uses the cheaper MIC. */
+	UPROPERTY(config, EditAnywhere, Category = "LOD", meta = (ClampMin = "1", EditCondition = "bGenerateLODVariants"))
+	int32 LODVariantStartLOD;
+
+	/** Static switches turned off on the cheaper MIC. The textures of the matching TextureRules are not sampled. */
+	UPROPERTY(config, EditAnywhere, Category = "LOD", meta = (EditCondition = "bGenerateLODVariants"))
+	TArray<FName> LODVariantDisabledSwitches;
+
+	/** Write a before/after impact report (materials, shader maps, slots, texture references) to Saved/MICRep/Reports after each conversion run from the Content Browser. */
+	UPROPERTY(config, EditAnywhere, Category = "Report")
+	bool bWriteImpactReport;
+
+	/** Average memory of one material shader map on the target platform, used to estimate shader-map memory in impact reports. */
+	UPROPERTY(config, EditAnywhere, Category = "Report", meta = (ClampMin = "0"))
+	int32 EstimatedShaderMapKilobytes;
+
+	/** Material duplicated as the base of generated MICs. It needs the texture parameters and static switches named in TextureRules. */
+	UPROPERTY(config, EditAnywhere, Category = "BaseMaterial", meta = (AllowedClasses = "Material"))
+	FStringAssetReference BaseMaterial;
+
+	/** How widely a generated base material is shared between converted meshes. */
+	UPROPERTY(config, EditAnywhere, Category = "BaseMaterial")
+	EMICRepBaseMaterialScope BaseMaterialScope;
+
+	/** Folder that holds the project-wide base material when BaseMaterialScope is PerProject. */
+	UPROPERTY(config, EditAnywhere, Category = "BaseMaterial", meta = (ContentDir))
+	FDirectoryPath SharedBaseMaterialDirectory;
+};
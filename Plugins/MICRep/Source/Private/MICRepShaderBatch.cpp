@@ -0,0 +1,150 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepShaderBatch.h"
+#include "MICRepSettings.h"
+#include "MICRepStats.h"
+#include "ShaderCompiler.h"
+
+
+#define LOCTEXT_NAMESPACE "MICRep"
+
+
+int32 FMICRepShaderBatch::Depth = 0;
+int32 FMICRepShaderBatch::NumSubmitted = 0;
+TArray<TWeakObjectPtr<UMaterialInstanceConstant>> FMICRepShaderBatch::PendingMICs;
+TSet<TWeakObjectPtr<UMaterialInstanceConstant>> FMICRepShaderBatch::PendingSet;
+TMap<TWeakObjectPtr<UMaterialInstanceConstant>, FStaticParameterSet> FMICRepShaderBatch::PendingStaticParams;
+
+
+FMICRepShaderBatch::FMICRepShaderBatch()
+	: bActive(GetDefault<UMICRepSettings>()->bDeferShaderCompilation)
+{
+	if(bActive)
+	{
+		Depth++;
+	}
+}
+
+FMICRepShaderBatch::~FMICRepShaderBatch()
+{
+	if(bActive)
+	{
+		// 入れ子の場合は最も外側のスコープでまとめて実行 
+		Depth--;
+		if(0 == Depth)
+		{
+			Flush();
+		}
+	}
+}
+
+void FMICRepShaderBatch::UpdateStaticPermutation(UMaterialInstanceConstant* MIC, const FStaticParameterSet& StaticParams)
+{
+	if(nullptr == MIC)
+	{
+		return;
+	}
+	if(0 == Depth)
+	{
+		MICREP_SCOPE_PHASE(ShaderUpdate);
+		MIC->UpdateStaticPermutation(StaticParams);
+		NumSubmitted++;
+		return;
+	}
+	AddPending(MIC);
+	PendingStaticParams.Add(MIC, StaticParams);
+}
+
+void FMICRepShaderBatch::PostEditChange(UMaterialInstanceConstant* MIC)
+{
+	if(nullptr == MIC)
+	{
+		return;
+	}
+	if(0 == Depth)
+	{
+		MICREP_SCOPE_PHASE(ShaderUpdate);
+		MIC->PostEditChange();
+		NumSubmitted++;
+		return;
+	}
+	AddPending(MIC);
+}
+
+void FMICRepShaderBatch::DiscardPending()
+{
+	PendingMICs.Reset();
+	PendingSet.Reset();
+	PendingStaticParams.Reset();
+}
+
+void FMICRepShaderBatch::AddPending(UMaterialInstanceConstant* MIC)
+{
+	bool bAlreadyPending = false;
+	PendingSet.Add(MIC, &bAlreadyPending);
+	if(!bAlreadyPending)
+	{
+		PendingMICs.Add(MIC);
+	}
+}
+
+void FMICRepShaderBatch::Flush()
+{
+	TArray<TWeakObjectPtr<UMaterialInstanceConstant>> MICs = MoveTemp(PendingMICs);
+	TMap<TWeakObjectPtr<UMaterialInstanceConstant>, FStaticParameterSet> StaticParams = MoveTemp(PendingStaticParams);
+	PendingMICs.Reset();
+	PendingSet.Reset();
+	PendingStaticParams.Reset();
+	if(0 == MICs.Num())
+	{
+		return;
+	}
+
+	MICREP_SCOPE_PHASE(ShaderUpdate);
+
+	FScopedSlowTask SlowTask(
+		MICs.Num() + 1,
+		FText::Format(LOCTEXT("CompilingMICs", "Compiling {0} MaterialInstances..."), FText::AsNumber(MICs.Num()))
+		);
+	SlowTask.MakeDialog();
+
+	{
+		// 描画状態の再作成はコンテキスト終了時の一度だけ 
+		FMaterialUpdateContext UpdateContext;
+		for(auto ItMIC = MICs.CreateConstIterator(); ItMIC; ++ItMIC)
+		{
+			SlowTask.EnterProgressFrame(1);
+
+			UMaterialInstanceConstant* MIC = (*ItMIC).Get();
+			if(nullptr == MIC)
+			{
+				continue;
+			}
+
+			// 親の変更や新規作成は現在のStaticParameterで更新する. PostEditChangeは個別に更新コンテキストを作るため使わない 
+			FStaticParameterSet CurrentParams;
+			const FStaticParameterSet* Params = StaticParams.Find(*ItMIC);
+			if(nullptr == Params)
+			{
+				MIC->GetStaticParameterValues(CurrentParams);
+				Params = &CurrentParams;
+			}
+			MIC->UpdateStaticPermutation(*Params, &UpdateContext);
+			// パラメータに変化が無いと再初期化されないため、親の参照をレンダリングリソースへ反映する 
+			MIC->InitResources();
+			UpdateContext.AddMaterialInstance(MIC);
+			NumSubmitted++;
+		}
+	}
+
+	// 投入済みのコンパイルの完了を待つ 
+	SlowTask.EnterProgressFrame(1, LOCTEXT("WaitingForShaders", "Waiting for shaders..."));
+	if(nullptr != GShaderCompilingManager)
+	{
+		GShaderCompilingManager->FinishAllCompilation();
+	}
+}
+
+
+#undef LOCTEXT_NAMESPACE
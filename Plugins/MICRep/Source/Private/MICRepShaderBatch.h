@@ -0,0 +1,41 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "StaticParameterSet.h"
+
+class UMaterialInstanceConstant;
+
+//
+// 一括処理中のシェーダーコンパイルを保留し、スコープ終了時にまとめて実行する 
+//
+class FMICRepShaderBatch
+{
+public:
+	FMICRepShaderBatch();
+	~FMICRepShaderBatch();
+
+	// バッチ中は登録のみ、それ以外は即時に適用 
+	static void UpdateStaticPermutation(UMaterialInstanceConstant* MIC, const FStaticParameterSet& StaticParams);
+	static void PostEditChange(UMaterialInstanceConstant* MIC);
+
+	// 保留中の更新を適用せずに破棄（エディタの終了時） 
+	static void DiscardPending();
+
+	// 起動してから適用したシェーダー更新の数（ベンチマーク用） 
+	static int32 GetNumSubmitted() { return NumSubmitted; }
+
+private:
+	static void AddPending(UMaterialInstanceConstant* MIC);
+	static void Flush();
+
+	bool bActive;
+
+	static int32 Depth;
+	static int32 NumSubmitted;
+	// 登録順（子孫は親より後に処理する）と重複確認用 
+	static TArray<TWeakObjectPtr<UMaterialInstanceConstant>> PendingMICs;
+	static TSet<TWeakObjectPtr<UMaterialInstanceConstant>> PendingSet;
+	static TMap<TWeakObjectPtr<UMaterialInstanceConstant>, FStaticParameterSet> PendingStaticParams;
+};
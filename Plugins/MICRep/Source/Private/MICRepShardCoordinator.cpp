@@ -0,0 +1,283 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepShardCoordinator.h"
+#include "MICRepModule.h"
+#include "MICRepMICIndex.h"
+#include "MICRepMaterialRemap.h"
+#include "MICRepPlanner.h"
+#include "MICRepStats.h"
+#include "MICRepJournal.h"
+#include "FileHelpers.h"
+#include "ObjectTools.h"
+
+
+bool FMICRepShardCoordinator::Run(const TArray<FAssetData>& MeshAssets, bool bUnify, int32 NumWorkers, const FString& WorkDir, TArray<FStringAssetReference>& OutObjectsToSync)
+{
+	FMICRepRunStats::FScopedRun ScopedRun(TEXT("Shard"));
+	FMICRepJournal::FScopedRun ScopedJournal(TEXT("Shard"));
+	NumWorkers = FMath::Max(1, NumWorkers);
+
+	// プラン作成（MICの重複はここでプラン全体から除かれる） 
+	FMICRepPlan Plan;
+	FMICRepPlanner::BuildPlan(MeshAssets, bUnify, Plan);
+	UE_LOG(LogMICRep, Display, TEXT("Shard: Meshes=%d, BaseMaterials=%d, MICs=%d, Workers=%d"),
+		Plan.Meshes.Num(), Plan.BaseMaterials.Num(), Plan.Instances.Num(), NumWorkers);
+
+	const FString PlanFile = FPaths::Combine(*WorkDir, TEXT("Plan.json"));
+	if(!FMICRepPlanner::SavePlan(Plan, PlanFile))
+	{
+		UE_LOG(LogMICRep, Error, TEXT("Failed to write plan '%s'."), *PlanFile);
+		return false;
+	}
+
+	// ベースマテリアルは全シャードで共有するため先に作成 
+	{
+		FMICRepApplyOptions Options;
+		Options.bInstances = false;
+		Options.bMeshes = false;
+		if(!FMICRepModule::ExecuteApplyPlan(Plan, Options, OutObjectsToSync))
+		{
+			return false;
+		}
+		SaveDirtyPackages();
+	}
+
+	// MIC作成 
+	TArray<FString> ResultFiles;
+	if(!RunWorkers(PlanFile, TEXT("instances"), NumWorkers, WorkDir, ResultFiles))
+	{
+		return false;
+	}
+	TArray<FString> Collapsed;
+	if(!MergeResults(Plan, NumWorkers, ResultFiles, Collapsed))
+	{
+		return false;
+	}
+
+	const FString MergedPlanFile = FPaths::Combine(*WorkDir, TEXT("Plan_Merged.json"));
+	if(!FMICRepPlanner::SavePlan(Plan, MergedPlanFile))
+	{
+		UE_LOG(LogMICRep, Error, TEXT("Failed to write plan '%s'."), *MergedPlanFile);
+		return false;
+	}
+	FMICRepMICIndex::Get().Save();
+
+	// メッシュへ割り当て 
+	TArray<FString> MeshResultFiles;
+	const bool bMeshesSucceeded = RunWorkers(MergedPlanFile, TEXT("meshes"), NumWorkers, WorkDir, MeshResultFiles);
+
+	// 失敗したシャードがあっても、割り当て済みのメッシュの分は記録しておく 
+	MergeRemaps(Plan, NumWorkers, MeshResultFiles);
+	if(!bMeshesSucceeded)
+	{
+		return false;
+	}
+
+	// どのメッシュからも参照されなくなった重複MICを削除 
+	const int32 NumDeleted = DeleteCollapsed(Collapsed);
+	UE_LOG(LogMICRep, Display, TEXT("Deleted %d of %d duplicate MICs."), NumDeleted, Collapsed.Num());
+	return true;
+}
+
+bool FMICRepShardCoordinator::RunWorkers(const FString& PlanFile, const TCHAR* Stage, int32 NumWorkers, const FString& WorkDir, TArray<FString>& OutResultFiles)
+{
+	const FString ExecutablePath = FPlatformProcess::ExecutablePath();
+	const FString ProjectPath = FPaths::ConvertRelativePathToFull(FPaths::GetProjectFilePath());
+
+	TArray<FProcHandle> Processes;
+	TArray<FString> JournalFiles;
+	for(int32 ShardIdx = 0; ShardIdx < NumWorkers; ++ShardIdx)
+	{
+		const FString ResultFile = FPaths::ConvertRelativePathToFull(
+			FPaths::Combine(*WorkDir, *FString::Printf(TEXT("Result_%s_%d.json"), Stage, ShardIdx)));
+		const FString LogFile = FPaths::ConvertRelativePathToFull(
+			FPaths::Combine(*WorkDir, *FString::Printf(TEXT("Worker_%s_%d.log"), Stage, ShardIdx)));
+		const FString JournalFile = FPaths::ConvertRelativePathToFull(
+			FPaths::Combine(*WorkDir, *FString::Printf(TEXT("Journal_%s_%d.bin"), Stage, ShardIdx)));
+		IFileManager::Get().Delete(*ResultFile);
+		IFileManager::Get().Delete(*JournalFile);
+		OutResultFiles.Add(ResultFile);
+		JournalFiles.Add(JournalFile);
+
+		// キャッシュの書き込みは統合側のみ（ジャーナルも統合側でまとめる） 
+		const FString Params = FString::Printf(
+			TEXT("\"%s\" -run=MICRep -mode=apply -plan=\"%s\" -stage=%s -shard=%d -shards=%d -result=\"%s\" -journal=\"%s\" -nocaches -abslog=\"%s\" -unattended -nopause"),
+			*ProjectPath,
+			*FPaths::ConvertRelativePathToFull(PlanFile),
+			Stage,
+			ShardIdx,
+			NumWorkers,
+			*ResultFile,
+			*JournalFile,
+			*LogFile
+			);
+		UE_LOG(LogMICRep, Display, TEXT("Launch worker %s %d/%d: %s"), Stage, ShardIdx + 1, NumWorkers, *LogFile);
+
+		FProcHandle Process = FPlatformProcess::CreateProc(*ExecutablePath, *Params, false, true, true, nullptr, 0, nullptr, nullptr);
+		if(!Process.IsValid())
+		{
+			UE_LOG(LogMICRep, Error, TEXT("Failed to launch worker '%s %s'."), *ExecutablePath, *Params);
+		}
+		Processes.Add(Process);
+	}
+
+	// 全ワーカーの終了を待つ 
+	bool bSucceeded = true;
+	for(int32 ShardIdx = 0; ShardIdx < Processes.Num(); ++ShardIdx)
+	{
+		FProcHandle& Process = Processes[ShardIdx];
+		if(!Process.IsValid())
+		{
+			bSucceeded = false;
+			continue;
+		}
+		FPlatformProcess::WaitForProc(Process);
+
+		int32 ReturnCode = 0;
+		FPlatformProcess::GetProcReturnCode(Process, &ReturnCode);
+		FPlatformProcess::CloseProc(Process);
+		if(0 != ReturnCode)
+		{
+			UE_LOG(LogMICRep, Error, TEXT("Worker %s %d/%d failed (ReturnCode=%d)."), Stage, ShardIdx + 1, NumWorkers, ReturnCode);
+			bSucceeded = false;
+		}
+	}
+
+	// 失敗したワーカーの変更もロールバックできるよう、残っているジャーナルはすべて統合 
+	for(auto ItJournal = JournalFiles.CreateConstIterator(); ItJournal; ++ItJournal)
+	{
+		if(IFileManager::Get().FileExists(**ItJournal) && FMICRepJournal::Append(*ItJournal))
+		{
+			IFileManager::Get().Delete(**ItJournal);
+		}
+	}
+	return bSucceeded;
+}
+
+bool FMICRepShardCoordinator::MergeResults(FMICRepPlan& Plan, int32 NumWorkers, const TArray<FString>& ResultFiles, TArray<FString>& OutCollapsed)
+{
+	for(int32 ShardIdx = 0; ShardIdx < ResultFiles.Num(); ++ShardIdx)
+	{
+		FMICRepPlan Result;
+		if(!FMICRepPlanner::LoadPlan(ResultFiles[ShardIdx], Result) || (Result.Instances.Num() != Plan.Instances.Num()))
+		{
+			UE_LOG(LogMICRep, Error, TEXT("Invalid worker result '%s'."), *ResultFiles[ShardIdx]);
+			return false;
+		}
+
+		// 各ワーカーの担当範囲のみ採用 
+		int32 Begin = 0;
+		int32 End = 0;
+		FMICRepPlanner::GetShardRange(Plan.Instances.Num(), ShardIdx, NumWorkers, Begin, End);
+		for(int32 InstanceIdx = Begin; InstanceIdx < End; ++InstanceIdx)
+		{
+			Plan.Instances[InstanceIdx].ObjectPath = Result.Instances[InstanceIdx].ObjectPath;
+			Plan.Instances[InstanceIdx].Hash = Result.Instances[InstanceIdx].Hash;
+		}
+	}
+
+	// 同一内容のMICは最初に見つかったものへまとめる <Hash, ObjectPath> 
+	TMap<FString, FString> HashToPath;
+	int32 NumMissing = 0;
+	int32 NumCollapsed = 0;
+	for(auto ItInstance = Plan.Instances.CreateIterator(); ItInstance; ++ItInstance)
+	{
+		FMICRepPlannedInstance& Instance = *ItInstance;
+		if(Instance.ObjectPath.IsEmpty())
+		{
+			NumMissing++;
+			continue;
+		}
+		if(Instance.Hash.IsEmpty())
+		{
+			continue;
+		}
+
+		const FString* CanonicalPath = HashToPath.Find(Instance.Hash);
+		if(nullptr == CanonicalPath)
+		{
+			HashToPath.Add(Instance.Hash, Instance.ObjectPath);
+
+			FSHAHash Hash;
+			Hash.FromString(Instance.Hash);
+			FMICRepMICIndex::Get().Add(Hash, Instance.ObjectPath);
+		}
+		else if(*CanonicalPath != Instance.ObjectPath)
+		{
+			UE_LOG(LogMICRep, Warning, TEXT("Duplicate MIC %s -> %s"), *Instance.ObjectPath, **CanonicalPath);
+			OutCollapsed.AddUnique(Instance.ObjectPath);
+			Instance.ObjectPath = *CanonicalPath;
+			NumCollapsed++;
+		}
+	}
+	UE_LOG(LogMICRep, Display, TEXT("Merged %d MICs (Unique=%d, Collapsed=%d, Missing=%d)."),
+		Plan.Instances.Num(), HashToPath.Num(), NumCollapsed, NumMissing);
+	return true;
+}
+
+void FMICRepShardCoordinator::MergeRemaps(const FMICRepPlan& Plan, int32 NumWorkers, const TArray<FString>& ResultFiles)
+{
+	FMICRepMaterialRemap& Remap = FMICRepMaterialRemap::Get();
+	int32 NumSlotRemaps = 0;
+	for(int32 ShardIdx = 0; ShardIdx < ResultFiles.Num(); ++ShardIdx)
+	{
+		FMICRepPlan Result;
+		if(!FMICRepPlanner::LoadPlan(ResultFiles[ShardIdx], Result) || (Result.Meshes.Num() != Plan.Meshes.Num()))
+		{
+			UE_LOG(LogMICRep, Warning, TEXT("Missing worker result '%s'. Its meshes are not recorded for level remapping."), *ResultFiles[ShardIdx]);
+			continue;
+		}
+
+		// 各ワーカーの担当範囲のみ採用 
+		int32 Begin = 0;
+		int32 End = 0;
+		FMICRepPlanner::GetShardRange(Plan.Meshes.Num(), ShardIdx, NumWorkers, Begin, End);
+		for(int32 MeshIdx = Begin; MeshIdx < End; ++MeshIdx)
+		{
+			const FMICRepPlannedMesh& Mesh = Result.Meshes[MeshIdx];
+			for(auto ItReplacement = Mesh.Replacements.CreateConstIterator(); ItReplacement; ++ItReplacement)
+			{
+				const int32 InstanceIdx = (*ItReplacement).Instance;
+				if(Plan.Instances.IsValidIndex(InstanceIdx) && !Plan.Instances[InstanceIdx].ObjectPath.IsEmpty())
+				{
+					Remap.Add((*ItReplacement).SourceMaterial, Plan.Instances[InstanceIdx].ObjectPath);
+				}
+			}
+			if(0 < Mesh.OldSlotToNew.Num())
+			{
+				Remap.AddSlotRemap(Mesh.ObjectPath, Mesh.OldSlotToNew);
+				NumSlotRemaps++;
+			}
+		}
+	}
+	Remap.Save();
+	UE_LOG(LogMICRep, Display, TEXT("Merged material remaps (SlotRemaps=%d)."), NumSlotRemaps);
+}
+
+int32 FMICRepShardCoordinator::DeleteCollapsed(const TArray<FString>& ObjectPaths)
+{
+	// ワーカーが保存したアセットはこのプロセスのレジストリに無いため直接ロード 
+	TArray<FAssetData> AssetsToDelete;
+	for(auto ItPath = ObjectPaths.CreateConstIterator(); ItPath; ++ItPath)
+	{
+		UObject* Asset = LoadObject<UMaterialInstanceConstant>(nullptr, **ItPath, nullptr, LOAD_NoWarn);
+		if(nullptr != Asset)
+		{
+			AssetsToDelete.Add(FAssetData(Asset));
+		}
+	}
+	if(0 == AssetsToDelete.Num())
+	{
+		return 0;
+	}
+	return ObjectTools::DeleteAssets(AssetsToDelete, false);
+}
+
+int32 FMICRepShardCoordinator::SaveDirtyPackages()
+{
+	TArray<UPackage*> DirtyPackages;
+	FEditorFileUtils::GetDirtyContentPackages(DirtyPackages);
+
+	return FMICRepModule::SavePackages(DirtyPackages);
+}
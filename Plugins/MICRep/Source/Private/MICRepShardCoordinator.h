@@ -0,0 +1,40 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+
+struct FMICRepPlan;
+
+//
+// 対象メッシュをシャードに分割し、ワーカーのエディタプロセスで並列に変換する 
+//
+// 1. プランを作成（(Base, BaseColor, Normal) が同じMICはプラン全体で1つに統合済み） 
+// 2. ベースマテリアルとNormalMapなしの親をこのプロセスで作成して保存 
+// 3. ワーカーがシャードごとにMICを作成し、結果をJSONで返す 
+// 4. 結果を統合して重複排除インデックスへ登録（同一内容のMICは1つにまとめる） 
+// 5. ワーカーがシャードごとにメッシュへ割り当て 
+// 6. 置換元→置換先とスロットの対応表を統合（レベルの置換に使う） 
+// 7. まとめた側の重複MICを削除 
+//
+// ワーカーのジャーナルはこのプロセスのジャーナルへ統合し、1回の実行としてロールバックできるようにする. 
+// ワーカーはキャッシュを書き込まないため、対応表はプランと結果ファイルからこのプロセスで記録する. 
+//
+class FMICRepShardCoordinator
+{
+public:
+	static bool Run(const TArray<FAssetData>& MeshAssets, bool bUnify, int32 NumWorkers, const FString& WorkDir, TArray<FStringAssetReference>& OutObjectsToSync);
+
+private:
+	// 全シャードのワーカーを起動して終了を待つ 
+	static bool RunWorkers(const FString& PlanFile, const TCHAR* Stage, int32 NumWorkers, const FString& WorkDir, TArray<FString>& OutResultFiles);
+	// ワーカーが作成したMICをプランと重複排除インデックスへ統合（OutCollapsed: まとめられた重複MIC） 
+	static bool MergeResults(FMICRepPlan& Plan, int32 NumWorkers, const TArray<FString>& ResultFiles, TArray<FString>& OutCollapsed);
+	// 割り当て結果から FMICRepMaterialRemap の対応表を記録 
+	static void MergeRemaps(const FMICRepPlan& Plan, int32 NumWorkers, const TArray<FString>& ResultFiles);
+	// まとめられた重複MICを削除 
+	static int32 DeleteCollapsed(const TArray<FString>& ObjectPaths);
+	// 変更されたパッケージを保存（ワーカーはディスク上のアセットを参照する） 
+	static int32 SaveDirtyPackages();
+};
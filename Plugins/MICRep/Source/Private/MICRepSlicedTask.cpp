@@ -0,0 +1,251 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepSlicedTask.h"
+#include "MICRepSettings.h"
+#include "MICRepShaderBatch.h"
+#include "MICRepStats.h"
+#include "NotificationManager.h"
+#include "SNotificationList.h"
+
+
+#define LOCTEXT_NAMESPACE "MICRep"
+
+
+TUniquePtr<FMICRepSlicedTask> FMICRepSlicedTask::ActiveTask;
+
+
+void FMICRepSlicedTask::Run(FMICRepSlicedWork& Work)
+{
+	const int32 WindowSize = FMath::Max(1, Work.WindowSize);
+	for(int32 Begin = 0; Begin < Work.NumItems; Begin += WindowSize)
+	{
+		const int32 End = FMath::Min(Begin + WindowSize, Work.NumItems);
+		if(Work.BeginWindow)
+		{
+			Work.BeginWindow(Begin, End);
+		}
+		for(int32 ItemIndex = Begin; ItemIndex < End; ++ItemIndex)
+		{
+			Work.ProcessItem(ItemIndex);
+		}
+		if(Work.EndWindow)
+		{
+			Work.EndWindow(Begin, End);
+		}
+	}
+	if(Work.Finished)
+	{
+		Work.Finished(false);
+	}
+}
+
+bool FMICRepSlicedTask::Start(FMICRepSlicedWork&& Work)
+{
+	if(!CanStart())
+	{
+		return false;
+	}
+
+	// エディタ上ではロード/シェーダーコンパイルの単位を小さくして1回の停止時間を抑える 
+	Work.WindowSize = FMath::Clamp(Work.WindowSize, 1, FMath::Max(1, GetDefault<UMICRepSettings>()->SlicedWindowSize));
+
+	// 終了済みのタスクはここで破棄（自身のTick中には破棄しない） 
+	ActiveTask.Reset(new FMICRepSlicedTask(MoveTemp(Work)));
+	return true;
+}
+
+bool FMICRepSlicedTask::IsRunning()
+{
+	return ActiveTask.IsValid() && !ActiveTask->bFinished;
+}
+
+bool FMICRepSlicedTask::CanStart()
+{
+	if(!IsRunning())
+	{
+		return true;
+	}
+
+	FNotificationInfo Info(LOCTEXT("SlicedTaskBusy", "Another MICRep operation is still running."));
+	Info.ExpireDuration = 3.0f;
+	FSlateNotificationManager::Get().AddNotification(Info);
+	return false;
+}
+
+void FMICRepSlicedTask::Abort()
+{
+	if(IsRunning())
+	{
+		ActiveTask->Release();
+	}
+	ActiveTask.Reset();
+}
+
+FMICRepSlicedTask::FMICRepSlicedTask(FMICRepSlicedWork&& InWork)
+	: Work(MoveTemp(InWork))
+	, NextItem(0)
+	, WindowBegin(0)
+	, WindowEnd(0)
+	, bWindowOpen(false)
+	, bCancelRequested(false)
+	, bFinished(false)
+{
+	FNotificationInfo Info(Work.Description);
+	Info.bFireAndForget = false;
+	Info.bUseThrobber = true;
+	Info.ExpireDuration = 3.0f;
+	Info.ButtonDetails.Add(FNotificationButtonInfo(
+		LOCTEXT("CancelTask", "Cancel"),
+		LOCTEXT("CancelTask_Tooltip", "Stop after the current asset. Assets processed so far are kept."),
+		FSimpleDelegate::CreateRaw(this, &FMICRepSlicedTask::Cancel),
+		SNotificationItem::CS_Pending
+		));
+	Notification = FSlateNotificationManager::Get().AddNotification(Info);
+	if(Notification.IsValid())
+	{
+		Notification->SetCompletionState(SNotificationItem::CS_Pending);
+	}
+	UpdateNotification();
+}
+
+void FMICRepSlicedTask::Tick(float DeltaTime)
+{
+	if(bFinished)
+	{
+		return;
+	}
+	if(bCancelRequested)
+	{
+		Finish(true);
+		return;
+	}
+
+	// 1フレームあたりの処理時間を制限 
+	const double Budget = GetDefault<UMICRepSettings>()->SliceBudgetMilliseconds / 1000.0;
+	const double StartTime = FPlatformTime::Seconds();
+	do
+	{
+		ProcessNext();
+	}
+	while(!bFinished && !bCancelRequested && ((FPlatformTime::Seconds() - StartTime) < Budget));
+
+	if(!bFinished)
+	{
+		UpdateNotification();
+	}
+}
+
+TStatId FMICRepSlicedTask::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(FMICRepSlicedTask, STATGROUP_MICRep);
+}
+
+void FMICRepSlicedTask::ProcessNext()
+{
+	if(Work.NumItems <= NextItem)
+	{
+		Finish(false);
+		return;
+	}
+
+	if(!bWindowOpen)
+	{
+		WindowBegin = NextItem;
+		WindowEnd = FMath::Min(NextItem + FMath::Max(1, Work.WindowSize), Work.NumItems);
+		bWindowOpen = true;
+		if(Work.BeginWindow)
+		{
+			Work.BeginWindow(WindowBegin, WindowEnd);
+		}
+	}
+
+	Work.ProcessItem(NextItem);
+	NextItem++;
+
+	if(WindowEnd <= NextItem)
+	{
+		CloseWindow();
+	}
+}
+
+void FMICRepSlicedTask::CloseWindow()
+{
+	bWindowOpen = false;
+	if(Work.EndWindow)
+	{
+		// 中断時は処理済みの範囲のみ 
+		Work.EndWindow(WindowBegin, NextItem);
+	}
+}
+
+void FMICRepSlicedTask::Finish(bool bCancelled)
+{
+	if(bFinished)
+	{
+		return;
+	}
+	if(bWindowOpen)
+	{
+		CloseWindow();
+	}
+	bFinished = true;
+
+	if(Work.Finished)
+	{
+		Work.Finished(bCancelled);
+	}
+
+	if(Notification.IsValid())
+	{
+		Notification->SetText(FText::Format(
+			bCancelled
+				? LOCTEXT("SlicedTaskCancelled", "{0} cancelled ({1}/{2})")
+				: LOCTEXT("SlicedTaskCompleted", "{0} completed ({1}/{2})"),
+			Work.Description,
+			FText::AsNumber(NextItem),
+			FText::AsNumber(Work.NumItems)
+			));
+		Notification->SetCompletionState(bCancelled ? SNotificationItem::CS_Fail : SNotificationItem::CS_Success);
+		Notification->ExpireAndFadeout();
+		Notification.Reset();
+	}
+}
+
+void FMICRepSlicedTask::Release()
+{
+	// 終了中のエディタではブラウザの同期や通知、シェーダーコンパイルの進捗ダイアログを出さない 
+	bFinished = true;
+	bWindowOpen = false;
+	FMICRepShaderBatch::DiscardPending();
+	if(Work.Aborted)
+	{
+		Work.Aborted();
+	}
+	Notification.Reset();
+}
+
+void FMICRepSlicedTask::Cancel()
+{
+	// 処理中の対象は最後まで行い、次のTickで終了 
+	bCancelRequested = true;
+}
+
+void FMICRepSlicedTask::UpdateNotification()
+{
+	if(!Notification.IsValid())
+	{
+		return;
+	}
+	const int32 Percent = (0 < Work.NumItems) ? (NextItem * 100 / Work.NumItems) : 100;
+	Notification->SetText(FText::Format(
+		LOCTEXT("SlicedTaskProgress", "{0} ({1}/{2}, {3}%)"),
+		Work.Description,
+		FText::AsNumber(NextItem),
+		FText::AsNumber(Work.NumItems),
+		FText::AsNumber(Percent)
+		));
+}
+
+
+#undef LOCTEXT_NAMESPACE
@@ -0,0 +1,75 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TickableEditorObject.h"
+
+class SNotificationItem;
+
+//
+// 分割実行する処理の内容 
+//
+// 対象をWindowSize件ずつ区切り、BeginWindow → ProcessItem × N → EndWindow の順に呼ぶ. 
+// キャンセル時も処理中のWindowはEndWindowまで呼ばれ、処理済みの対象までで整合した状態になる. 
+// モジュール終了時の中断では EndWindow/Finished を呼ばず、Aborted のみ呼ぶ. 
+//
+struct FMICRepSlicedWork
+{
+	FText Description;
+	int32 NumItems;
+	int32 WindowSize;
+
+	TFunction<void(int32 Begin, int32 End)> BeginWindow;
+	TFunction<void(int32 ItemIndex)> ProcessItem;
+	TFunction<void(int32 Begin, int32 End)> EndWindow;
+	TFunction<void(bool bCancelled)> Finished;
+	// モジュール終了時の中断で Finished の代わりに呼ぶ（実行のスコープを閉じるだけで、エディタのUIには触れない） 
+	TFunction<void()> Aborted;
+
+	FMICRepSlicedWork() : NumItems(0), WindowSize(1) {}
+};
+
+//
+// エディタのTickごとに一定時間だけ処理を進めるタスク（通知にキャンセルボタンを表示） 
+//
+class FMICRepSlicedTask : public FTickableEditorObject
+{
+public:
+	// その場で最後まで実行（コマンドレット等） 
+	static void Run(FMICRepSlicedWork& Work);
+
+	// エディタのTickで分割実行を開始（実行中のタスクがあれば失敗） 
+	static bool Start(FMICRepSlicedWork&& Work);
+	static bool IsRunning();
+	// 実行中のタスクがあれば通知してfalse 
+	static bool CanStart();
+	// 実行中のタスクを破棄する（モジュール終了時. 処理中のWindowと Finished は呼ばず、Aborted のみ呼ぶ） 
+	static void Abort();
+
+	// FTickableEditorObject
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override { return !bFinished; }
+	virtual TStatId GetStatId() const override;
+
+private:
+	explicit FMICRepSlicedTask(FMICRepSlicedWork&& InWork);
+
+	void ProcessNext();
+	void CloseWindow();
+	void Finish(bool bCancelled);
+	void Release();
+	void Cancel();
+	void UpdateNotification();
+
+	FMICRepSlicedWork Work;
+	int32 NextItem;
+	int32 WindowBegin;
+	int32 WindowEnd;
+	bool bWindowOpen;
+	bool bCancelRequested;
+	bool bFinished;
+	TSharedPtr<SNotificationItem> Notification;
+
+	static TUniquePtr<FMICRepSlicedTask> ActiveTask;
+};
@@ -0,0 +1,163 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepStats.h"
+
+
+DEFINE_STAT(STAT_MICRep_Load);
+DEFINE_STAT(STAT_MICRep_DuplicateAsset);
+DEFINE_STAT(STAT_MICRep_CreateAsset);
+DEFINE_STAT(STAT_MICRep_AnalyzeTextures);
+DEFINE_STAT(STAT_MICRep_HashTextures);
+DEFINE_STAT(STAT_MICRep_ShaderUpdate);
+DEFINE_STAT(STAT_MICRep_Save);
+DEFINE_STAT(STAT_MICRep_Unload);
+DEFINE_STAT(STAT_MICRep_SyncBrowser);
+
+DEFINE_STAT(STAT_MICRep_AssetsCreated);
+DEFINE_STAT(STAT_MICRep_MICIndexHits);
+DEFINE_STAT(STAT_MICRep_AnalysisCacheHits);
+DEFINE_STAT(STAT_MICRep_AnalysisCacheMisses);
+DEFINE_STAT(STAT_MICRep_SharedBaseHits);
+DEFINE_STAT(STAT_MICRep_PackagesSaved);
+DEFINE_STAT(STAT_MICRep_TextureHashHits);
+DEFINE_STAT(STAT_MICRep_DuplicateTextures);
+DEFINE_STAT(STAT_MICRep_ClusterCandidates);
+DEFINE_STAT(STAT_MICRep_ClusteredMICs);
+DEFINE_STAT(STAT_MICRep_SkippedAssets);
+DEFINE_STAT(STAT_MICRep_RefreshedMICs);
+
+
+namespace
+{
+	const TCHAR* PhaseNames[] =
+	{
+		TEXT("Load"),
+		TEXT("DuplicateAsset"),
+		TEXT("CreateAsset"),
+		TEXT("AnalyzeTextures"),
+		TEXT("HashTextures"),
+		TEXT("ShaderUpdate"),
+		TEXT("Save"),
+		TEXT("Unload"),
+		TEXT("SyncBrowser"),
+	};
+	static_assert(ARRAY_COUNT(PhaseNames) == (int32)EMICRepPhase::Num, "PhaseNames must match EMICRepPhase.");
+
+	const TCHAR* CounterNames[] =
+	{
+		TEXT("Assets Created"),
+		TEXT("MIC Index Hits"),
+		TEXT("Analysis Cache Hits"),
+		TEXT("Analysis Cache Misses"),
+		TEXT("Shared Base Hits"),
+		TEXT("Packages Saved"),
+		TEXT("Texture Hash Hits"),
+		TEXT("Duplicate Textures"),
+		TEXT("Cluster Candidates"),
+		TEXT("Clustered MICs"),
+		TEXT("Skipped Assets"),
+		TEXT("Refreshed MICs"),
+	};
+	static_assert(ARRAY_COUNT(CounterNames) == (int32)EMICRepCounter::Num, "CounterNames must match EMICRepCounter.");
+}
+
+
+int32 FMICRepRunStats::RunDepth = 0;
+int32 FMICRepRunStats::PhaseDepth[(int32)EMICRepPhase::Num] = {};
+double FMICRepRunStats::PhaseSeconds[(int32)EMICRepPhase::Num] = {};
+int32 FMICRepRunStats::PhaseCalls[(int32)EMICRepPhase::Num] = {};
+int32 FMICRepRunStats::Counters[(int32)EMICRepCounter::Num] = {};
+
+
+FMICRepRunStats::FScopedRun::FScopedRun(const TCHAR* InRunName)
+	: RunName(InRunName)
+	, StartTime(FPlatformTime::Seconds())
+{
+	if(0 == RunDepth)
+	{
+		Reset();
+	}
+	RunDepth++;
+}
+
+FMICRepRunStats::FScopedRun::~FScopedRun()
+{
+	RunDepth--;
+	if(0 == RunDepth)
+	{
+		PrintSummary(RunName, FPlatformTime::Seconds() - StartTime);
+	}
+}
+
+FMICRepRunStats::FScopedPhase::FScopedPhase(EMICRepPhase InPhase)
+	: Phase(InPhase)
+	, StartTime(FPlatformTime::Seconds())
+{
+	PhaseDepth[(int32)Phase]++;
+}
+
+FMICRepRunStats::FScopedPhase::~FScopedPhase()
+{
+	PhaseDepth[(int32)Phase]--;
+	if(0 == PhaseDepth[(int32)Phase])
+	{
+		PhaseSeconds[(int32)Phase] += FPlatformTime::Seconds() - StartTime;
+		PhaseCalls[(int32)Phase]++;
+	}
+}
+
+void FMICRepRunStats::Increment(EMICRepCounter Counter, int32 Amount)
+{
+	Counters[(int32)Counter] += Amount;
+}
+
+int32 FMICRepRunStats::GetCounter(EMICRepCounter Counter)
+{
+	return Counters[(int32)Counter];
+}
+
+void FMICRepRunStats::Reset()
+{
+	for(int32 PhaseIdx = 0; PhaseIdx < (int32)EMICRepPhase::Num; ++PhaseIdx)
+	{
+		PhaseSeconds[PhaseIdx] = 0.0;
+		PhaseCalls[PhaseIdx] = 0;
+	}
+	for(int32 CounterIdx = 0; CounterIdx < (int32)EMICRepCounter::Num; ++CounterIdx)
+	{
+		Counters[CounterIdx] = 0;
+	}
+}
+
+void FMICRepRunStats::PrintSummary(const TCHAR* RunName, double TotalSeconds)
+{
+	UE_LOG(LogMICRep, Display, TEXT("---- MICRep %s: %.3f sec ----"), RunName, TotalSeconds);
+	UE_LOG(LogMICRep, Display, TEXT("%-22s %10s %8s %6s"), TEXT("Phase"), TEXT("Seconds"), TEXT("Calls"), TEXT("%"));
+	for(int32 PhaseIdx = 0; PhaseIdx < (int32)EMICRepPhase::Num; ++PhaseIdx)
+	{
+		if(0 == PhaseCalls[PhaseIdx])
+		{
+			continue;
+		}
+		UE_LOG(LogMICRep, Display, TEXT("%-22s %10.3f %8d %5.1f%%"),
+			PhaseNames[PhaseIdx],
+			PhaseSeconds[PhaseIdx],
+			PhaseCalls[PhaseIdx],
+			(0.0 < TotalSeconds) ? (PhaseSeconds[PhaseIdx] * 100.0 / TotalSeconds) : 0.0
+			);
+	}
+	for(int32 CounterIdx = 0; CounterIdx < (int32)EMICRepCounter::Num; ++CounterIdx)
+	{
+		UE_LOG(LogMICRep, Display, TEXT("%-22s %10d"), CounterNames[CounterIdx], Counters[CounterIdx]);
+	}
+
+	// パラメータのクラスタリングで削減できたMIC数 
+	const int32 NumCandidates = Counters[(int32)EMICRepCounter::ClusterCandidates];
+	const int32 NumClustered = Counters[(int32)EMICRepCounter::ClusteredMICs];
+	if(0 < NumCandidates)
+	{
+		UE_LOG(LogMICRep, Display, TEXT("Parameter clustering: %d -> %d MICs (%.1f%% fewer)"),
+			NumCandidates, NumCandidates - NumClustered, NumClustered * 100.0 / NumCandidates);
+	}
+}
@@ -0,0 +1,119 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+//
+// stat MICRep
+//
+DECLARE_STATS_GROUP(TEXT("MICRep"), STATGROUP_MICRep, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Load"), STAT_MICRep_Load, STATGROUP_MICRep, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DuplicateAsset"), STAT_MICRep_DuplicateAsset, STATGROUP_MICRep, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("CreateAsset"), STAT_MICRep_CreateAsset, STATGROUP_MICRep, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("AnalyzeTextures"), STAT_MICRep_AnalyzeTextures, STATGROUP_MICRep, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("HashTextures"), STAT_MICRep_HashTextures, STATGROUP_MICRep, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("ShaderUpdate"), STAT_MICRep_ShaderUpdate, STATGROUP_MICRep, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Save"), STAT_MICRep_Save, STATGROUP_MICRep, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Unload"), STAT_MICRep_Unload, STATGROUP_MICRep, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("SyncBrowser"), STAT_MICRep_SyncBrowser, STATGROUP_MICRep, );
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Assets Created"), STAT_MICRep_AssetsCreated, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("MIC Index Hits"), STAT_MICRep_MICIndexHits, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Analysis Cache Hits"), STAT_MICRep_AnalysisCacheHits, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Analysis Cache Misses"), STAT_MICRep_AnalysisCacheMisses, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Shared Base Hits"), STAT_MICRep_SharedBaseHits, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Packages Saved"), STAT_MICRep_PackagesSaved, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Texture Hash Hits"), STAT_MICRep_TextureHashHits, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Duplicate Textures"), STAT_MICRep_DuplicateTextures, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Cluster Candidates"), STAT_MICRep_ClusterCandidates, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Clustered MICs"), STAT_MICRep_ClusteredMICs, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Skipped Assets"), STAT_MICRep_SkippedAssets, STATGROUP_MICRep, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Refreshed MICs"), STAT_MICRep_RefreshedMICs, STATGROUP_MICRep, );
+
+// 1回の実行で集計するフェーズ（STAT_MICRep_<Phase> と対応） 
+enum class EMICRepPhase : uint8
+{
+	Load,
+	DuplicateAsset,
+	CreateAsset,
+	AnalyzeTextures,
+	HashTextures,
+	ShaderUpdate,
+	Save,
+	Unload,
+	SyncBrowser,
+	Num,
+};
+
+// 1回の実行で集計するカウンター（STAT_MICRep_<Counter> と対応） 
+enum class EMICRepCounter : uint8
+{
+	AssetsCreated,
+	MICIndexHits,
+	AnalysisCacheHits,
+	AnalysisCacheMisses,
+	SharedBaseHits,
+	PackagesSaved,
+	TextureHashHits,
+	DuplicateTextures,
+	ClusterCandidates,
+	ClusteredMICs,
+	SkippedAssets,
+	RefreshedMICs,
+	Num,
+};
+
+//
+// 実行1回分の集計（stat が無効でも終了時に表を出力する） 
+//
+class FMICRepRunStats
+{
+public:
+	// 最も外側のスコープ終了時に集計表を出力 
+	class FScopedRun
+	{
+	public:
+		explicit FScopedRun(const TCHAR* InRunName);
+		~FScopedRun();
+	private:
+		const TCHAR* RunName;
+		double StartTime;
+	};
+
+	class FScopedPhase
+	{
+	public:
+		explicit FScopedPhase(EMICRepPhase InPhase);
+		~FScopedPhase();
+	private:
+		EMICRepPhase Phase;
+		double StartTime;
+	};
+
+	static void Increment(EMICRepCounter Counter, int32 Amount = 1);
+
+	// 実行中、または直前に終了した実行のカウンター 
+	static int32 GetCounter(EMICRepCounter Counter);
+
+private:
+	static void Reset();
+	static void PrintSummary(const TCHAR* RunName, double TotalSeconds);
+
+	static int32 RunDepth;
+	// 入れ子の同一フェーズは外側のみ計上 
+	static int32 PhaseDepth[(int32)EMICRepPhase::Num];
+	static double PhaseSeconds[(int32)EMICRepPhase::Num];
+	static int32 PhaseCalls[(int32)EMICRepPhase::Num];
+	static int32 Counters[(int32)EMICRepCounter::Num];
+};
+
+#define MICREP_SCOPE_PHASE(Phase) \
+	SCOPE_CYCLE_COUNTER(STAT_MICRep_##Phase); \
+	FMICRepRunStats::FScopedPhase MICRepScopedPhase_##Phase(EMICRepPhase::Phase)
+
+#define MICREP_INC_COUNTER(Counter, Amount) \
+	INC_DWORD_STAT_BY(STAT_MICRep_##Counter, Amount); \
+	FMICRepRunStats::Increment(EMICRepCounter::Counter, Amount)
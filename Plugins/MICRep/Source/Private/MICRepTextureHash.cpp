@@ -0,0 +1,232 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepTextureHash.h"
+#include "MICRepCache.h"
+#include "MICRepSettings.h"
+#include "MICRepStats.h"
+#include "AssetRegistryModule.h"
+#include "Hash/CityHash.h"
+
+
+namespace
+{
+	const TCHAR* TextureHashFileName = TEXT("TextureHash.bin");
+	const int32 TextureHashVersion = 2;
+}
+
+
+FMICRepTextureHashCache& FMICRepTextureHashCache::Get()
+{
+	static FMICRepTextureHashCache Instance;
+	return Instance;
+}
+
+FMICRepTextureHashCache::FMICRepTextureHashCache()
+	: bDirty(false)
+{
+	Load();
+}
+
+bool FMICRepTextureHashCache::GetContentHash(UTexture* Texture, uint64& OutHash)
+{
+	if((nullptr == Texture) || !Texture->Source.IsValid())
+	{
+		return false;
+	}
+
+	// ソースのIDはインポート/編集のたびに更新される 
+	const FString TexturePath = Texture->GetPathName();
+	const FGuid SourceId = Texture->Source.GetId();
+	const uint32 SamplingSettings = GetSamplingSettings(Texture);
+	UPackage* Package = Texture->GetOutermost();
+	FMICRepTextureHash* Cached = Entries.Find(TexturePath);
+	if((nullptr != Cached) && (Cached->SourceId == SourceId) && (Cached->SamplingSettings == SamplingSettings))
+	{
+		// 未保存の間に求めたものは、保存後の更新日時を記録してロードせずに判定できるようにする 
+		if((FDateTime::MinValue() == Cached->TimeStamp) && !Package->IsDirty())
+		{
+			Cached->TimeStamp = GetPackageTimeStamp(Package->GetName());
+			bDirty = true;
+		}
+		MICREP_INC_COUNTER(TextureHashHits, 1);
+		OutHash = Cached->ContentHash;
+		return true;
+	}
+
+	if(!ComputeContentHash(Texture, OutHash))
+	{
+		return false;
+	}
+
+	FMICRepTextureHash& Entry = Entries.FindOrAdd(TexturePath);
+	Entry.SourceId = SourceId;
+	Entry.SamplingSettings = SamplingSettings;
+	Entry.ContentHash = OutHash;
+	Entry.TimeStamp = Package->IsDirty() ? FDateTime::MinValue() : GetPackageTimeStamp(Package->GetName());
+	bDirty = true;
+	return true;
+}
+
+FString FMICRepTextureHashCache::GetCanonicalPath(UTexture* Texture)
+{
+	if(nullptr == Texture)
+	{
+		return FString();
+	}
+
+	const FString TexturePath = Texture->GetPathName();
+	uint64 ContentHash = 0;
+	if(!GetDefault<UMICRepSettings>()->bDeduplicateTextures || !GetContentHash(Texture, ContentHash))
+	{
+		return TexturePath;
+	}
+
+	FString* CanonicalPath = Canonicals.Find(ContentHash);
+	if((nullptr != CanonicalPath) && (*CanonicalPath != TexturePath))
+	{
+		// 代表が削除/リネーム、または再インポートで別の内容になっていれば自身を代表にする 
+		FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+		if(AssetRegistryModule.Get().GetAssetByObjectPath(FName(**CanonicalPath)).IsValid())
+		{
+			bool bCurrent = IsEntryCurrent(*CanonicalPath, ContentHash);
+			if(!bCurrent)
+			{
+				// 記録が古いだけかもしれないため、代表をロードしてハッシュを求め直す 
+				UTexture* CanonicalTexture = LoadObject<UTexture>(nullptr, **CanonicalPath, nullptr, LOAD_NoWarn);
+				uint64 CanonicalHash = 0;
+				bCurrent = (nullptr != CanonicalTexture) && GetContentHash(CanonicalTexture, CanonicalHash) && (CanonicalHash == ContentHash);
+			}
+			if(bCurrent)
+			{
+				MICREP_INC_COUNTER(DuplicateTextures, 1);
+				return *CanonicalPath;
+			}
+		}
+	}
+	if((nullptr == CanonicalPath) || (*CanonicalPath != TexturePath))
+	{
+		Canonicals.Add(ContentHash, TexturePath);
+		bDirty = true;
+	}
+	return TexturePath;
+}
+
+UTexture* FMICRepTextureHashCache::GetCanonicalTexture(UTexture* Texture)
+{
+	const FString CanonicalPath = GetCanonicalPath(Texture);
+	if((nullptr == Texture) || (CanonicalPath == Texture->GetPathName()))
+	{
+		return Texture;
+	}
+
+	UTexture* CanonicalTexture = LoadObject<UTexture>(nullptr, *CanonicalPath);
+	return (nullptr != CanonicalTexture) ? CanonicalTexture : Texture;
+}
+
+FString FMICRepTextureHashCache::FindCanonicalPath(const FString& TexturePath) const
+{
+	if(!GetDefault<UMICRepSettings>()->bDeduplicateTextures)
+	{
+		return TexturePath;
+	}
+
+	// 自身の記録も代表の記録も、前回の解析以降に変更されていない場合のみ使う 
+	const FMICRepTextureHash* Cached = Entries.Find(TexturePath);
+	if((nullptr == Cached) || !IsEntryCurrent(TexturePath, Cached->ContentHash))
+	{
+		return TexturePath;
+	}
+	const FString* CanonicalPath = Canonicals.Find(Cached->ContentHash);
+	if((nullptr == CanonicalPath) || !IsEntryCurrent(*CanonicalPath, Cached->ContentHash))
+	{
+		return TexturePath;
+	}
+	return *CanonicalPath;
+}
+
+bool FMICRepTextureHashCache::IsEntryCurrent(const FString& TexturePath, uint64 ContentHash) const
+{
+	const FMICRepTextureHash* Entry = Entries.Find(TexturePath);
+	if((nullptr == Entry) || (Entry->ContentHash != ContentHash))
+	{
+		return false;
+	}
+
+	// ロード済みであればソースのIDと設定で判定 
+	UTexture* LoadedTexture = FindObject<UTexture>(nullptr, *TexturePath);
+	if(nullptr != LoadedTexture)
+	{
+		return (LoadedTexture->Source.GetId() == Entry->SourceId) && (GetSamplingSettings(LoadedTexture) == Entry->SamplingSettings);
+	}
+	return (FDateTime::MinValue() != Entry->TimeStamp)
+		&& (GetPackageTimeStamp(FPackageName::ObjectPathToPackageName(TexturePath)) == Entry->TimeStamp);
+}
+
+bool FMICRepTextureHashCache::ComputeContentHash(UTexture* Texture, uint64& OutHash)
+{
+	MICREP_SCOPE_PHASE(HashTextures);
+
+	TArray<uint8> MipData;
+	if(!Texture->Source.GetMipData(MipData, 0))
+	{
+		return false;
+	}
+
+	// 同じバイト列でもサイズ/フォーマット、サンプリング時の解釈（sRGB/圧縮設定/LODグループ）が異なれば別のテクスチャ 
+	FTextureSource& Source = Texture->Source;
+	const uint64 Seed0 = ((uint64)Source.GetSizeX() << 32) | (uint64)Source.GetSizeY();
+	const uint64 Seed1 =
+		  ((uint64)GetSamplingSettings(Texture) << 32)
+		| ((uint64)Source.GetNumSlices() << 16)
+		| ((uint64)Source.GetNumMips() << 8)
+		| (uint64)Source.GetFormat();
+	OutHash = CityHash64WithSeeds(reinterpret_cast<const char*>(MipData.GetData()), MipData.Num(), Seed0, Seed1);
+	return true;
+}
+
+uint32 FMICRepTextureHashCache::GetSamplingSettings(UTexture* Texture)
+{
+	return ((Texture->SRGB ? 1u : 0u) << 16)
+		| ((uint32)Texture->CompressionSettings.GetValue() << 8)
+		| (uint32)Texture->LODGroup.GetValue();
+}
+
+FDateTime FMICRepTextureHashCache::GetPackageTimeStamp(const FString& PackageName)
+{
+	FString FileName;
+	if(!FPackageName::DoesPackageExist(PackageName, nullptr, &FileName))
+	{
+		return FDateTime::MinValue();
+	}
+	return IFileManager::Get().GetTimeStamp(*FileName);
+}
+
+void FMICRepTextureHashCache::Load()
+{
+	const bool bLoaded = MICRepCache::Load(TextureHashFileName, TextureHashVersion, [this](FArchive& Ar)
+		{
+			Ar << Entries;
+			Ar << Canonicals;
+		});
+	if(!bLoaded)
+	{
+		Entries.Reset();
+		Canonicals.Reset();
+	}
+	bDirty = false;
+}
+
+void FMICRepTextureHashCache::Save()
+{
+	if(!bDirty)
+	{
+		return;
+	}
+	MICRepCache::Save(TextureHashFileName, TextureHashVersion, [this](FArchive& Ar)
+		{
+			Ar << Entries;
+			Ar << Canonicals;
+		});
+	bDirty = false;
+}
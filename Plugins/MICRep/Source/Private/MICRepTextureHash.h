@@ -0,0 +1,71 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UTexture;
+
+//
+// テクスチャのソースデータの内容ハッシュ 
+//
+struct FMICRepTextureHash
+{
+	// ソースデータの変更検出用 
+	FGuid SourceId;
+	// サンプリング時の解釈の変更検出用（FMICRepTextureHashCache::GetSamplingSettings） 
+	uint32 SamplingSettings;
+	uint64 ContentHash;
+	// ロードせずに変更を検出するためのパッケージの更新日時（未保存の変更があった場合はMinValue） 
+	FDateTime TimeStamp;
+
+	FMICRepTextureHash() : SamplingSettings(0), ContentHash(0), TimeStamp(FDateTime::MinValue()) {}
+
+	friend FArchive& operator<<(FArchive& Ar, FMICRepTextureHash& Hash)
+	{
+		return Ar << Hash.SourceId << Hash.SamplingSettings << Hash.ContentHash << Hash.TimeStamp;
+	}
+};
+
+//
+// 内容が同一（ソースデータがバイト単位で一致）のテクスチャを1つの代表テクスチャとして扱う 
+//
+// 別名で何度もインポートされた同じ画像をUnifyで1つのキーにまとめるために使う. 
+// ハッシュはテクスチャごとにキャッシュし、ソースが変更された場合のみ計算し直す. 
+//
+class FMICRepTextureHashCache
+{
+public:
+	static FMICRepTextureHashCache& Get();
+
+	// ソースデータの内容ハッシュ（ソースが無い場合はfalse） 
+	bool GetContentHash(UTexture* Texture, uint64& OutHash);
+
+	// 同一内容のテクスチャの代表のパス（重複排除が無効、またはハッシュを求められない場合は自身のパス） 
+	FString GetCanonicalPath(UTexture* Texture);
+	// 同一内容のテクスチャの代表（参照の付け替え用） 
+	UTexture* GetCanonicalTexture(UTexture* Texture);
+
+	// ロードせずに前回の結果から代表のパスを参照（未解析ならそのまま） 
+	FString FindCanonicalPath(const FString& TexturePath) const;
+
+	void Save();
+
+private:
+	FMICRepTextureHashCache();
+	void Load();
+
+	static bool ComputeContentHash(UTexture* Texture, uint64& OutHash);
+	static FDateTime GetPackageTimeStamp(const FString& PackageName);
+	// sRGB/圧縮設定/LODグループ（ソースが同じでもこれが異なれば別のテクスチャ） 
+	static uint32 GetSamplingSettings(UTexture* Texture);
+
+	// 記録されたテクスチャが今もその内容か（ロードせずに判定. 未保存の変更があれば確認できないためfalse） 
+	bool IsEntryCurrent(const FString& TexturePath, uint64 ContentHash) const;
+
+	// <TexturePath, Hash>
+	TMap<FString, FMICRepTextureHash> Entries;
+	// <ContentHash, 代表のTexturePath>（最初に見つかったもの） 
+	TMap<uint64, FString> Canonicals;
+	bool bDirty;
+};
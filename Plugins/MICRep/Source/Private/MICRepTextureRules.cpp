@@ -0,0 +1,225 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "MICRepTextureRules.h"
+#include "MICRepMaterialAnalysis.h"
+#include "MICRepTextureHash.h"
+#include "MICRepSettings.h"
+
+
+UTexture* FMICRepTextureSet::Find(FName ParameterName) const
+{
+	for(auto ItTexture = Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+	{
+		if((*ItTexture).Key == ParameterName)
+		{
+			return (*ItTexture).Value;
+		}
+	}
+	return nullptr;
+}
+
+void FMICRepTextureSet::RedirectToCanonical()
+{
+	for(auto ItTexture = Textures.CreateIterator(); ItTexture; ++ItTexture)
+	{
+		(*ItTexture).Value = FMICRepTextureHashCache::Get().GetCanonicalTexture((*ItTexture).Value);
+	}
+}
+
+FString FMICRepTextureSet::GetUnifyKey() const
+{
+	FString Key;
+	for(auto ItTexture = Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+	{
+		Key += FString::Printf(TEXT("%s=%s;"), *(*ItTexture).Key.ToString(), *FMICRepTextureHashCache::Get().GetCanonicalPath((*ItTexture).Value));
+	}
+	return Key;
+}
+
+
+TArray<EMaterialProperty> FMICRepTextureRules::GetMappedProperties()
+{
+	TArray<EMaterialProperty> Properties;
+	const TArray<FMICRepTextureRule>& Rules = GetDefault<UMICRepSettings>()->TextureRules;
+	for(auto ItRule = Rules.CreateConstIterator(); ItRule; ++ItRule)
+	{
+		Properties.AddUnique((*ItRule).Property.GetValue());
+	}
+	return Properties;
+}
+
+EMICRepTextureChannel FMICRepTextureRules::GetRequiredChannel(EMaterialProperty Property)
+{
+	const TArray<FMICRepTextureRule>& Rules = GetDefault<UMICRepSettings>()->TextureRules;
+	for(auto ItRule = Rules.CreateConstIterator(); ItRule; ++ItRule)
+	{
+		if((Property == (*ItRule).Property.GetValue()) && (EMICRepTextureChannel::Any != (*ItRule).Channel))
+		{
+			return (*ItRule).Channel;
+		}
+	}
+	return EMICRepTextureChannel::Any;
+}
+
+void FMICRepTextureRules::ResolvePaths(const TMap<int32, FString>& PropertyTextures, TArray<TPair<FName, FString>>& OutTextures, TArray<FName>& OutDisabledSwitches)
+{
+	OutTextures.Reset();
+	OutDisabledSwitches.Reset();
+
+	// <ParameterName, Index>（同名パラメータのルールは1つのテクスチャにまとめる） 
+	TMap<FName, int32> ParameterIndices;
+	TArray<bool> Conflicts;
+	// <StaticSwitch, テクスチャが見つかったか> 
+	TMap<FName, bool> Switches;
+
+	const TArray<FMICRepTextureRule>& Rules = GetDefault<UMICRepSettings>()->TextureRules;
+	for(auto ItRule = Rules.CreateConstIterator(); ItRule; ++ItRule)
+	{
+		const FMICRepTextureRule& Rule = *ItRule;
+		if(NAME_None == Rule.ParameterName)
+		{
+			continue;
+		}
+		const FString TexturePath = PropertyTextures.FindRef(static_cast<int32>(Rule.Property.GetValue()));
+
+		// 同名パラメータのルールはすべて同じテクスチャを指している必要がある 
+		// （一部のプロパティにしかテクスチャが無い場合も、他のチャンネルを正しく表せないため不一致として扱う） 
+		const int32* FoundIndex = ParameterIndices.Find(Rule.ParameterName);
+		if(nullptr == FoundIndex)
+		{
+			ParameterIndices.Add(Rule.ParameterName, OutTextures.Add(TPair<FName, FString>(Rule.ParameterName, TexturePath)));
+			Conflicts.Add(false);
+		}
+		else if(OutTextures[*FoundIndex].Value != TexturePath)
+		{
+			// チャンネルをまとめたテクスチャとして扱えない 
+			Conflicts[*FoundIndex] = true;
+		}
+
+		if(NAME_None != Rule.StaticSwitch)
+		{
+			Switches.FindOrAdd(Rule.StaticSwitch);
+		}
+	}
+
+	for(int32 Idx = 0; Idx < OutTextures.Num(); ++Idx)
+	{
+		if(Conflicts[Idx])
+		{
+			UE_LOG(LogMICRep, Verbose, TEXT("Textures for parameter %s do not match across its channel rules. Leaving it unset."), *OutTextures[Idx].Key.ToString());
+			OutTextures[Idx].Value.Empty();
+		}
+	}
+
+	// StaticSwitchは対応するパラメータのいずれかにテクスチャがあればオン（不一致のパラメータはテクスチャ無し） 
+	for(auto ItRule = Rules.CreateConstIterator(); ItRule; ++ItRule)
+	{
+		const int32* FoundIndex = ParameterIndices.Find((*ItRule).ParameterName);
+		if((NAME_None != (*ItRule).StaticSwitch) && (nullptr != FoundIndex) && !OutTextures[*FoundIndex].Value.IsEmpty())
+		{
+			Switches[(*ItRule).StaticSwitch] = true;
+		}
+	}
+	for(auto ItSwitch = Switches.CreateConstIterator(); ItSwitch; ++ItSwitch)
+	{
+		if(!ItSwitch.Value())
+		{
+			OutDisabledSwitches.Add(ItSwitch.Key());
+		}
+	}
+	OutDisabledSwitches.Sort([](const FName& A, const FName& B) { return A.ToString() < B.ToString(); });
+}
+
+void FMICRepTextureRules::FilterForBase(UMaterialInterface* BaseMaterial, TArray<TPair<FName, FString>>& InOutTextures, TArray<FName>& InOutDisabledSwitches)
+{
+	UMaterial* RootMaterial = (nullptr != BaseMaterial) ? BaseMaterial->GetMaterial() : nullptr;
+	if(nullptr == RootMaterial)
+	{
+		return;
+	}
+
+	TArray<FName> TextureParameters;
+	TArray<FName> StaticSwitches;
+	{
+		TArray<FGuid> Ids;
+		RootMaterial->GetAllTextureParameterNames(TextureParameters, Ids);
+		Ids.Reset();
+		RootMaterial->GetAllStaticSwitchParameterNames(StaticSwitches, Ids);
+	}
+
+	InOutTextures.RemoveAll([&TextureParameters](const TPair<FName, FString>& Texture)
+		{ return !TextureParameters.Contains(Texture.Key); });
+	InOutDisabledSwitches.RemoveAll([&StaticSwitches](const FName& Switch)
+		{ return !StaticSwitches.Contains(Switch); });
+}
+
+bool FMICRepTextureRules::DisableSwitches(UMaterialInterface* BaseMaterial, const TArray<FName>& Switches, FMICRepTextureSet& InOutSet)
+{
+	UMaterial* RootMaterial = (nullptr != BaseMaterial) ? BaseMaterial->GetMaterial() : nullptr;
+	if(nullptr == RootMaterial)
+	{
+		return false;
+	}
+
+	TArray<FName> StaticSwitches;
+	{
+		TArray<FGuid> Ids;
+		RootMaterial->GetAllStaticSwitchParameterNames(StaticSwitches, Ids);
+	}
+
+	bool bChanged = false;
+	const TArray<FMICRepTextureRule>& Rules = GetDefault<UMICRepSettings>()->TextureRules;
+	for(auto ItRule = Rules.CreateConstIterator(); ItRule; ++ItRule)
+	{
+		const FName Switch = (*ItRule).StaticSwitch;
+		if((NAME_None == Switch) || !Switches.Contains(Switch) || !StaticSwitches.Contains(Switch))
+		{
+			continue;
+		}
+		for(auto ItTexture = InOutSet.Textures.CreateIterator(); ItTexture; ++ItTexture)
+		{
+			if(((*ItTexture).Key == (*ItRule).ParameterName) && (nullptr != (*ItTexture).Value))
+			{
+				(*ItTexture).Value = nullptr;
+				bChanged = true;
+			}
+		}
+		if(!InOutSet.DisabledSwitches.Contains(Switch))
+		{
+			InOutSet.DisabledSwitches.Add(Switch);
+			bChanged = true;
+		}
+	}
+	InOutSet.DisabledSwitches.Sort([](const FName& A, const FName& B) { return A.ToString() < B.ToString(); });
+	return bChanged;
+}
+
+void FMICRepTextureRules::LoadTextureSet(const TArray<TPair<FName, FString>>& Textures, const TArray<FName>& DisabledSwitches, FMICRepTextureSet& OutSet)
+{
+	OutSet.Textures.Reset(Textures.Num());
+	for(auto ItTexture = Textures.CreateConstIterator(); ItTexture; ++ItTexture)
+	{
+		UTexture* Texture = (*ItTexture).Value.IsEmpty() ? nullptr : LoadObject<UTexture>(nullptr, *(*ItTexture).Value);
+		OutSet.Textures.Add(TPair<FName, UTexture*>((*ItTexture).Key, Texture));
+	}
+	OutSet.DisabledSwitches = DisabledSwitches;
+}
+
+void FMICRepTextureRules::GetTextureSet(UMaterialInterface* SourceMaterial, UMaterialInterface* BaseMaterial, FMICRepTextureSet& OutSet)
+{
+	OutSet = FMICRepTextureSet();
+	if(nullptr == SourceMaterial)
+	{
+		return;
+	}
+
+	// プロパティチェーンの解析結果はキャッシュを利用 
+	const FMICRepMaterialAnalysis Analysis = FMICRepMaterialAnalysisCache::Get().Analyze(SourceMaterial);
+
+	TArray<TPair<FName, FString>> Textures;
+	TArray<FName> DisabledSwitches;
+	ResolvePaths(Analysis.PropertyTextures, Textures, DisabledSwitches);
+	FilterForBase(BaseMaterial, Textures, DisabledSwitches);
+	LoadTextureSet(Textures, DisabledSwitches, OutSet);
+}
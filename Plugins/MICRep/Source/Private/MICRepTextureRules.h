@@ -0,0 +1,57 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SceneTypes.h"
+
+class UMaterialInterface;
+class UTexture;
+enum class EMICRepTextureChannel : uint8;
+
+//
+// MICへ設定するテクスチャ一式 
+//
+struct FMICRepTextureSet
+{
+	// <ParameterName, Texture>（ルール順、見つからなかったパラメータは nullptr） 
+	TArray<TPair<FName, UTexture*>> Textures;
+	// テクスチャが無いためオフにするStaticSwitch（名前順） 
+	TArray<FName> DisabledSwitches;
+
+	UTexture* Find(FName ParameterName) const;
+
+	// 同一内容のテクスチャを代表に置き換える 
+	void RedirectToCanonical();
+
+	// Unify時に同じMICとみなすキー（同一内容のテクスチャは代表のパス） 
+	FString GetUnifyKey() const;
+};
+
+//
+// UMICRepSettings::TextureRules による元マテリアルのテクスチャとベースのパラメータの対応付け 
+//
+class FMICRepTextureRules
+{
+public:
+	// 解析が必要なマテリアルプロパティ 
+	static TArray<EMaterialProperty> GetMappedProperties();
+
+	// プロパティに対してルールが要求するチャンネル（指定が無ければ Any） 
+	static EMICRepTextureChannel GetRequiredChannel(EMaterialProperty Property);
+
+	// 解析結果 <EMaterialProperty, TexturePath> からパラメータごとのテクスチャを求める（ベースは確認しない） 
+	// 同名パラメータのルール間でテクスチャが一致しない場合は空とし、StaticSwitchもオンにしない 
+	static void ResolvePaths(const TMap<int32, FString>& PropertyTextures, TArray<TPair<FName, FString>>& OutTextures, TArray<FName>& OutDisabledSwitches);
+
+	// ベースが持たないパラメータ/StaticSwitchを除く 
+	static void FilterForBase(UMaterialInterface* BaseMaterial, TArray<TPair<FName, FString>>& InOutTextures, TArray<FName>& InOutDisabledSwitches);
+
+	// 指定したStaticSwitchをオフにし、対応するテクスチャを外す（ベースが持たないものは無視. 変更が無ければfalse） 
+	static bool DisableSwitches(UMaterialInterface* BaseMaterial, const TArray<FName>& Switches, FMICRepTextureSet& InOutSet);
+
+	static void LoadTextureSet(const TArray<TPair<FName, FString>>& Textures, const TArray<FName>& DisabledSwitches, FMICRepTextureSet& OutSet);
+
+	// 元マテリアルを解析し、ベースに設定するテクスチャ一式を求める 
+	static void GetTextureSet(UMaterialInterface* SourceMaterial, UMaterialInterface* BaseMaterial, FMICRepTextureSet& OutSet);
+};
@@ -0,0 +1,188 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MICRep.h"
+#include "SMICRepParentPicker.h"
+#include "MICRepParentIndex.h"
+#include "MICRepSettings.h"
+#include "AssetRegistryModule.h"
+#include "SlateBasics.h"
+#include "SSearchBox.h"
+
+#define LOCTEXT_NAMESPACE "MICRep"
+
+namespace
+{
+	// 一度に表示する検索結果の上限 
+	const int32 MaxResults = 200;
+}
+
+void SMICRepParentPicker::Construct(const FArguments& InArgs)
+{
+	OnParentPicked = InArgs._OnParentPicked;
+
+	// 残りの確認はTickで行う 
+	FMICRepParentIndex::Get().Refresh(GetDefault<UMICRepSettings>()->SliceBudgetMilliseconds / 1000.0);
+	UpdateItems();
+
+	ChildSlot
+	[
+		SNew(SBox)
+		.WidthOverride(320.0f)
+		.MaxDesiredHeight(480.0f)
+		[
+			SNew(SVerticalBox)
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			.Padding(4.0f)
+			[
+				SAssignNew(SearchBox, SSearchBox)
+				.OnTextChanged(this, &SMICRepParentPicker::OnSearchTextChanged)
+				.OnTextCommitted(this, &SMICRepParentPicker::OnSearchTextCommitted)
+			]
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			.Padding(4.0f, 2.0f)
+			[
+				SNew(STextBlock)
+				.Text(LOCTEXT("RecentParents", "Recent"))
+				.Visibility_Lambda([this]() { return (0 < RecentItems.Num()) ? EVisibility::Visible : EVisibility::Collapsed; })
+			]
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			[
+				SAssignNew(RecentListView, SListView<FItem>)
+				.ListItemsSource(&RecentItems)
+				.SelectionMode(ESelectionMode::Single)
+				.OnGenerateRow(this, &SMICRepParentPicker::OnGenerateRow)
+				.OnMouseButtonDoubleClick(this, &SMICRepParentPicker::OnItemDoubleClicked)
+				.Visibility_Lambda([this]() { return (0 < RecentItems.Num()) ? EVisibility::Visible : EVisibility::Collapsed; })
+			]
+			+ SVerticalBox::Slot()
+			.AutoHeight()
+			.Padding(4.0f, 2.0f)
+			[
+				SNew(STextBlock)
+				.Text(this, &SMICRepParentPicker::GetStatusText)
+			]
+			+ SVerticalBox::Slot()
+			.FillHeight(1.0f)
+			[
+				SAssignNew(ResultListView, SListView<FItem>)
+				.ListItemsSource(&ResultItems)
+				.SelectionMode(ESelectionMode::Single)
+				.OnGenerateRow(this, &SMICRepParentPicker::OnGenerateRow)
+				.OnMouseButtonDoubleClick(this, &SMICRepParentPicker::OnItemDoubleClicked)
+			]
+		]
+	];
+}
+
+FReply SMICRepParentPicker::OnFocusReceived(const FGeometry& MyGeometry, const FFocusEvent& InFocusEvent)
+{
+	return FReply::Handled().SetUserFocus(SearchBox.ToSharedRef(), InFocusEvent.GetCause());
+}
+
+void SMICRepParentPicker::UpdateItems()
+{
+	const FMICRepParentIndex& Index = FMICRepParentIndex::Get();
+
+	// 検索中は最近使った親を出さない 
+	RecentItems.Reset();
+	if(SearchText.IsEmpty())
+	{
+		for(auto ItRecent = Index.GetRecent().CreateConstIterator(); ItRecent; ++ItRecent)
+		{
+			RecentItems.Add(MakeShareable(new FString(*ItRecent)));
+		}
+	}
+
+	TArray<FString> ObjectPaths;
+	Index.Search(SearchText, MaxResults, ObjectPaths);
+	ResultItems.Reset(ObjectPaths.Num());
+	for(auto ItPath = ObjectPaths.CreateConstIterator(); ItPath; ++ItPath)
+	{
+		ResultItems.Add(MakeShareable(new FString(*ItPath)));
+	}
+
+	if(RecentListView.IsValid())
+	{
+		RecentListView->RequestListRefresh();
+	}
+	if(ResultListView.IsValid())
+	{
+		ResultListView->RequestListRefresh();
+	}
+}
+
+void SMICRepParentPicker::OnSearchTextChanged(const FText& InText)
+{
+	SearchText = InText.ToString();
+	UpdateItems();
+}
+
+void SMICRepParentPicker::OnSearchTextCommitted(const FText& InText, ETextCommit::Type CommitType)
+{
+	if(ETextCommit::OnEnter != CommitType)
+	{
+		return;
+	}
+	// Enterは選択中の項目、なければ先頭の候補 
+	TArray<FItem> Selected = ResultListView->GetSelectedItems();
+	if(0 < Selected.Num())
+	{
+		Pick(Selected[0]);
+	}
+	else if(0 < ResultItems.Num())
+	{
+		Pick(ResultItems[0]);
+	}
+}
+
+TSharedRef<ITableRow> SMICRepParentPicker::OnGenerateRow(FItem Item, const TSharedRef<STableViewBase>& OwnerTable)
+{
+	return SNew(STableRow<FItem>, OwnerTable)
+		.ToolTipText(FText::FromString(*Item))
+		[
+			SNew(STextBlock)
+			.Text(FText::FromString(FPackageName::ObjectPathToObjectName(*Item)))
+			.HighlightText_Lambda([this]() { return FText::FromString(SearchText); })
+		];
+}
+
+void SMICRepParentPicker::OnItemDoubleClicked(FItem Item)
+{
+	Pick(Item);
+}
+
+void SMICRepParentPicker::Pick(FItem Item)
+{
+	if(!Item.IsValid())
+	{
+		return;
+	}
+	FAssetRegistryModule& AssetRegistryModule = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry");
+	const FAssetData AssetData = AssetRegistryModule.Get().GetAssetByObjectPath(FName(**Item));
+	if(!AssetData.IsValid())
+	{
+		return;
+	}
+	FSlateApplication::Get().DismissAllMenus();
+	OnParentPicked.ExecuteIfBound(AssetData);
+}
+
+FText SMICRepParentPicker::GetStatusText() const
+{
+	const int32 NumPending = FMICRepParentIndex::Get().GetNumPending();
+	if(0 < NumPending)
+	{
+		return FText::Format(LOCTEXT("ParentIndexPending", "Materials ({0} still being indexed)"), FText::AsNumber(NumPending));
+	}
+	const int32 NumUnchecked = FMICRepParentIndex::Get().GetNumUnchecked();
+	if(0 < NumUnchecked)
+	{
+		return FText::Format(LOCTEXT("ParentIndexUnchecked", "Materials ({0} not loaded and unverified; run -mode=reindex to check them)"), FText::AsNumber(NumUnchecked));
+	}
+	return LOCTEXT("ParentIndexMaterials", "Materials");
+}
+
+#undef LOCTEXT_NAMESPACE
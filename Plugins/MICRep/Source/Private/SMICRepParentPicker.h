@@ -0,0 +1,48 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AssetData.h"
+#include "SCompoundWidget.h"
+#include "SListView.h"
+
+class SSearchBox;
+
+DECLARE_DELEGATE_OneParam(FOnMICRepParentPicked, const FAssetData&);
+
+//
+// Reparentメニューの親マテリアル選択（FMICRepParentIndex を検索するだけでアセットピッカーは作らない） 
+//
+class SMICRepParentPicker : public SCompoundWidget
+{
+public:
+	SLATE_BEGIN_ARGS(SMICRepParentPicker) {}
+		SLATE_EVENT(FOnMICRepParentPicked, OnParentPicked)
+	SLATE_END_ARGS()
+
+	void Construct(const FArguments& InArgs);
+
+	virtual bool SupportsKeyboardFocus() const override { return true; }
+	virtual FReply OnFocusReceived(const FGeometry& MyGeometry, const FFocusEvent& InFocusEvent) override;
+
+private:
+	typedef TSharedPtr<FString> FItem;
+
+	void UpdateItems();
+	void OnSearchTextChanged(const FText& InText);
+	void OnSearchTextCommitted(const FText& InText, ETextCommit::Type CommitType);
+	TSharedRef<ITableRow> OnGenerateRow(FItem Item, const TSharedRef<STableViewBase>& OwnerTable);
+	void OnItemDoubleClicked(FItem Item);
+	void Pick(FItem Item);
+	FText GetStatusText() const;
+
+	FOnMICRepParentPicked OnParentPicked;
+	FString SearchText;
+
+	TSharedPtr<SSearchBox> SearchBox;
+	TSharedPtr<SListView<FItem>> RecentListView;
+	TSharedPtr<SListView<FItem>> ResultListView;
+	TArray<FItem> RecentItems;
+	TArray<FItem> ResultItems;
+};
@@ -1,6 +1,8 @@
-// Fill out your copyright notice in the Description page of Project Settings.
-
-#pragma once
-
-#include "Engine.h"
-
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "Engine.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogMICRep, Log, All);
+